@@ -2,8 +2,9 @@
 #include "utility.h"
 #include "../common/csv_parser.h"
 #include "TextStore.h"
+#include "Scripts.h"
 
-Maps2::Maps2(const char *maps_path, const data_map_t &maps_data, const Tilesets2 &tilesets, const std::map<std::string, unsigned> &audio_map){
+Maps2::Maps2(const char *maps_path, const data_map_t &maps_data, const Tilesets2 &tilesets, const std::map<std::string, unsigned> &audio_map, Scripts &scripts){
 	static const std::vector<std::string> order = {
 		"name",				  //  0
 		"tileset",			  //  1
@@ -32,7 +33,7 @@ Maps2::Maps2(const char *maps_path, const data_map_t &maps_data, const Tilesets2
 		if (!columns[id_offset].size())
 			continue;
 
-		this->maps.emplace_back(new Map2(columns, tilesets, maps_data, audio_map));
+		this->maps.emplace_back(new Map2(columns, tilesets, maps_data, audio_map, scripts));
 		auto back = this->maps.back();
 		this->map[back->get_name()] = back;
 	}
@@ -51,7 +52,7 @@ Maps2::Maps2(const char *maps_path, const data_map_t &maps_data, const Tilesets2
 	}
 }
 
-Map2::Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, const data_map_t &maps_data, const std::map<std::string, unsigned> &audio_map){
+Map2::Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, const data_map_t &maps_data, const std::map<std::string, unsigned> &audio_map, Scripts &scripts){
 	this->legacy_id = to_unsigned(columns[15]);
 	this->name = columns[0];
 	this->tileset = tilesets.get(columns[1]);
@@ -66,7 +67,7 @@ Map2::Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, c
 	}
 	if (this->map_data->size() != this->width * this->height)
 		throw std::runtime_error("Error: Map \"" + this->name + "\" has invalid size.");
-	this->on_frame = columns[5];
+	this->on_frame = scripts.get(columns[5]);
 	this->objects = columns[6];
 	this->random_encounters = columns[8];
 	this->fishing_encounters = columns[9];
@@ -80,7 +81,7 @@ Map2::Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, c
 	if (columns[12].size())
 		this->special_warp_check = to_unsigned(columns[12]);
 	this->special_warp_tiles = to_int_vector(columns[13], true);
-	this->on_load = columns[14];
+	this->on_load = scripts.get(columns[14]);
 }
 
 std::shared_ptr<Map2> Maps2::get(const std::string &name){
@@ -180,7 +181,7 @@ void Map2::serialize(std::vector<byte_t> &dst){
 	write_varint(dst, this->map_text.size());
 	for (auto &text : this->map_text){
 		write_signed_varint(dst, text.text);
-		write_ascii_string(dst, text.script);
+		write_varint(dst, text.script);
 	}
 	write_varint(dst, this->special_warp_check > 0 ? this->special_warp_check : this->tileset->get_warp_check());
 	const std::vector<int> *warp_tiles = nullptr;
@@ -193,8 +194,8 @@ void Map2::serialize(std::vector<byte_t> &dst){
 	write_varint(dst, warp_tiles->size());
 	for (auto tile : *warp_tiles)
 		write_varint(dst, tile);
-	write_ascii_string(dst, this->on_frame);
-	write_ascii_string(dst, this->on_load);
+	write_varint(dst, this->on_frame);
+	write_varint(dst, this->on_load);
 	write_varint(dst, this->music);
 	write_varint(dst, this->sprite_visibility_flags.size());
 	for (auto id : this->sprite_visibility_flags)
@@ -255,23 +256,23 @@ void Map2::set_map_connection(int direction, const MapConnection &mc){
 	this->map_connections[direction] = mc;
 }
 
-void Maps2::load_map_text(const std::map<std::string, std::vector<MapTextEntry>> &map_text, TextStore &text_store){
+void Maps2::load_map_text(const std::map<std::string, std::vector<MapTextEntry>> &map_text, TextStore &text_store, Scripts &scripts){
 	for (auto &map : this->maps){
 		auto it = map_text.find(map->get_name());
 		if (it == map_text.end())
 			continue;
-		map->set_map_text(it->second, text_store);
+		map->set_map_text(it->second, text_store, scripts);
 	}
 }
 
-void Map2::set_map_text(const std::vector<MapTextEntry> &map_text, TextStore &text_store){
+void Map2::set_map_text(const std::vector<MapTextEntry> &map_text, TextStore &text_store, Scripts &scripts){
 	this->map_text.clear();
 	this->map_text.reserve(map_text.size());
 	for (auto &text : map_text){
 		if (text.text.size())
-			this->map_text.emplace_back(text_store.get_text_id_by_name(text.text));
+			this->map_text.emplace_back(text_store.get_text_id_by_name(text.text), 0);
 		else
-			this->map_text.emplace_back(text.script);
+			this->map_text.emplace_back(-1, scripts.get(text.script));
 	}
 }
 
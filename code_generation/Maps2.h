@@ -6,6 +6,7 @@
 #include "TextStore.h"
 
 class TextStore;
+class Scripts;
 
 struct MapConnection{
 	std::string destination;
@@ -15,10 +16,9 @@ struct MapConnection{
 
 struct MapTextEntry2{
 	int text;
-	std::string script;
+	unsigned script;
 
-	MapTextEntry2(int t): text(t){}
-	MapTextEntry2(const std:: string &s): text(-1), script(s){}
+	MapTextEntry2(int t, unsigned s): text(t), script(s){}
 };
 
 class Map2{
@@ -28,8 +28,8 @@ class Map2{
 	unsigned width, height;
 	std::string map_data_name;
 	std::shared_ptr<std::vector<byte_t>> map_data;
-	std::string on_frame;
-	std::string on_load;
+	unsigned on_frame;
+	unsigned on_load;
 	std::string objects;
 	std::string random_encounters;
 	std::string fishing_encounters;
@@ -41,7 +41,7 @@ class Map2{
 	std::vector<int> special_warp_tiles;
 	std::vector<int> sprite_visibility_flags;
 public:
-	Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, const data_map_t &maps_data, const std::map<std::string, unsigned> &audio_map);
+	Map2(const std::vector<std::string> &columns, const Tilesets2 &tilesets, const data_map_t &maps_data, const std::map<std::string, unsigned> &audio_map, Scripts &scripts);
 	DELETE_COPY_CONSTRUCTORS(Map2);
 	const std::string &get_name() const{
 		return this->name;
@@ -62,7 +62,7 @@ public:
 	unsigned get_height() const{
 		return this->height;
 	}
-	const std::string &get_script() const{
+	unsigned get_script() const{
 		return this->on_frame;
 	}
 	const std::string &get_objects() const{
@@ -79,7 +79,7 @@ public:
 	}
 	void serialize(std::vector<byte_t> &);
 	void set_map_connection(int direction, const MapConnection &);
-	void set_map_text(const std::vector<MapTextEntry> &map_text, TextStore &);
+	void set_map_text(const std::vector<MapTextEntry> &map_text, TextStore &, Scripts &);
 	void load_sprite_visibility_flags(const std::map<unsigned, unsigned> &);
 };
 
@@ -87,13 +87,13 @@ class Maps2{
 	std::vector<std::shared_ptr<Map2>> maps;
 	std::map<std::string, std::shared_ptr<Map2>> map;
 public:
-	Maps2(const char *maps_path, const data_map_t &reordered_map_data, const Tilesets2 &tilesets, const std::map<std::string, unsigned> &audio_map);
+	Maps2(const char *maps_path, const data_map_t &reordered_map_data, const Tilesets2 &tilesets, const std::map<std::string, unsigned> &audio_map, Scripts &scripts);
 	DELETE_COPY_CONSTRUCTORS(Maps2);
 	std::shared_ptr<Map2> get(const std::string &name);
 	const decltype(maps) &get_maps() const{
 		return this->maps;
 	}
 	void load_map_connections(const char *map_connections_path);
-	void load_map_text(const std::map<std::string, std::vector<MapTextEntry>> &, TextStore &);
+	void load_map_text(const std::map<std::string, std::vector<MapTextEntry>> &, TextStore &, Scripts &);
 	void load_sprite_visibility_flags(const std::map<std::string, std::map<unsigned, unsigned>> &);
 };
@@ -11,6 +11,28 @@ extern const char * const moves_file = "input/moves.csv";
 extern const char * const pokemon_types_file = "input/pokemon_types.csv";
 extern const char * const effects_file = "input/move_effects.csv";
 
+struct GrowthPolynomial{
+	int a;
+	int b;
+	int c;
+	int d;
+	int e;
+	int compute(int x) const{
+		return x * x * x * a / b + x * x * c + x * d + e;
+	}
+};
+
+static const GrowthPolynomial growth_polynomials[] = {
+	{ 1, 1,   0,   0,    0 },
+	{ 3, 4,  10,   0,  -30 },
+	{ 3, 4,  20,   0,  -70 },
+	{ 6, 5, -15, 100, -140 },
+	{ 4, 5,   0,   0,    0 },
+	{ 5, 4,   0,   0,    0 },
+};
+
+static const int max_pokemon_level = 100;
+
 PokemonData::PokemonData():
 		types(pokemon_types_file),
 		effects(effects_file),
@@ -136,6 +158,8 @@ SpeciesData::SpeciesData(const std::vector<std::string> &columns, const MoveStor
 			this->initial_attacks.push_back(moves.get_move(s));
 		}
 		this->growth_rate = to_unsigned_default(columns[16]);
+		if (this->growth_rate >= array_length(growth_polynomials))
+			throw std::runtime_error("Invalid growth rate: " + columns[16]);
 		{
 			auto &bitmap = columns[17];
 			if (bitmap.size() != 7 * 8)
@@ -245,9 +269,41 @@ void PokemonData::generate_static_data_declarations(const char *filename) const{
 		"\n";
 
 	for (auto &species : this->species)
-		file << "extern const PokemonInfo<" << species.initial_attacks.size() << ", " << species.evolution_triggers.size() << ", " << species.learned_moves.size() << "> pokemoninfo_" << species.name << ";\n";
+		file << "extern const BasePokemonInfo pokemoninfo_" << species.name << ";\n";
+
+	size_t initial_moves = 0,
+		evolution_triggers = 0,
+		learned_moves = 0;
+	for (auto &species : this->species){
+		initial_moves += species.initial_attacks.size();
+		evolution_triggers += species.evolution_triggers.size();
+		learned_moves += species.learned_moves.size();
+	}
+	auto n = this->species.size();
 
 	file <<
+		"\n"
+		"//Structure-of-arrays tables, indexed by SpeciesId. The pools hold the\n"
+		"//data of all species contiguously; the data of species i is in\n"
+		"//[offsets[i]; offsets[i + 1]).\n"
+		"extern const MoveId species_initial_moves_pool[" << std::max<size_t>(initial_moves, 1) << "];\n"
+		"extern const EvolutionTrigger species_evolution_triggers_pool[" << std::max<size_t>(evolution_triggers, 1) << "];\n"
+		"extern const LearnedMove species_learned_moves_pool[" << std::max<size_t>(learned_moves, 1) << "];\n"
+		"extern const std::uint16_t species_initial_moves_offsets[" << n + 1 << "];\n"
+		"extern const std::uint16_t species_evolution_triggers_offsets[" << n + 1 << "];\n"
+		"extern const std::uint16_t species_learned_moves_offsets[" << n + 1 << "];\n"
+		"extern const byte_t species_base_stats[" << n << "][5];\n"
+		"extern const PokemonTypeId species_types[" << n << "][2];\n"
+		"extern const byte_t species_growth_rates[" << n << "];\n"
+		"extern const byte_t species_base_xp_yields[" << n << "];\n"
+		"extern const byte_t species_catch_rates[" << n << "];\n"
+		"\n"
+		"//Minimum experience needed to reach each level, indexed by growth rate\n"
+		"//and level.\n"
+		"static const int growth_rate_count = " << array_length(growth_polynomials) << ";\n"
+		"static const int max_pokemon_level = " << max_pokemon_level << ";\n"
+		"extern const std::int32_t experience_by_growth_rate[" << array_length(growth_polynomials) << "][" << max_pokemon_level + 1 << "];\n"
+		"\n"
 		"extern const BasePokemonInfo * const pokemon_by_species_id[" << this->species.size() << "];\n"
 		"static const size_t pokemon_by_species_id_size = " << this->species.size() << ";\n"
 		"extern const BasePokemonInfo * const pokemon_by_pokedex_id[" << this->count_pokedex_species() << "];\n"
@@ -265,9 +321,123 @@ void PokemonData::generate_static_data_definitions(const char *filename, const c
 	this->types.generate_static_data_definitions(file);
 	this->moves.generate_static_data_definitions(file);
 
+	auto by_id = this->get_species_by_id();
+	struct Offsets{
+		size_t initial_moves;
+		size_t evolution_triggers;
+		size_t learned_moves;
+	};
+	std::map<const SpeciesData *, Offsets> offsets;
+	{
+		Offsets current = { 0, 0, 0 };
+		std::vector<Offsets> offsets_by_id;
+		for (auto species : by_id){
+			offsets[species] = current;
+			offsets_by_id.push_back(current);
+			current.initial_moves += species->initial_attacks.size();
+			current.evolution_triggers += species->evolution_triggers.size();
+			current.learned_moves += species->learned_moves.size();
+		}
+		offsets_by_id.push_back(current);
+
+		file << "const MoveId species_initial_moves_pool[" << std::max<size_t>(current.initial_moves, 1) << "] = {\n";
+		for (auto species : by_id)
+			for (auto &attack : species->initial_attacks)
+				file << "    MoveId::" << attack->get_name() << ",\n";
+		if (!current.initial_moves)
+			file << "    MoveId::None,\n";
+		file <<
+			"};\n"
+			"\n"
+			"const EvolutionTrigger species_evolution_triggers_pool[" << std::max<size_t>(current.evolution_triggers, 1) << "] = {\n";
+		for (auto species : by_id){
+			for (auto &evolution : species->evolution_triggers){
+				file << "    { ";
+				const char *type;
+				if (evolution.type == "level")
+					type = "AT_LEVEL";
+				else if (evolution.type == "item")
+					type = "WITH_ITEM";
+				else if (evolution.type == "trade")
+					type = "WHEN_TRADED";
+				else
+					throw std::runtime_error("Invalid type: " + evolution.type);
+				file << type << "(";
+				if (evolution.type == "item")
+					file << evolution.item << ", ";
+				file << evolution.minimum_level << ", " << evolution.next_form << ") },\n";
+			}
+		}
+		if (!current.evolution_triggers)
+			file << "    {},\n";
+		file <<
+			"};\n"
+			"\n"
+			"const LearnedMove species_learned_moves_pool[" << std::max<size_t>(current.learned_moves, 1) << "] = {\n";
+		for (auto species : by_id)
+			for (auto &move : species->learned_moves)
+				file << "    { LEARN(" << move.level << ", " << move.move->get_name() << ") },\n";
+		if (!current.learned_moves)
+			file << "    {},\n";
+		file <<
+			"};\n"
+			"\n";
+
+		const std::pair<const char *, size_t Offsets::*> offset_tables[] = {
+			{ "species_initial_moves_offsets", &Offsets::initial_moves },
+			{ "species_evolution_triggers_offsets", &Offsets::evolution_triggers },
+			{ "species_learned_moves_offsets", &Offsets::learned_moves },
+		};
+		for (auto &table : offset_tables){
+			file << "const std::uint16_t " << table.first << "[" << offsets_by_id.size() << "] = {\n";
+			for (auto &o : offsets_by_id)
+				file << "    " << o.*table.second << ",\n";
+			file <<
+				"};\n"
+				"\n";
+		}
+	}
+
+	file << "const byte_t species_base_stats[" << by_id.size() << "][5] = {\n";
+	for (auto species : by_id)
+		file << "    { " << species->base_hp << ", " << species->base_attack << ", " << species->base_defense << ", " << species->base_speed << ", " << species->base_special << ", },\n";
+	file <<
+		"};\n"
+		"\n"
+		"const PokemonTypeId species_types[" << by_id.size() << "][2] = {\n";
+	for (auto species : by_id)
+		file << "    { PokemonTypeId::" << species->type[0]->get_name() << ", PokemonTypeId::" << species->type[1]->get_name() << ", },\n";
+	file <<
+		"};\n"
+		"\n";
+	const std::pair<const char *, unsigned SpeciesData::*> byte_tables[] = {
+		{ "species_growth_rates", &SpeciesData::growth_rate },
+		{ "species_base_xp_yields", &SpeciesData::base_xp_yield },
+		{ "species_catch_rates", &SpeciesData::catch_rate },
+	};
+	for (auto &table : byte_tables){
+		file << "const byte_t " << table.first << "[" << by_id.size() << "] = {\n";
+		for (auto species : by_id)
+			file << "    " << species->*table.second << ",\n";
+		file <<
+			"};\n"
+			"\n";
+	}
+
+	file << "const std::int32_t experience_by_growth_rate[" << array_length(growth_polynomials) << "][" << max_pokemon_level + 1 << "] = {\n";
+	for (auto &polynomial : growth_polynomials){
+		file << "    {";
+		for (int level = 0; level <= max_pokemon_level; level++)
+			file << " " << polynomial.compute(level) << ",";
+		file << " },\n";
+	}
+	file <<
+		"};\n"
+		"\n";
+
 	for (auto &species : this->species){
 		file <<
-			"const PokemonInfo<" << species.initial_attacks.size() << ", " << species.evolution_triggers.size() << ", " << species.learned_moves.size() << "> pokemoninfo_" << species.name << " = {\n"
+			"const BasePokemonInfo pokemoninfo_" << species.name << " = {\n"
 			"    PokedexId::" << (species.pokedex_id ? species.name : "None") << ",\n"
 			"    SpeciesId::" << species.name << ",\n"
 			"    \"" << species.name << "\",\n"
@@ -310,53 +480,20 @@ void PokemonData::generate_static_data_definitions(const char *filename, const c
 		file <<
 			"    " << species.height_feet << ",\n"
 			"    " << species.height_inches<< ",\n"
-			"    " << species.weight_tenths_of_pounds << ",\n"
-			"    {\n"
-			;
-
-		for (auto &attack : species.initial_attacks)
-			file << "        MoveId::" << attack->get_name() << ",\n";
-
-		file <<
-			"    },\n"
-			"    {\n"
-			;
-
-		for (auto &evolution : species.evolution_triggers){
-			file << "        ";
-			const char *type;
-			if (evolution.type == "level")
-				type = "AT_LEVEL";
-			else if (evolution.type == "item")
-				type = "WITH_ITEM";
-			else if (evolution.type == "trade")
-				type = "WHEN_TRADED";
-			else
-				throw std::runtime_error("Invalid type: " + evolution.type);
-			file << type << "(";
-			if (evolution.type == "item")
-				file << evolution.item << ", ";
-			file << evolution.minimum_level << ", " << evolution.next_form << "),\n";
-		}
+			"    " << species.weight_tenths_of_pounds << ",\n";
+		auto &o = offsets[&species];
 		file <<
-			"    },\n"
-			"    {\n";
-		for (auto &move : species.learned_moves)
-			file << "        LEARN(" << move.level << ", " << move.move->get_name() << "),\n";
-		file <<
-			"    },\n"
+			"    { species_initial_moves_pool + " << o.initial_moves << ", " << species.initial_attacks.size() << " },\n"
+			"    { species_evolution_triggers_pool + " << o.evolution_triggers << ", " << species.evolution_triggers.size() << " },\n"
+			"    { species_learned_moves_pool + " << o.learned_moves << ", " << species.learned_moves.size() << " },\n"
 			"};\n"
 			"\n";
 	}
 
 	{
-		std::vector<std::pair<unsigned, std::string>> temp;
-		for (auto &species : this->species)
-			temp.push_back({ species.species_id, species.name });
-		std::sort(temp.begin(), temp.end());
-		file << "const BasePokemonInfo * const pokemon_by_species_id[" << temp.size() << "] = {\n";
-		for (auto &species : temp)
-			file << "    &pokemoninfo_" << species.second << ",\n";
+		file << "const BasePokemonInfo * const pokemon_by_species_id[" << by_id.size() << "] = {\n";
+		for (auto species : by_id)
+			file << "    &pokemoninfo_" << species->name << ",\n";
 		file <<
 			"};\n"
 			"\n";
@@ -374,6 +511,14 @@ void PokemonData::generate_static_data_definitions(const char *filename, const c
 	}
 }
 
+std::vector<const SpeciesData *> PokemonData::get_species_by_id() const{
+	std::vector<const SpeciesData *> ret;
+	for (auto &species : this->species)
+		ret.push_back(&species);
+	std::sort(ret.begin(), ret.end(), [](const SpeciesData *a, const SpeciesData *b){ return a->species_id < b->species_id; });
+	return ret;
+}
+
 unsigned PokemonData::count_pokedex_species() const{
 	unsigned ret = 0;
 	for (auto &species : this->species)
@@ -560,7 +705,13 @@ void MoveStore::generate_static_data_declarations(std::ostream &header) const{
 		"struct MoveData;\n"
 		"\n"
 		"extern const MoveData * const pokemon_moves_by_id[" << this->moves_serialized.size() << "];\n"
-		"static const size_t pokemon_moves_by_id_size = " << this->moves_serialized.size() << ";\n";
+		"static const size_t pokemon_moves_by_id_size = " << this->moves_serialized.size() << ";\n"
+		"\n"
+		"//Structure-of-arrays copies of MoveData, indexed by MoveId.\n"
+		"extern const byte_t pokemon_moves_power[" << this->moves_serialized.size() << "];\n"
+		"extern const PokemonTypeId pokemon_moves_type[" << this->moves_serialized.size() << "];\n"
+		"extern const byte_t pokemon_moves_accuracy[" << this->moves_serialized.size() << "];\n"
+		"extern const byte_t pokemon_moves_pp[" << this->moves_serialized.size() << "];\n";
 }
 
 void MoveStore::generate_static_data_definitions(std::ostream &source) const{
@@ -579,6 +730,24 @@ void MoveStore::generate_static_data_definitions(std::ostream &source) const{
 			source << "    nullptr";
 		source << ",\n";
 	}
+	source << "};\n"
+		"\n";
+
+	const std::pair<const char *, unsigned (MoveData::*)() const> tables[] = {
+		{ "pokemon_moves_power", &MoveData::get_power },
+		{ "pokemon_moves_accuracy", &MoveData::get_accuracy },
+		{ "pokemon_moves_pp", &MoveData::get_pp },
+	};
+	for (auto &table : tables){
+		source << "const byte_t " << table.first << "[" << this->moves_serialized.size() << "] = {\n";
+		for (auto &p : this->moves_serialized)
+			source << "    " << (p ? (p.get()->*table.second)() : 0) << ",\n";
+		source << "};\n"
+			"\n";
+	}
+	source << "const PokemonTypeId pokemon_moves_type[" << this->moves_serialized.size() << "] = {\n";
+	for (auto &p : this->moves_serialized)
+		source << "    PokemonTypeId::" << (p ? p->get_type().get_name() : "Normal") << ",\n";
 	source << "};\n";
 }
 
@@ -76,6 +76,18 @@ public:
 	const std::string &get_display_name() const{
 		return this->display_name;
 	}
+	unsigned get_power() const{
+		return this->power;
+	}
+	const TypeData &get_type() const{
+		return *this->type;
+	}
+	unsigned get_accuracy() const{
+		return this->accuracy;
+	}
+	unsigned get_pp() const{
+		return this->pp;
+	}
 	void output(std::ostream &) const;
 };
 
@@ -170,6 +182,7 @@ class PokemonData{
 	std::map<std::string, unsigned> map;
 
 	unsigned count_pokedex_species() const;
+	std::vector<const SpeciesData *> get_species_by_id() const;
 public:
 	PokemonData();
 	void generate_secondary_enums(const char *filename) const;
@@ -0,0 +1,95 @@
+#include "Scripts.h"
+#include "../common/csv_parser.h"
+#include "utility.h"
+#include <set>
+#include <cctype>
+
+extern const char * const maps_file;
+extern const char * const map_text_file;
+extern const char * const bookcases_file;
+extern const char * const map_objects_file;
+
+unsigned Scripts::get(const std::string &name){
+	if (!name.size())
+		return 0;
+	this->init();
+	auto it = this->scripts.find(name);
+	if (it == this->scripts.end())
+		throw std::runtime_error("Script " + name + " not defined.");
+	return it->second;
+}
+
+static bool is_identifier(const std::string &s){
+	if (!s.size() || isdigit((unsigned char)s[0]))
+		return false;
+	for (auto c : s)
+		if (!isalnum((unsigned char)c) && c != '_')
+			return false;
+	return true;
+}
+
+static void add_script(std::set<std::string> &dst, const std::string &name, const char *path){
+	if (!name.size())
+		return;
+	if (!is_identifier(name))
+		throw std::runtime_error((std::string)"Error: " + path + " references script \"" + name + "\", which is not a valid identifier.");
+	dst.insert(name);
+}
+
+void Scripts::init(){
+	if (this->initialized)
+		return;
+	this->initialized = true;
+
+	std::set<std::string> names;
+	{
+		static const std::vector<std::string> order = {"on_frame", "on_load"};
+		CsvParser csv(maps_file);
+		for (auto i = csv.row_count(); i--;)
+			for (auto &name : csv.get_ordered_row(i, order))
+				add_script(names, name, maps_file);
+	}
+	{
+		static const std::vector<std::string> order = {"script"};
+		CsvParser csv(map_text_file);
+		for (auto i = csv.row_count(); i--;)
+			add_script(names, csv.get_ordered_row(i, order)[0], map_text_file);
+	}
+	{
+		static const std::vector<std::string> order = {"name", "is_script"};
+		CsvParser csv(bookcases_file);
+		for (auto i = csv.row_count(); i--;){
+			auto columns = csv.get_ordered_row(i, order);
+			if (to_bool(columns[1]))
+				add_script(names, columns[0], bookcases_file);
+		}
+	}
+	{
+		static const std::vector<std::string> order = {"type", "param2"};
+		CsvParser csv(map_objects_file);
+		for (auto i = csv.row_count(); i--;){
+			auto columns = csv.get_ordered_row(i, order);
+			if (columns[0] == "hidden")
+				add_script(names, columns[1], map_objects_file);
+		}
+	}
+
+	unsigned id = 1;
+	for (auto &name : names)
+		this->scripts[name] = id++;
+}
+
+const std::map<std::string, unsigned> &Scripts::get_map(){
+	this->init();
+	return this->scripts;
+}
+
+const std::vector<std::string> &Scripts::get_input_files(){
+	static const std::vector<std::string> ret = {
+		maps_file,
+		map_text_file,
+		bookcases_file,
+		map_objects_file,
+	};
+	return ret;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+//Every script referenced by the data. IDs are assigned in name order,
+//starting at 1, since 0 is ScriptId::None.
+class Scripts{
+	bool initialized = false;
+	std::map<std::string, unsigned> scripts;
+
+	void init();
+public:
+	//Returns 0 for the empty name.
+	unsigned get(const std::string &name);
+	const std::map<std::string, unsigned> &get_map();
+	//Every generator that serializes script IDs must hash these files.
+	static const std::vector<std::string> &get_input_files();
+};
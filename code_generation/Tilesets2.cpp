@@ -1,12 +1,13 @@
 #include "Tilesets2.h"
 #include "TextStore.h"
+#include "Scripts.h"
 #include "../common/csv_parser.h"
 #include "utility.h"
 #include <sstream>
 
 int Tileset2::next_id = 1;
 
-std::map<std::string, std::set<BookcaseTile>> load_bookcases(const char *path, TextStore &text_store){
+std::map<std::string, std::set<BookcaseTile>> load_bookcases(const char *path, TextStore &text_store, Scripts &scripts){
 	static const std::vector<std::string> order = {
 		"tileset",
 		"tile",
@@ -22,7 +23,7 @@ std::map<std::string, std::set<BookcaseTile>> load_bookcases(const char *path, T
 		bt.tile_no = to_unsigned(columns[1]);
 		bt.is_script = to_bool(columns[3]);
 		if (bt.is_script)
-			bt.name = columns[2];
+			bt.script = scripts.get(columns[2]);
 		else
 			bt.text_id = text_store.get_text_id_by_name(columns[2]);
 		ret[columns[0]].insert(bt);
@@ -36,7 +37,8 @@ Tilesets2::Tilesets2(
 		const std::map<std::string, std::shared_ptr<std::vector<byte_t>>> &blockset,
 		const data_map_t &collision,
 		GraphicsStore &gs,
-		TextStore &text_store){
+		TextStore &text_store,
+		Scripts &scripts){
 
 	static const std::vector<std::string> order = {
 		"name",
@@ -55,7 +57,7 @@ Tilesets2::Tilesets2(
 	CsvParser csv(path);
 	auto rows = csv.row_count();
 
-	auto bookcases = load_bookcases(bookcases_path, text_store);
+	auto bookcases = load_bookcases(bookcases_path, text_store, scripts);
 
 	for (size_t i = 0; i < rows; i++){
 		auto columns = csv.get_ordered_row(i, order);
@@ -177,7 +179,7 @@ void Tileset2::serialize(std::vector<byte_t> &dst){
 		write_varint(dst, bt.tile_no);
 		write_varint(dst, bt.is_script);
 		if (bt.is_script)
-			write_ascii_string(dst, bt.name);
+			write_varint(dst, bt.script);
 		else
 			write_varint(dst, bt.text_id);
 	}
@@ -8,11 +8,12 @@
 #include "ReorderedBlockset.h"
 
 class TextStore;
+class Scripts;
 
 struct BookcaseTile{
 	unsigned tile_no;
 	bool is_script;
-	std::string name;
+	unsigned script;
 	unsigned text_id;
 
 	bool operator<(const BookcaseTile &other) const{
@@ -94,7 +95,8 @@ public:
 		const std::map<std::string, std::shared_ptr<std::vector<byte_t>>> &blockset,
 		const data_map_t &collision,
 		GraphicsStore &gs,
-		TextStore &text_store);
+		TextStore &text_store,
+		Scripts &scripts);
 	std::shared_ptr<Tileset2> get(const std::string &name) const;
 	const std::vector<std::shared_ptr<Tileset2>> &get_tilesets() const{
 		return this->tilesets;
@@ -2,9 +2,13 @@
 #include "../common/sha1.h"
 #include "PokemonData.h"
 #include "Variables.h"
+#include "Scripts.h"
 
-static const char * const map_objects_file = "input/map_objects.csv";
+extern const char * const map_objects_file = "input/map_objects.csv";
 static const char * const names_input_file = "input/map_object_names.csv";
+extern const char * const maps_file;
+extern const char * const map_text_file;
+extern const char * const bookcases_file;
 extern const char * const pokemon_data_file;
 extern const char * const evolutions_file;
 extern const char * const pokemon_moves_file;
@@ -21,6 +25,10 @@ static const std::vector<std::string> input_files = {
 	moves_file,
 	pokemon_types_file,
 	effects_file,
+	//Script IDs depend on them.
+	maps_file,
+	map_text_file,
+	bookcases_file,
 };
 
 static const char * const hash_key = "generate_map_objects";
@@ -91,10 +99,12 @@ struct MapObject{
 	PokemonData *pokemon_data;
 	int legacy_sprite_id = -1;
 	Variables &variables;
+	Scripts &scripts;
 
-	MapObject(const std::vector<std::string> &row, PokemonData &pokemon_data, const std::map<unsigned, std::string> &name_map, Variables &variables):
+	MapObject(const std::vector<std::string> &row, PokemonData &pokemon_data, const std::map<unsigned, std::string> &name_map, Variables &variables, Scripts &scripts):
 			pokemon_data(&pokemon_data),
-			variables(variables){
+			variables(variables),
+			scripts(scripts){
 		this->id = to_unsigned(row[0]);
 		{
 			auto it = name_map.find(this->id);
@@ -220,7 +230,7 @@ static std::string warp_f(const MapObject &mo){
 static void event_disp_f(std::vector<byte_t> &dst, const MapObject &mo){}
 
 static void hidden_f(std::vector<byte_t> &dst, const MapObject &mo){
-	write_ascii_string(dst, mo.params[1]);
+	write_varint(dst, mo.scripts.get(mo.params[1]));
 	write_ascii_string(dst, mo.params[0]);
 }
 
@@ -297,7 +307,7 @@ static std::map<unsigned, std::string> load_name_map(){
 
 //------------------------------------------------------------------------------
 
-static void generate_map_objects_internal(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &pokemon_data, Variables &variables){
+static void generate_map_objects_internal(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &pokemon_data, Variables &variables, Scripts &scripts){
 
 	auto current_hash = hash_files(input_files, date_string);
 	if (check_for_known_hash(known_hashes, hash_key, current_hash)){
@@ -331,7 +341,7 @@ static void generate_map_objects_internal(known_hashes_t &known_hashes, std::uni
 	auto name_map = load_name_map();
 	for (size_t i = 0; i < rows; i++){
 		auto row = csv.get_ordered_row(i, order);
-		map_sets[row[1]].emplace_back(row, *pokemon_data, name_map, variables);
+		map_sets[row[1]].emplace_back(row, *pokemon_data, name_map, variables, scripts);
 	}
 
 	{
@@ -385,9 +395,9 @@ static void generate_map_objects_internal(known_hashes_t &known_hashes, std::uni
 	known_hashes[hash_key] = current_hash;
 }
 
-void generate_map_objects(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &pokemon_data, Variables &variables){
+void generate_map_objects(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &pokemon_data, Variables &variables, Scripts &scripts){
 	try{
-		generate_map_objects_internal(known_hashes, pokemon_data, variables);
+		generate_map_objects_internal(known_hashes, pokemon_data, variables, scripts);
 	}catch (std::exception &e){
 		throw std::runtime_error((std::string)"generate_map_objects(): " + e.what());
 	}
@@ -3,5 +3,6 @@
 
 class PokemonData;
 class Variables;
+class Scripts;
 
-void generate_map_objects(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &, Variables &);
+void generate_map_objects(known_hashes_t &known_hashes, std::unique_ptr<PokemonData> &, Variables &, Scripts &);
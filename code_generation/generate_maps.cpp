@@ -7,12 +7,13 @@
 #include "Tilesets2.h"
 #include "Maps2.h"
 #include "TextStore.h"
+#include "Scripts.h"
 #include <string>
 #include <stdexcept>
 #include <iostream>
 #include <algorithm>
 
-static const char * const maps_file = "input/maps.csv";
+extern const char * const maps_file = "input/maps.csv";
 static const char * const tilesets_file = "input/tilesets.csv";
 static const char * const map_data_file = "input/map_data.csv";
 static const char * const map_data2_file = "input/map_data2.csv";
@@ -20,11 +21,12 @@ static const char * const blocksets_file = "input/blocksets.csv";
 static const char * const blocksets2_file = "input/blocksets2.csv";
 static const char * const collision_file = "input/collision.csv";
 static const char * const map_connections_file = "input/map_connections.csv";
-static const char * const map_text_file = "input/map_text.csv";
+extern const char * const map_text_file = "input/map_text.csv";
 extern const char * const text_file = "input/text.txt";
 static const char * const audio_csv_file = "output/audio.csv";
 static const char * const map_sprites_visibility_file = "input/map_sprites_visibility.csv";
-static const char * const bookcases_file = "input/bookcases.csv";
+extern const char * const bookcases_file = "input/bookcases.csv";
+extern const char * const map_objects_file;
 extern const char * const pokemon_data_file;
 extern const char * const evolutions_file;
 extern const char * const pokemon_moves_file;
@@ -44,6 +46,8 @@ static const std::vector<std::string> input_files = {
 	audio_csv_file,
 	map_sprites_visibility_file,
 	bookcases_file,
+	//Script IDs depend on it.
+	map_objects_file,
 	pokemon_data_file,
 	evolutions_file,
 	pokemon_moves_file,
@@ -194,7 +198,7 @@ static std::map<std::string, std::map<unsigned, unsigned>> load_sprite_visibilit
 	return ret;
 }
 
-static void generate_maps_internal(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store){
+static void generate_maps_internal(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store, Scripts &scripts){
 	auto current_hash = hash_files(input_files, date_string);
 	if (check_for_known_hash(known_hashes, hash_key, current_hash)){
 		std::cout << "Skipping generating maps.\n";
@@ -209,10 +213,10 @@ static void generate_maps_internal(known_hashes_t &known_hashes, GraphicsStore &
 	auto map_data = read_data_csv(map_data2_file);
 	auto map_text = read_string_map(map_text_file);
 	
-	Tilesets2 tilesets2(tilesets_file, bookcases_file, blocksets, collision, gs, text_store);
-	Maps2 maps2(maps_file, map_data, tilesets2, load_audio_map());
+	Tilesets2 tilesets2(tilesets_file, bookcases_file, blocksets, collision, gs, text_store, scripts);
+	Maps2 maps2(maps_file, map_data, tilesets2, load_audio_map(), scripts);
 	maps2.load_map_connections(map_connections_file);
-	maps2.load_map_text(map_text, text_store);
+	maps2.load_map_text(map_text, text_store, scripts);
 	maps2.load_sprite_visibility_flags(load_sprite_visibility_flags_map());
 
 	//Do consistency check.
@@ -243,9 +247,9 @@ static void generate_maps_internal(known_hashes_t &known_hashes, GraphicsStore &
 	known_hashes[hash_key] = current_hash;
 }
 
-void generate_maps(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store){
+void generate_maps(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store, Scripts &scripts){
 	try{
-		generate_maps_internal(known_hashes, gs, text_store);
+		generate_maps_internal(known_hashes, gs, text_store, scripts);
 	}catch (std::exception &e){
 		throw std::runtime_error((std::string)"generate_maps(): " + e.what());
 	}
@@ -3,5 +3,6 @@
 #include "Graphics.h"
 
 class TextStore;
+class Scripts;
 
-void generate_maps(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store);
+void generate_maps(known_hashes_t &known_hashes, GraphicsStore &gs, TextStore &text_store, Scripts &scripts);
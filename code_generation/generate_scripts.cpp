@@ -0,0 +1,51 @@
+#include "generate_scripts.h"
+#include "Scripts.h"
+
+static const char * const hash_key = "generate_scripts";
+static const char * const date_string = __DATE__ __TIME__;
+
+static void generate_scripts_internal(known_hashes_t &known_hashes, Scripts &scripts){
+	auto current_hash = hash_files(Scripts::get_input_files(), date_string);
+	if (check_for_known_hash(known_hashes, hash_key, current_hash)){
+		std::cout << "Skipping generating scripts.\n";
+		return;
+	}
+	std::cout << "Generating scripts...\n";
+
+	std::ofstream header("output/scripts.h");
+	std::ofstream source("output/scripts.inl");
+
+	header << generated_file_warning <<
+		"\n"
+		"#pragma once\n"
+		"#include <cstddef>\n"
+		"\n"
+		"namespace CppRed{\n"
+		"enum class ScriptId{\n"
+		"    None = 0,\n";
+
+	source << generated_file_warning <<
+		"\n"
+		"//Every script in ScriptId order, starting from 1. Define CPPRED_SCRIPT(name)\n"
+		"//before including.\n";
+
+	auto &map = scripts.get_map();
+	for (auto &kv : map){
+		header << "    " << kv.first << " = " << kv.second << ",\n";
+		source << "CPPRED_SCRIPT(" << kv.first << ")\n";
+	}
+
+	header << "};\n"
+		"static const size_t script_id_count = " << map.size() + 1 << ";\n"
+		"}\n";
+
+	known_hashes[hash_key] = current_hash;
+}
+
+void generate_scripts(known_hashes_t &known_hashes, Scripts &scripts){
+	try{
+		generate_scripts_internal(known_hashes, scripts);
+	}catch (std::exception &e){
+		throw std::runtime_error((std::string)"generate_scripts(): " + e.what());
+	}
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "code_generators.h"
+
+class Scripts;
+
+void generate_scripts(known_hashes_t &known_hashes, Scripts &scripts);
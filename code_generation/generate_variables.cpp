@@ -7,7 +7,7 @@ extern const char * const variables_file = "input/variables.csv";
 static const char * const hash_key = "generate_variables";
 static const char * const date_string = __DATE__ __TIME__;
 
-static void generate_file(std::ostream &stream, const char *enum_name, const char *input_filename, const char *id_column, const char *name_column){
+static void generate_file(std::ostream &stream, const char *enum_name, const char *count_name, const char *input_filename, const char *id_column, const char *name_column){
 	CsvParser csv(input_filename);
 	auto rows = csv.row_count();
 
@@ -20,12 +20,15 @@ static void generate_file(std::ostream &stream, const char *enum_name, const cha
 		"enum class " << enum_name << "{\n"
 		"    None = 0,\n";
 
+	unsigned max = 0;
 	for (size_t i = 0; i < rows; i++){
 		auto columns = csv.get_ordered_row(i, order);
 		auto id = to_unsigned(columns[0]);
 		stream << "    " << columns[1] << " = " << id << ",\n";
+		max = std::max(max, id);
 	}
-	stream << "};\n\n";
+	stream << "};\n"
+		"static const size_t " << count_name << " = " << max + 1 << ";\n\n";
 }
 
 static std::vector<byte_t> load_default_visibilities(){
@@ -79,8 +82,8 @@ static void generate_variables_internal(known_hashes_t &known_hashes, Variables
 		"namespace CppRed{\n";
 
 
-	generate_file(header, "EventId", events_file, "id", "name");
-	generate_file(header, "VisibilityFlagId", map_sprites_visibility_file, "id", "visibility_flag");
+	generate_file(header, "EventId", "event_id_count", events_file, "id", "name");
+	generate_file(header, "VisibilityFlagId", "visibility_flag_id_count", map_sprites_visibility_file, "id", "visibility_flag");
 
 	std::vector<std::string> integers;
 	std::vector<std::string> strings;
@@ -99,13 +102,15 @@ static void generate_variables_internal(known_hashes_t &known_hashes, Variables
 		header << "    " << name << " = " << i++ << ",\n";
 	header <<
 		"};\n"
+		"static const size_t integer_variable_id_count = " << integers.size() << ";\n"
 		"\n"
 		"enum class StringVariableId{\n";
 	i = 0;
 	for (auto &name : strings)
 		header << "    " << name << " = " << i++ << ",\n";
 
-	header << "};\n";
+	header << "};\n"
+		"static const size_t string_variable_id_count = " << strings.size() << ";\n";
 
 	write_buffer_to_header_and_source(header, source, default_visibilities, "default_sprite_vibisilities");
 	header << "}\n";
@@ -8,9 +8,11 @@
 #include "generate_map_objects.h"
 #include "generate_trainer_parties.h"
 #include "generate_variables.h"
+#include "generate_scripts.h"
 #include "PokemonData.h"
 #include "TextStore.h"
 #include "Variables.h"
+#include "Scripts.h"
 #include "../common/csv_parser.h"
 #include <iostream>
 #include <stdexcept>
@@ -57,16 +59,18 @@ int main(){
 		GraphicsStore gs;
 		std::unique_ptr<PokemonData> pokemon_data;
 		Variables variables;
+		Scripts scripts;
 		TextStore ts(text_file, pokemon_data, variables);
 		generate_graphics(hashes, gs);
 		generate_audio(hashes);
-		generate_maps(hashes, gs, ts);
+		generate_maps(hashes, gs, ts, scripts);
 		generate_pokemon_data(hashes, pokemon_data);
 		generate_text(hashes, ts);
 		generate_items(hashes);
-		generate_map_objects(hashes, pokemon_data, variables);
+		generate_map_objects(hashes, pokemon_data, variables, scripts);
 		generate_trainer_parties(hashes, pokemon_data);
 		generate_variables(hashes, variables);
+		generate_scripts(hashes, scripts);
 		save_hashes(hashes);
 		auto t1 = clock();
 		std::cout << "Elapsed: " << (double)(t1 - t0) / CLOCKS_PER_SEC << " s.\n";
@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "AsyncLog.h"
+#include "Console.h"
+#ifndef HAVE_PCH
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#endif
+
+LogRing::LogRing(std::uint32_t thread_index):
+		records(new LogRecord[capacity]),
+		thread_index(thread_index){
+	this->write_position = 0;
+	this->read_position = 0;
+	this->orphaned = false;
+}
+
+bool LogRing::push(const LogRecord &record, bool &half_full){
+	auto write = this->write_position.load(std::memory_order_relaxed);
+	auto read = this->read_position.load(std::memory_order_acquire);
+	half_full = write + 1 - read >= capacity / 2;
+	if (write - read >= capacity)
+		return false;
+	auto &dst = this->records[write % capacity];
+	memcpy(&dst, &record, offsetof(LogRecord, text) + record.length);
+	this->write_position.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+bool LogRing::pop(LogRecord &record){
+	auto read = this->read_position.load(std::memory_order_relaxed);
+	auto write = this->write_position.load(std::memory_order_acquire);
+	if (read == write)
+		return false;
+	auto &src = this->records[read % capacity];
+	memcpy(&record, &src, offsetof(LogRecord, text) + src.length);
+	this->read_position.store(read + 1, std::memory_order_release);
+	return true;
+}
+
+namespace{
+
+class ThreadRing{
+public:
+	LogRing *ring = nullptr;
+	~ThreadRing(){
+		if (this->ring)
+			this->ring->orphan();
+	}
+};
+
+thread_local ThreadRing thread_ring;
+
+}
+
+AsyncLog::AsyncLog(){
+	this->next_thread_index = 0;
+	this->dropped = 0;
+	this->thread = std::thread([this](){ this->thread_function(); });
+}
+
+AsyncLog::~AsyncLog(){
+	{
+		LOCK_MUTEX(this->mutex);
+		this->running = false;
+		this->cv.notify_all();
+	}
+	this->thread.join();
+}
+
+AsyncLog &AsyncLog::get(){
+	static AsyncLog ret;
+	return ret;
+}
+
+LogRing &AsyncLog::get_thread_ring(){
+	if (!thread_ring.ring){
+		std::unique_ptr<LogRing> ring(new LogRing(this->next_thread_index++));
+		thread_ring.ring = ring.get();
+		LOCK_MUTEX(this->mutex);
+		this->rings.emplace_back(std::move(ring));
+	}
+	return *thread_ring.ring;
+}
+
+void AsyncLog::submit(LogRecord &record){
+	auto &ring = this->get_thread_ring();
+	record.timestamp = this->clock.get();
+	record.thread_index = ring.get_thread_index();
+	bool half_full;
+	if (!ring.push(record, half_full))
+		this->dropped.fetch_add(1, std::memory_order_relaxed);
+	//Get the consumer going early during bursts. Notifying without the lock
+	//may occasionally be missed, but the consumer polls anyway.
+	if (half_full)
+		this->cv.notify_one();
+}
+
+void AsyncLog::flush(){
+	std::unique_lock<std::mutex> lock(this->mutex);
+	//A pass that's already underway may have missed records submitted before
+	//this call, so wait for the one after it to finish.
+	auto target = this->passes + 2;
+	this->cv.notify_all();
+	this->cv.wait(lock, [this, target](){ return this->passes >= target || !this->running; });
+}
+
+void AsyncLog::detach_console(Console *console){
+	this->flush();
+	global_console.compare_exchange_strong(console, nullptr);
+}
+
+void AsyncLog::set_text_file(const char *path){
+	std::unique_ptr<std::ofstream> file(new std::ofstream(path));
+	if (!*file)
+		throw std::runtime_error((std::string)"AsyncLog::set_text_file(): Can't open " + path);
+	LOCK_MUTEX(this->mutex);
+	this->new_text_file = std::move(file);
+}
+
+void AsyncLog::set_trace_file(const char *path){
+	std::unique_ptr<std::ofstream> file(new std::ofstream(path, std::ios::binary));
+	if (!*file)
+		throw std::runtime_error((std::string)"AsyncLog::set_trace_file(): Can't open " + path);
+	static const char signature[] = { 'C', 'R', 'L', 'O', 'G', 0, 0, 1 };
+	file->write(signature, sizeof(signature));
+	LOCK_MUTEX(this->mutex);
+	this->new_trace_file = std::move(file);
+}
+
+void AsyncLog::thread_function(){
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true){
+		this->collect();
+		lock.unlock();
+		this->deliver_batch();
+		lock.lock();
+		this->passes++;
+		this->cv.notify_all();
+		if (!this->running)
+			break;
+		this->cv.wait_for(lock, std::chrono::milliseconds(5));
+	}
+}
+
+void AsyncLog::collect(){
+	if (this->new_text_file)
+		this->text_file = std::move(this->new_text_file);
+	if (this->new_trace_file)
+		this->trace_file = std::move(this->new_trace_file);
+	LogRecord record;
+	for (size_t i = 0; i < this->rings.size();){
+		auto &ring = *this->rings[i];
+		//Check before draining, so that nothing the thread pushed before
+		//exiting can be missed.
+		bool orphaned = ring.is_orphaned();
+		while (ring.pop(record))
+			this->collect(record, ring);
+		if (orphaned){
+			this->rings.erase(this->rings.begin() + i);
+			continue;
+		}
+		i++;
+	}
+
+	auto dropped = this->dropped.load(std::memory_order_relaxed);
+	if (dropped != this->reported_dropped){
+		std::stringstream stream;
+		stream << dropped - this->reported_dropped << " log records dropped\n";
+		this->message_batch.push_back({ global_console.load(), (std::uint32_t)-1, this->clock.get(), stream.str() });
+		this->reported_dropped = dropped;
+	}
+}
+
+void AsyncLog::collect(const LogRecord &record, LogRing &ring){
+	if (this->trace_file)
+		this->trace_batch.push_back(record);
+	ring.pending_message.append(record.text, record.length);
+	if (record.continued)
+		return;
+	this->message_batch.push_back({ record.console, record.thread_index, record.timestamp, std::move(ring.pending_message) });
+	ring.pending_message.clear();
+}
+
+void AsyncLog::deliver_batch(){
+	if (this->trace_file){
+		auto &file = *this->trace_file;
+		for (auto &record : this->trace_batch){
+			file.write((const char *)&record.timestamp, sizeof(record.timestamp));
+			file.write((const char *)&record.thread_index, sizeof(record.thread_index));
+			file.write((const char *)&record.length, sizeof(record.length));
+			byte_t continued = record.continued;
+			file.write((const char *)&continued, sizeof(continued));
+			file.write(record.text, record.length);
+		}
+		file.flush();
+	}
+	this->trace_batch.clear();
+	for (auto &message : this->message_batch)
+		this->deliver_message(message);
+	this->message_batch.clear();
+	if (this->text_file)
+		this->text_file->flush();
+}
+
+void AsyncLog::deliver_message(const Message &message){
+	auto &text = message.text;
+	if (message.console)
+		message.console->log_string(text);
+	if (this->text_file){
+		auto &file = *this->text_file;
+		file << '[' << std::fixed << std::setprecision(6) << std::setw(12) << message.timestamp << "] ";
+		if (message.thread_index != (std::uint32_t)-1)
+			file << '#' << message.thread_index << ' ';
+		file << text;
+		if (text.size() && text.back() != '\n')
+			file << '\n';
+	}
+}
+
+Logger::Logger(){
+	this->record.console = thread_console ? thread_console : global_console.load();
+	this->record.length = 0;
+	this->record.continued = false;
+}
+
+Logger::Logger(Logger &&logger): record(logger.record){
+	logger.active = false;
+}
+
+Logger::~Logger(){
+	if (this->active)
+		this->submit(false);
+}
+
+void Logger::submit(bool continued){
+	this->record.continued = continued;
+	AsyncLog::get().submit(this->record);
+	this->record.length = 0;
+}
+
+void Logger::write(const char *string, size_t length){
+	while (length){
+		if (this->record.length == LogRecord::max_text_length)
+			this->submit(true);
+		auto n = std::min(length, LogRecord::max_text_length - this->record.length);
+		memcpy(this->record.text + this->record.length, string, n);
+		this->record.length += (std::uint16_t)n;
+		string += n;
+		length -= n;
+	}
+}
+
+void Logger::write(const char *string){
+	this->write(string, strlen(string));
+}
+
+#define DEFINE_LOGGER_WRITE(type, format) \
+	void Logger::write(type x){ \
+		char buffer[32]; \
+		auto n = snprintf(buffer, sizeof(buffer), format, x); \
+		this->write(buffer, std::min<size_t>(n, sizeof(buffer) - 1)); \
+	}
+
+DEFINE_LOGGER_WRITE(int, "%d")
+DEFINE_LOGGER_WRITE(unsigned, "%u")
+DEFINE_LOGGER_WRITE(long, "%ld")
+DEFINE_LOGGER_WRITE(unsigned long, "%lu")
+DEFINE_LOGGER_WRITE(long long, "%lld")
+DEFINE_LOGGER_WRITE(unsigned long long, "%llu")
+//Same as the default std::ostream formatting.
+DEFINE_LOGGER_WRITE(double, "%g")
@@ -0,0 +1,179 @@
+#pragma once
+#include "HighResolutionClock.h"
+#ifndef HAVE_PCH
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sstream>
+#endif
+
+class Console;
+
+//A preformatted piece of a log message. Fixed size so producers never
+//allocate. Messages longer than max_text_length are split over several
+//consecutive records from the same thread.
+struct LogRecord{
+	static const size_t max_text_length = 232;
+	double timestamp;
+	Console *console;
+	std::uint32_t thread_index;
+	std::uint16_t length;
+	//Set if the message continues in the next record.
+	bool continued;
+	char text[max_text_length];
+};
+
+//Single-producer, single-consumer ring of log records. The producer is the
+//thread the ring belongs to and the consumer is AsyncLog's thread.
+class LogRing{
+public:
+	static const size_t capacity = 1024;
+private:
+	std::unique_ptr<LogRecord[]> records;
+	std::atomic<std::uint64_t> write_position;
+	std::atomic<std::uint64_t> read_position;
+	std::atomic<bool> orphaned;
+	std::uint32_t thread_index;
+public:
+	//Only used by the consumer, to reassemble split messages.
+	std::string pending_message;
+
+	LogRing(std::uint32_t thread_index);
+	LogRing(const LogRing &) = delete;
+	void operator=(const LogRing &) = delete;
+	//Producer side. Returns false if the ring is full. Sets half_full if the
+	//ring is at least half full after the push.
+	bool push(const LogRecord &, bool &half_full);
+	//Consumer side. Returns false if the ring is empty.
+	bool pop(LogRecord &);
+	bool empty() const{
+		return this->read_position.load(std::memory_order_acquire) == this->write_position.load(std::memory_order_acquire);
+	}
+	//Called when the owning thread exits. The consumer frees the ring once it
+	//has drained it.
+	void orphan(){
+		this->orphaned.store(true, std::memory_order_release);
+	}
+	bool is_orphaned() const{
+		return this->orphaned.load(std::memory_order_acquire);
+	}
+	std::uint32_t get_thread_index() const{
+		return this->thread_index;
+	}
+};
+
+//Collects log records from every thread and delivers them from a background
+//thread to the console view and, optionally, to a text file and a binary
+//trace.
+//
+//Trace format: the 8 bytes "CRLOG\0\0\1", followed by one entry per record:
+//f64 timestamp, u32 thread index, u16 length, u8 continued, then the text.
+//All values are in native byte order.
+class AsyncLog{
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread thread;
+	bool running = true;
+	std::uint64_t passes = 0;
+	std::vector<std::unique_ptr<LogRing>> rings;
+	std::atomic<std::uint32_t> next_thread_index;
+	std::atomic<std::uint64_t> dropped;
+	std::uint64_t reported_dropped = 0;
+	HighResolutionClock clock;
+	//Set by set_text_file() and set_trace_file(), and picked up by the
+	//consumer at its next pass.
+	std::unique_ptr<std::ofstream> new_text_file;
+	std::unique_ptr<std::ofstream> new_trace_file;
+
+	//Everything below is only used by the consumer thread. Records are
+	//collected while holding the mutex, and delivered after releasing it, so
+	//that slow I/O never holds up a thread that's registering its ring or
+	//flushing.
+	struct Message{
+		Console *console;
+		std::uint32_t thread_index;
+		double timestamp;
+		std::string text;
+	};
+	std::unique_ptr<std::ofstream> text_file;
+	std::unique_ptr<std::ofstream> trace_file;
+	std::vector<LogRecord> trace_batch;
+	std::vector<Message> message_batch;
+
+	AsyncLog();
+	~AsyncLog();
+	LogRing &get_thread_ring();
+	void thread_function();
+	//Must be called with the mutex held.
+	void collect();
+	void collect(const LogRecord &, LogRing &);
+	void deliver_batch();
+	void deliver_message(const Message &);
+public:
+	static AsyncLog &get();
+	//Never blocks and never allocates, except the first time a given thread
+	//logs. If the thread's ring is full the record is dropped and counted.
+	void submit(LogRecord &);
+	//Blocks until every record submitted before the call has been delivered.
+	void flush();
+	//Flushes and stops using the console for anything that isn't explicitly
+	//logged to it. Called when a console is destroyed.
+	void detach_console(Console *);
+	void set_text_file(const char *path);
+	void set_trace_file(const char *path);
+	std::uint64_t get_dropped_count() const{
+		return this->dropped.load(std::memory_order_relaxed);
+	}
+	double get_time(){
+		return this->clock.get();
+	}
+};
+
+class Logger{
+	bool active = true;
+	LogRecord record;
+
+	void submit(bool continued);
+public:
+	Logger();
+	Logger(Logger &&logger);
+	~Logger();
+	void write(const char *string, size_t length);
+	void write(const char *string);
+	void write(const std::string &string){
+		this->write(string.c_str(), string.size());
+	}
+	void write(char c){
+		this->write(&c, 1);
+	}
+	void write(int);
+	void write(unsigned);
+	void write(long);
+	void write(unsigned long);
+	void write(long long);
+	void write(unsigned long long);
+	void write(double);
+	void write(float x){
+		this->write((double)x);
+	}
+	//Anything else goes through a stream. This allocates, so it should be kept
+	//off the time-critical threads.
+	template <typename T>
+	void write(const T &data){
+		std::stringstream stream;
+		stream << data;
+		this->write(stream.str());
+	}
+};
+
+template <typename T>
+Logger &&operator<<(Logger &&logger, const T &data){
+	logger.write(data);
+	return std::move(logger);
+}
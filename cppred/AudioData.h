@@ -6,6 +6,8 @@
 static const unsigned gb_cpu_frequency_power = 22;
 static const unsigned gb_cpu_frequency = 1 << gb_cpu_frequency_power;
 static const unsigned sampling_frequency = 44100;
+static const int int16_max = (1 << 15) - 1;
+static const int int16_min = -(1 << 15);
 
 template <typename T>
 struct basic_StereoSample{
@@ -73,9 +75,23 @@ typedef basic_StereoSample<intermediate_audio_type> StereoSampleIntermediate;
 
 basic_StereoSample<std::int16_t> convert(const basic_StereoSample<intermediate_audio_type> &);
 
+//How the square and wave channels are reduced to the output sampling rate.
+enum class SynthesisQuality{
+	//Waveforms are sampled once per output sample. Cheapest, but aliases
+	//audibly at high notes.
+	PointSampled,
+	//Each transition is spread linearly over the sample it falls in.
+	Fast,
+	//Each transition is replaced by a windowed-sinc band-limited step. Delays
+	//the output by a few samples.
+	BandLimited,
+};
+
+//Frames are passed from the HeliosRenderers to TwoWayMixer at intermediate
+//precision. Only the mixer reduces them to StereoSampleFinal.
 struct AudioFrame{
 	static const unsigned length = 1024;
 	std::uint64_t frame_no;
 	bool active;
-	StereoSampleFinal buffer[length];
+	StereoSampleIntermediate buffer[length];
 };
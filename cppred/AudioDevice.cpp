@@ -3,29 +3,44 @@
 #include "AudioData.h"
 #include "AudioRenderer.h"
 #include "utility.h"
+#include "AsyncLog.h"
+#ifndef HAVE_PCH
+#include <cassert>
+#endif
 
-bool operator==(const SDL_AudioSpec &a, const SDL_AudioSpec &b){
-	return
-		a.freq == b.freq &&
-		a.format == b.format &&
-		a.channels == b.channels;
+static int get_native_frequency(){
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+	SDL_AudioSpec spec;
+	if (!SDL_GetDefaultAudioInfo(nullptr, &spec, 0) && spec.freq > 0)
+		return spec.freq;
+#endif
+	return sampling_frequency;
 }
 
-AudioDevice::AudioDevice(){
+AudioDevice::AudioDevice(unsigned buffer_length){
 	SDL_AudioSpec desired, actual;
 	memset(&desired, 0, sizeof(desired));
-	desired.freq = sampling_frequency;
+	desired.freq = get_native_frequency();
 	desired.format = AUDIO_S16SYS;
 	desired.channels = 2;
-	desired.samples = AudioFrame::length;
+	assert(buffer_length <= 0xFFFF);
+	desired.samples = (Uint16)(buffer_length ? buffer_length : AudioFrame::length);
 	desired.callback = audio_callback;
 	desired.userdata = this;
-	this->audio_device = SDL_OpenAudioDevice(nullptr, false, &desired, &actual, 0);
-	if (!(actual == desired)){
-		SDL_CloseAudioDevice(this->audio_device);
-		this->audio_device = 0;
+	//The format and the channel count are converted by SDL if they have to,
+	//but that's cheap. The rate is left to the device, since SDL's rate
+	//conversion isn't.
+	int allowed_changes = SDL_AUDIO_ALLOW_FREQUENCY_CHANGE;
+	if (!buffer_length)
+		allowed_changes |= SDL_AUDIO_ALLOW_SAMPLES_CHANGE;
+	this->audio_device = SDL_OpenAudioDevice(nullptr, false, &desired, &actual, allowed_changes);
+	if (!this->audio_device){
+		Logger() << "AudioDevice::AudioDevice(): Can't open the audio device: " << SDL_GetError() << "\n";
 		return;
 	}
+	this->device_frequency = actual.freq;
+	this->period_length = actual.samples;
+	Logger() << "Audio device opened at " << actual.freq << " Hz, " << actual.samples << " samples per period.\n";
 	SDL_PauseAudioDevice(this->audio_device, 0);
 }
 
@@ -42,31 +57,7 @@ void AudioDevice::audio_callback(Uint8 *stream, int len){
 		memset(stream, 0, len);
 		return;
 	}
-	if (this->spillover_buffer_size){
-		const auto s = sizeof(StereoSampleFinal);
-		const auto size2 = (int)(this->spillover_buffer_size * s);
-		if (len >= size2){
-			memcpy(stream, this->spillover_buffer, size2);
-			stream += size2;
-			len -= size2;
-			this->spillover_buffer_size = 0;
-		}else{
-			memcpy(stream, this->spillover_buffer, len);
-
-			const auto m = (len + (s - 1)) / s * s;
-			assert(m <= size2);
-			if (m < size2){
-				memmove(this->spillover_buffer, (byte_t *)this->spillover_buffer + m, size2 - m);
-				this->spillover_buffer_size = (size2 - m) / s;
-			}
-
-			stream += len;
-			len = 0;
-		}
-	}
-
-	if (len)
-		this->renderer->write_data_to_device(stream, len, this->spillover_buffer, this->spillover_buffer_size);
+	this->renderer->write_data_to_device(stream, len);
 }
 
 class AudioLock{
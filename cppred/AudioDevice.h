@@ -12,20 +12,45 @@ public:
 	virtual ~AbstractAudioDevice(){}
 	virtual void set_renderer(AudioRenderer &) = 0;
 	virtual void clear_renderer() = 0;
+	//The rate the device consumes samples at.
+	virtual unsigned get_sampling_frequency() const{
+		return ::sampling_frequency;
+	}
+	//Samples taken per callback, at the device's rate. 0 if unknown.
+	virtual unsigned get_period_length() const{
+		return 0;
+	}
 };
 
+//Used by headless engines. Nothing ever consumes the output.
+class NullAudioDevice : public AbstractAudioDevice{
+public:
+	void set_renderer(AudioRenderer &) override{}
+	void clear_renderer() override{}
+};
+
+//Opened at the native rate of the default device. TwoWayMixer resamples its
+//output if that's not sampling_frequency.
 class AudioDevice : public AbstractAudioDevice{
 	SDL_AudioDeviceID audio_device = 0;
 	AudioRenderer *renderer = nullptr;
-	StereoSampleFinal spillover_buffer[AudioFrame::length];
-	size_t spillover_buffer_size = 0;
+	unsigned device_frequency = ::sampling_frequency;
+	unsigned period_length = 0;
 	void audio_callback(Uint8 *stream, int len);
 	static void SDLCALL audio_callback(void *userdata, Uint8 *stream, int len){
 		((AudioDevice *)userdata)->audio_callback(stream, len);
 	}
 public:
-	AudioDevice();
+	//buffer_length is the number of samples per device period, at most 65535.
+	//If 0, the device's preference is used.
+	AudioDevice(unsigned buffer_length = 0);
 	~AudioDevice();
 	void set_renderer(AudioRenderer &) override;
 	void clear_renderer() override;
+	unsigned get_sampling_frequency() const override{
+		return this->device_frequency;
+	}
+	unsigned get_period_length() const override{
+		return this->period_length;
+	}
 };
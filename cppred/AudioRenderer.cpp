@@ -1,6 +1,24 @@
 #include "stdafx.h"
 #include "AudioRenderer.h"
 #include "AudioDevice.h"
+#include "FrameRecorder.h"
+#ifndef HAVE_PCH
+#include <cmath>
+#include <algorithm>
+#endif
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define TwoWayMixer_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+//Relative levels of music and sound effects, before the volume divisor.
+static const float music_gain = 1.f / 3.f;
+static const float sfx_gain = 1.f / 2.f;
+#ifdef USE_FLOAT_AUDIO
+static const float input_scale = (float)int16_max;
+#else
+static const float input_scale = 1.f;
+#endif
 
 AudioRenderer::AudioRenderer(AbstractAudioDevice &device): device(&device){
 	this->device->set_renderer(*this);
@@ -9,47 +27,31 @@ AudioRenderer::AudioRenderer(AbstractAudioDevice &device): device(&device){
 AudioRenderer::~AudioRenderer(){
 }
 
-void AudioRenderer::write_data_to_device(Uint8 *stream, int len, StereoSampleFinal *spillover_buffer, size_t &spillover_buffer_size){
-	{
-		LOCK_MUTEX(this->mutex);
-		while (len){
-			auto frame = this->get_current_frame_with_object();
-			if (!frame.first)
-				break;
-			if (frame.first->frame_no < this->expected_frame){
-				this->return_used_frame(frame);
-				continue;
-			}
-
-			this->expected_frame = frame.first->frame_no + 1;
-			const auto size2 = (int)sizeof(frame.first->buffer);
-
-			if (len >= size2){
-				memcpy(stream, frame.first->buffer, size2);
-				stream += size2;
-				len -= size2;
-			}else{
-				memcpy(stream, frame.first->buffer, len);
-
-				const auto s = sizeof(StereoSampleFinal);
-				const auto m = (len + (s - 1)) / s * s;
-				assert(m <= size2);
-				if (m < size2){
-					memcpy(spillover_buffer, (byte_t *)frame.first->buffer + m, size2 - m);
-					spillover_buffer_size = (size2 - m) / s;
-				}
-
-				stream += len;
-				len = 0;
-			}
-			this->return_used_frame(frame);
-		}
-	}
-	if (len)
-		memset(stream, 0, len);
+void AudioRenderer::write_data_to_device(Uint8 *stream, int len){
+	memset(stream, 0, len);
 }
 
-TwoWayMixer::TwoWayMixer(AudioDevice &device): AudioRenderer(device){}
+//At least two device periods, so the device never takes more than the ring
+//can have ready.
+static size_t get_output_buffer_length(const AbstractAudioDevice &device){
+	auto ret = (size_t)((std::uint64_t)TwoWayMixer::output_buffer_length * device.get_sampling_frequency() / sampling_frequency);
+	return std::max(ret, (size_t)device.get_period_length() * 2);
+}
+
+TwoWayMixer::TwoWayMixer(AbstractAudioDevice &device):
+		AudioRenderer(device),
+		output_buffer(get_output_buffer_length(device)){
+	auto device_frequency = device.get_sampling_frequency();
+	if (device_frequency != sampling_frequency){
+		this->resampler.reset(new Resampler(sampling_frequency, device_frequency));
+		this->resample_buffer.resize(this->resampler->get_max_output(AudioFrame::length));
+	}
+	this->volume_divisor = 1;
+	this->low_priority_fade = 1;
+	memset(this->silence, 0, sizeof(this->silence));
+	this->low_priority_gain = this->get_low_priority_target_gain(false);
+	this->high_priority_gain = this->get_high_priority_target_gain();
+}
 
 TwoWayMixer::~TwoWayMixer(){
 	this->device->clear_renderer();
@@ -67,40 +69,121 @@ void TwoWayMixer::start(){
 	this->high_priority_renderer->set_NR50(0x77);
 }
 
+float TwoWayMixer::get_low_priority_target_gain(bool high_priority_active) const{
+	//While the high priority renderer is active it takes over the output, as
+	//sound effects did on the hardware.
+	if (high_priority_active)
+		return 0;
+	return music_gain * input_scale * this->low_priority_fade / this->volume_divisor;
+}
+
+float TwoWayMixer::get_high_priority_target_gain() const{
+	return sfx_gain * input_scale;
+}
+
+//dst[i] = saturate(low[i] * low_gain + high[i] * high_gain), where both gains
+//ramp linearly from their *0 value to their *1 value across the n samples.
+static void mix_frames(
+		StereoSampleFinal *dst,
+		const StereoSampleIntermediate *low,
+		const StereoSampleIntermediate *high,
+		size_t n,
+		float low_gain0,
+		float low_gain1,
+		float high_gain0,
+		float high_gain1){
+	auto low_step = (low_gain1 - low_gain0) / n;
+	auto high_step = (high_gain1 - high_gain0) / n;
+	size_t i = 0;
+#ifdef TwoWayMixer_USE_SSE2
+	//Four stereo samples (eight channel values) per iteration. Lanes are laid
+	//out as L0 R0 L1 R1 / L2 R2 L3 R3.
+	auto low_gain_a = _mm_setr_ps(low_gain0, low_gain0, low_gain0 + low_step, low_gain0 + low_step);
+	auto low_gain_b = _mm_add_ps(low_gain_a, _mm_set1_ps(low_step * 2));
+	auto low_gain_step = _mm_set1_ps(low_step * 4);
+	auto high_gain_a = _mm_setr_ps(high_gain0, high_gain0, high_gain0 + high_step, high_gain0 + high_step);
+	auto high_gain_b = _mm_add_ps(high_gain_a, _mm_set1_ps(high_step * 2));
+	auto high_gain_step = _mm_set1_ps(high_step * 4);
+	for (; i + 4 <= n; i += 4){
+#ifdef USE_FLOAT_AUDIO
+		auto low_a = _mm_loadu_ps(&low[i].left);
+		auto low_b = _mm_loadu_ps(&low[i + 2].left);
+		auto high_a = _mm_loadu_ps(&high[i].left);
+		auto high_b = _mm_loadu_ps(&high[i + 2].left);
+#else
+		auto low_a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&low[i]));
+		auto low_b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&low[i + 2]));
+		auto high_a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&high[i]));
+		auto high_b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&high[i + 2]));
+#endif
+		auto a = _mm_add_ps(_mm_mul_ps(low_a, low_gain_a), _mm_mul_ps(high_a, high_gain_a));
+		auto b = _mm_add_ps(_mm_mul_ps(low_b, low_gain_b), _mm_mul_ps(high_b, high_gain_b));
+		//_mm_packs_epi32 saturates to the int16 range.
+		auto packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storeu_si128((__m128i *)&dst[i], packed);
+
+		low_gain_a = _mm_add_ps(low_gain_a, low_gain_step);
+		low_gain_b = _mm_add_ps(low_gain_b, low_gain_step);
+		high_gain_a = _mm_add_ps(high_gain_a, high_gain_step);
+		high_gain_b = _mm_add_ps(high_gain_b, high_gain_step);
+	}
+#endif
+	for (; i < n; i++){
+		auto low_gain = low_gain0 + low_step * i;
+		auto high_gain = high_gain0 + high_step * i;
+		auto left = lrintf(low[i].left * low_gain + high[i].left * high_gain);
+		auto right = lrintf(low[i].right * low_gain + high[i].right * high_gain);
+		dst[i].left = (std::int16_t)std::max<long>(std::min<long>(left, int16_max), int16_min);
+		dst[i].right = (std::int16_t)std::max<long>(std::min<long>(right, int16_max), int16_min);
+	}
+}
+
 void TwoWayMixer::update(double now){
-	this->low_priority_renderer->update(now);
+	if (!this->low_priority_ahead)
+		this->low_priority_renderer->update(now);
 	this->high_priority_renderer->update(now);
-	LOCK_MUTEX(this->mutex);
 	while (true){
-		auto low_frame = this->low_priority_renderer->get_current_frame_with_object();
 		auto high_frame = this->high_priority_renderer->get_current_frame_with_object();
-		assert(!low_frame.first == !high_frame.first);
-		if (!low_frame.first)
+		if (!high_frame.first)
 			break;
-		assert(low_frame.first->frame_no == high_frame.first->frame_no);
-		bool active = high_frame.first->active;
-		if (active){
-			int divisor = this->volume_divisor * 3;
-			for (size_t i = 0; i < AudioFrame::length; i++){
-				low_frame.first->buffer[i] = high_frame.first->buffer[i] / 2;
-			}
-		}else{
-			int divisor = this->volume_divisor * 3;
-			for (size_t i = 0; i < AudioFrame::length; i++){
-				low_frame.first->buffer[i] /= divisor;
-				low_frame.first->buffer[i] += high_frame.first->buffer[i] / 2;
-			}
-		}
+		auto low_frame = this->low_priority_renderer->get_current_frame_with_object();
+		assert(low_frame.first || this->low_priority_ahead);
+		assert(this->low_priority_ahead || low_frame.first->frame_no == high_frame.first->frame_no);
+		auto high_active = this->sfx_voice.render(high_frame.first->buffer, AudioFrame::length);
+		high_active |= high_frame.first->active;
+		auto low_target = this->get_low_priority_target_gain(high_active);
+		auto high_target = this->get_high_priority_target_gain();
+		mix_frames(
+			this->mix_buffer,
+			low_frame.first ? low_frame.first->buffer : this->silence,
+			high_frame.first->buffer,
+			AudioFrame::length,
+			this->low_priority_gain,
+			low_target,
+			this->high_priority_gain,
+			high_target
+		);
+		this->low_priority_gain = low_target;
+		this->high_priority_gain = high_target;
+		if (this->resampler){
+			auto n = this->resampler->process(this->resample_buffer.data(), this->mix_buffer, AudioFrame::length);
+			this->output_buffer.write(this->resample_buffer.data(), n);
+		}else
+			this->output_buffer.write(this->mix_buffer, AudioFrame::length);
+		if (this->recorder)
+			this->recorder->submit_audio(this->mix_buffer, AudioFrame::length);
 		AudioRenderer::return_used_frame(high_frame);
-		if (!this->queue.try_enqueue(low_frame))
+		if (low_frame.first)
 			AudioRenderer::return_used_frame(low_frame);
 	}
 }
 
-AudioRenderer::frame_t TwoWayMixer::get_current_frame_with_object(){
-	frame_t ret(nullptr, nullptr);
-	this->queue.try_dequeue(ret);
-	return ret;
+void TwoWayMixer::write_data_to_device(Uint8 *stream, int len){
+	const auto s = (int)sizeof(StereoSampleFinal);
+	auto samples = len / s;
+	this->output_buffer.read((StereoSampleFinal *)stream, samples);
+	if (len > samples * s)
+		memset(stream + samples * s, 0, len - samples * s);
 }
 
 AudioFrame *TwoWayMixer::get_current_frame(){
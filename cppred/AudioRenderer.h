@@ -1,15 +1,21 @@
 #pragma once
 #include "SoundGenerators.h"
 #include "PublishingResource.h"
+#include "AudioRingBuffer.h"
 #include "AudioData.h"
 #include "AudioDevice.h"
+#include "SfxCache.h"
+#include "Resampler.h"
 #ifndef HAVE_PCH
 #include <fstream>
+#include <atomic>
 #include <SDL_hints.h>
 #endif
 
 //#define OUTPUT_AUDIO_TO_FILE
 
+class FrameRecorder;
+
 struct Panning{
 	bool left = true,
 		right = true,
@@ -17,8 +23,6 @@ struct Panning{
 };
 
 class AudioRenderer{
-	std::mutex mutex;
-	std::uint64_t expected_frame = 0;
 protected:
 	AbstractAudioDevice *device;
 	bool active = false;
@@ -36,7 +40,8 @@ public:
 	static void return_used_frame(const frame_t &frame){
 		frame.second->return_used_frame(frame.first);
 	}
-	void write_data_to_device(Uint8 *stream, int len, StereoSampleFinal *spillover_buffer, size_t &spillover_buffer_size);
+	//Called from the device callback. Must not lock or allocate.
+	virtual void write_data_to_device(Uint8 *stream, int len);
 	virtual void set_active(bool active){
 		this->active = active;
 	}
@@ -87,31 +92,87 @@ public:
 	virtual byte_t get_NR51() const = 0;
 	virtual byte_t get_NR52() const = 0;
 	virtual void copy_voluntary_wave(const void *buffer) = 0;
+	virtual void set_synthesis_quality(SynthesisQuality) = 0;
+	//Frames published and not yet taken by the consumer. Called by the
+	//producer.
+	virtual size_t get_queued_frame_count() const = 0;
+	//Seconds of output left before the frame being rendered is published.
+	//Called by the producer.
+	virtual double get_time_to_next_frame() const = 0;
+	//The frames published so far are dropped instead of being handed to the
+	//consumer, and the frame being rendered starts over from its beginning.
+	virtual void discard_queued_frames() = 0;
 };
 
 class TwoWayMixer : public AudioRenderer, public AbstractAudioDevice{
-	std::mutex mutex;
 	std::unique_ptr<GbAudioRenderer> low_priority_renderer;
 	std::unique_ptr<GbAudioRenderer> high_priority_renderer;
-	moodycamel::ReaderWriterQueue<AudioRenderer::frame_t> queue;
-	int volume_divisor = 1;
+	AudioRingBuffer output_buffer;
+	//Written by the game thread, read by the audio thread.
+	std::atomic<int> volume_divisor;
+	//Set when the low priority renderer is updated by someone else, ahead of
+	//the high priority one. Its frames are then paired with whatever high
+	//priority frames are being mixed, and silence is mixed in while it has
+	//none.
+	bool low_priority_ahead = false;
+	//Multiplies the low priority gain. Used to fade out music that was
+	//rendered ahead.
+	std::atomic<float> low_priority_fade;
+	StereoSampleIntermediate silence[AudioFrame::length];
+	//Gains actually applied at the end of the last mixed frame. Each frame
+	//ramps linearly from these towards the current targets, so volume changes
+	//don't click.
+	float low_priority_gain;
+	float high_priority_gain;
+	StereoSampleFinal mix_buffer[AudioFrame::length];
+	FrameRecorder *recorder = nullptr;
+	//Added to the high priority renderer's output.
+	SfxVoice sfx_voice;
+	//Null if the device runs at sampling_frequency.
+	std::unique_ptr<Resampler> resampler;
+	std::vector<StereoSampleFinal> resample_buffer;
+
+	float get_low_priority_target_gain(bool high_priority_active) const;
+	float get_high_priority_target_gain() const;
 
 	AudioFrame *get_current_frame() override;
 	void return_used_frame(AudioFrame *frame) override;
-	frame_t get_current_frame_with_object() override;
 public:
-	TwoWayMixer(AudioDevice &device);
+	//In samples at sampling_frequency. Scaled to the device's rate, and raised
+	//to two device periods if those are longer.
+	static const size_t output_buffer_length = AudioFrame::length * 8;
+
+	TwoWayMixer(AbstractAudioDevice &device);
 	~TwoWayMixer();
 	void set_renderers(std::unique_ptr<GbAudioRenderer> &&low_priority_renderer, std::unique_ptr<GbAudioRenderer> &&high_priority_renderer);
+	//Must be set before the mixer starts being updated. The mixed output is
+	//also submitted to the recorder.
+	void set_recorder(FrameRecorder *recorder){
+		this->recorder = recorder;
+	}
 	void start() override;
 	void update(double now) override;
+	void write_data_to_device(Uint8 *stream, int len) override;
+	std::uint64_t get_underrun_count() const{
+		return this->output_buffer.get_underrun_count();
+	}
+	std::uint64_t get_overrun_count() const{
+		return this->output_buffer.get_overrun_count();
+	}
 	void set_renderer(AudioRenderer &) override{}
 	void clear_renderer() override{}
 	void add_volume_divisor(int d){
-		this->volume_divisor *= d;
+		this->volume_divisor = this->volume_divisor * d;
 	}
 	void remove_volume_divisor(int d){
-		this->volume_divisor /= d;
+		this->volume_divisor = this->volume_divisor / d;
+	}
+	//Must be set before the mixer starts being updated.
+	void set_low_priority_ahead(bool ahead){
+		this->low_priority_ahead = ahead;
+	}
+	void set_low_priority_fade(float fade){
+		this->low_priority_fade = fade;
 	}
 	GbAudioRenderer &get_low_priority_renderer(){
 		return *this->low_priority_renderer;
@@ -119,4 +180,11 @@ public:
 	GbAudioRenderer &get_high_priority_renderer(){
 		return *this->high_priority_renderer;
 	}
+	SfxVoice &get_sfx_voice(){
+		return this->sfx_voice;
+	}
+	void set_synthesis_quality(SynthesisQuality quality){
+		this->low_priority_renderer->set_synthesis_quality(quality);
+		this->high_priority_renderer->set_synthesis_quality(quality);
+	}
 };
@@ -0,0 +1,69 @@
+#include "stdafx.h"
+#include "AudioRingBuffer.h"
+#ifndef HAVE_PCH
+#include <cstring>
+#include <algorithm>
+#endif
+
+static size_t round_up_to_power_of_two(size_t n){
+	size_t ret = 1;
+	while (ret < n)
+		ret <<= 1;
+	return ret;
+}
+
+AudioRingBuffer::AudioRingBuffer(size_t capacity){
+	this->capacity = round_up_to_power_of_two(capacity);
+	this->mask = this->capacity - 1;
+	this->buffer.reset(new StereoSampleFinal[this->capacity]);
+	memset(this->buffer.get(), 0, this->capacity * sizeof(StereoSampleFinal));
+	this->write_position = 0;
+	this->read_position = 0;
+	this->underruns = 0;
+	this->overruns = 0;
+}
+
+size_t AudioRingBuffer::write(const StereoSampleFinal *samples, size_t count){
+	auto w = this->write_position.load(std::memory_order_relaxed);
+	auto r = this->read_position.load(std::memory_order_acquire);
+	auto space = this->capacity - (size_t)(w - r);
+	if (count > space){
+		this->overruns.fetch_add(1, std::memory_order_relaxed);
+		count = space;
+	}
+
+	auto offset = (size_t)w & this->mask;
+	auto first = std::min(count, this->capacity - offset);
+	memcpy(this->buffer.get() + offset, samples, first * sizeof(StereoSampleFinal));
+	memcpy(this->buffer.get(), samples + first, (count - first) * sizeof(StereoSampleFinal));
+
+	this->write_position.store(w + count, std::memory_order_release);
+	return count;
+}
+
+void AudioRingBuffer::read(StereoSampleFinal *dst, size_t count){
+	auto r = this->read_position.load(std::memory_order_relaxed);
+	auto w = this->write_position.load(std::memory_order_acquire);
+	auto n = std::min(count, (size_t)(w - r));
+
+	auto offset = (size_t)r & this->mask;
+	auto first = std::min(n, this->capacity - offset);
+	memcpy(dst, this->buffer.get() + offset, first * sizeof(StereoSampleFinal));
+	memcpy(dst + first, this->buffer.get(), (n - first) * sizeof(StereoSampleFinal));
+
+	this->read_position.store(r + n, std::memory_order_release);
+
+	if (n < count){
+		memset(dst + n, 0, (count - n) * sizeof(StereoSampleFinal));
+		//Running dry before the producer has written anything is just startup,
+		//not an underrun.
+		if (w)
+			this->underruns.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+size_t AudioRingBuffer::get_available_samples() const{
+	auto r = this->read_position.load(std::memory_order_acquire);
+	auto w = this->write_position.load(std::memory_order_acquire);
+	return (size_t)(w - r);
+}
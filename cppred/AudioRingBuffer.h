@@ -0,0 +1,47 @@
+#pragma once
+#include "AudioData.h"
+#ifndef HAVE_PCH
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#endif
+
+//Single-producer, single-consumer ring of final samples. The producer is the
+//audio scheduler thread (through TwoWayMixer) and the consumer is the device
+//callback. Neither side ever locks or allocates after construction.
+class AudioRingBuffer{
+	std::unique_ptr<StereoSampleFinal[]> buffer;
+	size_t capacity;
+	size_t mask;
+	//Both positions only ever increase. The number of samples currently in the
+	//buffer is write_position - read_position.
+	std::atomic<std::uint64_t> write_position;
+	std::atomic<std::uint64_t> read_position;
+	std::atomic<std::uint64_t> underruns;
+	std::atomic<std::uint64_t> overruns;
+public:
+	//capacity is rounded up to a power of two.
+	AudioRingBuffer(size_t capacity);
+	AudioRingBuffer(const AudioRingBuffer &) = delete;
+	AudioRingBuffer(AudioRingBuffer &&) = delete;
+	void operator=(const AudioRingBuffer &) = delete;
+	void operator=(AudioRingBuffer &&) = delete;
+	//Producer side. Returns the number of samples actually written. If the
+	//buffer doesn't have room for all of them, the excess is dropped and an
+	//overrun is counted.
+	size_t write(const StereoSampleFinal *samples, size_t count);
+	//Consumer side. Always fills the entire destination. If not enough samples
+	//are available, the remainder is filled with silence and an underrun is
+	//counted.
+	void read(StereoSampleFinal *dst, size_t count);
+	size_t get_capacity() const{
+		return this->capacity;
+	}
+	size_t get_available_samples() const;
+	std::uint64_t get_underrun_count() const{
+		return this->underruns.load(std::memory_order_relaxed);
+	}
+	std::uint64_t get_overrun_count() const{
+		return this->overruns.load(std::memory_order_relaxed);
+	}
+};
@@ -8,10 +8,14 @@
 AudioScheduler::AudioScheduler(
 			Engine &engine,
 			std::unique_ptr<AudioRenderer> &&renderer,
-			std::unique_ptr<CppRed::AudioProgramInterface> &&program_interface
-		): engine(&engine), renderer(std::move(renderer)), program_interface(std::move(program_interface)){
+			std::unique_ptr<CppRed::AudioProgramInterface> &&program_interface,
+			bool threaded
+		): engine(&engine), renderer(std::move(renderer)), program_interface(std::move(program_interface)), threaded(threaded){
 	this->continue_running = false;
-	this->timer_id = SDL_AddTimer(1, timer_callback, this);
+	if (this->threaded){
+		this->timer_id = SDL_AddTimer(1, timer_callback, this);
+		this->program_interface->set_request_event(&this->request_event);
+	}
 }
 
 AudioScheduler::~AudioScheduler(){
@@ -21,6 +25,10 @@ AudioScheduler::~AudioScheduler(){
 }
 
 void AudioScheduler::start(){
+	if (!this->threaded){
+		this->renderer->start();
+		return;
+	}
 	if (this->thread.joinable())
 		return;
 	this->continue_running = true;
@@ -43,18 +51,26 @@ void AudioScheduler::processor(){
 #ifdef CPU_USAGE
 			auto t0 = clock.get();
 #endif
-			auto now = clock.get();
-			this->program_interface->update(now);
-			this->renderer->update(now);
+			this->update(clock.get());
 #ifdef CPU_USAGE
 			auto t1 = clock.get();
 			time_processing += t1 - t0;
 			if (t1 >= last + 1){
-				Logger() << "AudioScheduler::processor() CPU usage: " << time_processing / (t1 - last) * 100 << " %\n";
+				//Audio is emulated in real time, so this is also the cost of an
+				//emulated second.
+				auto usage = time_processing / (t1 - last);
+				Logger() << "AudioScheduler::processor() CPU usage: " << usage * 100 << " % (" << usage * 1000 << " ms per emulated second)\n";
 				last = t1;
 				time_processing = 0;
 			}
 #endif
+			//While nothing needs to be stepped every millisecond, sleep until the
+			//mixer is due for another frame or a sound is requested.
+			auto idle_ms = (unsigned)(this->program_interface->get_idle_time() * 1000);
+			if (idle_ms > 1){
+				this->request_event.wait_for(idle_ms);
+				continue;
+			}
 			//Delay for ~1 ms. Experimentation shows that, at least on Windows, the
 			//actual wait can last up to a few ms.
 			this->timer_event.wait();
@@ -64,6 +80,11 @@ void AudioScheduler::processor(){
 	}
 }
 
+void AudioScheduler::update(double now){
+	this->program_interface->update(now);
+	this->renderer->update(now);
+}
+
 void AudioScheduler::stop(){
 	if (this->thread.joinable()){
 		this->continue_running = false;
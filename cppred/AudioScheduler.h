@@ -20,20 +20,27 @@ class AudioScheduler{
 	Engine *engine;
 	std::unique_ptr<AudioRenderer> renderer;
 	std::unique_ptr<CppRed::AudioProgramInterface> program_interface;
+	bool threaded;
 	std::thread thread;
 	std::atomic<bool> continue_running;
 	SDL_TimerID timer_id = 0;
 	Event timer_event;
+	//Signalled by the program interface when a sound is requested.
+	Event request_event;
 
 	static Uint32 SDLCALL timer_callback(Uint32 interval, void *param);
 	void processor();
 	void stop();
 public:
+	//If threaded is false, the scheduler runs no thread and no timer, and the
+	//owner must call update() itself.
 	AudioScheduler(
 		Engine &engine,
 		std::unique_ptr<AudioRenderer> &&renderer,
-		std::unique_ptr<CppRed::AudioProgramInterface> &&program_interface
+		std::unique_ptr<CppRed::AudioProgramInterface> &&program_interface,
+		bool threaded = true
 	);
 	~AudioScheduler();
 	void start();
+	void update(double now);
 };
@@ -7,28 +7,45 @@
 #include "font.inl"
 #include "Coroutine.h"
 #include "HighResolutionClock.h"
+#include "AudioData.h"
 #ifndef HAVE_PCH
 #include <sstream>
 #include <iomanip>
 #include <cassert>
 #include <algorithm>
+#include <cstdlib>
 #endif
 
 #ifdef RGB
 #undef RGB
 #endif
 
-Console *global_console = nullptr;
+std::atomic<Console *> global_console(nullptr);
+thread_local Console *thread_console = nullptr;
 
 static int console_text_scale = 2;
 static int log_text_scale = 1;
 
+static Point get_screen_size(Engine &engine){
+	auto &renderer = engine.get_renderer();
+	if (renderer.is_headless())
+		return Point{ Renderer::logical_screen_width, Renderer::logical_screen_height } * Engine::screen_scale;
+	return renderer.get_device().get_screen_size();
+}
+
 Console::Console(Engine &engine):
 		engine(&engine),
-		device(&engine.get_renderer().get_device()),
-		console(this->device->get_screen_size() * (1.0 / 8.0 / console_text_scale), console_text_scale),
-		log(this->device->get_screen_size() * (1.0 / 8.0 / log_text_scale) + Point(0, 1), log_text_scale),
+		device(engine.get_renderer().is_headless() ? nullptr : &engine.get_renderer().get_device()),
+		console(get_screen_size(engine) * (1.0 / 8.0 / console_text_scale), console_text_scale),
+		log(get_screen_size(engine) * (1.0 / 8.0 / log_text_scale) + Point(0, 1), log_text_scale),
 		visible(false){
+	this->coroutine.reset(new Coroutine("Console coroutine", engine.get_ui_clock(), [this](Coroutine &){
+		this->coroutine_entry_point();
+	}));
+	//Headless consoles only keep the log.
+	if (!this->device)
+		return;
+
 	auto &dev = *this->device;
 	auto size = dev.get_screen_size();
 	this->background = dev.allocate_texture(size);
@@ -38,12 +55,58 @@ Console::Console(Engine &engine):
 	this->initialize_background(0x80);
 	this->initialize_text_layer(this->text_layer);
 	this->initialize_text_layer(this->log_layer);
-	this->coroutine.reset(new Coroutine("Console coroutine", engine.get_stepping_clock(), [this](Coroutine &){
-		this->coroutine_entry_point();
-	}));
 }
 
-CharacterMatrix::CharacterMatrix(const Point &size, int scale){
+Console::~Console(){
+	AsyncLog::get().detach_console(this);
+}
+
+namespace{
+
+//Computes which pixels of a cell must be outlined. wide holds rows -1 to 8 of
+//the cell, each covering columns -1 to 8, with column -1 in bit 9.
+void compute_outline(byte_t (&dst)[8], const unsigned (&wide)[10]){
+	for (int y = 0; y < 8; y++){
+		auto m = wide[y] | wide[y + 1] | wide[y + 2];
+		m |= (m << 1) | (m >> 1);
+		dst[y] = (byte_t)((m & ~wide[y + 1]) >> 1);
+	}
+}
+
+const RGB text_white = {255, 255, 255, 255};
+const RGB text_black = {0, 0, 0, 255};
+const RGB text_off = {0, 0, 0, 0};
+
+}
+
+const byte_t *GlyphAtlas::get_rows(byte_t character){
+	static const byte_t blank[8] = {};
+	return character ? GFX_font + character * 8 : blank;
+}
+
+GlyphAtlas::GlyphAtlas(int text_scale):
+		cell_size(8 * text_scale),
+		pixels(256 * cell_size * cell_size){
+	for (int c = 0; c < 256; c++){
+		auto rows = get_rows((byte_t)c);
+		unsigned wide[10] = {};
+		for (int y = 0; y < 8; y++)
+			wide[y + 1] = rows[y] << 1;
+		byte_t outline[8];
+		compute_outline(outline, wide);
+		auto dst = &this->pixels[c * this->cell_size * this->cell_size];
+		for (int y = 0; y < this->cell_size; y++){
+			auto row = rows[y / text_scale];
+			auto outline_row = outline[y / text_scale];
+			for (int x = 0; x < this->cell_size; x++){
+				byte_t mask = 0x80 >> (x / text_scale);
+				*(dst++) = row & mask ? text_white : (outline_row & mask ? text_black : text_off);
+			}
+		}
+	}
+}
+
+CharacterMatrix::CharacterMatrix(const Point &size, int scale): atlas(scale){
 	this->text_scale = scale;
 	this->matrix_size = size;
 	this->character_matrix.resize(this->matrix_size.x * this->matrix_size.y);
@@ -148,7 +211,7 @@ bool Console::handle_event(const SDL_Event &event){
 }
 
 void Console::render(){
-	if (!this->visible && !this->log_enabled)
+	if (!this->device || (!this->visible && !this->log_enabled))
 		return;
 
 	this->device->render_copy(this->background);
@@ -172,44 +235,173 @@ bool CharacterMatrix::needs_redraw(){
 	return true;
 }
 
-void CharacterMatrix::draw(RGB *pixels, int w, int h){
-	const RGB white = {255, 255, 255, 255},
-		black = {0, 0, 0, 255},
-		off = {0, 0, 0, 0};
-	auto matrix = &this->character_matrix[0];
-	for (int y = 0; y < h; y++){
-		for (int x = 0; x < w; x++){
-			auto x0 = x / (8 * text_scale);
-			auto y0 = y / (8 * text_scale);
-			x0 = euclidean_modulo(x0 - this->shift.x, this->matrix_size.x);
-			y0 = euclidean_modulo(y0 - this->shift.y, this->matrix_size.y);
-			auto c = matrix[x0 + y0 * this->matrix_size.x];
-			if (!c){
-				pixels[x + y * w] = off;
-				continue;
+byte_t CharacterMatrix::get_visible_character(int x, int y) const{
+	if (x < 0 || y < 0 || x >= this->cell_count.x || y >= this->cell_count.y)
+		return 0;
+	return this->visible_cells[x + y * this->cell_count.x];
+}
+
+void CharacterMatrix::resize_surface(int w, int h){
+	auto cell_size = this->atlas.get_cell_size();
+	this->surface_size = { w, h };
+	this->surface.assign(w * h, text_off);
+	this->cell_count = { (w + cell_size - 1) / cell_size, (h + cell_size - 1) / cell_size };
+	this->drawn_cells.assign(this->cell_count.multiply_components(), -1);
+	this->cells_scratch.assign(this->drawn_cells.size(), 0);
+	this->visible_cells.resize(this->drawn_cells.size());
+}
+
+void CharacterMatrix::scroll_surface(const Point &cells){
+	auto cell_size = this->atlas.get_cell_size();
+	auto w = this->surface_size.x;
+	auto h = this->surface_size.y;
+	auto dx = cells.x * cell_size;
+	auto dy = cells.y * cell_size;
+	if (abs(dx) >= w || abs(dy) >= h){
+		fill(this->drawn_cells, -1);
+		return;
+	}
+
+	auto src_x = std::max(-dx, 0);
+	auto dst_x = std::max(dx, 0);
+	auto length = (w - abs(dx)) * sizeof(RGB);
+	auto pixels = &this->surface[0];
+	if (dy >= 0){
+		for (int y = h - 1; y >= dy; y--)
+			memmove(pixels + dst_x + y * w, pixels + src_x + (y - dy) * w, length);
+	}else{
+		for (int y = 0; y < h + dy; y++)
+			memmove(pixels + dst_x + y * w, pixels + src_x + (y - dy) * w, length);
+	}
+
+	//Cells that come from outside the surface or from a partially visible
+	//cell have to be redrawn, and so do the ones that end up along the edges,
+	//which may have lost a neighbor that was outlining them.
+	auto &count = this->cell_count;
+	int full_x = w / cell_size;
+	int full_y = h / cell_size;
+	for (int y = 0; y < count.y; y++){
+		for (int x = 0; x < count.x; x++){
+			int x0 = x - cells.x;
+			int y0 = y - cells.y;
+			bool valid = x0 >= 0 && y0 >= 0 && x0 < full_x && y0 < full_y;
+			valid = valid && x > 0 && y > 0 && x < count.x - 1 && y < count.y - 1;
+			this->cells_scratch[x + y * count.x] = valid ? this->drawn_cells[x0 + y0 * count.x] : -1;
+		}
+	}
+	std::swap(this->drawn_cells, this->cells_scratch);
+}
+
+byte_t CharacterMatrix::get_visible_row(int x, int y, int row) const{
+	auto ret = GlyphAtlas::get_rows(this->get_visible_character(x, y))[row];
+	//Pixels past the edges of the surface don't get outlined.
+	auto s = this->text_scale;
+	if ((y * 8 + row) * s >= this->surface_size.y)
+		return 0;
+	auto columns = (this->surface_size.x - x * 8 * s + s - 1) / s;
+	if (columns < 8)
+		ret &= (byte_t)(0xFF << (8 - columns));
+	return ret;
+}
+
+void CharacterMatrix::draw_cell(int x, int y){
+	unsigned wide[10];
+	for (int i = 0; i < 10; i++){
+		int cell_y = y + (i == 0 ? -1 : (i == 9 ? 1 : 0));
+		int row = (i + 7) % 8;
+		auto left = this->get_visible_row(x - 1, cell_y, row);
+		auto middle = this->get_visible_row(x, cell_y, row);
+		auto right = this->get_visible_row(x + 1, cell_y, row);
+		wide[i] = ((left & 1) << 9) | (middle << 1) | (right >> 7);
+	}
+	auto character = this->get_visible_character(x, y);
+	auto rows = GlyphAtlas::get_rows(character);
+	byte_t outline[8];
+	compute_outline(outline, wide);
+
+	auto cell_size = this->atlas.get_cell_size();
+	auto w = this->surface_size.x;
+	auto x0 = x * cell_size;
+	auto y0 = y * cell_size;
+	auto cell_w = std::min(cell_size, w - x0);
+	auto cell_h = std::min(cell_size, this->surface_size.y - y0);
+	auto dst = &this->surface[x0 + y0 * w];
+	if (cell_w < cell_size || cell_h < cell_size){
+		//The atlas glyph might be outlined by pixels that aren't visible.
+		for (int i = 0; i < cell_h; i++){
+			auto row = i / this->text_scale;
+			for (int j = 0; j < cell_w; j++){
+				byte_t mask = 0x80 >> (j / this->text_scale);
+				dst[i * w + j] = rows[row] & mask ? text_white : (outline[row] & mask ? text_black : text_off);
 			}
-			int first_font_index = c * 8;
-			pixels[x + y * w] = !!(GFX_font[first_font_index + (y / text_scale) % 8] & (0x80 >> ((x / text_scale) % 8))) ? white : off;
 		}
+		return;
 	}
-	for (int y = 0; y < h; y++){
-		int y0 = std::max(y - text_scale, 0);
-		int y1 = std::min(y + text_scale * 2, h);
-		for (int x = 0; x < w; x++){
-			if (!!pixels[x + y * w].a)
-				continue;
-			int x0 = std::max(x - text_scale, 0);
-			int x1 = std::min(x + text_scale * 2, w);
-			bool any = false;
-			for (int y2 = y0; !any && y2 < y1; y2 += text_scale)
-				for (int x2 = x0; !any && x2 < x1; x2 += text_scale)
-					any = !!(((x2 != x) | (y2 != y)) & !!pixels[x2 + y2 * w].r);
-
-			if (any)
-				pixels[x + y * w] = black;
+
+	auto glyph = this->atlas.get_glyph(character);
+	for (int i = 0; i < cell_size; i++)
+		memcpy(dst + i * w, glyph + i * cell_size, cell_size * sizeof(RGB));
+
+	//The atlas only has the glyph's own outline. Add whatever spills over
+	//from the neighbors.
+	for (int i = 0; i < cell_size; i++){
+		auto row = i / this->text_scale;
+		byte_t black = outline[row] & (byte_t)~rows[row];
+		if (!black)
+			continue;
+		for (int j = 0; j < cell_size; j++)
+			if (black & (0x80 >> (j / this->text_scale)) && !dst[i * w + j].a)
+				dst[i * w + j] = text_black;
+	}
+}
+
+static int shortest_delta(int delta, int period){
+	delta = euclidean_modulo(delta, period);
+	return delta > period / 2 ? delta - period : delta;
+}
+
+void CharacterMatrix::draw(RGB *pixels, int w, int h){
+	if (this->surface_size != Point(w, h))
+		this->resize_surface(w, h);
+	else if (this->shift != this->drawn_shift){
+		//Scroll what's already been drawn instead of redrawing it.
+		auto delta = this->shift - this->drawn_shift;
+		delta.x = shortest_delta(delta.x, this->matrix_size.x);
+		delta.y = shortest_delta(delta.y, this->matrix_size.y);
+		this->scroll_surface(delta);
+	}
+	this->drawn_shift = this->shift;
+
+	auto &count = this->cell_count;
+	for (int y = 0; y < count.y; y++){
+		auto row = &this->character_matrix[euclidean_modulo(y - this->shift.y, this->matrix_size.y) * this->matrix_size.x];
+		auto x0 = euclidean_modulo(-this->shift.x, this->matrix_size.x);
+		for (int x = 0; x < count.x; x++){
+			this->visible_cells[x + y * count.x] = row[x0];
+			if (++x0 == this->matrix_size.x)
+				x0 = 0;
 		}
 	}
 
+	//Outlines spill into neighboring cells, so a cell must be redrawn if
+	//anything in the 3x3 block around it changed.
+	auto &changed = this->cells_scratch;
+	for (size_t i = 0; i < changed.size(); i++)
+		changed[i] = this->drawn_cells[i] != this->visible_cells[i];
+	for (int y = 0; y < count.y; y++){
+		for (int x = 0; x < count.x; x++){
+			bool dirty = false;
+			for (int y2 = std::max(y - 1, 0); !dirty && y2 < std::min(y + 2, count.y); y2++)
+				for (int x2 = std::max(x - 1, 0); !dirty && x2 < std::min(x + 2, count.x); x2++)
+					dirty = !!changed[x2 + y2 * count.x];
+			if (dirty)
+				this->draw_cell(x, y);
+		}
+	}
+	std::copy(this->visible_cells.begin(), this->visible_cells.end(), this->drawn_cells.begin());
+
+	memcpy(pixels, &this->surface[0], w * h * sizeof(RGB));
+
 	memcpy(&this->last_character_matrix[0], &this->character_matrix[0], this->character_matrix.size());
 	this->last_shift = shift;
 	this->matrix_modified = false;
@@ -364,6 +556,19 @@ static const char *to_string(PokemonVersion version){
 	}
 }
 
+static const char *to_string(SynthesisQuality quality){
+	switch (quality){
+		case SynthesisQuality::PointSampled:
+			return "Point sampled";
+		case SynthesisQuality::Fast:
+			return "Fast";
+		case SynthesisQuality::BandLimited:
+			return "Band-limited";
+		default:
+			return "?";
+	}
+}
+
 void Console::coroutine_entry_point(){
 	int item = 0;
 	while (true){
@@ -373,6 +578,10 @@ void Console::coroutine_entry_point(){
 		main_menu.push_back((std::string)"Enable console: " + (this->log_enabled ? "ON" : "OFF"));
 		main_menu.push_back("Sound test");
 		main_menu.push_back("Pok\x82mon cries");
+		main_menu.push_back((std::string)"Audio quality: " + to_string(this->get_synthesis_quality()));
+		main_menu.push_back("Capture renderer scene");
+		main_menu.push_back((std::string)"Input latency probe: " + (this->get_latency_probe() ? "ON" : "OFF"));
+		main_menu.push_back((std::string)"Cached sound effects: " + (this->get_sfx_cache() ? "ON" : "OFF"));
 
 		bool run = true;
 		while (run){
@@ -397,6 +606,21 @@ void Console::coroutine_entry_point(){
 				case 4:
 					this->cry_test();
 					break;
+				case 5:
+					this->cycle_synthesis_quality();
+					run = false;
+					break;
+				case 6:
+					this->capture_renderer_scene();
+					break;
+				case 7:
+					this->toggle_latency_probe();
+					run = false;
+					break;
+				case 8:
+					this->toggle_sfx_cache();
+					run = false;
+					break;
 			}
 		}
 	}
@@ -471,6 +695,51 @@ PokemonVersion Console::get_version(){
 	return ccc.version;
 }
 
+void Console::cycle_synthesis_quality(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::CycleSynthesisQuality;
+	this->yield(ccc);
+}
+
+SynthesisQuality Console::get_synthesis_quality(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::GetSynthesisQuality;
+	this->yield(ccc);
+	return ccc.synthesis_quality;
+}
+
+void Console::capture_renderer_scene(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::CaptureRendererScene;
+	this->yield(ccc);
+}
+
+void Console::toggle_latency_probe(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::ToggleLatencyProbe;
+	this->yield(ccc);
+}
+
+bool Console::get_latency_probe(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::GetLatencyProbe;
+	this->yield(ccc);
+	return ccc.latency_probe_enabled;
+}
+
+void Console::toggle_sfx_cache(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::ToggleSfxCache;
+	this->yield(ccc);
+}
+
+bool Console::get_sfx_cache(){
+	ConsoleCommunicationChannel ccc;
+	ccc.request_id = ConsoleRequestId::GetSfxCache;
+	this->yield(ccc);
+	return ccc.sfx_cache_enabled;
+}
+
 void Console::log_string(const std::string &s){
 	LOCK_MUTEX(this->log_mutex);
 	this->log.write_string2(s.c_str());
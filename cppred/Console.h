@@ -3,16 +3,18 @@
 #include "CppRed/AudioInterface.h"
 #include "VideoDevice.h"
 #include "pokemon_version.h"
+#include "AsyncLog.h"
 #ifndef HAVE_PCH
 #include <SDL.h>
 #include <memory>
 #include <vector>
-#include <sstream>
 #include <mutex>
+#include <atomic>
 #endif
 
 class Engine;
 class Coroutine;
+enum class SynthesisQuality;
 
 enum class ConsoleRequestId{
 	None,
@@ -20,12 +22,37 @@ enum class ConsoleRequestId{
 	Restart,
 	FlipVersion,
 	GetVersion,
+	CycleSynthesisQuality,
+	GetSynthesisQuality,
+	CaptureRendererScene,
+	ToggleLatencyProbe,
+	GetLatencyProbe,
+	ToggleSfxCache,
+	GetSfxCache,
 };
 
 struct ConsoleCommunicationChannel{
 	ConsoleRequestId request_id = ConsoleRequestId::None;
 	CppRed::AudioProgramInterface *audio_program = nullptr;
 	PokemonVersion version;
+	SynthesisQuality synthesis_quality;
+	bool latency_probe_enabled = false;
+	bool sfx_cache_enabled = false;
+};
+
+//Every glyph of GFX_font rendered at a given scale, outlined as if it had no
+//neighbors.
+class GlyphAtlas{
+	int cell_size;
+	std::vector<RGB> pixels;
+public:
+	GlyphAtlas(int text_scale);
+	const RGB *get_glyph(byte_t character) const{
+		return &this->pixels[character * this->cell_size * this->cell_size];
+	}
+	DEFINE_GETTER(cell_size)
+	//Glyph rows, MSB leftmost. Character 0 is always blank.
+	static const byte_t *get_rows(byte_t character);
 };
 
 class CharacterMatrix{
@@ -36,6 +63,25 @@ class CharacterMatrix{
 	Point matrix_size;
 	bool matrix_modified = false;
 	int text_scale;
+	GlyphAtlas atlas;
+	//The rendered text is kept here and only changed cells are redrawn,
+	//because the texture can't be read back.
+	std::vector<RGB> surface;
+	Point surface_size;
+	//Characters as they're currently shown on each cell of the surface. -1
+	//means the cell must be redrawn.
+	std::vector<int> drawn_cells;
+	std::vector<int> cells_scratch;
+	//What each cell should show now, given the shift.
+	std::vector<byte_t> visible_cells;
+	Point drawn_shift;
+	Point cell_count;
+
+	void resize_surface(int w, int h);
+	void scroll_surface(const Point &cells);
+	byte_t get_visible_character(int x, int y) const;
+	byte_t get_visible_row(int x, int y, int row) const;
+	void draw_cell(int x, int y);
 public:
 	CharacterMatrix(const Point &size, int scale);
 	bool needs_redraw();
@@ -83,43 +129,32 @@ class Console{
 	void cry_test();
 	void restart_game();
 	void flip_version();
+	void cycle_synthesis_quality();
+	SynthesisQuality get_synthesis_quality();
+	void capture_renderer_scene();
+	void toggle_latency_probe();
+	bool get_latency_probe();
+	void toggle_sfx_cache();
+	bool get_sfx_cache();
 	PokemonVersion get_version();
 	static void draw(Texture &dst, CharacterMatrix &src);
 	void draw_console_menu();
 	void draw_console_log();
 public:
 	Console(Engine &engine);
+	~Console();
 	void toggle_visible(){
 		this->visible = !this->visible;
 	}
+	DEFINE_GETTER(visible)
 	bool handle_event(const SDL_Event &);
 	ConsoleCommunicationChannel *update();
 	void render();
+	//Called from AsyncLog's thread. Use Logger instead.
 	void log_string(const std::string &);
 };
 
-extern Console *global_console;
-
-class Logger{
-	bool active = true;
-	std::stringstream stream;
-public:
-	Logger() = default;
-	Logger(Logger &&logger): stream(std::move(stream)){
-		logger.active = false;
-	}
-	~Logger(){
-		if (global_console && this->active)
-			global_console->log_string(this->stream.str());
-	}
-	template <typename T>
-	void write(const T &data){
-		this->stream << data;
-	}
-};
-
-template <typename T>
-Logger &&operator<<(Logger &&logger, const T &data){
-	logger.write(data);
-	return std::move(logger);
-}
+extern std::atomic<Console *> global_console;
+//Overrides global_console on the calling thread. Used by headless engines,
+//which may be stepped on any thread.
+extern thread_local Console *thread_console;
@@ -24,12 +24,14 @@ class Coroutine::Pimpl{
 	bool first_run;
 	double wait_remainder = 0;
 	
+	static Pimpl *&get_coroutine_stack();
 	void push(){
-		this->next_coroutine = coroutine_stack;
-		coroutine_stack = this;
+		auto &stack = get_coroutine_stack();
+		this->next_coroutine = stack;
+		stack = this;
 	}
 	void pop(){
-		coroutine_stack = this->next_coroutine;
+		get_coroutine_stack() = this->next_coroutine;
 	}
 	void init(){
 		this->first_run = true;
@@ -72,7 +74,7 @@ public:
 		return ret;
 	}
 	void yield(){
-		if (coroutine_stack != this)
+		if (get_coroutine_stack() != this)
 			throw std::runtime_error("Coroutine::yield() was used incorrectly!");
 		if (std::this_thread::get_id() != this->resume_thread_id)
 			throw std::runtime_error("Coroutine::yield() must be called from the thread that resumed the coroutine!");
@@ -106,7 +108,7 @@ public:
 		this->on_yield = on_yield_t();
 	}
 	static Coroutine *get_current_coroutine_ptr(){
-		return coroutine_stack->owner;
+		return get_coroutine_stack()->owner;
 	}
 	static Coroutine &get_current_coroutine(){
 		auto p = get_current_coroutine_ptr();
@@ -123,6 +125,19 @@ public:
 
 thread_local Coroutine::Pimpl *Coroutine::Pimpl::coroutine_stack = nullptr;
 
+//A coroutine may be resumed by a different thread each time (see
+//HeadlessHost). If this was inlined into a coroutine body, the compiler would
+//be free to compute the address of the thread-local once and keep using the
+//first thread's stack after a context switch.
+#if defined _MSC_VER
+__declspec(noinline)
+#elif defined __GNUC__
+__attribute__((noinline))
+#endif
+Coroutine::Pimpl *&Coroutine::Pimpl::get_coroutine_stack(){
+	return coroutine_stack;
+}
+
 Coroutine::Coroutine(const std::string &name, entry_point_t &&entry_point){
 	this->pimpl.reset(new Pimpl(*this, name, std::move(entry_point)));
 }
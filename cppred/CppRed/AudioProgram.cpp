@@ -7,8 +7,10 @@
 #include "../CodeGeneration/output/audio.h"
 #include "../Coroutine.h"
 #include "Console.h"
+#include "../SfxCache.h"
 #ifndef HAVE_PCH
 #include <sstream>
+#include <algorithm>
 #endif
 
 const byte_t command_parameter_counts[] = {
@@ -195,13 +197,22 @@ static const instrument_data_t * const * const instruments_by_bank[] = {
 	instruments_bank_3,
 };
 
-AudioProgram::AudioProgram(GbAudioRenderer &renderer, PokemonVersion version, bool mode): for_music(mode), renderer(&renderer), version(version){
+AudioProgramData::AudioProgramData(){
 	this->load_commands();
 	this->load_resources();
+}
+
+AudioProgram::AudioProgram(GbAudioRenderer &renderer, PokemonVersion version, bool mode, const std::shared_ptr<const AudioProgramData> &data):
+		data(data),
+		commands(data->commands),
+		resources(data->resources),
+		renderer(&renderer),
+		for_music(mode),
+		version(version){
 	this->play_sound_internal(AudioResourceId::Stop);
 }
 
-void AudioProgram::load_commands(){
+void AudioProgramData::load_commands(){
 	static_assert(array_length(command_parameter_counts) == (size_t)AudioCommandType::End + 1, "Error: command_parameter_counts must have as many elements as there are command types!");
 	auto buffer = audio_sequence_data;
 	size_t offset = 0;
@@ -210,7 +221,7 @@ void AudioProgram::load_commands(){
 	for (auto &command : this->commands){
 		auto type = read_varint(buffer, offset, size);
 		if (type > (std::uint32_t)AudioCommandType::End)
-			throw std::runtime_error("AudioProgram::load_commands(): Invalid data.");
+			throw std::runtime_error("AudioProgramData::load_commands(): Invalid data.");
 		command.type = (AudioCommandType)type;
 		std::fill(command.params, command.params + array_length(command.params), std::numeric_limits<std::uint32_t>::max());
 		for (int i = 0; i < (int)command_parameter_counts[type]; i++)
@@ -219,7 +230,7 @@ void AudioProgram::load_commands(){
 	assert(offset == size);
 }
 
-void AudioProgram::load_resources(){
+void AudioProgramData::load_resources(){
 	auto buffer = audio_header_data;
 	size_t offset = 0;
 	const size_t size = audio_header_data_size;
@@ -1211,15 +1222,28 @@ bool AudioProgram::channel_is_busy(int index){
 }
 
 
-AudioProgramInterface::AudioProgramInterface(GbAudioRenderer &music_renderer, GbAudioRenderer &sfx_renderer, PokemonVersion version):
-		music(music_renderer, version, true),
-		sfx(sfx_renderer, version, false){
+AudioProgramInterface::AudioProgramInterface(GbAudioRenderer &music_renderer, GbAudioRenderer &sfx_renderer, PokemonVersion version, const std::shared_ptr<const AudioProgramData> &data):
+		music(music_renderer, version, true, data),
+		sfx(sfx_renderer, version, false, data){
 }
 
 void AudioProgramInterface::play_sound(AudioResourceId id, bool obtain_lock){
+	this->start_sound(id, obtain_lock);
+	//Only now, so that the scheduler sees the sound once it wakes up.
+	if (this->request_event)
+		this->request_event->signal();
+}
+
+void AudioProgramInterface::start_sound(AudioResourceId id, bool obtain_lock){
 	if (id == AudioResourceId::Stop){
-		this->music.play_sound(id);
+		//Stop touches both programs, so it needs both locks.
+		double_lock lock;
+		if (obtain_lock)
+			lock = this->acquire_lock();
+		this->play_music(id);
 		this->sfx.play_sound(id);
+		if (this->sfx_voice)
+			this->sfx_voice->stop();
 		return;
 	}
 	auto &resource = this->music.resources[(int)id];
@@ -1227,21 +1251,182 @@ void AudioProgramInterface::play_sound(AudioResourceId id, bool obtain_lock){
 	std::unique_lock<std::mutex> lock;
 	if (obtain_lock)
 		lock = program.acquire_lock();
-	program.play_sound(id);
+	if (&program == &this->sfx && this->play_cached_sfx(id, resource.type))
+		return;
+	if (&program == &this->music)
+		this->play_music(id);
+	else
+		program.play_sound(id);
+}
+
+//Must be called with the music lock held.
+void AudioProgramInterface::play_music(AudioResourceId id){
+	bool changed = this->music.get_sound_id() != id;
+	this->music.play_sound(id);
+	if (!this->music_lookahead || !changed)
+		return;
+	//The program starts the new track where it's at, so what it rendered of
+	//the old one has to go. Like the program, the new track also cancels any
+	//fade.
+	this->music.renderer->discard_queued_frames();
+	this->music_fade.active = false;
+	this->mixer->set_low_priority_fade(1);
+}
+
+bool AudioProgramInterface::play_cached_sfx(AudioResourceId id, AudioResourceType type){
+	if (!this->sfx_cache)
+		return false;
+	if (type != AudioResourceType::Sfx && type != AudioResourceType::Cry)
+		return false;
+	AudioResourceId playing;
+	if (this->sfx_voice->get_sound_id(playing)){
+		//The program applies the same rule to each channel.
+		if (id > playing)
+			return true;
+		this->sfx_voice->stop();
+	}
+	//Let the program handle sounds that interrupt one it's playing.
+	if (this->sfx.is_sfx_playing())
+		return false;
+	bool cry = type == AudioResourceType::Cry;
+	SfxCache::Key key{ id, cry ? this->sfx.frequency_modifier : 0, cry ? this->sfx.tempo_modifier : 0 };
+	auto clip = this->sfx_cache->get(key);
+	if (!clip)
+		return false;
+	this->sfx_voice->play(clip, id);
+	return true;
+}
+
+void AudioProgramInterface::set_sfx_cache(SfxCache *cache, SfxVoice *voice){
+	auto lock = this->acquire_lock();
+	if (this->sfx_voice && !voice)
+		this->sfx_voice->stop();
+	this->sfx_cache = cache;
+	this->sfx_voice = voice;
 }
 
 void AudioProgramInterface::wait_for_sfx_to_end(){
 	this->sfx.wait_for_sfx_to_end();
+	SfxVoice *voice;
+	{
+		auto lock = this->sfx.acquire_lock();
+		voice = this->sfx_voice;
+	}
+	if (voice)
+		voice->wait_for_end();
+}
+
+void AudioProgramInterface::set_music_lookahead(double seconds, TwoWayMixer &mixer){
+	this->music_lookahead = seconds;
+	this->mixer = &mixer;
+	mixer.set_low_priority_ahead(seconds > 0);
+}
+
+//Live sound effects and music fades have to be stepped every millisecond.
+//Otherwise, the mixer only does something once a whole sound effect frame is
+//rendered, and the music only needs to be rendered again once less than half
+//the look-ahead is left. Cached clips are mixed a whole frame at a time, so
+//they don't keep the scheduler awake either.
+double AudioProgramInterface::get_idle_time(){
+	if (!this->music_lookahead)
+		return 0;
+	{
+		auto lock = this->acquire_lock();
+		if (this->music_fade.active || this->sfx.is_sfx_playing() || this->sfx.get_fade_out_control())
+			return 0;
+	}
+	const double frame_duration = (double)AudioFrame::length / sampling_frequency;
+	auto target = std::max<size_t>((size_t)(this->music_lookahead / frame_duration), 1);
+	auto queued = this->music.renderer->get_queued_frame_count();
+	if (queued * 2 < target)
+		return 0;
+	auto music_idle = (queued - target / 2) * frame_duration;
+	return std::min(music_idle, this->mixer->get_high_priority_renderer().get_time_to_next_frame());
 }
 
 void AudioProgramInterface::update(double now){
-	this->music.update(now);
+	if (this->music_lookahead){
+		this->update_music_ahead(now);
+		//The scheduler may have been idle since the last update. Render up to
+		//now first, so that a sound that was requested in the meantime starts
+		//now, rather than at the last update.
+		this->sfx.renderer->update(now);
+	}else
+		this->music.update(now);
 	this->sfx.update(now);
 }
 
+//Nothing is rendered until less than half the look-ahead is left, and then
+//it's refilled in one go, so that between bursts the music costs nothing.
+//Bursts step through time as finely as AudioScheduler does, so that the music
+//sounds exactly like it does when it's rendered live. The lock is only held
+//for one step at a time, so that the game thread is never held up for a whole
+//burst.
+void AudioProgramInterface::update_music_ahead(double now){
+	{
+		auto lock = this->music.acquire_lock();
+		this->update_music_fade(now);
+	}
+	auto &renderer = *this->music.renderer;
+	if (this->music_time < 0){
+		//Start both clocks where the mixer would have.
+		this->music_time = now;
+		this->music.update(now);
+		renderer.update(now);
+	}
+	const double step = 0.001;
+	const double frame_duration = (double)AudioFrame::length / sampling_frequency;
+	auto target = std::max<size_t>((size_t)(this->music_lookahead / frame_duration), 1);
+	if (renderer.get_queued_frame_count() * 2 >= target)
+		return;
+	auto max_steps = (size_t)(this->music_lookahead / step) + 1;
+	for (size_t i = 0; i < max_steps && renderer.get_queued_frame_count() < target; i++){
+		this->music_time += step;
+		this->music.update(this->music_time);
+		//The program only updates the renderer when it's due for an update
+		//itself, while the mixer would have done it at every step.
+		renderer.update(this->music_time);
+	}
+}
+
+//Follows the same schedule as AudioProgram::compute_fade_out(), but in real
+//time. Must be called with the music lock held.
+void AudioProgramInterface::update_music_fade(double now){
+	auto &fade = this->music_fade;
+	if (!fade.active)
+		return;
+	if (fade.start < 0)
+		fade.start = now;
+	auto updates = (int)((now - fade.start) / AudioProgram::update_threshold);
+	if (updates <= fade.initial_level * fade.period){
+		fade.level = fade.initial_level - updates / fade.period;
+		this->mixer->set_low_priority_fade(fade.level / 7.f);
+		return;
+	}
+	fade.active = false;
+	this->play_music(fade.next);
+	this->mixer->set_low_priority_fade(1);
+}
+
+//Must be called with the music lock held.
+void AudioProgramInterface::start_music_fade(double duration, AudioResourceId next){
+	auto &fade = this->music_fade;
+	//A fade that's already running carries on from its current volume.
+	fade.initial_level = fade.active ? fade.level : 7;
+	fade.active = true;
+	fade.start = -1;
+	fade.period = std::max((int)(duration * 60) / 7, 1);
+	fade.next = next;
+	//The fade has to be stepped every millisecond.
+	if (this->request_event)
+		this->request_event->signal();
+}
+
 void AudioProgramInterface::stop_sfx(){
 	auto lock = this->sfx.acquire_lock();
 	this->sfx.play_sound(AudioResourceId::Stop);
+	if (this->sfx_voice)
+		this->sfx_voice->stop();
 }
 
 AudioProgramInterface::double_lock AudioProgramInterface::acquire_lock(){
@@ -1250,6 +1435,10 @@ AudioProgramInterface::double_lock AudioProgramInterface::acquire_lock(){
 
 void AudioProgramInterface::fade_out_music_to_silence(double duration){
 	auto lock = this->music.acquire_lock();
+	if (this->music_lookahead){
+		this->start_music_fade(duration, this->music_fade.active ? this->music_fade.next : AudioResourceId::Stop);
+		return;
+	}
 	this->music.set_fade_out_control(1);
 	auto c = (int)(duration * 60) / 7;
 	this->music.set_fade_out_counter_reload_value(c);
@@ -1258,6 +1447,11 @@ void AudioProgramInterface::fade_out_music_to_silence(double duration){
 
 void AudioProgramInterface::fade_out_music_then_change_tracks(AudioResourceId id, double duration){
 	auto lock = this->music.acquire_lock();
+	if (this->music_lookahead){
+		if ((this->music_fade.active ? this->music_fade.next : this->music.get_sound_id()) != id)
+			this->start_music_fade(duration, id);
+		return;
+	}
 	if (!this->music.get_fade_out_control()){
 		if(this->music.get_sound_id() == id)
 			return;
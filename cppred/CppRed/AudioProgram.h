@@ -13,6 +13,9 @@
 #endif
 
 class GbAudioRenderer;
+class TwoWayMixer;
+class SfxCache;
+class SfxVoice;
 
 namespace CppRed{
 
@@ -33,18 +36,31 @@ struct AudioResource{
 	AudioResourceType type;
 };
 
+//The decoded command and header tables. They don't depend on the version or
+//on whether the program plays music or SFX, so every program shares a single
+//copy.
+class AudioProgramData{
+	void load_commands();
+	void load_resources();
+public:
+	std::vector<AudioCommand> commands;
+	std::vector<AudioResource> resources;
+	AudioProgramData();
+};
+
 class AudioProgram{
 	friend class AudioProgramInterface;
 
 	static const double update_threshold;
 	double last_update = -1;
-	std::vector<AudioCommand> commands;
-	std::vector<AudioResource> resources;
+	std::shared_ptr<const AudioProgramData> data;
+	const std::vector<AudioCommand> &commands;
+	const std::vector<AudioResource> &resources;
 
 	GbAudioRenderer *renderer;
 	bool for_music;
 	PokemonVersion version;
-	AudioResourceId sound_id;
+	AudioResourceId sound_id = AudioResourceId::None;
 	AudioResourceId sound_id_after_fade_out = AudioResourceId::Stop;
 	enum class PauseMusicState{
 		NotPaused,
@@ -168,8 +184,6 @@ class AudioProgram{
 	};
 	std::unique_ptr<Channel> channels[8];
 
-	void load_commands();
-	void load_resources();
 	bool is_cry_playing();
 	enum class RegisterId{
 		DutySoundLength = 1,
@@ -189,11 +203,10 @@ class AudioProgram{
 	void update_channel(int);
 	void compute_fade_out();
 	bool is_music_playing();
-	bool is_sfx_playing();
 	bool channel_is_busy(int);
 	void play_sound_internal(AudioResourceId);
 public:
-	AudioProgram(GbAudioRenderer &renderer, PokemonVersion, bool for_music);
+	AudioProgram(GbAudioRenderer &renderer, PokemonVersion, bool for_music, const std::shared_ptr<const AudioProgramData> &);
 	void play_sound(AudioResourceId);
 	void update(double now);
 	void pause_music();
@@ -207,6 +220,8 @@ public:
 	DEFINE_GETTER_SETTER(sound_id_after_fade_out)
 	DEFINE_GETTER_SETTER(sound_id)
 	void copy_fade_control();
+	//Must be called with the lock held.
+	bool is_sfx_playing();
 	void wait_for_sfx_to_end();
 	void set_frequency_modifier(int value){
 		this->frequency_modifier = value;
@@ -219,8 +234,40 @@ public:
 class AudioProgramInterface{
 	AudioProgram music;
 	AudioProgram sfx;
+	//Both null unless cached SFX are enabled.
+	SfxCache *sfx_cache = nullptr;
+	SfxVoice *sfx_voice = nullptr;
+	//In seconds. Zero unless music is rendered ahead, in which case the mixer
+	//is set.
+	double music_lookahead = 0;
+	TwoWayMixer *mixer = nullptr;
+	//What the music program and renderer have been updated to.
+	double music_time = -1;
+	//While music is rendered ahead, fades are applied by the mixer instead of
+	//the program, since the program is already past the point where they
+	//start. Guarded by the music lock.
+	struct MusicFade{
+		bool active = false;
+		//Negative until the next update() sees the fade.
+		double start = -1;
+		//In program updates per volume step.
+		int period = 1;
+		int initial_level = 7;
+		int level = 7;
+		AudioResourceId next;
+	};
+	MusicFade music_fade;
+	//Signalled whenever a sound is requested. Null unless set.
+	Event *request_event = nullptr;
+
+	void start_sound(AudioResourceId, bool obtain_lock);
+	bool play_cached_sfx(AudioResourceId, AudioResourceType);
+	void play_music(AudioResourceId);
+	void update_music_ahead(double now);
+	void update_music_fade(double now);
+	void start_music_fade(double duration, AudioResourceId next);
 public:
-	AudioProgramInterface(GbAudioRenderer &music_renderer, GbAudioRenderer &sfx_renderer, PokemonVersion version);
+	AudioProgramInterface(GbAudioRenderer &music_renderer, GbAudioRenderer &sfx_renderer, PokemonVersion version, const std::shared_ptr<const AudioProgramData> &);
 	void play_sound(AudioResourceId, bool lock = true);
 	void wait_for_sfx_to_end();
 	void update(double now);
@@ -236,6 +283,28 @@ public:
 	std::vector<std::string> get_resource_strings(){
 		return this->music.get_resource_strings();
 	}
+	PokemonVersion get_version() const{
+		return this->music.version;
+	}
+	const std::shared_ptr<const AudioProgramData> &get_data() const{
+		return this->music.data;
+	}
+	//Once set, sound effects and cries that are found in the cache are played
+	//through the voice instead of the SFX program. Pass nulls to go back to
+	//playing everything live.
+	void set_sfx_cache(SfxCache *, SfxVoice *);
+	//Renders music in bursts, up to this many seconds ahead of the mixer,
+	//instead of keeping up with it every update. Changing tracks discards
+	//whatever was rendered ahead. The music renderer must be able to queue
+	//that many frames. Must be called before the first update().
+	void set_music_lookahead(double seconds, TwoWayMixer &);
+	void set_request_event(Event *event){
+		this->request_event = event;
+	}
+	//How long, in seconds, update() can go without being called before what
+	//is heard changes. Always zero unless music is rendered ahead, since
+	//otherwise the music program has to be stepped in real time.
+	double get_idle_time();
 	void fade_out_music_to_silence(double duration);
 	void fade_out_music_then_change_tracks(AudioResourceId, double duration);
 };
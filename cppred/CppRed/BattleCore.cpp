@@ -0,0 +1,792 @@
+#include "stdafx.h"
+#include "BattleCore.h"
+#include "Pokemon.h"
+#ifndef HAVE_PCH
+#include <algorithm>
+#include <cassert>
+#endif
+
+namespace CppRed{
+
+struct TypeMatchup{
+	PokemonTypeId attacker;
+	PokemonTypeId defender;
+	//In tenths.
+	int multiplier;
+};
+
+#define MATCHUP(attacker, defender, multiplier) { PokemonTypeId::attacker, PokemonTypeId::defender, multiplier }
+
+//Same order as the original game, since it determines the rounding of
+//the damage.
+static const TypeMatchup type_matchups[] = {
+	MATCHUP(Water,    Fire,     20),
+	MATCHUP(Fire,     Grass,    20),
+	MATCHUP(Fire,     Ice,      20),
+	MATCHUP(Grass,    Water,    20),
+	MATCHUP(Electric, Water,    20),
+	MATCHUP(Water,    Rock,     20),
+	MATCHUP(Ground,   Flying,    0),
+	MATCHUP(Water,    Water,     5),
+	MATCHUP(Fire,     Fire,      5),
+	MATCHUP(Electric, Electric,  5),
+	MATCHUP(Ice,      Ice,       5),
+	MATCHUP(Grass,    Grass,     5),
+	MATCHUP(Psychic,  Psychic,   5),
+	MATCHUP(Fire,     Water,     5),
+	MATCHUP(Grass,    Fire,      5),
+	MATCHUP(Water,    Grass,     5),
+	MATCHUP(Electric, Grass,     5),
+	MATCHUP(Normal,   Rock,      5),
+	MATCHUP(Normal,   Ghost,     0),
+	MATCHUP(Ghost,    Ghost,    20),
+	MATCHUP(Fire,     Bug,      20),
+	MATCHUP(Fire,     Rock,      5),
+	MATCHUP(Water,    Ground,   20),
+	MATCHUP(Electric, Ground,    0),
+	MATCHUP(Electric, Flying,   20),
+	MATCHUP(Grass,    Ground,   20),
+	MATCHUP(Grass,    Bug,       5),
+	MATCHUP(Grass,    Poison,    5),
+	MATCHUP(Grass,    Rock,     20),
+	MATCHUP(Grass,    Flying,    5),
+	MATCHUP(Ice,      Water,     5),
+	MATCHUP(Ice,      Grass,    20),
+	MATCHUP(Ice,      Ground,   20),
+	MATCHUP(Ice,      Flying,   20),
+	MATCHUP(Fighting, Normal,   20),
+	MATCHUP(Fighting, Poison,    5),
+	MATCHUP(Fighting, Flying,    5),
+	MATCHUP(Fighting, Psychic,   5),
+	MATCHUP(Fighting, Bug,       5),
+	MATCHUP(Fighting, Rock,     20),
+	MATCHUP(Fighting, Ice,      20),
+	MATCHUP(Fighting, Ghost,     0),
+	MATCHUP(Poison,   Grass,    20),
+	MATCHUP(Poison,   Poison,    5),
+	MATCHUP(Poison,   Ground,    5),
+	MATCHUP(Poison,   Bug,      20),
+	MATCHUP(Poison,   Rock,      5),
+	MATCHUP(Poison,   Ghost,     5),
+	MATCHUP(Ground,   Fire,     20),
+	MATCHUP(Ground,   Electric, 20),
+	MATCHUP(Ground,   Grass,     5),
+	MATCHUP(Ground,   Bug,       5),
+	MATCHUP(Ground,   Rock,     20),
+	MATCHUP(Ground,   Poison,   20),
+	MATCHUP(Flying,   Electric,  5),
+	MATCHUP(Flying,   Fighting, 20),
+	MATCHUP(Flying,   Bug,      20),
+	MATCHUP(Flying,   Grass,    20),
+	MATCHUP(Flying,   Rock,      5),
+	MATCHUP(Psychic,  Fighting, 20),
+	MATCHUP(Psychic,  Poison,   20),
+	MATCHUP(Bug,      Fire,      5),
+	MATCHUP(Bug,      Grass,    20),
+	MATCHUP(Bug,      Fighting,  5),
+	MATCHUP(Bug,      Flying,    5),
+	MATCHUP(Bug,      Psychic,  20),
+	MATCHUP(Bug,      Ghost,     5),
+	MATCHUP(Bug,      Poison,   20),
+	MATCHUP(Rock,     Fire,     20),
+	MATCHUP(Rock,     Fighting,  5),
+	MATCHUP(Rock,     Ground,    5),
+	MATCHUP(Rock,     Flying,   20),
+	MATCHUP(Rock,     Bug,      20),
+	MATCHUP(Rock,     Ice,      20),
+	MATCHUP(Ghost,    Normal,    0),
+	MATCHUP(Ghost,    Psychic,   0),
+	MATCHUP(Fire,     Dragon,    5),
+	MATCHUP(Water,    Dragon,    5),
+	MATCHUP(Electric, Dragon,    5),
+	MATCHUP(Grass,    Dragon,    5),
+	MATCHUP(Ice,      Fire,      5),
+	MATCHUP(Dragon,   Dragon,   20),
+};
+
+#undef MATCHUP
+
+//Stat that each of Attack, Defense, Speed and Special modifies.
+static const PokemonStats::StatId stat_by_stage[] = {
+	PokemonStats::StatId::Attack,
+	PokemonStats::StatId::Defense,
+	PokemonStats::StatId::Speed,
+	PokemonStats::StatId::Special,
+};
+
+//Stage -6 to +6, as fractions.
+static const int stage_multipliers[13][2] = {
+	{ 25, 100 },
+	{ 28, 100 },
+	{ 33, 100 },
+	{ 40, 100 },
+	{ 50, 100 },
+	{ 66, 100 },
+	{  1,   1 },
+	{ 15,  10 },
+	{  2,   1 },
+	{ 25,  10 },
+	{  3,   1 },
+	{ 35,  10 },
+	{  4,   1 },
+};
+
+static MoveAdditionalEffect get_effect(MoveId move){
+	auto data = pokemon_moves_by_id[(int)move];
+	return data ? data->additional_effect : MoveAdditionalEffect::NoAdditionalEffect;
+}
+
+static bool in_effect_range(MoveAdditionalEffect effect, MoveAdditionalEffect first, MoveAdditionalEffect last){
+	return (int)effect >= (int)first && (int)effect <= (int)last;
+}
+
+static bool is_stat_raising_effect(MoveAdditionalEffect effect){
+	return in_effect_range(effect, MoveAdditionalEffect::AttackUp1Effect, MoveAdditionalEffect::EvasionUp1Effect) ||
+		in_effect_range(effect, MoveAdditionalEffect::AttackUp2Effect, MoveAdditionalEffect::EvasionUp2Effect);
+}
+
+static bool is_status_inflicting_effect(MoveAdditionalEffect effect){
+	switch (effect){
+		case MoveAdditionalEffect::SleepEffect:
+		case MoveAdditionalEffect::PoisonEffect:
+		case MoveAdditionalEffect::ParalyzeEffect:
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+static bool is_high_critical_move(MoveId move){
+	switch (move){
+		case MoveId::KarateChop:
+		case MoveId::RazorLeaf:
+		case MoveId::Crabhammer:
+		case MoveId::Slash:
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+//Returns the effectiveness in tenths.
+static int get_effectiveness(PokemonTypeId move_type, const BattlePokemon &defender){
+	int ret = 10;
+	for (auto &matchup : type_matchups)
+		if (matchup.attacker == move_type && (matchup.defender == defender.type[0] || matchup.defender == defender.type[1]))
+			ret = ret * matchup.multiplier / 10;
+	return ret;
+}
+
+static bool is_usable(const BattlePokemon &pokemon){
+	return pokemon.hp > 0;
+}
+
+static void load_member(BattlePokemon &dst, Pokemon &src){
+	dst.species = src.get_species();
+	dst.level = src.get_level();
+	for (int i = 0; i < BattlePokemon::max_moves; i++){
+		dst.moves[i] = src.get_moves()[i];
+		dst.pp[i] = src.get_pp(i);
+	}
+	dst.hp = src.get_current_hp();
+	dst.max_hp = src.get_max_hp();
+	for (int i = 0; i < 5; i++)
+		dst.stats[i] = src.get_stat((PokemonStats::StatId)i);
+	dst.type[0] = species_types[(int)dst.species][0];
+	dst.type[1] = species_types[(int)dst.species][1];
+	dst.status = (StatusCondition)src.get_status();
+	if (src.get_status() == StatusCondition2::Fainted)
+		dst.status = StatusCondition::Normal;
+	dst.sleep_turns = 0;
+}
+
+BattleParty::BattleParty(Party &party){
+	this->size = party.size() < max_size ? party.size() : max_size;
+	for (int i = 0; i < this->size; i++)
+		load_member(this->members[i], party.get(i));
+}
+
+BattleParty::BattleParty(Party &party, const int (&ai_move_choice_modifiers)[4]): BattleParty(party){
+	std::copy(ai_move_choice_modifiers, ai_move_choice_modifiers + 4, this->ai_move_choice_modifiers);
+}
+
+void BattleParty::store(Party &party) const{
+	for (int i = 0; i < this->size && i < party.size(); i++){
+		auto &src = this->members[i];
+		auto &dst = party.get(i);
+		dst.current_hp = src.hp;
+		for (int j = 0; j < BattlePokemon::max_moves; j++)
+			dst.pp[j] = src.pp[j];
+		//Sleep isn't representable in StatusCondition, so it doesn't
+		//persist after the battle.
+		dst.status = src.status;
+	}
+}
+
+int BattleParty::get_first_usable_member() const{
+	for (int i = 0; i < this->size; i++)
+		if (is_usable(this->members[i]))
+			return i;
+	return -1;
+}
+
+BattleCore::BattleCore(const BattleParty &side0, const BattleParty &side1, const xorshift128_state &seed):
+		rng(seed){
+	this->parties[0] = side0;
+	this->parties[1] = side1;
+	for (int side = 0; side < 2; side++)
+		this->send_out(side, std::max(this->parties[side].get_first_usable_member(), 0));
+	this->event_count = 0;
+	this->update_outcome();
+}
+
+void BattleCore::add_event(BattleEventType type, int side, MoveId move, int value){
+	if (this->event_count >= max_events)
+		return;
+	auto &event = this->events[this->event_count++];
+	event.type = type;
+	event.side = (std::uint8_t)side;
+	event.member = (std::uint8_t)this->active[side].member;
+	event.move = move;
+	event.value = value;
+}
+
+void BattleCore::send_out(int side, int member){
+	auto &active = this->active[side];
+	active.member = member;
+	active.turns_active = 0;
+	fill(active.stages, 0);
+	active.flinched = false;
+	active.moved_this_turn = false;
+	active.faint_reported = false;
+	this->add_event(BattleEventType::SentOut, side);
+}
+
+int BattleCore::get_effective_stat(int side, StageId stat, bool critical){
+	auto &pokemon = this->get_active(side);
+	assert((size_t)stat < array_length(stat_by_stage));
+	int ret = pokemon.stats[(int)stat_by_stage[stat]];
+	if (critical)
+		return ret;
+	auto &multiplier = stage_multipliers[this->active[side].stages[stat] + 6];
+	ret = ret * multiplier[0] / multiplier[1];
+	if (stat == Attack && pokemon.status == StatusCondition::Burned)
+		ret /= 2;
+	return std::max(ret, 1);
+}
+
+int BattleCore::get_speed(int side){
+	int ret = this->get_effective_stat(side, Speed, false);
+	if (this->get_active(side).status == StatusCondition::Paralized)
+		ret = std::max(ret / 4, 1);
+	return ret;
+}
+
+bool BattleCore::roll(int chance_out_of_256){
+	return (int)this->rng(256) < chance_out_of_256;
+}
+
+bool BattleCore::can_move(int side){
+	auto &pokemon = this->get_active(side);
+	if (pokemon.sleep_turns > 0){
+		if (!--pokemon.sleep_turns)
+			this->add_event(BattleEventType::WokeUp, side);
+		else
+			this->add_event(BattleEventType::FastAsleep, side);
+		return false;
+	}
+	if (pokemon.status == StatusCondition::Frozen){
+		this->add_event(BattleEventType::IsFrozen, side);
+		return false;
+	}
+	if (this->active[side].flinched){
+		this->add_event(BattleEventType::Flinched, side);
+		return false;
+	}
+	if (pokemon.status == StatusCondition::Paralized && this->roll(63)){
+		this->add_event(BattleEventType::FullyParalyzed, side);
+		return false;
+	}
+	return true;
+}
+
+bool BattleCore::check_accuracy(int side, MoveId move){
+	if (get_effect(move) == MoveAdditionalEffect::SwiftEffect)
+		return true;
+	int accuracy = pokemon_moves_accuracy[(int)move] * 255 / 100;
+	auto &accuracy_stage = stage_multipliers[this->active[side].stages[Accuracy] + 6];
+	auto &evasion_stage = stage_multipliers[6 - this->active[1 - side].stages[Evasion]];
+	accuracy = accuracy * accuracy_stage[0] / accuracy_stage[1];
+	accuracy = accuracy * evasion_stage[0] / evasion_stage[1];
+	accuracy = std::min(std::max(accuracy, 1), 255);
+	return this->roll(accuracy);
+}
+
+int BattleCore::compute_damage(int side, MoveId move, bool &critical, int &effectiveness){
+	auto &attacker = this->get_active(side);
+	auto &defender = this->get_active(1 - side);
+	auto type = pokemon_moves_type[(int)move];
+	int power = pokemon_moves_power[(int)move];
+
+	int critical_threshold = species_base_stats[(int)attacker.species][(int)PokemonStats::StatId::Speed] / 2;
+	if (is_high_critical_move(move))
+		critical_threshold = std::min(critical_threshold * 8, 255);
+	critical = this->roll(critical_threshold);
+
+	bool physical = (int)type < (int)PokemonTypeId::Fire;
+	int attack = this->get_effective_stat(side, physical ? Attack : Special, critical);
+	int defense = this->get_effective_stat(1 - side, physical ? Defense : Special, critical);
+	if (get_effect(move) == MoveAdditionalEffect::ExplodeEffect)
+		defense = std::max(defense / 2, 1);
+	if (attack > 255 || defense > 255){
+		attack = std::max(attack / 4, 1);
+		defense = std::max(defense / 4, 1);
+	}
+	int level = attacker.level * (critical ? 2 : 1);
+
+	int damage = (level * 2 / 5 + 2) * attack * power / defense / 50;
+	damage = std::min(damage, 997) + 2;
+	if (type == attacker.type[0] || type == attacker.type[1])
+		damage += damage / 2;
+	effectiveness = 10;
+	for (auto &matchup : type_matchups){
+		if (matchup.attacker != type || (matchup.defender != defender.type[0] && matchup.defender != defender.type[1]))
+			continue;
+		damage = damage * matchup.multiplier / 10;
+		effectiveness = effectiveness * matchup.multiplier / 10;
+	}
+	if (damage > 1)
+		damage = damage * (int)this->rng(217, 256) / 255;
+	return damage;
+}
+
+void BattleCore::deal_damage(int side, int damage){
+	auto &pokemon = this->get_active(side);
+	if (pokemon.hp <= 0)
+		return;
+	pokemon.hp = std::max(pokemon.hp - damage, 0);
+	if (!pokemon.hp){
+		pokemon.status = StatusCondition::Normal;
+		pokemon.sleep_turns = 0;
+	}
+}
+
+void BattleCore::report_faint(int side){
+	auto &active = this->active[side];
+	if (this->get_active(side).hp > 0 || active.faint_reported)
+		return;
+	active.faint_reported = true;
+	this->add_event(BattleEventType::Fainted, side);
+}
+
+bool BattleCore::inflict_status(int side, StatusCondition status, int sleep_turns){
+	auto &pokemon = this->get_active(side);
+	if (pokemon.hp <= 0 || pokemon.status != StatusCondition::Normal || pokemon.sleep_turns)
+		return false;
+	PokemonTypeId immune_type;
+	switch (status){
+		case StatusCondition::Poisoned:
+			immune_type = PokemonTypeId::Poison;
+			break;
+		case StatusCondition::Burned:
+			immune_type = PokemonTypeId::Fire;
+			break;
+		case StatusCondition::Frozen:
+			immune_type = PokemonTypeId::Ice;
+			break;
+		default:
+			immune_type = (PokemonTypeId)-1;
+			break;
+	}
+	if (pokemon.type[0] == immune_type || pokemon.type[1] == immune_type)
+		return false;
+	if (sleep_turns)
+		pokemon.sleep_turns = sleep_turns;
+	else
+		pokemon.status = status;
+	this->add_event(BattleEventType::StatusInflicted, side, MoveId::None, sleep_turns ? -1 : (int)status);
+	return true;
+}
+
+void BattleCore::change_stage(int side, StageId stat, int delta){
+	auto &stage = this->active[side].stages[stat];
+	auto new_stage = std::min(std::max(stage + delta, -6), 6);
+	if (new_stage == stage){
+		this->add_event(BattleEventType::Failed, side);
+		return;
+	}
+	stage = new_stage;
+	this->add_event(BattleEventType::StatChanged, side, MoveId::None, (int)stat * 16 + delta);
+}
+
+void BattleCore::apply_secondary_effect(int side, MoveId move, bool damaged){
+	typedef MoveAdditionalEffect E;
+	auto effect = get_effect(move);
+	auto target = 1 - side;
+	if (!damaged || this->get_active(target).hp <= 0)
+		return;
+	switch (effect){
+		case E::PoisonSideEffect1:
+		case E::TwineedleEffect:
+			if (this->roll(52))
+				this->inflict_status(target, StatusCondition::Poisoned);
+			break;
+		case E::PoisonSideEffect2:
+			if (this->roll(103))
+				this->inflict_status(target, StatusCondition::Poisoned);
+			break;
+		case E::BurnSideEffect1:
+			if (this->roll(26))
+				this->inflict_status(target, StatusCondition::Burned);
+			break;
+		case E::BurnSideEffect2:
+			if (this->roll(77))
+				this->inflict_status(target, StatusCondition::Burned);
+			break;
+		case E::FreezeSideEffect:
+			if (this->roll(26))
+				this->inflict_status(target, StatusCondition::Frozen);
+			break;
+		case E::ParalyzeSideEffect1:
+			if (this->roll(26))
+				this->inflict_status(target, StatusCondition::Paralized);
+			break;
+		case E::ParalyzeSideEffect2:
+			if (this->roll(77))
+				this->inflict_status(target, StatusCondition::Paralized);
+			break;
+		case E::FlinchSideEffect1:
+			if (!this->active[target].moved_this_turn && this->roll(26))
+				this->active[target].flinched = true;
+			break;
+		case E::FlinchSideEffect2:
+			if (!this->active[target].moved_this_turn && this->roll(77))
+				this->active[target].flinched = true;
+			break;
+		case E::AttackDownSideEffect:
+		case E::DefenseDownSideEffect:
+		case E::SpeedDownSideEffect:
+		case E::SpecialDownSideEffect:
+			if (this->roll(85))
+				this->change_stage(target, (StageId)((int)effect - (int)E::AttackDownSideEffect), -1);
+			break;
+		default:
+			break;
+	}
+}
+
+void BattleCore::use_move(int side, int move_index){
+	typedef MoveAdditionalEffect E;
+	auto &user = this->get_active(side);
+	auto target = 1 - side;
+	if (move_index == no_action || user.hp <= 0 || this->get_active(target).hp <= 0 || this->outcome != BattleOutcome::Undecided)
+		return;
+	this->active[side].moved_this_turn = true;
+	if (!this->can_move(side))
+		return;
+
+	MoveId move;
+	if (move_index == struggle)
+		move = MoveId::Struggle;
+	else{
+		move = user.moves[move_index];
+		user.pp[move_index] = std::max(user.pp[move_index] - 1, 0);
+	}
+	this->add_event(BattleEventType::MoveUsed, side, move);
+
+	auto effect = get_effect(move);
+	auto &defender = this->get_active(target);
+	int power = pokemon_moves_power[(int)move];
+
+	if (!power){
+		//Moves that only affect the user never miss.
+		if (is_stat_raising_effect(effect)){
+			int stat = (int)effect - (int)E::AttackUp1Effect;
+			int delta = 1;
+			if (effect >= E::AttackUp2Effect){
+				stat = (int)effect - (int)E::AttackUp2Effect;
+				delta = 2;
+			}
+			this->change_stage(side, (StageId)stat, delta);
+			return;
+		}
+		if (effect == E::HealEffect){
+			if (user.hp >= user.max_hp){
+				this->add_event(BattleEventType::Failed, side, move);
+				return;
+			}
+			int healed;
+			if (move == MoveId::Rest){
+				healed = user.max_hp - user.hp;
+				user.status = StatusCondition::Normal;
+				user.sleep_turns = 2;
+			}else
+				healed = std::min(user.max_hp / 2, user.max_hp - user.hp);
+			user.hp += healed;
+			this->add_event(BattleEventType::Healed, side, move, healed);
+			return;
+		}
+		if (effect == E::HazeEffect){
+			for (auto &a : this->active)
+				fill(a.stages, 0);
+			return;
+		}
+		if (!this->check_accuracy(side, move)){
+			this->add_event(BattleEventType::Missed, side, move);
+			return;
+		}
+		bool success = true;
+		if (in_effect_range(effect, E::AttackDown1Effect, E::EvasionDown1Effect))
+			this->change_stage(target, (StageId)((int)effect - (int)E::AttackDown1Effect), -1);
+		else if (in_effect_range(effect, E::AttackDown2Effect, E::EvasionDown2Effect))
+			this->change_stage(target, (StageId)((int)effect - (int)E::AttackDown2Effect), -2);
+		else if (effect == E::SleepEffect)
+			success = this->inflict_status(target, StatusCondition::Normal, (int)this->rng(1, 8));
+		else if (effect == E::PoisonEffect)
+			success = this->inflict_status(target, StatusCondition::Poisoned);
+		else if (effect == E::ParalyzeEffect)
+			success = get_effectiveness(pokemon_moves_type[(int)move], defender) && this->inflict_status(target, StatusCondition::Paralized);
+		if (!success)
+			this->add_event(BattleEventType::Failed, side, move);
+		return;
+	}
+
+	if (effect == E::DreamEaterEffect && !defender.sleep_turns){
+		this->add_event(BattleEventType::Failed, side, move);
+		return;
+	}
+	bool hit = this->check_accuracy(side, move);
+	if (effect == E::OhkoEffect && this->get_speed(side) < this->get_speed(target))
+		hit = false;
+	if (!hit){
+		this->add_event(BattleEventType::Missed, side, move);
+		if (effect == E::ExplodeEffect)
+			this->deal_damage(side, user.hp);
+		return;
+	}
+
+	int hits = 1;
+	if (effect == E::TwoToFiveAttacksEffect){
+		static const int distribution[] = { 2, 2, 2, 3, 3, 3, 4, 5 };
+		hits = distribution[this->rng(array_length(distribution))];
+	}else if (effect == E::AttackTwiceEffect || effect == E::TwineedleEffect)
+		hits = 2;
+
+	int total_damage = 0;
+	bool critical = false;
+	int effectiveness = 10;
+	for (int i = 0; i < hits && defender.hp > 0; i++){
+		int damage;
+		bool hit_critical = false;
+		switch (effect){
+			case E::SpecialDamageEffect:
+				if (move == MoveId::Sonicboom)
+					damage = 20;
+				else if (move == MoveId::DragonRage)
+					damage = 40;
+				else if (move == MoveId::Psywave)
+					damage = (int)this->rng(1, std::max(user.level * 3 / 2, 2));
+				else
+					damage = user.level;
+				break;
+			case E::SuperFangEffect:
+				damage = std::max(defender.hp / 2, 1);
+				break;
+			case E::OhkoEffect:
+				damage = defender.hp;
+				break;
+			default:
+				damage = this->compute_damage(side, move, hit_critical, effectiveness);
+				break;
+		}
+		if (!effectiveness){
+			this->add_event(BattleEventType::NoEffect, side, move);
+			break;
+		}
+		critical |= hit_critical;
+		damage = std::min(damage, defender.hp);
+		total_damage += damage;
+		this->add_event(BattleEventType::Damage, target, move, damage);
+		this->deal_damage(target, damage);
+	}
+	if (critical)
+		this->add_event(BattleEventType::CriticalHit, side, move);
+	if (effectiveness > 10)
+		this->add_event(BattleEventType::SuperEffective, side, move);
+	else if (effectiveness && effectiveness < 10)
+		this->add_event(BattleEventType::NotVeryEffective, side, move);
+
+	switch (effect){
+		case E::DrainHpEffect:
+		case E::DreamEaterEffect:
+			{
+				int healed = std::min(std::max(total_damage / 2, 1), user.max_hp - user.hp);
+				user.hp += healed;
+				this->add_event(BattleEventType::Healed, side, move, healed);
+			}
+			break;
+		case E::RecoilEffect:
+			if (total_damage){
+				int recoil = std::max(total_damage / (move == MoveId::Struggle ? 2 : 4), 1);
+				this->add_event(BattleEventType::Recoil, side, move, recoil);
+				this->deal_damage(side, recoil);
+			}
+			break;
+		case E::ExplodeEffect:
+			this->deal_damage(side, user.hp);
+			break;
+		default:
+			break;
+	}
+	this->apply_secondary_effect(side, move, total_damage > 0);
+}
+
+void BattleCore::end_of_turn(int side){
+	auto &pokemon = this->get_active(side);
+	auto &active = this->active[side];
+	active.flinched = false;
+	active.moved_this_turn = false;
+	active.turns_active++;
+	if (pokemon.hp <= 0)
+		return;
+	BattleEventType type;
+	if (pokemon.status == StatusCondition::Poisoned)
+		type = BattleEventType::HurtByPoison;
+	else if (pokemon.status == StatusCondition::Burned)
+		type = BattleEventType::HurtByBurn;
+	else
+		return;
+	int damage = std::max(pokemon.max_hp / 16, 1);
+	this->add_event(type, side, MoveId::None, damage);
+	this->deal_damage(side, damage);
+}
+
+void BattleCore::update_outcome(){
+	bool usable[2];
+	for (int side = 0; side < 2; side++)
+		usable[side] = this->parties[side].get_first_usable_member() >= 0;
+	if (!usable[0] && !usable[1])
+		this->outcome = BattleOutcome::Draw;
+	else if (!usable[1])
+		this->outcome = BattleOutcome::Side0Victory;
+	else if (!usable[0])
+		this->outcome = BattleOutcome::Side1Victory;
+	else if (this->turn >= max_turns)
+		this->outcome = BattleOutcome::Draw;
+}
+
+void BattleCore::resolve_turn(int side0_move, int side1_move){
+	this->event_count = 0;
+	if (this->outcome != BattleOutcome::Undecided)
+		return;
+	int moves[] = { side0_move, side1_move };
+
+	int first;
+	auto priority0 = moves[0] >= 0 && this->get_active(0).moves[moves[0]] == MoveId::QuickAttack;
+	auto priority1 = moves[1] >= 0 && this->get_active(1).moves[moves[1]] == MoveId::QuickAttack;
+	if (moves[0] == no_action)
+		first = 0;
+	else if (moves[1] == no_action)
+		first = 1;
+	else if (priority0 != priority1)
+		first = priority0 ? 0 : 1;
+	else{
+		auto speed0 = this->get_speed(0);
+		auto speed1 = this->get_speed(1);
+		if (speed0 != speed1)
+			first = speed0 > speed1 ? 0 : 1;
+		else
+			first = (int)this->rng(2);
+	}
+
+	for (int i = 0; i < 2; i++){
+		auto side = i ? 1 - first : first;
+		this->use_move(side, moves[side]);
+		this->report_faint(1 - side);
+		this->report_faint(side);
+	}
+	for (int i = 0; i < 2; i++){
+		auto side = i ? 1 - first : first;
+		this->end_of_turn(side);
+		this->report_faint(side);
+	}
+
+	this->turn++;
+	this->update_outcome();
+	if (this->outcome != BattleOutcome::Undecided)
+		return;
+	for (int side = 0; side < 2; side++)
+		if (this->get_active(side).hp <= 0)
+			this->send_out(side, this->parties[side].get_first_usable_member());
+}
+
+int BattleCore::rate_move(int side, int move_index){
+	auto move = this->get_active(side).moves[move_index];
+	auto effect = get_effect(move);
+	auto &target = this->get_active(1 - side);
+	int ret = 10;
+	for (auto modifier : this->parties[side].ai_move_choice_modifiers){
+		if (modifier < 0)
+			break;
+		switch (modifier){
+			case 1:
+				//Discourage moves that inflict a status on a target that
+				//already has one.
+				if (is_status_inflicting_effect(effect) && (target.status != StatusCondition::Normal || target.sleep_turns))
+					ret += 5;
+				break;
+			case 2:
+				//Encourage stat-raising moves early on.
+				if (this->active[side].turns_active == 1 && is_stat_raising_effect(effect))
+					ret--;
+				break;
+			case 3:
+				//Prefer moves that are effective against the target.
+				{
+					auto effectiveness = get_effectiveness(pokemon_moves_type[(int)move], target);
+					if (effectiveness > 10)
+						ret--;
+					else if (effectiveness < 10 && pokemon_moves_power[(int)move])
+						ret++;
+				}
+				break;
+		}
+	}
+	return ret;
+}
+
+int BattleCore::choose_ai_move(int side){
+	auto &pokemon = this->get_active(side);
+	int ratings[BattlePokemon::max_moves];
+	int best = -1;
+	for (int i = 0; i < BattlePokemon::max_moves; i++){
+		if (pokemon.moves[i] == MoveId::None || pokemon.pp[i] <= 0){
+			ratings[i] = -1;
+			continue;
+		}
+		ratings[i] = this->rate_move(side, i);
+		if (best < 0 || ratings[i] < best)
+			best = ratings[i];
+	}
+	if (best < 0)
+		return struggle;
+	int candidates[BattlePokemon::max_moves];
+	int candidate_count = 0;
+	for (int i = 0; i < BattlePokemon::max_moves; i++)
+		if (ratings[i] == best)
+			candidates[candidate_count++] = i;
+	return candidates[this->rng(candidate_count)];
+}
+
+BattleOutcome BattleCore::run(){
+	while (this->outcome == BattleOutcome::Undecided){
+		auto move0 = this->choose_ai_move(0);
+		auto move1 = this->choose_ai_move(1);
+		this->resolve_turn(move0, move1);
+	}
+	return this->outcome;
+}
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include "Status.h"
+#include "../PokemonInfo.h"
+#include "../utility.h"
+#ifndef HAVE_PCH
+#include <cstdint>
+#endif
+
+namespace CppRed{
+
+class Party;
+
+//Copy of the battle-relevant state of a Pokemon.
+struct BattlePokemon{
+	static const int max_moves = 4;
+	SpeciesId species;
+	int level;
+	MoveId moves[max_moves];
+	int pp[max_moves];
+	int hp;
+	int max_hp;
+	//Indexed by PokemonStats::StatId.
+	int stats[5];
+	PokemonTypeId type[2];
+	StatusCondition status;
+	int sleep_turns;
+};
+
+//Fixed-size copy of a Party, together with the AI settings of its trainer.
+//Loading and storing a party are the only operations that touch Pokemon
+//objects; everything in between is allocation-free.
+class BattleParty{
+public:
+	static const int max_size = 6;
+	BattlePokemon members[max_size];
+	int size = 0;
+	//Same format as PartialTrainerClass::ai_move_choice_modifiers.
+	int ai_move_choice_modifiers[4] = { -1, -1, -1, -1 };
+
+	BattleParty() = default;
+	BattleParty(Party &);
+	BattleParty(Party &, const int (&ai_move_choice_modifiers)[4]);
+	//Writes the HP, PP and status of the members back into the party.
+	void store(Party &) const;
+	int get_first_usable_member() const;
+};
+
+enum class BattleEventType{
+	SentOut,
+	MoveUsed,
+	Missed,
+	Failed,
+	Damage,
+	CriticalHit,
+	SuperEffective,
+	NotVeryEffective,
+	NoEffect,
+	Recoil,
+	Healed,
+	StatusInflicted,
+	StatChanged,
+	FullyParalyzed,
+	FastAsleep,
+	WokeUp,
+	IsFrozen,
+	HurtByPoison,
+	HurtByBurn,
+	Flinched,
+	Fainted,
+};
+
+struct BattleEvent{
+	BattleEventType type;
+	std::uint8_t side;
+	std::uint8_t member;
+	MoveId move;
+	//Damage, amount healed, status inflicted, or stat and stage delta,
+	//depending on the type.
+	int value;
+};
+
+enum class BattleOutcome{
+	Undecided,
+	Side0Victory,
+	Side1Victory,
+	Draw,
+};
+
+//Deterministic turn resolution, independent of rendering and coroutines.
+//The same parties, seed and move choices always produce the same battle.
+//Side 0 is the player in the interactive game.
+//
+//Not simulated yet: two-turn moves, trapping, confusion, Substitute,
+//Transform, Mimic, Metronome, Mirror Move, Disable, Bide, Reflect and Light
+//Screen. Such moves only deal their damage, if any.
+class BattleCore{
+public:
+	static const int struggle = -1;
+	static const int no_action = -2;
+	static const int max_turns = 1000;
+	static const size_t max_events = 64;
+private:
+	enum StageId{
+		Attack = 0,
+		Defense,
+		Speed,
+		Special,
+		Accuracy,
+		Evasion,
+		StageCount,
+	};
+	struct ActiveState{
+		int member;
+		int turns_active;
+		int stages[StageCount];
+		bool flinched;
+		bool moved_this_turn;
+		bool faint_reported;
+	};
+
+	BattleParty parties[2];
+	ActiveState active[2];
+	XorShift128 rng;
+	int turn = 0;
+	BattleOutcome outcome = BattleOutcome::Undecided;
+	BattleEvent events[max_events];
+	size_t event_count = 0;
+
+	BattlePokemon &get_active(int side){
+		return this->parties[side].members[this->active[side].member];
+	}
+	void add_event(BattleEventType, int side, MoveId = MoveId::None, int value = 0);
+	void send_out(int side, int member);
+	int get_effective_stat(int side, StageId, bool critical);
+	int get_speed(int side);
+	bool roll(int chance_out_of_256);
+	bool can_move(int side);
+	void use_move(int side, int move_index);
+	bool check_accuracy(int side, MoveId);
+	int compute_damage(int side, MoveId, bool &critical, int &effectiveness);
+	void deal_damage(int side, int damage);
+	void report_faint(int side);
+	void apply_secondary_effect(int side, MoveId, bool damaged);
+	bool inflict_status(int target_side, StatusCondition, int sleep_turns = 0);
+	void change_stage(int side, StageId, int delta);
+	void end_of_turn(int side);
+	void update_outcome();
+	int rate_move(int side, int move_index);
+public:
+	BattleCore(const BattleParty &side0, const BattleParty &side1, const xorshift128_state &seed);
+	//Chooses a move for the given side following its AI modifiers. Returns
+	//struggle if no move has PP left.
+	int choose_ai_move(int side);
+	//Each argument is a move index, struggle, or no_action (e.g. the player
+	//used an item). Replaces the event log with the events of this turn.
+	//Pokemon that faint are replaced by the next usable member.
+	void resolve_turn(int side0_move, int side1_move);
+	//Resolves turns with AI-chosen moves on both sides until the battle ends.
+	BattleOutcome run();
+	const BattleParty &get_party(int side) const{
+		return this->parties[side];
+	}
+	int get_active_member(int side) const{
+		return this->active[side].member;
+	}
+	const BattleEvent *get_events() const{
+		return this->events;
+	}
+	size_t get_event_count() const{
+		return this->event_count;
+	}
+	DEFINE_GETTER(turn)
+	DEFINE_GETTER(outcome)
+};
+
+}
@@ -4,6 +4,7 @@
 #include "Trainer.h"
 #include "World.h"
 #include "PlayerCharacter.h"
+#include "BattleCore.h"
 #include "../Coroutine.h"
 #include "../../CodeGeneration/output/audio.h"
 #include "../../CodeGeneration/output/variables.h"
@@ -24,6 +25,15 @@ BattleOwner::BattleOwner(Game &game, FullTrainerClass &&ftc) :
 static const Point opponent_balls_display_corner(1, 2);
 static const Point player_balls_display_corner(9, 10);
 static const Point balls_display_size(10, 2);
+//Indexed by BattleCore's stage order.
+static const char * const stage_names[] = {
+	"ATTACK",
+	"DEFENSE",
+	"SPEED",
+	"SPECIAL",
+	"ACCURACY",
+	"EVADE",
+};
 
 void BattleOwner::coroutine_entry_point(){
 	auto &audio = this->game->get_audio_interface();
@@ -59,18 +69,15 @@ void BattleOwner::coroutine_entry_point(){
 	vs.set(StringVariableId::wTrainerName, trainer_class.get_display_name());
 	this->game->run_dialogue(TextResourceId::TrainerWantsToFightText, false, true);
 
+	xorshift128_state seed;
+	engine.get_prng().generate_block(&seed, sizeof(seed));
+	BattleCore core(BattleParty(player.get_party()), BattleParty(ct.get_party(), trainer_class.get_ai_move_choice_modifiers()), seed);
+
 	bool first_round = true;
-	while (true){
+	int shown_members[] = { -1, -1 };
+	while (core.get_outcome() == BattleOutcome::Undecided){
 		bool current_is_first_rount = first_round;
 		first_round = false;
-		if (!ct.get_party().get_first_usable_pokemon()){
-			this->result = BattleResult::PlayerVictory;
-			break;
-		}
-		if (!ct.get_party().get_first_usable_pokemon()){
-			this->result = BattleResult::PlayerDefeat;
-			break;
-		}
 		
 		if (current_is_first_rount){
 			renderer.fill_rectangle(TileRegion::Background, opponent_balls_display_corner, balls_display_size, Tile());
@@ -78,45 +85,56 @@ void BattleOwner::coroutine_entry_point(){
 			this->opponent_moves_back(std::move(opponent_tiles));
 		}
 
-		auto &opponent_pokemon = *ct.get_party().get_first_usable_pokemon();
+		auto &opponent_pokemon = ct.get_party().get(core.get_active_member(1));
 		auto &opponent_pokemon_data = opponent_pokemon.get_data();
 		vs.set(StringVariableId::wEnemyMonNick, opponent_pokemon.get_display_name());
-		this->game->run_dialogue(TextResourceId::TrainerSentOutText, false, false);
-		this->game->draw_portrait(*opponent_pokemon_data.front, TileRegion::Background, opponent_position);
-		audio.play_cry(opponent_pokemon_data.species_id);
-		audio.wait_for_sfx_to_end();
+		if (shown_members[1] != core.get_active_member(1)){
+			shown_members[1] = core.get_active_member(1);
+			this->game->run_dialogue(TextResourceId::TrainerSentOutText, false, false);
+			this->game->draw_portrait(*opponent_pokemon_data.front, TileRegion::Background, opponent_position);
+			audio.play_cry(opponent_pokemon_data.species_id);
+			audio.wait_for_sfx_to_end();
+		}
 		this->display_opponent_pokemon_status(opponent_pokemon);
 
-		auto &red_pokemon = *ct.get_party().get_first_usable_pokemon();
-		auto &red_pokemon_data = red_pokemon.get_data();
-
 		if (current_is_first_rount){
 			this->player_moves_back(std::move(red_tiles));
 		}
 
-		auto &reds_pokemon = *player.get_party().get_first_usable_pokemon();
+		auto &reds_pokemon = player.get_party().get(core.get_active_member(0));
 		auto &reds_pokemon_data = reds_pokemon.get_data();
 		this->display_player_pokemon_status(reds_pokemon);
 		vs.set(StringVariableId::wBattleMonNick, reds_pokemon.get_display_name());
-		auto enemy_percentage_health = opponent_pokemon.get_current_hp() * 25 / (opponent_pokemon.get_max_hp() / 4);
-		TextResourceId go_text;
-		if (enemy_percentage_health >= 70)
-			go_text = TextResourceId::GoText;
-		else if (enemy_percentage_health >= 40)
-			go_text = TextResourceId::DoItText;
-		else if (enemy_percentage_health >= 10)
-			go_text = TextResourceId::GetmText;
-		else
-			go_text = TextResourceId::EnemysWeakText;
-		this->game->reset_dialogue_state(false);
-		this->game->run_dialogue(go_text, false, false);
-		this->game->draw_portrait(*reds_pokemon_data.back, TileRegion::Background, red_position);
-		this->game->draw_box(standard_dialogue_box_position, standard_dialogue_box_size, TileRegion::Background);
-		audio.play_cry(reds_pokemon_data.species_id);
-		audio.wait_for_sfx_to_end();
-		this->game->reset_dialogue_state(true);
+		if (shown_members[0] != core.get_active_member(0)){
+			shown_members[0] = core.get_active_member(0);
+			auto enemy_percentage_health = opponent_pokemon.get_current_hp() * 25 / std::max(opponent_pokemon.get_max_hp() / 4, 1);
+			TextResourceId go_text;
+			if (enemy_percentage_health >= 70)
+				go_text = TextResourceId::GoText;
+			else if (enemy_percentage_health >= 40)
+				go_text = TextResourceId::DoItText;
+			else if (enemy_percentage_health >= 10)
+				go_text = TextResourceId::GetmText;
+			else
+				go_text = TextResourceId::EnemysWeakText;
+			this->game->reset_dialogue_state(false);
+			this->game->run_dialogue(go_text, false, false);
+			this->game->draw_portrait(*reds_pokemon_data.back, TileRegion::Background, red_position);
+			this->game->draw_box(standard_dialogue_box_position, standard_dialogue_box_size, TileRegion::Background);
+			audio.play_cry(reds_pokemon_data.species_id);
+			audio.wait_for_sfx_to_end();
+			this->game->reset_dialogue_state(true);
+		}
 		
-		while (this->run_one_round(reds_pokemon, opponent_pokemon));
+		while (this->run_one_round(core, player, ct));
+	}
+
+	if (core.get_outcome() == BattleOutcome::Side0Victory){
+		this->result = BattleResult::PlayerVictory;
+		this->game->run_dialogue(TextResourceId::TrainerDefeatedText, true, true);
+	}else{
+		this->result = BattleResult::PlayerDefeat;
+		this->game->run_dialogue(TextResourceId::PlayerBlackedOutText2, true, true);
 	}
 }
 
@@ -191,12 +209,136 @@ void BattleOwner::display_player_pokemon_status(Pokemon &pokemon){
 	renderer.put_string({15, 10}, TileRegion::Background, number_to_decimal_string(pokemon.get_max_hp(), 3).data());
 }
 	
-bool BattleOwner::run_one_round(Pokemon &own, Pokemon &opponent){
-	this->display_battle_menu(own);
-	return true;
+bool BattleOwner::run_one_round(BattleCore &core, Trainer &player, Trainer &opponent){
+	int members[] = { core.get_active_member(0), core.get_active_member(1) };
+	auto move = this->display_battle_menu(player.get_party().get(members[0]));
+	core.resolve_turn(move, core.choose_ai_move(1));
+	core.get_party(0).store(player.get_party());
+	core.get_party(1).store(opponent.get_party());
+	this->display_battle_events(core, player, opponent);
+	return core.get_outcome() == BattleOutcome::Undecided && core.get_active_member(0) == members[0] && core.get_active_member(1) == members[1];
+}
+
+void BattleOwner::display_battle_events(BattleCore &core, Trainer &player, Trainer &opponent){
+	auto &game = *this->game;
+	auto &vs = game.get_variable_store();
+	Trainer *trainers[] = { &player, &opponent };
+	auto events = core.get_events();
+	for (size_t i = 0; i < core.get_event_count(); i++){
+		auto &event = events[i];
+		auto &user = trainers[event.side]->get_party().get(event.member);
+		std::string user_name = user.get_display_name();
+		if (event.side)
+			user_name = "Enemy " + user_name;
+		vs.set(StringVariableId::user_name, user_name);
+		vs.set(StringVariableId::target_name, user_name);
+		switch (event.type){
+			case BattleEventType::MoveUsed:
+				vs.set(StringVariableId::wcf4b_UsedMoveName, pokemon_moves_by_id[(int)event.move]->display_name);
+				game.run_dialogue(TextResourceId::MonName1Text, false, false);
+				game.run_dialogue(TextResourceId::Used1Text, false, false);
+				game.run_dialogue(TextResourceId::CF4BText, false, false);
+				game.run_dialogue(TextResourceId::ExclamationPoint1Text, false, false);
+				break;
+			case BattleEventType::Damage:
+			case BattleEventType::Healed:
+			case BattleEventType::HurtByPoison:
+			case BattleEventType::HurtByBurn:
+				this->display_player_pokemon_status(player.get_party().get(core.get_active_member(0)));
+				this->display_opponent_pokemon_status(opponent.get_party().get(core.get_active_member(1)));
+				if (event.type == BattleEventType::HurtByPoison)
+					game.run_dialogue(TextResourceId::HurtByPoisonText, true, false);
+				else if (event.type == BattleEventType::HurtByBurn)
+					game.run_dialogue(TextResourceId::HurtByBurnText, true, false);
+				else if (event.type == BattleEventType::Healed)
+					game.run_dialogue(TextResourceId::RegainedHealthText, true, false);
+				break;
+			case BattleEventType::Missed:
+				game.run_dialogue(TextResourceId::AttackMissedText, true, false);
+				break;
+			case BattleEventType::Failed:
+				game.run_dialogue(TextResourceId::ButItFailedText, true, false);
+				break;
+			case BattleEventType::NoEffect:
+				vs.set(StringVariableId::target_name, trainers[1 - event.side]->get_party().get(core.get_active_member(1 - event.side)).get_display_name());
+				game.run_dialogue(TextResourceId::DoesntAffectMonText, true, false);
+				break;
+			case BattleEventType::CriticalHit:
+				game.run_dialogue(TextResourceId::CriticalHitText, true, false);
+				break;
+			case BattleEventType::SuperEffective:
+				game.run_dialogue(TextResourceId::SuperEffectiveText, true, false);
+				break;
+			case BattleEventType::NotVeryEffective:
+				game.run_dialogue(TextResourceId::NotVeryEffectiveText, true, false);
+				break;
+			case BattleEventType::Recoil:
+				game.run_dialogue(TextResourceId::HitWithRecoilText, true, false);
+				break;
+			case BattleEventType::StatusInflicted:
+				switch ((StatusCondition)event.value){
+					case StatusCondition::Poisoned:
+						game.run_dialogue(TextResourceId::PoisonedText, true, false);
+						break;
+					case StatusCondition::Burned:
+						game.run_dialogue(TextResourceId::BurnedText, true, false);
+						break;
+					case StatusCondition::Frozen:
+						game.run_dialogue(TextResourceId::FrozenText, true, false);
+						break;
+					case StatusCondition::Paralized:
+						game.run_dialogue(TextResourceId::ParalyzedMayNotAttackText, true, false);
+						break;
+					default:
+						game.run_dialogue(TextResourceId::FellAsleepText, true, false);
+						break;
+				}
+				break;
+			case BattleEventType::FullyParalyzed:
+				game.run_dialogue(TextResourceId::FullyParalyzedText, true, false);
+				break;
+			case BattleEventType::FastAsleep:
+				game.run_dialogue(TextResourceId::FastAsleepText, true, false);
+				break;
+			case BattleEventType::WokeUp:
+				game.run_dialogue(TextResourceId::WokeUpText, true, false);
+				break;
+			case BattleEventType::IsFrozen:
+				game.run_dialogue(TextResourceId::IsFrozenText, true, false);
+				break;
+			case BattleEventType::Flinched:
+				game.run_dialogue(TextResourceId::FlinchedText, true, false);
+				break;
+			case BattleEventType::Fainted:
+				if (event.side){
+					vs.set(StringVariableId::wEnemyMonNick, user.get_display_name());
+					game.run_dialogue(TextResourceId::EnemyMonFaintedText, true, false);
+				}else{
+					vs.set(StringVariableId::wBattleMonNick, user.get_display_name());
+					game.run_dialogue(TextResourceId::PlayerMonFaintedText, true, false);
+				}
+				break;
+			case BattleEventType::StatChanged:
+				{
+					//value = stage * 16 + delta, with delta in [-6; 6].
+					int delta = (event.value % 16 + 24) % 16 - 8;
+					int stage = (event.value - delta) / 16;
+					vs.set(StringVariableId::wcf4b_StatChangedMonName, stage >= 0 && (size_t)stage < array_length(stage_names) ? stage_names[stage] : "");
+					game.run_dialogue(delta > 0 ? TextResourceId::MonsStatsRoseText : TextResourceId::MonsStatsFellText, false, false);
+					if (delta > 1 || delta < -1)
+						game.run_dialogue(delta > 0 ? TextResourceId::GreatlyRoseText : TextResourceId::GreatlyFellText, false, false);
+					game.run_dialogue(delta > 0 ? TextResourceId::RoseText : TextResourceId::FellText, true, false);
+				}
+				break;
+			case BattleEventType::SentOut:
+				//The battle loop in coroutine_entry_point() announces send-outs itself.
+				break;
+		}
+	}
+	game.reset_dialogue_state(false);
 }
 
-void BattleOwner::display_battle_menu(Pokemon &pokemon){
+int BattleOwner::display_battle_menu(Pokemon &pokemon){
 	auto &game = *this->game;
 	auto &engine = game.get_engine();
 	auto &renderer = engine.get_renderer();
@@ -246,15 +388,18 @@ void BattleOwner::display_battle_menu(Pokemon &pokemon){
 				game.reset_joypad_state();
 				switch (selection){
 					case 0:
-						if (this->display_move_selection(pokemon))
-							return;
+						{
+							auto move = this->display_move_selection(pokemon);
+							if (move != BattleCore::no_action)
+								return move;
+						}
 						break;
 					case 1:
 						//Show pokemon selection menu.
 						break;
 					case 2:
 						if (player.display_inventory_menu())
-							return;
+							return BattleCore::no_action;
 						break;
 					case 3:
 						//Try to run away.
@@ -283,9 +428,14 @@ void BattleOwner::display_battle_menu(Pokemon &pokemon){
 
 }
 
-bool BattleOwner::display_move_selection(Pokemon &pokemon){
+int BattleOwner::display_move_selection(Pokemon &pokemon){
 	auto &game = *this->game;
 	auto &renderer = game.get_engine().get_renderer();
+	bool any_pp = false;
+	for (int i = 0; i < Pokemon::max_moves; i++)
+		any_pp |= pokemon.get_moves()[i] != MoveId::None && pokemon.get_pp(i) > 0;
+	if (!any_pp)
+		return BattleCore::struggle;
 	std::vector<std::string> moves;
 	for (auto &move : pokemon.get_moves()){
 		if (move != MoveId::None){
@@ -316,7 +466,10 @@ bool BattleOwner::display_move_selection(Pokemon &pokemon){
 		renderer.put_string({5, 3}, TileRegion::Window, number_to_decimal_string(pokemon.get_pp(move_hovered), 2).data());
 		renderer.put_string({8, 3}, TileRegion::Window, number_to_decimal_string(pokemon.get_max_pp(move_hovered), 2).data());
 	};
-	this->game->handle_standard_menu(options);
+	auto selection = this->game->handle_standard_menu(options);
+	if (selection < 0 || pokemon.get_moves()[selection] == MoveId::None || pokemon.get_pp(selection) <= 0)
+		return BattleCore::no_action;
+	return selection;
 }
 
 }
@@ -9,6 +9,7 @@ class FullTrainerClass;
 namespace CppRed{
 class Trainer;
 class Pokemon;
+class BattleCore;
 
 enum class BattleResult{
 	None,
@@ -30,9 +31,11 @@ class BattleOwner : public ScreenOwner{
 	void display_balls(Trainer &, const Point &placement, int increment, const GraphicsAsset &);
 	void display_opponent_pokemon_status(Pokemon &);
 	void display_player_pokemon_status(Pokemon &);
-	bool run_one_round(Pokemon &own, Pokemon &opponent);
-	void display_battle_menu(Pokemon &);
-	bool display_move_selection(Pokemon &);
+	bool run_one_round(BattleCore &, Trainer &player, Trainer &opponent);
+	void display_battle_events(BattleCore &, Trainer &player, Trainer &opponent);
+	//Returns a move index, BattleCore::struggle, or BattleCore::no_action.
+	int display_battle_menu(Pokemon &);
+	int display_move_selection(Pokemon &);
 public:
 	BattleOwner(Game &game, FullTrainerClass &&);
 	void pause() override{}
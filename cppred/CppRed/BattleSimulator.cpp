@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "BattleSimulator.h"
+#include "Trainer.h"
+#include "../Maps.h"
+#include "../TrainerData.h"
+#include "../HighResolutionClock.h"
+#ifndef HAVE_PCH
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <sstream>
+#endif
+
+namespace CppRed{
+
+BattleSimulator::BattleSimulator(const TrainerClassesStore &store, unsigned thread_count): pool(thread_count){
+	//Fixed seed, so that the IVs of the parties are the same on every run.
+	XorShift128 prng(get_seed(0, 0, 0));
+	for (auto &trainer_class : store.get_trainer_classes()){
+		for (size_t i = 0; i < trainer_class->get_party_count(); i++){
+			auto ftc = trainer_class->get_trainer(i);
+			if (!ftc.get_party().size())
+				continue;
+			ComputerTrainer trainer(ftc, prng);
+			Entry entry;
+			std::stringstream stream;
+			stream << trainer_class->get_name() << " #" << i + 1;
+			entry.name = stream.str();
+			entry.party = BattleParty(trainer.get_party(), ftc.get_ai_move_choice_modifiers());
+			this->entries.push_back(entry);
+		}
+	}
+}
+
+BattleSimulator::BattleSimulator(unsigned thread_count): BattleSimulator(MapStore::load_trainer_parties(), thread_count){}
+
+xorshift128_state BattleSimulator::get_seed(std::uint64_t a, std::uint64_t b, std::uint64_t c){
+	//splitmix64
+	std::uint64_t x = (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL) ^ (c * 0x165667B19E3779F9ULL);
+	xorshift128_state ret;
+	for (int i = 0; i < 4; i += 2){
+		x += 0x9E3779B97F4A7C15ULL;
+		auto z = x;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+		ret.data[i] = (std::uint32_t)z;
+		ret.data[i + 1] = (std::uint32_t)(z >> 32);
+	}
+	if (!(ret.data[0] | ret.data[1] | ret.data[2] | ret.data[3]))
+		ret.data[0] = 1;
+	return ret;
+}
+
+BattleOutcome BattleSimulator::simulate(const BattleParty &side0, const BattleParty &side1, const xorshift128_state &seed, int *turns){
+	BattleCore core(side0, side1, seed);
+	auto ret = core.run();
+	if (turns)
+		*turns = core.get_turn();
+	return ret;
+}
+
+void BattleSimulator::run(unsigned battles_per_pairing){
+	HighResolutionClock clock;
+	//Each task only updates the entry that plays as side 0, so no
+	//synchronization is needed.
+	this->pool.run(this->entries.size(), [this, battles_per_pairing](size_t i){
+		auto &entry = this->entries[i];
+		for (size_t j = 0; j < this->entries.size(); j++){
+			if (j == i)
+				continue;
+			for (unsigned k = 0; k < battles_per_pairing; k++){
+				int turns;
+				auto outcome = simulate(entry.party, this->entries[j].party, get_seed(i + 1, j + 1, entry.battles + 1), &turns);
+				entry.battles++;
+				entry.turns += turns;
+				if (outcome == BattleOutcome::Side0Victory)
+					entry.wins++;
+				else if (outcome == BattleOutcome::Side1Victory)
+					entry.losses++;
+				else
+					entry.draws++;
+			}
+		}
+		return false;
+	});
+	this->wall_time += clock.get();
+
+	this->battles_run = 0;
+	for (auto &entry : this->entries)
+		this->battles_run += entry.battles;
+}
+
+void BattleSimulator::report(std::ostream &stream) const{
+	std::vector<const Entry *> sorted;
+	for (auto &entry : this->entries)
+		sorted.push_back(&entry);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b){
+		return a->wins * (b->battles ? b->battles : 1) > b->wins * (a->battles ? a->battles : 1);
+	});
+
+	auto flags = stream.flags();
+	stream << std::fixed << std::setprecision(3)
+		<< "Parties: " << this->entries.size() << ", threads: " << this->pool.get_thread_count() << std::endl
+		<< "Battles: " << this->battles_run << " in " << this->wall_time << " s";
+	if (this->wall_time > 0)
+		stream << ", " << this->battles_run / this->wall_time << " battles/s";
+	stream << std::endl;
+	for (auto entry : sorted){
+		if (!entry->battles)
+			continue;
+		stream << std::setprecision(2)
+			<< "  " << entry->name << ": " << entry->wins * 100.0 / entry->battles << "% won ("
+			<< entry->wins << "/" << entry->losses << "/" << entry->draws << "), "
+			<< (double)entry->turns / entry->battles << " turns/battle\n";
+	}
+	stream.flags(flags);
+}
+
+}
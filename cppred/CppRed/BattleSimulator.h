@@ -0,0 +1,50 @@
+#pragma once
+#include "BattleCore.h"
+#include "../threads.h"
+#ifndef HAVE_PCH
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#endif
+
+class TrainerClassesStore;
+
+namespace CppRed{
+
+//Pits every trainer party in the game against every other one, spread over a
+//WorkStealingPool, and reports the win rate of each party. Results only
+//depend on the static data and the number of battles per pairing, not on
+//the number of threads.
+class BattleSimulator{
+public:
+	struct Entry{
+		std::string name;
+		BattleParty party;
+		std::uint64_t battles = 0;
+		std::uint64_t wins = 0;
+		std::uint64_t losses = 0;
+		std::uint64_t draws = 0;
+		std::uint64_t turns = 0;
+	};
+private:
+	std::vector<Entry> entries;
+	WorkStealingPool pool;
+	std::uint64_t battles_run = 0;
+	double wall_time = 0;
+
+	static xorshift128_state get_seed(std::uint64_t a, std::uint64_t b, std::uint64_t c);
+public:
+	BattleSimulator(const TrainerClassesStore &, unsigned thread_count);
+	//Loads the trainer parties from the static data.
+	BattleSimulator(unsigned thread_count);
+	//Each ordered pair of parties fights this many battles.
+	void run(unsigned battles_per_pairing);
+	static BattleOutcome simulate(const BattleParty &side0, const BattleParty &side1, const xorshift128_state &seed, int *turns = nullptr);
+	const std::vector<Entry> &get_entries() const{
+		return this->entries;
+	}
+	void report(std::ostream &) const;
+};
+
+}
@@ -11,6 +11,7 @@
 #include "Maps.h"
 #include "World.h"
 #include "PlayerCharacter.h"
+#include "SavableData.h"
 #include "../utility.h"
 #ifndef HAVE_PCH
 #include <cassert>
@@ -46,7 +47,10 @@ void entry_point(Game &game){
 #else
 	if (false){
 #endif
-		//Continue game.
+		auto save = game.load_save();
+		save->restore(game);
+		game.game_loop();
+		assert(false);
 	}else{
 		auto names = oak_speech(game);
 		game.create_main_characters(names.player_name, names.rival_name);
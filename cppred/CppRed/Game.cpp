@@ -15,6 +15,7 @@
 #include "PokedexPageDisplay.h"
 #include "CoroutineExecuter.h"
 #include "BattleOwner.h"
+#include "SavableData.h"
 #ifndef HAVE_PCH
 #include <iostream>
 #include <sstream>
@@ -44,11 +45,12 @@ const FadePaletteData fade_palettes[8] = {
 	/* 7 */ { BITMAP(00000000), BITMAP(00000000), BITMAP(00000000) },
 };
 
-Game::Game(Engine &engine, PokemonVersion version, CppRed::AudioProgramInterface &program):
+Game::Game(Engine &engine, PokemonVersion version, CppRed::AudioProgramInterface &program, TextStore &&text_store, MapStore &&map_store):
 		engine(&engine),
 		version(version),
+		text_store(std::move(text_store)),
 		audio_interface(program){
-	this->world.reset(new World(*this));
+	this->world.reset(new World(*this, std::move(map_store)));
 	this->coroutine.reset(new Coroutine("Game coroutine", this->engine->get_stepping_clock(), [this](Coroutine &){ Scripts::entry_point(*this); }));
 	this->coroutine->set_on_yield([this](){ this->update_joypad_state(); });
 	this->reset_dialogue_state();
@@ -183,8 +185,11 @@ void Game::wait_for_sound_to_finish(){
 }
 
 Game::load_save_t Game::load_save(){
-	//TODO
-	return nullptr;
+	return SavableData::load(SavableData::default_path);
+}
+
+void Game::save_game(){
+	SavableData::capture(*this)->save(SavableData::default_path);
 }
 
 void Game::draw_box(const Point &corner, const Point &size, TileRegion region){
@@ -431,43 +436,189 @@ void Game::text_print_delay(){
 	Coroutine::get_current_coroutine().wait_frames((int)this->options.text_speed);
 }
 
+const size_t VariableStore::string_count = string_variable_id_count;
+const size_t VariableStore::integer_count = integer_variable_id_count;
+//Event and visibility flag IDs start at 1.
+const size_t VariableStore::event_count = event_id_count - 1;
+const size_t VariableStore::visibility_flag_count = visibility_flag_id_count - 1;
+
+static size_t count_blocks(size_t n){
+	return (n + VariableStore::block_size - 1) / VariableStore::block_size;
+}
+
+VariableStore::VariableStore():
+		strings(string_count),
+		integers(integer_count),
+		events(count_blocks(event_count)),
+		vibility_flags(count_blocks(visibility_flag_count)){
+	this->changed_blocks[(int)VariableType::String].resize(count_blocks(count_blocks(string_count)));
+	this->changed_blocks[(int)VariableType::Integer].resize(count_blocks(count_blocks(integer_count)));
+	this->changed_blocks[(int)VariableType::Event].resize(count_blocks(count_blocks(event_count)));
+	this->changed_blocks[(int)VariableType::VisibilityFlag].resize(count_blocks(count_blocks(visibility_flag_count)));
+}
+
+void VariableStore::SmallString::set(const std::string &s){
+	this->overflowed = s.size() > small_string_capacity;
+	if (this->overflowed){
+		this->overflow = s;
+		return;
+	}
+	memcpy(this->data, s.c_str(), s.size() + 1);
+}
+
+void VariableStore::record_change(VariableType type, size_t index, std::uint32_t id){
+	set_bit(this->changed_blocks[(int)type], index / block_size, true);
+	if (this->journal_enabled)
+		this->journal.push_back({ type, id });
+}
+
 void VariableStore::set(StringVariableId id, const std::string &val){
-	set_vector<0>(this->strings, id, val);
+	auto index = check_index((size_t)id, string_count);
+	this->strings[index].set(val);
+	this->record_change(VariableType::String, index, (std::uint32_t)id);
 }
 
 void VariableStore::set(IntegerVariableId id, int val){
-	set_vector<0>(this->integers, id, val);
+	auto index = check_index((size_t)id, integer_count);
+	this->integers[index] = val;
+	this->record_change(VariableType::Integer, index, (std::uint32_t)id);
 }
 
 void VariableStore::set(EventId id, bool val){
-	set_vector<1>(this->events, id, val);
+	auto index = check_index((size_t)id - 1, event_count);
+	set_bit(this->events, index, val);
+	this->record_change(VariableType::Event, index, (std::uint32_t)id);
 }
 
 void VariableStore::set(VisibilityFlagId id, bool val){
-	set_vector<1>(this->vibility_flags, id, val);
+	auto index = check_index((size_t)id - 1, visibility_flag_count);
+	set_bit(this->vibility_flags, index, val);
+	this->record_change(VariableType::VisibilityFlag, index, (std::uint32_t)id);
 }
 
-const std::string &VariableStore::get(StringVariableId id){
-	return get_vector<0>(this->strings, id);
+const char *VariableStore::get(StringVariableId id) const{
+	return this->strings[check_index((size_t)id, string_count)].c_str();
 }
 
-int VariableStore::get(IntegerVariableId id){
-	return get_vector<0>(this->integers, id);
+int VariableStore::get(IntegerVariableId id) const{
+	return this->integers[check_index((size_t)id, integer_count)];
 }
 
-bool VariableStore::get(EventId id){
-	return get_vector<1>(this->events, id);
+bool VariableStore::get(EventId id) const{
+	return get_bit(this->events, check_index((size_t)id - 1, event_count));
 }
 
-bool VariableStore::get(VisibilityFlagId id){
-	return get_vector<1>(this->vibility_flags, id);
+bool VariableStore::get(VisibilityFlagId id) const{
+	return get_bit(this->vibility_flags, check_index((size_t)id - 1, visibility_flag_count));
 }
 
 void VariableStore::load_initial_visibility_flags(){
-	this->vibility_flags.resize(default_sprite_vibisilities_size * 8);
-	for (size_t i = 0; i < default_sprite_vibisilities_size; i++)
-		for (int j = 0; j < 8; j++)
-			this->vibility_flags[i * 8 + j] = !!(default_sprite_vibisilities[i] & (1 << j));
+	std::fill(this->vibility_flags.begin(), this->vibility_flags.end(), 0);
+	auto n = std::min(default_sprite_vibisilities_size * 8, visibility_flag_count);
+	for (size_t i = 0; i < n; i++)
+		set_bit(this->vibility_flags, i, !!(default_sprite_vibisilities[i / 8] & (1 << (i % 8))));
+	auto &changed = this->changed_blocks[(int)VariableType::VisibilityFlag];
+	for (size_t i = count_blocks(visibility_flag_count); i--;)
+		set_bit(changed, i, true);
+}
+
+//Serialized format, for each variable type:
+//    varint size, varint block count, blocks.
+//Block:
+//    varint index, then the block's elements. Booleans are packed eight to
+//    a byte.
+void VariableStore::serialize(BufferWriter &writer, bool only_changed) const{
+	auto write_blocks = [this, &writer, only_changed](VariableType type, size_t size, const auto &write_block){
+		auto &changed = this->changed_blocks[(int)type];
+		auto blocks = count_blocks(size);
+		size_t count = 0;
+		for (size_t i = 0; i < blocks; i++)
+			count += !only_changed || get_bit(changed, i);
+		writer.write_varint((std::uint32_t)size);
+		writer.write_varint((std::uint32_t)count);
+		for (size_t i = 0; i < blocks; i++){
+			if (only_changed && !get_bit(changed, i))
+				continue;
+			writer.write_varint((std::uint32_t)i);
+			write_block(i, std::min((i + 1) * block_size, size));
+		}
+	};
+	auto write_bits = [&writer](const std::vector<block_t> &v){
+		return [&writer, &v](size_t block, size_t end){
+			for (auto i = block * block_size; i < end; i += 8)
+				writer.write_byte((byte_t)(v[block] >> (i % block_size)));
+		};
+	};
+
+	write_blocks(VariableType::String, string_count, [this, &writer](size_t block, size_t end){
+		for (auto i = block * block_size; i < end; i++){
+			auto s = this->strings[i].c_str();
+			writer.write_raw(s, strlen(s) + 1);
+		}
+	});
+	write_blocks(VariableType::Integer, integer_count, [this, &writer](size_t block, size_t end){
+		for (auto i = block * block_size; i < end; i++)
+			writer.write_signed_varint(this->integers[i]);
+	});
+	write_blocks(VariableType::Event, event_count, write_bits(this->events));
+	write_blocks(VariableType::VisibilityFlag, visibility_flag_count, write_bits(this->vibility_flags));
+}
+
+void VariableStore::deserialize(BufferReader &reader, bool patch){
+	if (!patch){
+		for (auto &s : this->strings)
+			s.set(std::string());
+		std::fill(this->integers.begin(), this->integers.end(), 0);
+		std::fill(this->events.begin(), this->events.end(), 0);
+		std::fill(this->vibility_flags.begin(), this->vibility_flags.end(), 0);
+	}
+	//Elements past the end of the store were written by a build with more
+	//variables. They're read and discarded.
+	auto read_blocks = [&reader](const auto &read_block){
+		size_t size = reader.read_varint();
+		auto count = reader.read_varint();
+		while (count--){
+			size_t block = reader.read_varint();
+			read_block(block, std::min((block + 1) * block_size, size));
+		}
+	};
+	auto read_bits = [&reader](std::vector<block_t> &v, size_t capacity){
+		return [&reader, &v, capacity](size_t block, size_t end){
+			for (auto i = block * block_size; i < end; i += 8){
+				auto byte = reader.read_byte();
+				for (auto j = i; j < std::min(i + 8, std::min(end, capacity)); j++)
+					set_bit(v, j, !!(byte & (1 << (j % 8))));
+			}
+		};
+	};
+
+	read_blocks([this, &reader](size_t block, size_t end){
+		for (auto i = block * block_size; i < end; i++){
+			auto s = reader.read_string();
+			if (i < string_count)
+				this->strings[i].set(s);
+		}
+	});
+	read_blocks([this, &reader](size_t block, size_t end){
+		for (auto i = block * block_size; i < end; i++){
+			auto n = reader.read_signed_varint();
+			if (i < integer_count)
+				this->integers[i] = n;
+		}
+	});
+	read_blocks(read_bits(this->events, event_count));
+	read_blocks(read_bits(this->vibility_flags, visibility_flag_count));
+}
+
+void VariableStore::clear_changes(){
+	for (auto &v : this->changed_blocks)
+		std::fill(v.begin(), v.end(), 0);
+}
+
+void VariableStore::set_journal_enabled(bool enabled){
+	this->journal_enabled = enabled;
+	if (enabled)
+		this->journal.reserve(1024);
 }
 
 std::string Game::get_name_from_user(NameEntryType type, SpeciesId species, int max_length_){
@@ -718,9 +869,9 @@ void Game::teleport_player(const WorldCoordinates &wc){
 	this->world->teleport_player(wc);
 }
 
-void Game::execute(const char *script_name, Actor &caller, const char *parameter){
+void Game::execute(ScriptId script, Actor &caller, const char *parameter){
 	Scripts::script_parameters params;
-	params.script_name = script_name;
+	params.script = script;
 	params.game = this;
 	params.caller = &caller;
 	params.parameter = parameter;
@@ -2,7 +2,7 @@
 #include "Engine.h"
 #include "utility.h"
 #include "Data.h"
-#include "SavableData.h"
+#include "MiscClasses.h"
 #include "TextResources.h"
 #include "pokemon_version.h"
 #include "AudioInterface.h"
@@ -14,6 +14,7 @@
 #endif
 
 struct MapData;
+class MapStore;
 class Coroutine;
 
 namespace CppRed{
@@ -23,6 +24,7 @@ const int max_character_name_size = 7;
 
 class Trainer;
 class NpcTrainer;
+class SavableData;
 class PlayerCharacter;
 class World;
 enum class EventId;
@@ -30,43 +32,96 @@ enum class VisibilityFlagId;
 enum class IntegerVariableId;
 enum class StringVariableId;
 enum class BattleResult;
+enum class ScriptId;
 
 class VariableStore{
-	std::vector<std::string> strings;
+public:
+	//Granularity of change tracking for incremental snapshots. Also the size
+	//of the words that hold events and visibility flags.
+	static const size_t block_size = 64;
+	//Longer strings are stored on the heap.
+	static const size_t small_string_capacity = 23;
+	enum class VariableType{
+		String = 0,
+		Integer,
+		Event,
+		VisibilityFlag,
+		Count,
+	};
+	struct Change{
+		VariableType type;
+		std::uint32_t id;
+	};
+	//Sized from the generated variable counts.
+	static const size_t string_count;
+	static const size_t integer_count;
+	static const size_t event_count;
+	static const size_t visibility_flag_count;
+private:
+	typedef std::uint64_t block_t;
+	class SmallString{
+		char data[small_string_capacity + 1];
+		std::string overflow;
+		bool overflowed = false;
+	public:
+		SmallString(){
+			this->data[0] = 0;
+		}
+		void set(const std::string &);
+		const char *c_str() const{
+			return this->overflowed ? this->overflow.c_str() : this->data;
+		}
+	};
+	std::vector<SmallString> strings;
 	std::vector<int> integers;
-	std::vector<bool> events;
-	std::vector<bool> vibility_flags;
-	template <int Offset, typename T1, typename T2>
-	static void set_vector(std::vector<T1> &v, T2 s, const T1 &value){
-		size_t k = (size_t)s - Offset;
-		if (v.size() < k + 1)
-			v.resize(k + 1);
-		v[k] = value;
-	}
-	template <int Offset, typename T1, typename T2>
-	static const T1 &get_vector(std::vector<T1> &v, T2 s){
-		size_t k = (size_t)s - Offset;
-		if (v.size() < k + 1)
-			v.resize(k + 1);
-		return v[k];
-	}
-	template <int Offset, typename T2>
-	static bool get_vector(std::vector<bool> &v, T2 s){
-		size_t k = (size_t)s - Offset;
-		if (v.size() < k + 1)
-			v.resize(k + 1);
-		return v[k];
+	std::vector<block_t> events;
+	std::vector<block_t> vibility_flags;
+	//One bit per block of each type, set when the block changes.
+	std::vector<block_t> changed_blocks[(int)VariableType::Count];
+	bool journal_enabled = false;
+	std::vector<Change> journal;
+
+	static size_t check_index(size_t index, size_t count){
+		if (index >= count)
+			throw std::runtime_error("VariableStore: Invalid variable ID.");
+		return index;
+	}
+	static bool get_bit(const std::vector<block_t> &v, size_t index){
+		return !!(v[index / block_size] & ((block_t)1 << (index % block_size)));
 	}
+	static void set_bit(std::vector<block_t> &v, size_t index, bool value){
+		auto &block = v[index / block_size];
+		auto mask = (block_t)1 << (index % block_size);
+		block = value ? block | mask : block & ~mask;
+	}
+	void record_change(VariableType, size_t index, std::uint32_t id);
 public:
+	VariableStore();
 	void set(StringVariableId, const std::string &);
 	void set(IntegerVariableId, int);
 	void set(EventId, bool);
 	void set(VisibilityFlagId, bool);
-	const std::string &get(StringVariableId);
-	int get(IntegerVariableId);
-	bool get(EventId);
-	bool get(VisibilityFlagId);
+	//None of the getters allocate.
+	const char *get(StringVariableId) const;
+	int get(IntegerVariableId) const;
+	bool get(EventId) const;
+	bool get(VisibilityFlagId) const;
 	void load_initial_visibility_flags();
+	//If only_changed, writes only the blocks that changed since the last
+	//call to clear_changes().
+	void serialize(BufferWriter &, bool only_changed) const;
+	//If !patch, the store is cleared before the blocks are read.
+	void deserialize(BufferReader &, bool patch);
+	void clear_changes();
+	//While enabled, every set() appends an entry to the journal, so that an
+	//observer can follow changes without polling the variables.
+	void set_journal_enabled(bool);
+	const std::vector<Change> &get_journal() const{
+		return this->journal;
+	}
+	void clear_journal(){
+		this->journal.clear();
+	}
 };
 
 class Game;
@@ -174,7 +229,9 @@ class Game{
 	ScreenOwner *get_current_owner();
 	std::array<std::shared_ptr<Sprite>, 2> load_mon_sprites(SpeciesId species);
 public:
-	Game(Engine &engine, PokemonVersion version, CppRed::AudioProgramInterface &program);
+	//The stores are built ahead of time, so that the engine can decode them
+	//concurrently.
+	Game(Engine &engine, PokemonVersion version, CppRed::AudioProgramInterface &program, TextStore &&, MapStore &&);
 	Game(Game &&) = delete;
 	Game(const Game &) = delete;
 	void operator=(Game &&) = delete;
@@ -198,8 +255,9 @@ public:
 	InputState joypad_only_newly_pressed();
 	void wait_for_sound_to_finish();
 	bool run_yes_no_menu(const Point &point);
-	typedef decltype(SavableData::load("")) load_save_t;
+	typedef std::shared_ptr<SavableData> load_save_t;
 	load_save_t load_save();
+	void save_game();
 	void draw_box(const Point &corner, const Point &size, TileRegion);
 	int handle_standard_menu(StandardMenuOptions &);
 	bool handle_standard_menu(StandardMenuOptions &, const std::vector<std::function<void()>> &callbacks);
@@ -229,7 +287,7 @@ public:
 	World &get_world(){
 		return *this->world;
 	}
-	void execute(const char *script_name, Actor &caller, const char *parameter = nullptr);
+	void execute(ScriptId script, Actor &caller, const char *parameter = nullptr);
 	Coroutine &get_coroutine(){
 		return *this->coroutine;
 	}
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "MainMenu.h"
 #include "Game.h"
+#include "SavableData.h"
 #include "MiscClasses.h"
 #include "Engine.h"
 #include "Renderer.h"
@@ -202,7 +202,7 @@ void PlayerCharacter::check_for_bookshelf_or_card_key_door(){
 	if (!info)
 		return;
 	if (info->is_script)
-		this->game->execute(info->script_name.c_str(), *this);
+		this->game->execute(info->script, *this);
 	else
 		this->game->run_dialogue(info->text_id, true, true);
 }
@@ -394,7 +394,17 @@ void PlayerCharacter::display_inventory_menu(Inventory &inventory, const std::fu
 
 void PlayerCharacter::display_player_menu(){}
 
-void PlayerCharacter::display_save_dialog(){}
+void PlayerCharacter::display_save_dialog(){
+	auto &game = *this->game;
+	AutoRendererWindowPusher pusher(game.get_engine().get_renderer());
+	game.run_dialogue(TextResourceId::WouldYouLikeToSaveText, false, false);
+	if (game.run_yes_no_menu(standard_dialogue_yes_no_position)){
+		game.save_game();
+		game.get_audio_interface().play_sound(AudioResourceId::SFX_Save);
+		game.run_dialogue(TextResourceId::GameSavedText, true, false);
+	}
+	game.reset_dialogue_state();
+}
 
 void Pokedex::set(FixedBitmap<pokemon_by_pokedex_id_size> &v, int &c, SpeciesId s){
 	auto &data = *pokemon_by_species_id[(int)s];
@@ -415,6 +425,22 @@ bool Pokedex::get(const FixedBitmap<pokemon_by_pokedex_id_size> &v, SpeciesId s)
 	return v.get(index);
 }
 
+void Pokedex::get_data(bitmap_t &seen, bitmap_t &owned) const{
+	this->seen.get_data(seen);
+	this->owned.get_data(owned);
+}
+
+void Pokedex::set_data(const bitmap_t &seen, const bitmap_t &owned){
+	this->seen.set_data(seen);
+	this->owned.set_data(owned);
+	this->seen_count = 0;
+	this->owned_count = 0;
+	for (size_t i = 0; i < pokemon_by_pokedex_id_size; i++){
+		this->seen_count += this->seen.get(i);
+		this->owned_count += this->owned.get(i);
+	}
+}
+
 void PlayerCharacter::open_pc(bool opened_at_home){
 	this->game->run_dialogue(TextResourceId::WhatDoYouWantText, false, false);
 	StandardMenuOptions options;
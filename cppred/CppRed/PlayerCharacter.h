@@ -39,6 +39,9 @@ public:
 	}
 	DEFINE_GETTER(seen_count)
 	DEFINE_GETTER(owned_count)
+	typedef byte_t bitmap_t[FixedBitmap<pokemon_by_pokedex_id_size>::size];
+	void get_data(bitmap_t &seen, bitmap_t &owned) const;
+	void set_data(const bitmap_t &seen, const bitmap_t &owned);
 };
 
 class PlayerCharacter : public Actor, public Trainer{
@@ -5,7 +5,7 @@
 #include "../Renderer.h"
 #ifndef HAVE_PCH
 #include <sstream>
-#include <cmath>
+#include <algorithm>
 #endif
 
 namespace CppRed{
@@ -35,28 +35,44 @@ void Party::heal(){
 		member.heal();
 }
 
+void Party::recompute_stats(){
+	if (this->members.size())
+		Pokemon::recompute_stats(&this->members[0], this->members.size());
+}
+
+int Pokemon::compute_stat(PokemonStats::StatId which, bool ignore_xp) const{
+	int base_stat = species_base_stats[(int)this->species][(int)which];
+	int bonus = 0;
+	if (!ignore_xp)
+		bonus = (int)ceil_sqrt((std::uint32_t)std::max(this->stat_experience.get_stat(which), 0));
+	int iv = this->get_iv(which);
+	int ret = ((base_stat + iv) * 2 + bonus / 4) * this->level / 100;
+	if (which == PokemonStats::StatId::Hp)
+		ret += this->level + 10;
+	else
+		ret += 5;
+	return ret;
+}
+
 int Pokemon::get_stat(PokemonStats::StatId which, bool ignore_xp){
+	if (ignore_xp)
+		return this->compute_stat(which, true);
 	auto &stat = this->computed_stats.get_stat(which);
-	int ret;
-	if (stat < 0){
-		auto &pokemon = *pokemon_by_species_id[(int)this->species];
-		int base_stat = pokemon.base_stats.get_stat(which);
-		int bonus = 0;
-		if (!ignore_xp){
-			int stat_xp = this->stat_experience.get_stat(which);
-			bonus = (int)ceil(sqrt(stat_xp));
-		}
-		int iv = this->get_iv(which);
-		ret = ((base_stat + iv) * 2 + bonus / 4) * this->level / 100;
-		if (which == PokemonStats::StatId::Hp)
-			ret += this->level + 10;
-		else
-			ret += 5;
-		if (!ignore_xp)
-			stat = ret;
-	}else
-		ret = stat;
-	return ret;
+	if (stat < 0)
+		stat = this->compute_stat(which, false);
+	return stat;
+}
+
+void Pokemon::recompute_stats(){
+	for (int i = 0; i < 5; i++){
+		auto which = (PokemonStats::StatId)i;
+		this->computed_stats.get_stat(which) = this->compute_stat(which, false);
+	}
+}
+
+void Pokemon::recompute_stats(Pokemon *pokemon, size_t count){
+	for (size_t i = 0; i < count; i++)
+		pokemon[i].recompute_stats();
 }
 
 /*
@@ -106,83 +122,38 @@ Pokemon::Pokemon(SpeciesId species, int level, const Trainer &ot, XorShift128 &r
 	int i = 0;
 	for (auto move : pokemon.get_initial_moves()){
 		this->moves[i] = move;
-		auto move_data = pokemon_moves_by_id[(int)move];
-		this->pp[i] = move_data ? move_data->pp : 0;
+		this->pp[i] = pokemon_moves_pp[(int)move];
 		i++;
 	}
 	this->original_trainer_id = ot.get_trainer_id();
 	this->original_trainer_name = ot.get_name();
 	this->status = StatusCondition::Normal;
 	rng.generate(this->individual_values);
-	this->current_hp = this->get_max_hp();
-	this->experience = this->calculate_min_xp_to_reach_level(this->species, this->level);
 	if (!input_stats.null())
 		this->computed_stats = input_stats;
 	else
-		this->computed_stats.set_all(-1);
+		this->recompute_stats();
+	this->current_hp = this->get_max_hp();
+	this->experience = this->calculate_min_xp_to_reach_level(this->species, this->level);
 }
 
-struct GrowthPolynomial{
-	int a;
-	int b;
-	int c;
-	int d;
-	int e;
-	int compute(int x) const{
-		return x * x * x * a / b + x * x * c + x * d + e;
-	}
-};
-
-static const GrowthPolynomial polynomials[] = {
-	{ 1, 1,   0,   0,    0 },
-	{ 3, 4,  10,   0,  -30 },
-	{ 3, 4,  20,   0,  -70 },
-	{ 6, 5, -15, 100, -140 },
-	{ 4, 5,   0,   0,    0 },
-	{ 5, 4,   0,   0,    0 },
-};
-
-static void check_rate(const BasePokemonInfo &data){
-	auto growth_rate = data.growth_rate;
-	if (growth_rate < 0 || growth_rate >= array_length(polynomials)){
-		std::stringstream stream;
-		stream << "Internal error: species " << data.internal_name << " has invalid growth rate of " << (int)growth_rate;
-		throw std::runtime_error(stream.str());
-	}
+static const std::int32_t *get_experience_table(SpeciesId species){
+	return experience_by_growth_rate[species_growth_rates[(int)species]];
 }
 
 int Pokemon::calculate_min_xp_to_reach_level(SpeciesId species, int level){
-	auto &data = *pokemon_by_species_id[(int)species];
-	auto growth_rate = data.growth_rate;
-	check_rate(data);
-	return polynomials[growth_rate].compute(level);
+	if (level < 0 || level > max_pokemon_level){
+		std::stringstream stream;
+		stream << "Internal error: invalid level " << level;
+		throw std::runtime_error(stream.str());
+	}
+	return get_experience_table(species)[level];
 }
 
 int Pokemon::calculate_level_at_xp(SpeciesId species, int xp){
-	auto &data = *pokemon_by_species_id[(int)species];
-	auto growth_rate = data.growth_rate;
-	check_rate(data);
-	auto &poly = polynomials[growth_rate];
-	int lo = 1,
-		hi = 100;
-	if (xp <= poly.compute(lo))
-		return lo;
-	if (xp >= poly.compute(hi))
-		return hi;
-	hi++;
-	int d = hi - lo;
-	while (d > 1){
-		auto pivot = lo + d / 2;
-		auto y = poly.compute(pivot);
-		if (xp > y)
-			lo = pivot;
-		else if (xp < y)
-			hi = pivot;
-		else
-			return pivot;
-		d = hi - lo;
-	}
-	return lo;
+	auto table = get_experience_table(species);
+	auto level = (int)(std::upper_bound(table + 1, table + max_pokemon_level + 1, xp) - table) - 1;
+	return std::max(level, 1);
 }
 
 void Pokemon::heal(){
@@ -357,6 +328,6 @@ int Pokemon::get_pp(int move_index){
 
 int Pokemon::get_max_pp(int move_index){
 	//TODO: PP can be upgraded by items.
-	return pokemon_moves_by_id[(int)this->moves[move_index]]->pp;
+	return pokemon_moves_pp[(int)this->moves[move_index]];
 }
 }
@@ -18,7 +18,12 @@ enum class StatsScreenResult{
 	GoToPrevious,
 };
 
+class SavableData;
+class BattleParty;
+
 class Pokemon{
+	friend class SavableData;
+	friend class BattleParty;
 public:
 	static const int max_moves = 4;
 private:
@@ -37,6 +42,7 @@ private:
 	int pp[max_moves];
 	
 	int get_iv(PokemonStats::StatId) const;
+	int compute_stat(PokemonStats::StatId, bool ignore_xp) const;
 	int get_stat(PokemonStats::StatId, bool ignore_xp);
 	void render_common_data(Renderer &, const GraphicsAsset &layout);
 	void render_page1(Renderer &);
@@ -58,6 +64,10 @@ public:
 	int get_stat(PokemonStats::StatId stat){
 		return this->get_stat(stat, false);
 	}
+	//Recomputes and caches all stats from the current level, IVs and stat
+	//experience. Must be called after any of them changes.
+	void recompute_stats();
+	static void recompute_stats(Pokemon *, size_t count);
 	static int calculate_min_xp_to_reach_level(SpeciesId species, int level);
 	int calculate_min_xp_to_reach_level(int level){
 		return calculate_min_xp_to_reach_level(this->species, level);
@@ -97,6 +107,7 @@ public:
 	bool add_pokemon(const Pokemon &);
 	Pokemon &get_last_added_pokemon();
 	void heal();
+	void recompute_stats();
 	int size() const{
 		return (int)this->members.size();
 	}
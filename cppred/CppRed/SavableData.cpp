@@ -1,11 +1,749 @@
 #include "stdafx.h"
 #include "SavableData.h"
+#include "World.h"
+#include "../Maps.h"
+#include "../../CodeGeneration/output/variables.h"
+#ifndef HAVE_PCH
+#include <fstream>
+#include <cstring>
+#endif
 
 namespace CppRed{
 
+const char * const SavableData::default_path = "cppred.sav";
+
+//Native format:
+//    magic, u32 version, byte flags, then any number of sections.
+//Section:
+//    byte id, u32 length, payload.
+//Unknown sections are skipped, so new sections can be added without bumping
+//the version.
+static const byte_t native_magic[] = { 'C', 'R', 'S', 'V', };
+static const byte_t flag_incremental = 1 << 0;
+
+enum class SectionId{
+	Player = 1,
+	Position,
+	Party,
+	Items,
+	Pokedex,
+	Variables,
+	Objects,
+};
+
+//Bank 1 of the SRAM of the original game.
+static const size_t sram_size = 0x8000;
+static const size_t sram_player_name = 0x2598;
+static const size_t sram_pokedex_owned = 0x25A3;
+static const size_t sram_pokedex_seen = 0x25B6;
+static const size_t sram_bag_items = 0x25C9;
+static const size_t sram_money = 0x25F3;
+static const size_t sram_rival_name = 0x25F6;
+static const size_t sram_options = 0x2601;
+static const size_t sram_player_id = 0x2605;
+static const size_t sram_current_map = 0x260A;
+static const size_t sram_y_coordinate = 0x260D;
+static const size_t sram_x_coordinate = 0x260E;
+static const size_t sram_pc_items = 0x27E6;
+static const size_t sram_coins = 0x2850;
+static const size_t sram_missable_objects = 0x2852;
+static const size_t sram_event_flags = 0x29F3;
+static const size_t sram_player_facing_direction = 0x2D2C + 9;
+static const size_t sram_party = 0x2F2C;
+static const size_t sram_checksum = 0x3523;
+static const size_t sram_name_size = 11;
+static const size_t sram_party_struct_size = 44;
+static const size_t sram_bag_capacity = 20;
+static const size_t sram_pc_capacity = 50;
+static const size_t sram_missable_object_count = 256;
+static const size_t sram_event_flag_count = 2560;
+static const byte_t sram_string_terminator = 0x50;
+
+static_assert(sizeof(Pokedex::bitmap_t) == sram_pokedex_seen - sram_pokedex_owned, "The Pokedex bitmaps don't match the SRAM layout.");
+
+static size_t begin_section(BufferWriter &writer, SectionId id){
+	writer.write_byte((byte_t)id);
+	auto ret = writer.size();
+	writer.write_u32(0);
+	return ret;
+}
+
+static void end_section(BufferWriter &writer, size_t offset){
+	writer.overwrite_u32(offset, (std::uint32_t)(writer.size() - offset - 4));
+}
+
+static void write_stats(BufferWriter &writer, const PokemonStats &stats){
+	writer.write_signed_varint(stats.hp);
+	writer.write_signed_varint(stats.attack);
+	writer.write_signed_varint(stats.defense);
+	writer.write_signed_varint(stats.speed);
+	writer.write_signed_varint(stats.special);
+}
+
+static PokemonStats read_stats(BufferReader &reader){
+	PokemonStats ret;
+	ret.hp = reader.read_signed_varint();
+	ret.attack = reader.read_signed_varint();
+	ret.defense = reader.read_signed_varint();
+	ret.speed = reader.read_signed_varint();
+	ret.special = reader.read_signed_varint();
+	return ret;
+}
+
+static void write_items(BufferWriter &writer, const std::vector<InventorySpace> &items){
+	writer.write_varint((std::uint32_t)items.size());
+	for (auto &item : items){
+		writer.write_varint((std::uint32_t)item.item);
+		writer.write_varint((std::uint32_t)item.quantity);
+	}
+}
+
+//Every element takes at least min_element_size bytes, so a count that needs
+//more than what's left can only come from a corrupt file, and is rejected
+//before anything is allocated for it.
+static size_t read_count(BufferReader &reader, size_t min_element_size){
+	size_t ret = reader.read_varint();
+	if (ret > reader.remaining_bytes() / min_element_size)
+		throw std::runtime_error("SavableData: Invalid element count.");
+	return ret;
+}
+
+static void read_items(BufferReader &reader, std::vector<InventorySpace> &items){
+	//Two varints.
+	items.resize(read_count(reader, 2));
+	for (auto &item : items){
+		item.item = (ItemId)reader.read_varint();
+		item.quantity = (int)reader.read_varint();
+	}
+}
+
+static SpeciesId check_species(std::uint32_t species){
+	if (!species || species >= pokemon_by_species_id_size || !pokemon_by_species_id[species])
+		throw std::runtime_error("SavableData: Invalid species.");
+	return (SpeciesId)species;
+}
+
+std::shared_ptr<SavableData> SavableData::capture(Game &game){
+	std::shared_ptr<SavableData> ret(new SavableData);
+	auto &world = game.get_world();
+	auto &pc = world.get_pc();
+	ret->valid = true;
+	ret->player_name = pc.get_name();
+	ret->rival_name = world.get_rival_name();
+	ret->options = game.get_options();
+	ret->trainer_id = pc.get_trainer_id();
+	ret->position = { pc.get_current_map(), pc.get_map_position() };
+	ret->legacy_map = world.get_map_store().get_map_data(ret->position.map).legacy_id;
+	ret->facing_direction = pc.get_facing_direction();
+	for (auto &pokemon : pc.get_party().iterate())
+		ret->party.push_back(pokemon);
+	for (auto &item : pc.get_inventory().iterate_items())
+		ret->inventory.push_back(item);
+	for (auto &item : pc.get_pc_inventory().iterate_items())
+		ret->pc_inventory.push_back(item);
+	pc.get_pokedex().get_data(ret->pokedex_seen, ret->pokedex_owned);
+	auto &variables = game.get_variable_store();
+	ret->variables = variables;
+	variables.clear_changes();
+	for (auto &instance : world.get_map_store().get_map_instances()){
+		if (!instance)
+			continue;
+		std::uint32_t index = 0;
+		for (auto &object : instance->get_objects())
+			ret->objects.push_back({ instance->get_map(), index++, object.get_position() });
+	}
+	return ret;
+}
+
+void SavableData::restore(Game &game) const{
+	if (!this->valid)
+		throw std::runtime_error("SavableData::restore(): Attempted to restore an invalid save.");
+	game.set_options(this->options);
+	game.set_options_initialized(true);
+	game.create_main_characters(this->player_name, this->rival_name);
+	auto &variables = game.get_variable_store();
+	variables = this->variables;
+	variables.clear_changes();
+
+	auto &world = game.get_world();
+	auto &map_store = world.get_map_store();
+	auto &pc = world.get_pc();
+	pc.set_trainer_id(this->trainer_id);
+	Party party;
+	for (auto &pokemon : this->party)
+		party.add_pokemon(pokemon);
+	pc.get_party() = party;
+	for (auto &item : this->inventory)
+		pc.get_inventory().receive(item.item, item.quantity);
+	for (auto &item : this->pc_inventory)
+		pc.get_pc_inventory().receive(item.item, item.quantity);
+	pc.get_pokedex().set_data(this->pokedex_seen, this->pokedex_owned);
+
+	//Object positions must be in place before the player enters the map, since
+	//that's when the actors are created.
+	for (auto &state : this->objects){
+		auto objects = world.get_map_instance(state.map).get_objects();
+		if (state.index >= (size_t)(objects.end() - objects.begin()))
+			continue;
+		objects.begin()[state.index].set_position(state.position);
+	}
+
+	auto position = this->position;
+	if (position.map == Map::Nowhere){
+		auto data = map_store.try_get_map_by_legacy_id(this->legacy_map);
+		if (!data)
+			throw std::runtime_error("SavableData::restore(): Invalid map.");
+		position.map = data->map_id;
+	}
+	pc.set_facing_direction(this->facing_direction);
+	game.teleport_player(position);
+}
+
+void SavableData::serialize(std::vector<byte_t> &dst, bool incremental) const{
+	dst.clear();
+	BufferWriter writer(dst);
+	writer.write_raw(native_magic, sizeof(native_magic));
+	writer.write_u32(format_version);
+	writer.write_byte(incremental ? flag_incremental : 0);
+
+	auto section = begin_section(writer, SectionId::Player);
+	writer.write_string(this->player_name);
+	writer.write_string(this->rival_name);
+	writer.write_byte(this->options.battle_animations_enabled);
+	writer.write_varint((std::uint32_t)this->options.battle_style);
+	writer.write_varint((std::uint32_t)this->options.text_speed);
+	writer.write_varint(this->trainer_id);
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Position);
+	writer.write_varint((std::uint32_t)this->position.map);
+	writer.write_signed_varint(this->legacy_map);
+	writer.write_signed_varint(this->position.position.x);
+	writer.write_signed_varint(this->position.position.y);
+	writer.write_byte((byte_t)this->facing_direction);
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Party);
+	writer.write_varint((std::uint32_t)this->party.size());
+	for (auto &pokemon : this->party){
+		writer.write_varint((std::uint32_t)pokemon.species);
+		writer.write_string(pokemon.nickname);
+		writer.write_signed_varint(pokemon.current_hp);
+		writer.write_varint(pokemon.level);
+		writer.write_varint((std::uint32_t)pokemon.status);
+		for (int i = 0; i < Pokemon::max_moves; i++){
+			writer.write_varint((std::uint32_t)pokemon.moves[i]);
+			writer.write_signed_varint(pokemon.pp[i]);
+		}
+		writer.write_varint(pokemon.original_trainer_id);
+		writer.write_string(pokemon.original_trainer_name);
+		writer.write_varint(pokemon.experience);
+		write_stats(writer, pokemon.stat_experience);
+		write_stats(writer, pokemon.computed_stats);
+		writer.write_varint(pokemon.individual_values);
+	}
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Items);
+	write_items(writer, this->inventory);
+	write_items(writer, this->pc_inventory);
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Pokedex);
+	writer.write_buffer(this->pokedex_seen, sizeof(this->pokedex_seen));
+	writer.write_buffer(this->pokedex_owned, sizeof(this->pokedex_owned));
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Variables);
+	this->variables.serialize(writer, incremental);
+	end_section(writer, section);
+
+	section = begin_section(writer, SectionId::Objects);
+	writer.write_varint((std::uint32_t)this->objects.size());
+	for (auto &state : this->objects){
+		writer.write_varint((std::uint32_t)state.map);
+		writer.write_varint(state.index);
+		writer.write_signed_varint(state.position.x);
+		writer.write_signed_varint(state.position.y);
+	}
+	end_section(writer, section);
+}
+
+void SavableData::deserialize(BufferReader &reader){
+	for (auto b : native_magic)
+		if (reader.read_byte() != b)
+			throw std::runtime_error("SavableData: Not a save file.");
+	auto version = reader.read_u32();
+	if (version > format_version)
+		throw std::runtime_error("SavableData: Save file was written by a newer version.");
+	this->incremental = !!(reader.read_byte() & flag_incremental);
+
+	while (!reader.empty()){
+		auto id = (SectionId)reader.read_byte();
+		auto section = reader.read_sub_buffer(reader.read_u32());
+		switch (id){
+			case SectionId::Player:
+				this->player_name = section.read_string();
+				this->rival_name = section.read_string();
+				this->options.battle_animations_enabled = !!section.read_byte();
+				this->options.battle_style = (BattleStyle)section.read_varint();
+				this->options.text_speed = (TextSpeed)section.read_varint();
+				this->trainer_id = (std::uint16_t)section.read_varint();
+				break;
+			case SectionId::Position:
+				this->position.map = (Map)section.read_varint();
+				this->legacy_map = section.read_signed_varint();
+				this->position.position.x = section.read_signed_varint();
+				this->position.position.y = section.read_signed_varint();
+				this->facing_direction = (FacingDirection)(section.read_byte() % 4);
+				break;
+			case SectionId::Party:
+				{
+					auto size = section.read_varint();
+					if (size > Party::max_party_size)
+						throw std::runtime_error("SavableData: Invalid party.");
+					this->party.resize(size);
+				}
+				for (auto &pokemon : this->party){
+					pokemon.species = check_species(section.read_varint());
+					pokemon.nickname = section.read_string();
+					pokemon.current_hp = section.read_signed_varint();
+					pokemon.level = section.read_varint();
+					pokemon.status = (StatusCondition)section.read_varint();
+					for (int i = 0; i < Pokemon::max_moves; i++){
+						pokemon.moves[i] = (MoveId)section.read_varint();
+						pokemon.pp[i] = section.read_signed_varint();
+					}
+					pokemon.original_trainer_id = (std::uint16_t)section.read_varint();
+					pokemon.original_trainer_name = section.read_string();
+					pokemon.experience = section.read_varint();
+					pokemon.stat_experience = read_stats(section);
+					pokemon.computed_stats = read_stats(section);
+					pokemon.individual_values = (std::uint16_t)section.read_varint();
+				}
+				break;
+			case SectionId::Items:
+				read_items(section, this->inventory);
+				read_items(section, this->pc_inventory);
+				break;
+			case SectionId::Pokedex:
+				{
+					auto seen = section.read_buffer();
+					auto owned = section.read_buffer();
+					if (seen.size() != sizeof(this->pokedex_seen) || owned.size() != sizeof(this->pokedex_owned))
+						throw std::runtime_error("SavableData: Invalid Pokedex.");
+					memcpy(this->pokedex_seen, &seen[0], seen.size());
+					memcpy(this->pokedex_owned, &owned[0], owned.size());
+				}
+				break;
+			case SectionId::Variables:
+				this->variables.deserialize(section, this->incremental);
+				break;
+			case SectionId::Objects:
+				//Four varints.
+				this->objects.resize(read_count(section, 4));
+				for (auto &state : this->objects){
+					state.map = (Map)section.read_varint();
+					state.index = section.read_varint();
+					state.position.x = section.read_signed_varint();
+					state.position.y = section.read_signed_varint();
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	this->valid = true;
+}
+
 std::shared_ptr<SavableData> SavableData::load(const std::string &path){
-	//TODO
-	return nullptr;
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return nullptr;
+	std::vector<byte_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return load(buffer.data(), buffer.size());
+}
+
+std::shared_ptr<SavableData> SavableData::load(const byte_t *buffer, size_t size){
+	std::shared_ptr<SavableData> ret(new SavableData);
+	try{
+		if (size >= sizeof(native_magic) && !memcmp(buffer, native_magic, sizeof(native_magic))){
+			BufferReader reader(buffer, size);
+			ret->deserialize(reader);
+		}else
+			ret->import_sram(buffer, size);
+	}catch (std::exception &){
+		ret->valid = false;
+	}
+	return ret;
+}
+
+void SavableData::apply(const byte_t *buffer, size_t size){
+	BufferReader reader(buffer, size);
+	this->deserialize(reader);
+}
+
+static void write_file(const std::string &path, const std::vector<byte_t> &buffer){
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("SavableData: Can't open " + path + " for writing.");
+	file.write((const char *)buffer.data(), buffer.size());
+	if (!file)
+		throw std::runtime_error("SavableData: Error while writing " + path);
+}
+
+void SavableData::save(const std::string &path) const{
+	std::vector<byte_t> buffer;
+	this->serialize(buffer);
+	write_file(path, buffer);
+}
+
+void SavableData::save_sram(const std::string &path) const{
+	std::vector<byte_t> buffer;
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (file)
+			buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	this->export_sram(buffer);
+	write_file(path, buffer);
+}
+
+//SRAM encoding.
+
+static char sram_to_ascii(byte_t c){
+	if (c >= 0x80 && c <= 0x99)
+		return 'A' + (c - 0x80);
+	if (c >= 0xA0 && c <= 0xB9)
+		return 'a' + (c - 0xA0);
+	if (c >= 0xF6)
+		return '0' + (c - 0xF6);
+	switch (c){
+		case 0x7F:
+			return ' ';
+		case 0x9A:
+			return '(';
+		case 0x9B:
+			return ')';
+		case 0x9C:
+			return ':';
+		case 0x9D:
+			return ';';
+		case 0xE0:
+			return '\'';
+		case 0xE3:
+			return '-';
+		case 0xE7:
+			return '!';
+		case 0xE8:
+			return '.';
+		case 0xF3:
+			return '/';
+		case 0xF4:
+			return ',';
+	}
+	return '?';
+}
+
+static byte_t ascii_to_sram(char c){
+	if (c >= 'A' && c <= 'Z')
+		return 0x80 + (c - 'A');
+	if (c >= 'a' && c <= 'z')
+		return 0xA0 + (c - 'a');
+	if (c >= '0' && c <= '9')
+		return 0xF6 + (c - '0');
+	switch (c){
+		case ' ':
+			return 0x7F;
+		case '(':
+			return 0x9A;
+		case ')':
+			return 0x9B;
+		case ':':
+			return 0x9C;
+		case ';':
+			return 0x9D;
+		case '\'':
+			return 0xE0;
+		case '-':
+			return 0xE3;
+		case '!':
+			return 0xE7;
+		case '.':
+			return 0xE8;
+		case '/':
+			return 0xF3;
+		case ',':
+			return 0xF4;
+	}
+	return 0xE6;
+}
+
+static std::string read_sram_string(const byte_t *src){
+	std::string ret;
+	for (size_t i = 0; i < sram_name_size && src[i] != sram_string_terminator; i++)
+		ret.push_back(sram_to_ascii(src[i]));
+	return ret;
+}
+
+static void write_sram_string(byte_t *dst, const std::string &s){
+	memset(dst, sram_string_terminator, sram_name_size);
+	auto n = std::min(s.size(), sram_name_size - 1);
+	for (size_t i = 0; i < n; i++)
+		dst[i] = ascii_to_sram(s[i]);
+}
+
+static unsigned read_sram_u16(const byte_t *src){
+	return src[0] << 8 | src[1];
+}
+
+static void write_sram_u16(byte_t *dst, unsigned n){
+	dst[0] = (byte_t)(n >> 8);
+	dst[1] = (byte_t)n;
+}
+
+static unsigned read_sram_bcd(const byte_t *src, size_t digit_pairs){
+	unsigned ret = 0;
+	for (size_t i = 0; i < digit_pairs; i++)
+		ret = ret * 100 + (src[i] >> 4) * 10 + (src[i] & 0x0F);
+	return ret;
+}
+
+static void write_sram_bcd(byte_t *dst, int n, size_t digit_pairs){
+	n = std::max(n, 0);
+	for (size_t i = digit_pairs; i--;){
+		auto pair = n % 100;
+		n /= 100;
+		dst[i] = (byte_t)(pair / 10 << 4 | pair % 10);
+	}
+}
+
+static void read_sram_items(std::vector<InventorySpace> &dst, const byte_t *src, size_t capacity){
+	size_t count = std::min<size_t>(src[0], capacity);
+	dst.clear();
+	for (size_t i = 0; i < count && src[1 + i * 2] != 0xFF; i++)
+		dst.push_back({ (ItemId)src[1 + i * 2], src[2 + i * 2] });
+}
+
+static void write_sram_items(byte_t *dst, const std::vector<InventorySpace> &src, size_t capacity){
+	auto count = std::min(src.size(), capacity);
+	dst[0] = (byte_t)count;
+	for (size_t i = 0; i < count; i++){
+		dst[1 + i * 2] = (byte_t)src[i].item;
+		dst[2 + i * 2] = (byte_t)src[i].quantity;
+	}
+	dst[1 + count * 2] = 0xFF;
+}
+
+static byte_t compute_sram_checksum(const byte_t *sram){
+	byte_t ret = 0;
+	for (auto i = sram_player_name; i < sram_checksum; i++)
+		ret += sram[i];
+	return ~ret;
+}
+
+//The SRAM stores the status as a bitmap; the bit indices match
+//StatusCondition. The sleep counter is not represented.
+static StatusCondition status_from_sram(byte_t status){
+	for (auto s : { StatusCondition::Poisoned, StatusCondition::Burned, StatusCondition::Frozen, StatusCondition::Paralized })
+		if (status & (1 << (int)s))
+			return s;
+	return StatusCondition::Normal;
+}
+
+static byte_t status_to_sram(StatusCondition status){
+	return status == StatusCondition::Normal ? 0 : (byte_t)(1 << (int)status);
+}
+
+static FacingDirection facing_direction_from_sram(byte_t direction){
+	switch (direction){
+		case 0x04:
+			return FacingDirection::Up;
+		case 0x08:
+			return FacingDirection::Left;
+		case 0x0C:
+			return FacingDirection::Right;
+	}
+	return FacingDirection::Down;
+}
+
+static byte_t facing_direction_to_sram(FacingDirection direction){
+	switch (direction){
+		case FacingDirection::Down:
+			return 0x00;
+		case FacingDirection::Up:
+			return 0x04;
+		case FacingDirection::Left:
+			return 0x08;
+		case FacingDirection::Right:
+			return 0x0C;
+	}
+	return 0x00;
+}
+
+void SavableData::import_sram_pokemon(Pokemon &dst, const byte_t *src, const byte_t *ot_name, const byte_t *nickname){
+	dst.species = check_species(src[0]);
+	dst.current_hp = read_sram_u16(src + 1);
+	dst.status = status_from_sram(src[4]);
+	for (int i = 0; i < Pokemon::max_moves; i++){
+		dst.moves[i] = (MoveId)src[8 + i];
+		dst.pp[i] = src[29 + i] & 0x3F;
+	}
+	dst.original_trainer_id = (std::uint16_t)read_sram_u16(src + 12);
+	dst.experience = src[14] << 16 | src[15] << 8 | src[16];
+	dst.stat_experience = PokemonStats(read_sram_u16(src + 17), read_sram_u16(src + 19), read_sram_u16(src + 21), read_sram_u16(src + 23), read_sram_u16(src + 25));
+	dst.individual_values = (std::uint16_t)(src[27] | src[28] << 8);
+	dst.level = src[33];
+	dst.computed_stats = PokemonStats(read_sram_u16(src + 34), read_sram_u16(src + 36), read_sram_u16(src + 38), read_sram_u16(src + 40), read_sram_u16(src + 42));
+	dst.original_trainer_name = read_sram_string(ot_name);
+	dst.nickname = read_sram_string(nickname);
+	//The original game stores the species name when there's no nickname.
+	if (dst.nickname == dst.get_data().display_name)
+		dst.nickname.clear();
+}
+
+void SavableData::export_sram_pokemon(byte_t *dst, byte_t *ot_name, byte_t *nickname, Pokemon pokemon){
+	auto &data = pokemon.get_data();
+	dst[0] = (byte_t)pokemon.species;
+	write_sram_u16(dst + 1, pokemon.current_hp);
+	dst[3] = (byte_t)pokemon.level;
+	dst[4] = status_to_sram(pokemon.status);
+	dst[5] = (byte_t)data.type[0];
+	dst[6] = (byte_t)data.type[1];
+	dst[7] = data.catch_rate;
+	for (int i = 0; i < Pokemon::max_moves; i++){
+		dst[8 + i] = (byte_t)pokemon.moves[i];
+		dst[29 + i] = pokemon.moves[i] == MoveId::None ? 0 : (byte_t)pokemon.pp[i];
+	}
+	write_sram_u16(dst + 12, pokemon.original_trainer_id);
+	dst[14] = (byte_t)(pokemon.experience >> 16);
+	dst[15] = (byte_t)(pokemon.experience >> 8);
+	dst[16] = (byte_t)pokemon.experience;
+	write_sram_u16(dst + 17, pokemon.stat_experience.hp);
+	write_sram_u16(dst + 19, pokemon.stat_experience.attack);
+	write_sram_u16(dst + 21, pokemon.stat_experience.defense);
+	write_sram_u16(dst + 23, pokemon.stat_experience.speed);
+	write_sram_u16(dst + 25, pokemon.stat_experience.special);
+	dst[27] = (byte_t)pokemon.individual_values;
+	dst[28] = (byte_t)(pokemon.individual_values >> 8);
+	dst[33] = (byte_t)pokemon.level;
+	for (int i = 0; i < 5; i++)
+		write_sram_u16(dst + 34 + i * 2, pokemon.get_stat((PokemonStats::StatId)i));
+	write_sram_string(ot_name, pokemon.original_trainer_name);
+	write_sram_string(nickname, pokemon.get_display_name());
+}
+
+void SavableData::import_sram(const byte_t *sram, size_t size){
+	if (size < sram_size)
+		throw std::runtime_error("SavableData: Not a save file.");
+	if (compute_sram_checksum(sram) != sram[sram_checksum])
+		throw std::runtime_error("SavableData: Bad checksum.");
+
+	this->incremental = false;
+	this->player_name = read_sram_string(sram + sram_player_name);
+	this->rival_name = read_sram_string(sram + sram_rival_name);
+	auto options = sram[sram_options];
+	switch (options & 0x0F){
+		case (int)TextSpeed::Fast:
+		case (int)TextSpeed::Medium:
+		case (int)TextSpeed::Slow:
+			this->options.text_speed = (TextSpeed)(options & 0x0F);
+			break;
+		default:
+			this->options.text_speed = TextSpeed::Medium;
+			break;
+	}
+	this->options.battle_style = options & 0x40 ? BattleStyle::Set : BattleStyle::Shift;
+	this->options.battle_animations_enabled = !(options & 0x80);
+	this->trainer_id = (std::uint16_t)read_sram_u16(sram + sram_player_id);
+	this->position = { Map::Nowhere, Point(sram[sram_x_coordinate], sram[sram_y_coordinate]) };
+	this->legacy_map = sram[sram_current_map];
+	this->facing_direction = facing_direction_from_sram(sram[sram_player_facing_direction]);
+
+	auto party = sram + sram_party;
+	size_t party_size = party[0];
+	if (party_size > Party::max_party_size)
+		throw std::runtime_error("SavableData: Invalid party.");
+	auto structs = party + 2 + Party::max_party_size;
+	auto ot_names = structs + Party::max_party_size * sram_party_struct_size;
+	auto nicknames = ot_names + Party::max_party_size * sram_name_size;
+	this->party.resize(party_size);
+	for (size_t i = 0; i < party_size; i++)
+		import_sram_pokemon(this->party[i], structs + i * sram_party_struct_size, ot_names + i * sram_name_size, nicknames + i * sram_name_size);
+
+	read_sram_items(this->inventory, sram + sram_bag_items, sram_bag_capacity);
+	read_sram_items(this->pc_inventory, sram + sram_pc_items, sram_pc_capacity);
+	memcpy(this->pokedex_owned, sram + sram_pokedex_owned, sizeof(this->pokedex_owned));
+	memcpy(this->pokedex_seen, sram + sram_pokedex_seen, sizeof(this->pokedex_seen));
+
+	auto &vs = this->variables;
+	vs = VariableStore();
+	vs.set(StringVariableId::player_name, this->player_name);
+	vs.set(StringVariableId::rival_name, this->rival_name);
+	vs.set(IntegerVariableId::hMoney, (int)read_sram_bcd(sram + sram_money, 3));
+	vs.set(IntegerVariableId::wPlayerCoins, (int)read_sram_bcd(sram + sram_coins, 2));
+	auto event_flags = std::min(sram_event_flag_count, VariableStore::event_count);
+	for (size_t i = 0; i < event_flags; i++)
+		vs.set((EventId)(i + 1), !!(sram[sram_event_flags + i / 8] & (1 << (i % 8))));
+	//Set bits in the SRAM mean the object is hidden.
+	auto visibility_flags = std::min(sram_missable_object_count, VariableStore::visibility_flag_count);
+	for (size_t i = 0; i < visibility_flags; i++)
+		vs.set((VisibilityFlagId)(i + 1), !(sram[sram_missable_objects + i / 8] & (1 << (i % 8))));
+	this->objects.clear();
+	this->valid = true;
+}
+
+void SavableData::export_sram(std::vector<byte_t> &sram_buffer) const{
+	if (sram_buffer.size() < sram_size)
+		sram_buffer.resize(sram_size);
+	auto sram = sram_buffer.data();
+
+	write_sram_string(sram + sram_player_name, this->player_name);
+	write_sram_string(sram + sram_rival_name, this->rival_name);
+	sram[sram_options] = (byte_t)this->options.text_speed
+		| (this->options.battle_style == BattleStyle::Set ? 0x40 : 0)
+		| (this->options.battle_animations_enabled ? 0 : 0x80);
+	write_sram_u16(sram + sram_player_id, this->trainer_id);
+	sram[sram_current_map] = (byte_t)std::max(this->legacy_map, 0);
+	sram[sram_x_coordinate] = (byte_t)this->position.position.x;
+	sram[sram_y_coordinate] = (byte_t)this->position.position.y;
+	sram[sram_player_facing_direction] = facing_direction_to_sram(this->facing_direction);
+
+	auto party = sram + sram_party;
+	auto party_size = std::min(this->party.size(), Party::max_party_size);
+	auto structs = party + 2 + Party::max_party_size;
+	auto ot_names = structs + Party::max_party_size * sram_party_struct_size;
+	auto nicknames = ot_names + Party::max_party_size * sram_name_size;
+	memset(party, 0, nicknames + Party::max_party_size * sram_name_size - party);
+	party[0] = (byte_t)party_size;
+	for (size_t i = 0; i < party_size; i++){
+		party[1 + i] = (byte_t)this->party[i].species;
+		export_sram_pokemon(structs + i * sram_party_struct_size, ot_names + i * sram_name_size, nicknames + i * sram_name_size, this->party[i]);
+	}
+	party[1 + party_size] = 0xFF;
+
+	write_sram_items(sram + sram_bag_items, this->inventory, sram_bag_capacity);
+	write_sram_items(sram + sram_pc_items, this->pc_inventory, sram_pc_capacity);
+	memcpy(sram + sram_pokedex_owned, this->pokedex_owned, sizeof(this->pokedex_owned));
+	memcpy(sram + sram_pokedex_seen, this->pokedex_seen, sizeof(this->pokedex_seen));
+
+	auto &vs = this->variables;
+	write_sram_bcd(sram + sram_money, vs.get(IntegerVariableId::hMoney), 3);
+	write_sram_bcd(sram + sram_coins, vs.get(IntegerVariableId::wPlayerCoins), 2);
+	auto event_flags = std::min(sram_event_flag_count, VariableStore::event_count);
+	for (size_t i = 0; i < event_flags; i++){
+		auto &byte = sram[sram_event_flags + i / 8];
+		byte_t mask = 1 << (i % 8);
+		byte = vs.get((EventId)(i + 1)) ? byte | mask : byte & ~mask;
+	}
+	auto visibility_flags = std::min(sram_missable_object_count, VariableStore::visibility_flag_count);
+	for (size_t i = 0; i < visibility_flags; i++){
+		auto &byte = sram[sram_missable_objects + i / 8];
+		byte_t mask = 1 << (i % 8);
+		byte = vs.get((VisibilityFlagId)(i + 1)) ? byte & ~mask : byte | mask;
+	}
+
+	sram[sram_checksum] = compute_sram_checksum(sram);
 }
 
 }
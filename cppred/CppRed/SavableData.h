@@ -1,22 +1,73 @@
 #pragma once
 #include "MiscClasses.h"
+#include "Game.h"
+#include "Pokemon.h"
+#include "Trainer.h"
+#include "PlayerCharacter.h"
 #ifndef HAVE_PCH
 #include <memory>
 #include <string>
+#include <vector>
 #endif
 
 namespace CppRed{
 
+//Snapshot of everything needed to resume a game. A snapshot is captured from
+//and restored to a Game, and can be stored either in the native format, or in
+//the SRAM layout of the original game, which emulators use as .sav files.
 class SavableData{
+public:
+	static const std::uint32_t format_version = 1;
+	static const char * const default_path;
+	struct ObjectState{
+		Map map;
+		std::uint32_t index;
+		Point position;
+	};
+private:
 	SavableData() = default;
+
+	void deserialize(BufferReader &);
+	void import_sram(const byte_t *, size_t);
+	void export_sram(std::vector<byte_t> &) const;
+	static void import_sram_pokemon(Pokemon &, const byte_t *, const byte_t *ot_name, const byte_t *nickname);
+	static void export_sram_pokemon(byte_t *, byte_t *ot_name, byte_t *nickname, Pokemon);
 public:
-	bool valid;
+	bool valid = false;
+	//Incremental snapshots contain only the variable blocks that changed
+	//since the previous capture, and must be applied on top of it.
+	bool incremental = false;
 	std::string player_name;
 	std::string rival_name;
 	GameOptions options;
+	std::uint16_t trainer_id = 0;
+	WorldCoordinates position = {Map::Nowhere};
+	//Set instead of position.map by import_sram(), since the map IDs of the
+	//original game can only be resolved through the MapStore.
+	int legacy_map = -1;
+	FacingDirection facing_direction = FacingDirection::Down;
+	std::vector<Pokemon> party;
+	std::vector<InventorySpace> inventory;
+	std::vector<InventorySpace> pc_inventory;
+	Pokedex::bitmap_t pokedex_seen;
+	Pokedex::bitmap_t pokedex_owned;
+	VariableStore variables;
+	std::vector<ObjectState> objects;
 
+	static std::shared_ptr<SavableData> capture(Game &);
+	//Must be called from the game coroutine, before the game loop starts.
+	void restore(Game &) const;
+	//Detects the format of the file. Returns nullptr if the file doesn't
+	//exist.
 	static std::shared_ptr<SavableData> load(const std::string &path);
-	void save(const std::string &path);
+	static std::shared_ptr<SavableData> load(const byte_t *, size_t);
+	//Applies an incremental snapshot on top of this one.
+	void apply(const byte_t *, size_t);
+	void serialize(std::vector<byte_t> &dst, bool incremental = false) const;
+	void save(const std::string &path) const;
+	//If path already contains an SRAM image, the fields that aren't
+	//represented here are preserved.
+	void save_sram(const std::string &path) const;
 };
 
 }
@@ -1,28 +1,34 @@
 #pragma once
 
 #include "Scripts.h"
+#include "../../../CodeGeneration/output/scripts.h"
 
 #define DECLARE_SCRIPT(name) void name(const script_parameters &parameters)
+//Scripts are dispatched by ScriptId, so a script the data doesn't reference
+//could never run. Referencing the ID turns that into a compile error.
+#define DECLARE_DATA_SCRIPT(name) \
+	static_assert(CppRed::ScriptId::name != CppRed::ScriptId::None, ""); \
+	DECLARE_SCRIPT(name)
 
 namespace CppRed{
 namespace Scripts{
 
-DECLARE_SCRIPT(PrintRedSNESText);
-DECLARE_SCRIPT(RedsHouse1FText1);
-DECLARE_SCRIPT(RedsHouse1FText2);
-DECLARE_SCRIPT(PalletTownScript);
-DECLARE_SCRIPT(BluesHouseScript);
-DECLARE_SCRIPT(BluesHouseText1);
-DECLARE_SCRIPT(OaksLabScript);
-DECLARE_SCRIPT(OaksLabText1);
-DECLARE_SCRIPT(OaksLabText2);
-DECLARE_SCRIPT(OaksLabText3);
-DECLARE_SCRIPT(OaksLabText4);
-DECLARE_SCRIPT(OaksLabText5);
-DECLARE_SCRIPT(DisplayOakLabEmailText);
-DECLARE_SCRIPT(DisplayOakLabLeftPoster);
-DECLARE_SCRIPT(DisplayOakLabRightPoster);
-DECLARE_SCRIPT(OpenRedsPC);
+DECLARE_DATA_SCRIPT(PrintRedSNESText);
+DECLARE_DATA_SCRIPT(RedsHouse1FText1);
+DECLARE_DATA_SCRIPT(RedsHouse1FText2);
+DECLARE_DATA_SCRIPT(PalletTownScript);
+DECLARE_DATA_SCRIPT(BluesHouseScript);
+DECLARE_DATA_SCRIPT(BluesHouseText1);
+DECLARE_DATA_SCRIPT(OaksLabScript);
+DECLARE_DATA_SCRIPT(OaksLabText1);
+DECLARE_DATA_SCRIPT(OaksLabText2);
+DECLARE_DATA_SCRIPT(OaksLabText3);
+DECLARE_DATA_SCRIPT(OaksLabText4);
+DECLARE_DATA_SCRIPT(OaksLabText5);
+DECLARE_DATA_SCRIPT(DisplayOakLabEmailText);
+DECLARE_DATA_SCRIPT(DisplayOakLabLeftPoster);
+DECLARE_DATA_SCRIPT(DisplayOakLabRightPoster);
+DECLARE_DATA_SCRIPT(OpenRedsPC);
 
 }
 }
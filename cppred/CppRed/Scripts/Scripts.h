@@ -7,10 +7,11 @@
 namespace CppRed{
 class Game;
 class Actor;
+enum class ScriptId;
 namespace Scripts{
 
 struct script_parameters{
-	const char *script_name;
+	ScriptId script;
 	const char *parameter;
 	CppRed::Game *game;
 	CppRed::Actor *caller;
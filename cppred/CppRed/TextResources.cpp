@@ -211,7 +211,8 @@ void DexCommand::execute(Game &game, TextState &state){
 void AutocontCommand::execute(Game &, TextState &){}
 
 void MemCommand::execute(Game &game, TextState &state){
-	auto value = game.get_variable_store().get(this->variable);
+	//Copied, since the variable could change while the text is printed.
+	std::string value = game.get_variable_store().get(this->variable);
 	progressively_write_text(value, game, state);
 }
 
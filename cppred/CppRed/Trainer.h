@@ -45,7 +45,7 @@ public:
 	const Party &get_party() const{
 		return this->party;
 	}
-	DEFINE_GETTER(trainer_id)
+	DEFINE_GETTER_SETTER(trainer_id)
 	DEFINE_NON_CONST_GETTER(inventory)
 	virtual const std::string &get_name() const{
 		return empty_string;
@@ -13,9 +13,10 @@
 
 namespace CppRed{
 
-World::World(Game &game):
+World::World(Game &game, MapStore &&map_store):
 	ScreenOwner(game),
-	player_character(null_actor_ptr<PlayerCharacter>()){
+	player_character(null_actor_ptr<PlayerCharacter>()),
+	map_store(std::move(map_store)){
 }
 
 World::~World(){
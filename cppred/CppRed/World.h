@@ -35,7 +35,7 @@ class World : public ScreenOwner{
 	std::unique_ptr<ScreenOwner> update();
 	void render(Renderer &, bool was_paused);
 public:
-	World(Game &game);
+	World(Game &game, MapStore &&);
 	~World();
 	MapStore &get_map_store(){
 		return this->map_store;
@@ -65,6 +65,7 @@ public:
 	void set_default_palettes();
 	AudioResourceId get_current_map_music();
 
+	DEFINE_GETTER(rival_name)
 	DEFINE_GETTER(camera_position)
 	DEFINE_GETTER(pixel_offset)
 	DEFINE_GETTER_SETTER(automatic_music_transition)
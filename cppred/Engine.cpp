@@ -4,16 +4,24 @@
 #include "CppRed/Game.h"
 #include "CppRed/PlayerCharacter.h"
 #include "CppRed/World.h"
+#include "CppRed/TextResources.h"
+#include "Maps.h"
 #include "AudioScheduler.h"
 #include "AudioDevice.h"
 #include "AudioRenderer.h"
 #include "HeliosRenderer.h"
 #include "Console.h"
+#include "FrameRecorder.h"
+#include "SfxCache.h"
+#include "RendererBenchmark.h"
 #ifndef HAVE_PCH
 #include <stdexcept>
 #include <cassert>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <SDL.h>
 #endif
 
@@ -21,28 +29,53 @@ const double Engine::logical_refresh_rate = (double)dmg_clock_frequency / dmg_di
 const double Engine::logical_refresh_period = (double)dmg_display_period / dmg_clock_frequency;
 const int Engine::screen_scale = 4;
 
-Engine::Engine():
+struct SessionData{
+	std::unique_ptr<CppRed::TextStore> text_store;
+	std::unique_ptr<MapStore> map_store;
+	std::shared_ptr<const CppRed::AudioProgramData> audio_data;
+};
+
+Engine::Engine(bool headless, unsigned audio_buffer_length):
+		headless(headless),
+		audio_buffer_length(audio_buffer_length),
 #ifndef Engine_USE_FIXED_CLOCK
-		clock(this->base_clock),
+		clock(this->manual_clock),
+		ui_clock(headless ? (AbstractClock &)this->manual_clock : (AbstractClock &)this->base_clock),
 #endif
-		prng(get_seed()){
-	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
+		prng(get_seed()),
+		synthesis_quality(SynthesisQuality::PointSampled){
+	this->shared_input_state = 0;
+	this->debug_mode = false;
+	this->scene_capture_requested = false;
+	this->logic_thread_running = false;
+	this->start_loading_session_data();
+	auto &graph = *this->startup_graph;
+	if (!this->headless)
+		graph.run_inline("SDL", [](){ SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER); });
 
-	this->initialize_video();
-	this->initialize_audio();
+	graph.run_inline("Video device", [this](){ this->initialize_video(); });
+	graph.run_inline("Audio device", [this](){ this->initialize_audio(); });
 }
 
 Engine::~Engine(){
+	this->stop_logic_thread();
+	this->game.reset();
 	this->audio_scheduler.reset();
-	SDL_Quit();
+	if (!this->headless)
+		SDL_Quit();
 }
 
 void Engine::initialize_video(){
+	if (this->headless)
+		return;
 	this->video_device = Renderer::initialize_device(screen_scale);
 }
 
 void Engine::initialize_audio(){
-	this->audio_device.reset(new AudioDevice);
+	if (this->headless)
+		this->audio_device.reset(new NullAudioDevice);
+	else
+		this->audio_device.reset(new AudioDevice(this->audio_buffer_length));
 }
 
 static const char *to_string(PokemonVersion version){
@@ -60,85 +93,329 @@ static const char *to_string(PokemonVersion version){
 #undef interface
 #endif
 
-#if defined CPPRED_TESTING
-//#define CPU_USAGE
-#endif
-
 void Engine::run(){
 	PokemonVersion version = PokemonVersion::Red;
 	bool continue_running = true;
-#ifdef CPU_USAGE
-	HighResolutionClock clock;
-	double last = clock.get();
-	double time_processing = 0;
-	double logic_time = 0;
-	double renderer_time = 0;
-#endif
 	while (continue_running){
 		this->video_device->set_window_title(to_string(version));
-		this->debug_mode = false;
-		this->renderer.reset(new Renderer(*this->video_device));
-		if (!this->console){
-			this->console.reset(new Console(*this));
-			global_console = this->console.get();
-		}
-		auto two_way_mixer = std::make_unique<TwoWayMixer>(*this->audio_device);
-		this->two_way_mixer = two_way_mixer.get();
-		two_way_mixer->set_renderers(std::make_unique<HeliosRenderer>(*two_way_mixer), std::make_unique<HeliosRenderer>(*two_way_mixer));
-		auto interfacep = std::make_unique<CppRed::AudioProgramInterface>(two_way_mixer->get_low_priority_renderer(), two_way_mixer->get_high_priority_renderer(), version);
-		auto &interface = *interfacep;
-		this->audio_scheduler.reset(new AudioScheduler(*this, std::move(two_way_mixer), std::move(interfacep)));
-		this->audio_scheduler->start();
-		this->gamepad_disabled = false;
-		this->game.reset(new CppRed::Game(*this, version, interface));
-		fill(this->direction_press_times, -1);
-
-		//Main loop.
+		this->start_session(version);
+		global_console = this->console.get();
+		auto &interface = *this->audio_program;
+		this->input_queue.attach();
+		this->start_logic_thread();
+
+		//Main loop. The game itself runs on the logic thread. This thread only
+		//handles events, runs the console and presents whatever frame the
+		//logic thread last completed, so waiting for vsync here never holds up
+		//the game.
 		while (true){
-#ifdef CPU_USAGE
-			auto t0 = clock.get();
-#endif
-			this->clock.step();
+			this->ui_clock.step();
 			continue_running &= this->handle_events();
 			if (!continue_running)
 				break;
 			if (!this->update_console(version, interface))
 				break;
+			this->input_queue.set_accept_presses(!this->console->get_visible());
 			this->check_exceptions();
 
-			if (!this->debug_mode)
-				this->game->update();
+			auto input_time = this->renderer->present();
+			this->console->render();
+			this->video_device->present();
+			if (input_time >= 0)
+				this->latency_probe.frame_presented(input_time, this->input_queue.get_time());
+		}
 
-#ifdef CPU_USAGE
-			auto t1 = clock.get();
+		this->input_queue.detach();
+		this->end_session();
+	}
+}
+
+void Engine::start_recording(const std::string &path){
+	if (this->game)
+		throw std::runtime_error("Engine::start_recording(): A session is already running.");
+	RGB palette[4];
+	Renderer::get_final_palette(palette);
+	this->recorder.reset(new FrameRecorder(path, palette));
+}
+
+void Engine::set_music_lookahead(double seconds){
+	if (seconds < 0)
+		throw std::runtime_error("Engine::set_music_lookahead(): Invalid look-ahead.");
+	this->music_lookahead = seconds;
+}
+
+void Engine::start_loading_session_data(){
+	this->session_data.reset(new SessionData);
+	this->startup_graph.reset(new TaskGraph);
+	auto &data = *this->session_data;
+	auto &graph = *this->startup_graph;
+	graph.add("Text store", [&data](){ data.text_store.reset(new CppRed::TextStore); });
+	graph.add("Map store", [&data](){ data.map_store.reset(new MapStore); });
+	graph.add("Audio tables", [&data](){ data.audio_data = std::make_shared<CppRed::AudioProgramData>(); });
+	//Headless engines may be run many at a time by HeadlessHost, which
+	//already keeps every core busy, so they decode everything in wait().
+	unsigned threads = 0;
+	if (!this->headless)
+		threads = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+	graph.start(threads);
+}
+
+void Engine::start_session(PokemonVersion version){
+	//The first session's data started loading in the constructor.
+	if (!this->startup_graph)
+		this->start_loading_session_data();
+	auto &graph = *this->startup_graph;
+	this->debug_mode = false;
+	graph.run_inline("Renderer", [this](){
+		if (this->headless)
+			this->renderer.reset(new Renderer);
+		else
+			this->renderer.reset(new Renderer(*this->video_device));
+	});
+	if (!this->console)
+		this->console.reset(new Console(*this));
+	std::unique_ptr<TwoWayMixer> two_way_mixer;
+	graph.run_inline("Mixer", [this, &two_way_mixer](){
+		two_way_mixer = std::make_unique<TwoWayMixer>(*this->audio_device);
+		//The music renderer must be able to queue the whole look-ahead twice,
+		//since after a track change the discarded frames are only released
+		//once the mixer gets to them, and by then the new track has been
+		//rendered ahead.
+		auto extra_frames = 2 * (size_t)ceil(this->music_lookahead * sampling_frequency / AudioFrame::length);
+		two_way_mixer->set_renderers(std::make_unique<HeliosRenderer>(*two_way_mixer, extra_frames), std::make_unique<HeliosRenderer>(*two_way_mixer));
+	});
+	this->two_way_mixer = two_way_mixer.get();
+	two_way_mixer->set_synthesis_quality(this->synthesis_quality);
+	two_way_mixer->set_recorder(this->recorder.get());
+	graph.wait();
+	auto data = std::move(this->session_data);
+	auto interfacep = std::make_unique<CppRed::AudioProgramInterface>(two_way_mixer->get_low_priority_renderer(), two_way_mixer->get_high_priority_renderer(), version, data->audio_data);
+	this->audio_program = interfacep.get();
+	if (this->music_lookahead > 0)
+		interfacep->set_music_lookahead(this->music_lookahead, *this->two_way_mixer);
+	this->update_sfx_cache();
+	this->audio_scheduler.reset(new AudioScheduler(*this, std::move(two_way_mixer), std::move(interfacep), !this->headless));
+	this->audio_scheduler->start();
+	this->renderer->set_recorder(this->recorder.get());
+	this->gamepad_disabled = false;
+	graph.run_inline("Game", [this, version, &data](){
+		this->game.reset(new CppRed::Game(*this, version, *this->audio_program, std::move(*data->text_store), std::move(*data->map_store)));
+	});
+	if (!this->headless){
+		std::stringstream stream;
+		stream << "Startup trace:\n";
+		graph.print_trace(stream);
+		Logger() << stream.str();
+	}
+	this->startup_graph.reset();
+}
+
+void Engine::end_session(){
+	this->stop_logic_thread();
+	this->game.reset();
+	this->audio_scheduler.reset();
+	this->audio_program = nullptr;
+	this->two_way_mixer = nullptr;
+}
+
+void Engine::update_sfx_cache(){
+	auto &program = *this->audio_program;
+	program.set_sfx_cache(nullptr, nullptr);
+	if (!this->sfx_cache_enabled){
+		this->sfx_cache.reset();
+		return;
+	}
+	if (!this->sfx_cache || this->sfx_cache->get_version() != program.get_version())
+		this->sfx_cache.reset(new SfxCache(program.get_version(), this->synthesis_quality, program.get_data()));
+	program.set_sfx_cache(this->sfx_cache.get(), &this->two_way_mixer->get_sfx_voice());
+}
+
+void Engine::start_logic_thread(){
+	this->logic_thread_running = true;
+	this->debug_mode_entered.reset();
+	this->debug_mode_signalled = false;
+	this->logic_thread.reset(new std::thread([this](){ this->logic_thread_function(); }));
+}
+
+void Engine::stop_logic_thread(){
+	this->logic_thread_running = false;
+	join_thread(this->logic_thread);
+}
+
+static void sleep_until(HighResolutionClock &clock, double target){
+	while (true){
+		auto remaining = target - clock.get();
+		if (remaining <= 0)
+			return;
+		//Sleeps tend to overshoot, so spin through the last stretch.
+		if (remaining > 0.002)
+			std::this_thread::sleep_for(std::chrono::microseconds((std::int64_t)((remaining - 0.002) * 1e6)));
+		else
+			std::this_thread::yield();
+	}
+}
+
+#if defined CPPRED_TESTING
+//#define CPU_USAGE
 #endif
 
-			this->renderer->render();
-			this->console->render();
+//How many logic ticks may be run back to back to catch up with real time.
+//Beyond that the game is allowed to slow down.
+static const int max_catch_up_ticks = 5;
+
+void Engine::logic_tick(){
+#ifndef Engine_USE_FIXED_CLOCK
+	this->manual_clock.advance(logical_refresh_period);
+#endif
+	this->clock.step();
+	if (this->recorder)
+		this->recorder->advance_tick();
+	this->handle_pending_clicks();
+	//As late as possible, so that the tick sees every event that arrived
+	//before it started.
+	if (!this->headless){
+		this->shared_input_state = this->input_queue.latch().get_value();
+		this->renderer->set_input_time(this->input_queue.get_last_press_time());
+	}
+	if (!this->debug_mode)
+		this->game->update();
+	else if (!this->debug_mode_signalled){
+		this->debug_mode_entered.signal();
+		this->debug_mode_signalled = true;
+	}
+}
+
+void Engine::logic_thread_function(){
+	HighResolutionClock real_time;
+	//The real time the game has been simulated up to. Always a whole number
+	//of ticks past the start.
+	auto simulated_time = real_time.get();
 #ifdef CPU_USAGE
-			auto t2 = clock.get();
+	double last = simulated_time;
+	double logic_time = 0;
+	double renderer_time = 0;
+#endif
+	try{
+		while (this->logic_thread_running){
+#ifdef CPU_USAGE
+			auto t0 = real_time.get();
+#endif
+			//Game time only ever advances in steps of exactly one logical
+			//frame, however often this loop runs.
+			auto now = real_time.get();
+			int ticks = 0;
+			while (simulated_time + logical_refresh_period <= now){
+				if (ticks == max_catch_up_ticks){
+					//Drop the periods that can't be caught up with, but stay on
+					//the tick grid.
+					simulated_time += floor((now - simulated_time) / logical_refresh_period) * logical_refresh_period;
+					break;
+				}
+				this->logic_tick();
+				simulated_time += logical_refresh_period;
+				ticks++;
+			}
+#ifdef CPU_USAGE
+			auto t1 = real_time.get();
+#endif
+			//Only the state after the last tick is ever shown.
+			if (ticks)
+				this->renderer->render();
+			this->capture_scene_if_requested();
+#ifdef CPU_USAGE
+			auto t2 = real_time.get();
 			logic_time += t1 - t0;
 			renderer_time += t2 - t1;
-			time_processing += t2 - t0;
 			if (t2 >= last + 1){
-				std::stringstream temp;
 				auto total = t2 - last;
-				auto total_usage = time_processing / total * 100;
-				auto current_logic_time = (int)(logic_time / time_processing * 100);
-				auto current_renderer_time = (int)(renderer_time / time_processing * 100);
-				temp << "Engine::run() CPU usage: " << std::setw(5) << std::setprecision(3) << total_usage << " % (logic: " << current_logic_time << " %, renderer: " << current_renderer_time << "%)\n";
-				this->console->log_string(temp.str());
+				Logger() << "Engine logic thread CPU usage: " << (logic_time + renderer_time) / total * 100 << " % (logic: " << logic_time / total * 100 << " %, renderer: " << renderer_time / total * 100 << " %)\n";
 				last = t2;
 				logic_time = 0;
 				renderer_time = 0;
-				time_processing = 0;
 			}
 #endif
-			this->video_device->present();
+			sleep_until(real_time, simulated_time + logical_refresh_period);
+		}
+	}catch (std::exception &e){
+		this->throw_exception(e);
+	}
+	//Don't leave go_to_debug() waiting on a thread that's gone.
+	this->debug_mode_entered.signal();
+}
+
+void Engine::handle_pending_clicks(){
+	std::vector<Point> clicks;
+	{
+		LOCK_MUTEX(this->pending_clicks_mutex);
+		if (!this->pending_clicks.size())
+			return;
+		clicks.swap(this->pending_clicks);
+	}
+	auto &world = this->game->get_world();
+	if (!world.player_initialized())
+		return;
+	for (auto location : clicks){
+		location.x = location.x / (this->screen_scale * Renderer::tile_size * 2);
+		location.y = location.y / (this->screen_scale * Renderer::tile_size * 2);
+		location -= CppRed::PlayerCharacter::screen_block_offset;
+		auto &pc = world.get_pc();
+		location += pc.get_map_position();
+		MapObjectInstance *objects[8];
+		world.get_objects_at_location(objects, {pc.get_current_map(), location});
+		std::stringstream stream;
+		stream << "Clicked at " << location << '\n';
+		for (auto object : objects){
+			if (!object)
+				break;
+			stream << "Found a " << object->get_object().get_type_string() << " named " << object->get_object().get_name() << '\n';
 		}
+		Logger() << stream.str();
+	}
+}
 
-		this->game.reset();
-		this->audio_scheduler.reset();
+namespace{
+
+class ThreadConsoleSetter{
+	Console *previous;
+public:
+	ThreadConsoleSetter(Console *console): previous(thread_console){
+		thread_console = console;
+	}
+	~ThreadConsoleSetter(){
+		thread_console = this->previous;
+	}
+};
+
+}
+
+void Engine::start_headless(PokemonVersion version){
+	if (!this->headless)
+		throw std::runtime_error("Engine::start_headless(): The engine was not constructed headless.");
+	this->start_session(version);
+}
+
+void Engine::step_headless(){
+	ThreadConsoleSetter tcs(this->console.get());
+	this->check_exceptions();
+	this->logic_tick();
+	this->ui_clock.step();
+	this->audio_scheduler->update(this->clock.get());
+	this->renderer->render();
+	this->capture_scene_if_requested();
+}
+
+void Engine::capture_scene_if_requested(){
+	if (!this->scene_capture_requested.exchange(false))
+		return;
+	for (int i = 0;; i++){
+		std::stringstream stream;
+		stream << "scene_" << std::setw(3) << std::setfill('0') << i << ".crscene";
+		auto path = stream.str();
+		if (std::ifstream(path))
+			continue;
+		RendererScene::save(*this->renderer, path);
+		Logger() << "Renderer scene saved to " << path << '\n';
+		break;
 	}
 }
 
@@ -165,6 +442,31 @@ bool Engine::update_console(PokemonVersion &version, CppRed::AudioProgramInterfa
 			case ConsoleRequestId::GetVersion:
 				console_request->version = version;
 				break;
+			case ConsoleRequestId::CycleSynthesisQuality:
+				this->synthesis_quality = (SynthesisQuality)(((int)this->synthesis_quality + 1) % ((int)SynthesisQuality::BandLimited + 1));
+				this->two_way_mixer->set_synthesis_quality(this->synthesis_quality);
+				if (this->sfx_cache)
+					this->sfx_cache->set_synthesis_quality(this->synthesis_quality);
+				break;
+			case ConsoleRequestId::GetSynthesisQuality:
+				console_request->synthesis_quality = this->synthesis_quality;
+				break;
+			case ConsoleRequestId::CaptureRendererScene:
+				this->scene_capture_requested = true;
+				break;
+			case ConsoleRequestId::ToggleLatencyProbe:
+				this->latency_probe.set_enabled(!this->latency_probe.get_enabled());
+				break;
+			case ConsoleRequestId::GetLatencyProbe:
+				console_request->latency_probe_enabled = this->latency_probe.get_enabled();
+				break;
+			case ConsoleRequestId::ToggleSfxCache:
+				this->sfx_cache_enabled = !this->sfx_cache_enabled;
+				this->update_sfx_cache();
+				break;
+			case ConsoleRequestId::GetSfxCache:
+				console_request->sfx_cache_enabled = this->sfx_cache_enabled;
+				break;
 			default:
 				return true;
 		}
@@ -172,74 +474,10 @@ bool Engine::update_console(PokemonVersion &version, CppRed::AudioProgramInterfa
 	return true;
 }
 
-template <bool DOWN, int OFFSET>
-static void process_times(InputState &state, double clock, double (&press_times)[8]){
-	auto val = state.get_value() & ~InputState::any_direction_mask;
-	if (DOWN){
-		state.set_value(val | (1 << OFFSET));
-		press_times[OFFSET] = clock;
-		return;
-	}
-	press_times[OFFSET] = -1;
-	int index = -1;
-	double max = -1;
-	for (int i = 0; i < array_length(press_times); i++){
-		if (press_times[i] > max){
-			max = press_times[i];
-			index = i;
-		}
-	}
-	if (index < 0){
-		state.set_value(val);
-		return;
-	}
-	state.set_value(val | (1 << index));
-}
-
-template <bool DOWN>
-static void handle_event(InputState &state, SDL_Event &event, bool &flag, double clock, double (&press_times)[8]){
-	switch (event.key.keysym.sym){
-		case SDLK_UP:
-			flag = true;
-			process_times<DOWN, InputState::offset_up>(state, clock, press_times);
-			break;
-		case SDLK_DOWN:
-			flag = true;
-			process_times<DOWN, InputState::offset_down>(state, clock, press_times);
-			break;
-		case SDLK_LEFT:
-			flag = true;
-			process_times<DOWN, InputState::offset_left>(state, clock, press_times);
-			break;
-		case SDLK_RIGHT:
-			flag = true;
-			process_times<DOWN, InputState::offset_right>(state, clock, press_times);
-			break;
-		case SDLK_z:
-			flag = true;
-			state.set_a(DOWN);
-			break;
-		case SDLK_x:
-			flag = true;
-			state.set_b(DOWN);
-			break;
-		case SDLK_a:
-			flag = true;
-			state.set_start(DOWN);
-			break;
-		case SDLK_s:
-			flag = true;
-			state.set_select(DOWN);
-			break;
-	}
-}
-
 bool Engine::handle_events(){
 	SDL_Event event;
-	auto &state = this->input_state;
-	bool button_down = false;
-	bool button_up = false;
-	auto clock = this->clock.get();
+	//Game buttons are picked up by input_queue's event watch as SDL receives
+	//them. This only handles what's left.
 	while (SDL_PollEvent(&event)){
 		if (this->console->handle_event(event))
 			continue;
@@ -248,55 +486,27 @@ bool Engine::handle_events(){
 				return false;
 			case SDL_MOUSEBUTTONDOWN:
 				{
-					auto &world = this->game->get_world();
-					if (world.player_initialized()){
-						Point location(event.button.x, event.button.y);
-						location.x = location.x / (this->screen_scale * Renderer::tile_size * 2);
-						location.y = location.y / (this->screen_scale * Renderer::tile_size * 2);
-						location -= CppRed::PlayerCharacter::screen_block_offset;
-						auto &pc = world.get_pc();
-						location += pc.get_map_position();
-						MapObjectInstance *objects[8];
-						world.get_objects_at_location(objects, {pc.get_current_map(), location});
-						std::stringstream stream;
-						stream << "Clicked at " << location << '\n';
-						for (auto object : objects){
-							if (!object)
-								break;
-							stream << "Found a " << object->get_object().get_type_string() << " named " << object->get_object().get_name() << '\n';
-						}
-						Logger() << stream.str();
-					}
+					//The world belongs to the logic thread.
+					LOCK_MUTEX(this->pending_clicks_mutex);
+					this->pending_clicks.emplace_back(event.button.x, event.button.y);
 					break;
 				}
 			case SDL_KEYDOWN:
-				if (!event.key.repeat){
-					switch (event.key.keysym.sym){
-						case SDLK_ESCAPE:
-							this->console->toggle_visible();
-							break;
-						default:
-							handle_event<true>(state, event, button_down, clock, this->direction_press_times);
-					}
-				}
-				break;
-			case SDL_KEYUP:
-				if (!event.key.repeat)
-					handle_event<false>(state, event, button_up, clock, this->direction_press_times);
+				if (!event.key.repeat && event.key.keysym.sym == SDLK_ESCAPE)
+					this->console->toggle_visible();
 				break;
 			default:
 				break;
 		}
 	}
-	const byte_t mask = InputState::mask_a | InputState::mask_b | InputState::mask_select | InputState::mask_start;
-	if (button_down && (state.get_value() & mask) == mask){
-		//Do soft reset
-	}
 	return true;
 }
 
 void Engine::go_to_debug(){
-	this->debug_mode = true;
+	if (this->debug_mode.exchange(true))
+		return;
+	if (this->logic_thread && std::this_thread::get_id() != this->logic_thread->get_id())
+		this->debug_mode_entered.wait();
 }
 
 void Engine::throw_exception(const std::exception &e){
@@ -308,6 +518,6 @@ void Engine::execute_script(const CppRed::Scripts::script_parameters &parameter)
 	this->script_store.execute(parameter);
 }
 
-ScriptStore::script_f Engine::get_script(const char *script_name) const{
-	return this->script_store.get_script(script_name);
+ScriptStore::script_f Engine::get_script(CppRed::ScriptId script) const{
+	return this->script_store.get_script(script);
 }
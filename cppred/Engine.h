@@ -1,22 +1,31 @@
 #pragma once
 #include "utility.h"
 #include "InputState.h"
+#include "InputQueue.h"
 #include "Renderer.h"
 #include "HighResolutionClock.h"
 #include "ScriptStore.h"
+#include "threads.h"
 #ifndef HAVE_PCH
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <atomic>
+#include <vector>
+#include <string>
 #endif
 
 enum class PokemonVersion;
+enum class SynthesisQuality;
 class XorShift128;
 class Renderer;
 class Console;
-class AudioDevice;
+class AbstractAudioDevice;
 class AudioScheduler;
 class TwoWayMixer;
+class FrameRecorder;
+class SfxCache;
+struct SessionData;
 struct SDL_Window;
 typedef struct SDL_Window SDL_Window;
 
@@ -28,42 +37,106 @@ class Game;
 //#define Engine_USE_FIXED_CLOCK
 
 class Engine{
+	bool headless;
+	unsigned audio_buffer_length;
+	//In seconds. Zero if music is rendered as it's played.
+	double music_lookahead = 0;
 #ifndef Engine_USE_FIXED_CLOCK
 	HighResolutionClock base_clock;
+	//Game time. Advanced by exactly one logical frame per logic tick, so it
+	//never depends on how often ticks actually get to run.
+	ManualClock manual_clock;
 	SteppingClock clock;
+	//Stepped by the thread that handles events and runs the console, while
+	//clock is stepped by the logic thread.
+	SteppingClock ui_clock;
 #else
 	FixedClock clock;
+	FixedClock ui_clock;
 #endif
 	SDL_Window *window = nullptr;
-	std::unique_ptr<AudioDevice> audio_device;
+	//The data a session needs that can be decoded independently of
+	//everything else. startup_graph decodes it on worker threads while this
+	//thread initializes SDL and builds the renderer and the mixer. Declared
+	//in this order so that the graph is destroyed, and its workers joined,
+	//before the data they write to.
+	std::unique_ptr<SessionData> session_data;
+	std::unique_ptr<TaskGraph> startup_graph;
+	std::unique_ptr<AbstractAudioDevice> audio_device;
 	std::unique_ptr<VideoDevice> video_device;
+	//Outlives the sessions, so that a recording spans restarts.
+	std::unique_ptr<FrameRecorder> recorder;
 	std::unique_ptr<Renderer> renderer;
 	std::unique_ptr<CppRed::Game> game;
 	XorShift128 prng;
-	InputState input_state;
+	//Latched by the logic thread right before each tick. Headless engines
+	//have their input set through set_input_state() instead.
+	InputQueue input_queue;
+	std::atomic<byte_t> shared_input_state;
+	//Owned by the main thread.
+	LatencyProbe latency_probe;
+	//Outlives the sessions, as long as the version doesn't change. Must be
+	//destroyed after the audio scheduler, which uses it.
+	std::unique_ptr<SfxCache> sfx_cache;
+	bool sfx_cache_enabled = false;
 	std::unique_ptr<AudioScheduler> audio_scheduler;
 	std::unique_ptr<Console> console;
-	bool debug_mode = false;
+	std::atomic<bool> debug_mode;
+	//Set by the event thread. The logic thread, which owns the renderer, does
+	//the capture.
+	std::atomic<bool> scene_capture_requested;
+	std::unique_ptr<std::thread> logic_thread;
+	std::atomic<bool> logic_thread_running;
+	Event debug_mode_entered;
+	bool debug_mode_signalled = false;
+	std::mutex pending_clicks_mutex;
+	std::vector<Point> pending_clicks;
 	std::mutex exception_thrown_mutex;
 	std::unique_ptr<std::string> exception_thrown;
 	ScriptStore script_store;
 	bool gamepad_disabled = false;
 	TwoWayMixer *two_way_mixer = nullptr;
-	double direction_press_times[8];
+	CppRed::AudioProgramInterface *audio_program = nullptr;
+	SynthesisQuality synthesis_quality;
 
 	void initialize_video();
 	void initialize_audio();
+	void start_loading_session_data();
+	void start_session(PokemonVersion version);
+	void end_session();
+	void update_sfx_cache();
+	void start_logic_thread();
+	void stop_logic_thread();
+	void logic_thread_function();
+	void logic_tick();
+	void handle_pending_clicks();
 	bool handle_events();
 	bool update_console(PokemonVersion &version, CppRed::AudioProgramInterface &program);
 	void check_exceptions();
+	void capture_scene_if_requested();
 public:
-	Engine();
+	//Headless engines don't touch SDL. They're driven by start_headless() and
+	//step_headless() instead of run(), one logic tick per step.
+	//audio_buffer_length is passed on to AudioDevice.
+	explicit Engine(bool headless = false, unsigned audio_buffer_length = 0);
 	~Engine();
 	Engine(const Engine &) = delete;
 	Engine(Engine &&other) = delete;
 	void operator=(const Engine &) = delete;
 	void operator=(Engine &&) = delete;
 	void run();
+	//Records every following session. See FrameRecorder for the meaning of
+	//path.
+	void start_recording(const std::string &path);
+	//Renders music this many seconds ahead of playback in every following
+	//session. See AudioProgramInterface::set_music_lookahead().
+	void set_music_lookahead(double seconds);
+	void start_headless(PokemonVersion version);
+	void step_headless();
+	void set_input_state(const InputState &state){
+		this->shared_input_state = state.get_value();
+	}
+	DEFINE_GETTER(headless)
 	DEFINE_NON_CONST_GETTER(prng)
 	Renderer &get_renderer(){
 		return *this->renderer;
@@ -71,16 +144,24 @@ public:
 	SteppingClock &get_stepping_clock(){
 		return this->clock;
 	}
+	SteppingClock &get_ui_clock(){
+		return this->ui_clock;
+	}
 	void execute_script(const CppRed::Scripts::script_parameters &parameter) const;
-	ScriptStore::script_f get_script(const char *script_name) const;
+	ScriptStore::script_f get_script(CppRed::ScriptId) const;
 	InputState get_input_state() const{
-		return this->gamepad_disabled ? InputState() : this->input_state;
+		InputState ret;
+		if (!this->gamepad_disabled)
+			ret.set_value(this->shared_input_state);
+		return ret;
 	}
 	DEFINE_GETTER_SETTER(gamepad_disabled)
 	TwoWayMixer &get_mixer(){
 		return *this->two_way_mixer;
 	}
 
+	//Stops the game logic. When called from outside the logic thread, doesn't
+	//return until the logic thread has stopped touching the game.
 	void go_to_debug();
 	void restart();
 	void throw_exception(const std::exception &e);
@@ -0,0 +1,281 @@
+#include "stdafx.h"
+#include "FrameRecorder.h"
+#include "Engine.h"
+#include "AsyncLog.h"
+#ifndef HAVE_PCH
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#endif
+
+static_assert(FrameRecorder::width == Renderer::logical_screen_width && FrameRecorder::height == Renderer::logical_screen_height, "");
+
+namespace{
+
+class Crc32Table{
+public:
+	std::uint32_t table[256];
+	Crc32Table(){
+		for (std::uint32_t i = 0; i < 256; i++){
+			auto c = i;
+			for (int j = 0; j < 8; j++)
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			this->table[i] = c;
+		}
+	}
+	std::uint32_t compute(const byte_t *data, size_t size, std::uint32_t crc = 0) const{
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = this->table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+};
+
+const Crc32Table crc32_table;
+
+std::uint32_t adler32(const byte_t *data, size_t size){
+	std::uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < size; i++){
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+void write_u32_be(std::vector<byte_t> &dst, std::uint32_t x){
+	for (int i = 4; i--;)
+		dst.push_back((byte_t)(x >> (i * 8)));
+}
+
+void write_u16_le(std::ostream &stream, std::uint16_t x){
+	byte_t buffer[] = { (byte_t)x, (byte_t)(x >> 8) };
+	stream.write((const char *)buffer, sizeof(buffer));
+}
+
+void write_u32_le(std::ostream &stream, std::uint32_t x){
+	byte_t buffer[] = { (byte_t)x, (byte_t)(x >> 8), (byte_t)(x >> 16), (byte_t)(x >> 24) };
+	stream.write((const char *)buffer, sizeof(buffer));
+}
+
+void append_png_chunk(std::vector<byte_t> &dst, const char *type, const byte_t *data, size_t size){
+	write_u32_be(dst, (std::uint32_t)size);
+	auto start = dst.size();
+	dst.insert(dst.end(), type, type + 4);
+	dst.insert(dst.end(), data, data + size);
+	write_u32_be(dst, crc32_table.compute(&dst[start], dst.size() - start));
+}
+
+bool ends_with(const std::string &s, const char *suffix){
+	auto n = strlen(suffix);
+	return s.size() >= n && !s.compare(s.size() - n, n, suffix);
+}
+
+}
+
+FrameRecorder::FrameRecorder(const std::string &path, const RGB (&palette)[4]):
+		path(path),
+		format(ends_with(path, ".y4m") ? Format::Y4M : Format::Png),
+		frames(new CapturedFrame[frame_ring_size]),
+		audio(audio_ring_length),
+		last_image(width * height, 0),
+		audio_buffer(AudioFrame::length * 4){
+	std::copy(palette, palette + 4, this->palette);
+	for (int i = 0; i < 4; i++){
+		auto &c = palette[i];
+		this->luma[i] = (byte_t)((c.r * 77 + c.g * 150 + c.b * 29 + 128) >> 8);
+	}
+	this->frame_write_position = 0;
+	this->frame_read_position = 0;
+	this->frames_captured = 0;
+	this->frames_dropped = 0;
+	this->samples_dropped = 0;
+
+	auto base = this->path;
+	if (this->format == Format::Y4M){
+		base.resize(base.size() - 4);
+		this->video_file.open(this->path, std::ios::binary);
+		if (!this->video_file)
+			throw std::runtime_error("FrameRecorder::FrameRecorder(): Can't open " + this->path);
+		std::stringstream header;
+		header << "YUV4MPEG2 W" << width << " H" << height << " F" << Engine::dmg_clock_frequency << ':' << Engine::dmg_display_period << " Ip A1:1 Cmono\n";
+		this->video_file << header.str();
+	}
+	auto audio_path = base + ".wav";
+	this->audio_file.open(audio_path, std::ios::binary);
+	if (!this->audio_file)
+		throw std::runtime_error("FrameRecorder::FrameRecorder(): Can't open " + audio_path);
+	this->write_wav_header();
+
+	this->thread = std::thread([this](){ this->thread_function(); });
+}
+
+FrameRecorder::~FrameRecorder(){
+	{
+		LOCK_MUTEX(this->mutex);
+		this->running = false;
+		this->cv.notify_all();
+	}
+	this->thread.join();
+	this->audio_file.seekp(0);
+	this->write_wav_header();
+	Logger() << "Recording finished: " << this->frames_written << " frames, " << this->get_dropped_frame_count() << " frames dropped, " << this->get_dropped_sample_count() << " audio samples dropped.\n";
+}
+
+byte_t *FrameRecorder::begin_frame(){
+	auto write = this->frame_write_position.load(std::memory_order_relaxed);
+	auto read = this->frame_read_position.load(std::memory_order_acquire);
+	if (write - read >= frame_ring_size){
+		this->frames_dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	auto &frame = this->frames[write % frame_ring_size];
+	frame.tick = this->tick;
+	return frame.pixels;
+}
+
+void FrameRecorder::end_frame(){
+	auto write = this->frame_write_position.load(std::memory_order_relaxed);
+	this->frame_write_position.store(write + 1, std::memory_order_release);
+	this->frames_captured.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameRecorder::submit_audio(const StereoSampleFinal *samples, size_t count){
+	auto written = this->audio.write(samples, count);
+	if (written < count)
+		this->samples_dropped.fetch_add(count - written, std::memory_order_relaxed);
+}
+
+void FrameRecorder::thread_function(){
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true){
+		//Whatever was produced before the stop request is still written.
+		bool stop = !this->running;
+		while (this->consume());
+		if (stop)
+			break;
+		this->cv.wait_for(lock, std::chrono::milliseconds(5));
+	}
+}
+
+bool FrameRecorder::consume(){
+	bool ret = false;
+	auto read = this->frame_read_position.load(std::memory_order_relaxed);
+	auto write = this->frame_write_position.load(std::memory_order_acquire);
+	if (read != write){
+		this->encode(this->frames[read % frame_ring_size]);
+		this->frame_read_position.store(read + 1, std::memory_order_release);
+		ret = true;
+	}
+	auto samples = std::min(this->audio.get_available_samples(), this->audio_buffer.size());
+	if (samples){
+		this->audio.read(&this->audio_buffer[0], samples);
+		this->audio_file.write((const char *)&this->audio_buffer[0], samples * sizeof(StereoSampleFinal));
+		this->samples_written += samples;
+		ret = true;
+	}
+	return ret;
+}
+
+void FrameRecorder::encode(const CapturedFrame &frame){
+	if (frame.tick < this->next_tick)
+		return;
+	if (this->format == Format::Png)
+		this->write_png(frame.pixels, frame.tick);
+	else{
+		//Ticks without a frame of their own show the last one.
+		for (; this->next_tick < frame.tick; this->next_tick++)
+			this->write_y4m_frame(&this->last_image[0]);
+		this->write_y4m_frame(frame.pixels);
+		memcpy(&this->last_image[0], frame.pixels, width * height);
+	}
+	this->next_tick = frame.tick + 1;
+}
+
+void FrameRecorder::write_y4m_frame(const byte_t *pixels){
+	byte_t image[width * height];
+	for (int i = 0; i < width * height; i++)
+		image[i] = this->luma[pixels[i]];
+	this->video_file << "FRAME\n";
+	this->video_file.write((const char *)image, sizeof(image));
+	this->frames_written++;
+}
+
+void FrameRecorder::write_png(const byte_t *pixels, std::uint64_t tick){
+	const int row_size = 1 + width / 4;
+	const size_t raw_size = row_size * height;
+	static_assert(raw_size <= 0xFFFF, "The image must fit in a single stored deflate block.");
+
+	auto &png = this->png_buffer;
+	png.clear();
+	static const byte_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	png.insert(png.end(), signature, signature + sizeof(signature));
+
+	std::vector<byte_t> chunk;
+	write_u32_be(chunk, width);
+	write_u32_be(chunk, height);
+	//2 bits per pixel, indexed color, deflate, no filtering, no interlacing.
+	static const byte_t ihdr_tail[] = { 2, 3, 0, 0, 0 };
+	chunk.insert(chunk.end(), ihdr_tail, ihdr_tail + sizeof(ihdr_tail));
+	append_png_chunk(png, "IHDR", &chunk[0], chunk.size());
+
+	chunk.clear();
+	for (auto &c : this->palette){
+		chunk.push_back(c.r);
+		chunk.push_back(c.g);
+		chunk.push_back(c.b);
+	}
+	append_png_chunk(png, "PLTE", &chunk[0], chunk.size());
+
+	//zlib stream made of a single stored block. The images are small enough
+	//that compressing them isn't worth the time.
+	byte_t raw[raw_size];
+	for (int y = 0; y < height; y++){
+		auto row = raw + y * row_size;
+		row[0] = 0;
+		for (int x = 0; x < width; x += 4){
+			auto p = pixels + y * width + x;
+			row[1 + x / 4] = (byte_t)((p[0] << 6) | (p[1] << 4) | (p[2] << 2) | p[3]);
+		}
+	}
+	chunk.clear();
+	chunk.push_back(0x78);
+	chunk.push_back(0x01);
+	chunk.push_back(1);
+	chunk.push_back((byte_t)raw_size);
+	chunk.push_back((byte_t)(raw_size >> 8));
+	chunk.push_back((byte_t)~raw_size);
+	chunk.push_back((byte_t)(~raw_size >> 8));
+	chunk.insert(chunk.end(), raw, raw + raw_size);
+	write_u32_be(chunk, adler32(raw, raw_size));
+	append_png_chunk(png, "IDAT", &chunk[0], chunk.size());
+	append_png_chunk(png, "IEND", nullptr, 0);
+
+	std::stringstream name;
+	name << this->path << std::setw(6) << std::setfill('0') << tick << ".png";
+	std::ofstream file(name.str(), std::ios::binary);
+	file.write((const char *)&png[0], png.size());
+	this->frames_written++;
+}
+
+void FrameRecorder::write_wav_header(){
+	const int channels = 2;
+	const int bytes_per_sample = sizeof(StereoSampleFinal) / channels;
+	auto data_size = (std::uint32_t)(this->samples_written * sizeof(StereoSampleFinal));
+	auto &file = this->audio_file;
+	file.write("RIFF", 4);
+	write_u32_le(file, 36 + data_size);
+	file.write("WAVEfmt ", 8);
+	write_u32_le(file, 16);
+	//PCM
+	write_u16_le(file, 1);
+	write_u16_le(file, channels);
+	write_u32_le(file, sampling_frequency);
+	write_u32_le(file, sampling_frequency * sizeof(StereoSampleFinal));
+	write_u16_le(file, sizeof(StereoSampleFinal));
+	write_u16_le(file, bytes_per_sample * 8);
+	file.write("data", 4);
+	write_u32_le(file, data_size);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "AudioData.h"
+#include "AudioRingBuffer.h"
+#include "RendererStructs.h"
+#ifndef HAVE_PCH
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#endif
+
+//Records gameplay without ever holding up the game. The renderer copies the
+//shade index of every pixel (0-3, before the RGB expansion) into a fixed
+//ring of frames and the mixer copies its output into a fixed ring of
+//samples. A background thread encodes both to disk. When either ring is full
+//the data is dropped and counted, and the producer moves on.
+//
+//Video is written either as a single Y4M stream (if the path ends in
+//".y4m") or as a sequence of 2-bit indexed PNGs named <path>NNNNNN.png.
+//Audio is written to <path>.wav, as 16-bit stereo PCM.
+//
+//Frames are stamped with the logic tick they were rendered on, and the Y4M
+//encoder repeats the previous image for ticks that weren't rendered or were
+//dropped, so the video always runs at exactly one image per logical frame
+//and stays in sync with the audio.
+class FrameRecorder{
+public:
+	static const int width = 160;
+	static const int height = 144;
+	static const size_t frame_ring_size = 64;
+	static const size_t audio_ring_length = sampling_frequency * 2;
+	enum class Format{
+		Y4M,
+		Png,
+	};
+private:
+	struct CapturedFrame{
+		std::uint64_t tick;
+		byte_t pixels[width * height];
+	};
+
+	std::string path;
+	Format format;
+	RGB palette[4];
+	byte_t luma[4];
+	std::unique_ptr<CapturedFrame[]> frames;
+	std::atomic<std::uint64_t> frame_write_position;
+	std::atomic<std::uint64_t> frame_read_position;
+	AudioRingBuffer audio;
+	//Only touched by the producer of frames.
+	std::uint64_t tick = 0;
+	std::atomic<std::uint64_t> frames_captured;
+	std::atomic<std::uint64_t> frames_dropped;
+	std::atomic<std::uint64_t> samples_dropped;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread thread;
+	bool running = true;
+
+	//Consumer state.
+	std::ofstream video_file;
+	std::ofstream audio_file;
+	std::uint64_t frames_written = 0;
+	std::uint64_t samples_written = 0;
+	//The first logic tick is tick 1.
+	std::uint64_t next_tick = 1;
+	std::vector<byte_t> last_image;
+	std::vector<StereoSampleFinal> audio_buffer;
+	std::vector<byte_t> png_buffer;
+
+	void thread_function();
+	bool consume();
+	void encode(const CapturedFrame &);
+	void write_y4m_frame(const byte_t *pixels);
+	void write_png(const byte_t *pixels, std::uint64_t tick);
+	void write_wav_header();
+public:
+	//The palette maps shade indices to colors, for the encoded output.
+	FrameRecorder(const std::string &path, const RGB (&palette)[4]);
+	~FrameRecorder();
+	FrameRecorder(const FrameRecorder &) = delete;
+	void operator=(const FrameRecorder &) = delete;
+	//Called by the logic thread once per logic tick.
+	void advance_tick(){
+		this->tick++;
+	}
+	//Returns the buffer the next frame should be written to, or null if the
+	//ring is full, in which case the frame is counted as dropped. A non-null
+	//return must be followed by end_frame().
+	byte_t *begin_frame();
+	void end_frame();
+	//Called by the mixer. Never blocks.
+	void submit_audio(const StereoSampleFinal *samples, size_t count);
+	std::uint64_t get_captured_frame_count() const{
+		return this->frames_captured.load(std::memory_order_relaxed);
+	}
+	std::uint64_t get_dropped_frame_count() const{
+		return this->frames_dropped.load(std::memory_order_relaxed);
+	}
+	std::uint64_t get_dropped_sample_count() const{
+		return this->samples_dropped.load(std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,112 @@
+#include "stdafx.h"
+#include "HeadlessHost.h"
+#include "Engine.h"
+#include "HighResolutionClock.h"
+#ifndef HAVE_PCH
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#endif
+
+HeadlessHost::HeadlessHost(size_t instance_count, unsigned thread_count, PokemonVersion version):
+		instances(instance_count),
+		statistics(instance_count),
+		pool(thread_count){
+	this->pool.run(instance_count, [this, version](size_t i){
+		try{
+			std::unique_ptr<Engine> engine(new Engine(true));
+			engine->start_headless(version);
+			this->instances[i] = std::move(engine);
+		}catch (std::exception &e){
+			this->statistics[i].error = e.what();
+		}catch (...){
+			this->statistics[i].error = "Unknown exception.";
+		}
+		return false;
+	});
+}
+
+HeadlessHost::~HeadlessHost(){
+	this->pool.run(this->instances.size(), [this](size_t i){
+		this->instances[i].reset();
+		return false;
+	});
+}
+
+bool HeadlessHost::step(size_t i, std::uint64_t target_frames){
+	auto &engine = this->instances[i];
+	auto &stats = this->statistics[i];
+	if (!engine || stats.frames >= target_frames)
+		return false;
+	HighResolutionClock clock;
+	try{
+		if (this->input_source)
+			engine->set_input_state(this->input_source(i, stats.frames));
+		engine->step_headless();
+	}catch (std::exception &e){
+		stats.error = e.what();
+		engine.reset();
+		return false;
+	}catch (...){
+		stats.error = "Unknown exception.";
+		engine.reset();
+		return false;
+	}
+	auto elapsed = clock.get();
+	stats.frames++;
+	stats.total_step_time += elapsed;
+	stats.max_step_time = std::max(stats.max_step_time, elapsed);
+	return stats.frames < target_frames;
+}
+
+void HeadlessHost::run(std::uint64_t frames){
+	std::vector<std::uint64_t> targets(this->statistics.size());
+	for (size_t i = 0; i < targets.size(); i++)
+		targets[i] = this->statistics[i].frames + frames;
+
+	HighResolutionClock clock;
+	this->pool.run(this->instances.size(), [this, &targets](size_t i){
+		return this->step(i, targets[i]);
+	});
+	this->wall_time += clock.get();
+
+	this->frames_run = 0;
+	for (auto &stats : this->statistics)
+		this->frames_run += stats.frames;
+}
+
+double HeadlessHost::get_aggregate_frame_rate() const{
+	if (this->wall_time <= 0)
+		return 0;
+	return this->frames_run / this->wall_time;
+}
+
+void HeadlessHost::report(std::ostream &stream) const{
+	size_t failed = 0;
+	double total_time = 0;
+	double max_time = 0;
+	for (auto &stats : this->statistics){
+		if (stats.error.size())
+			failed++;
+		total_time += stats.total_step_time;
+		max_time = std::max(max_time, stats.max_step_time);
+	}
+	auto flags = stream.flags();
+	stream << std::fixed << std::setprecision(3)
+		<< "Instances: " << this->instances.size() << " (" << failed << " failed), threads: " << this->pool.get_thread_count() << std::endl
+		<< "Frames: " << this->frames_run << " in " << this->wall_time << " s, " << this->get_aggregate_frame_rate() << " fps aggregate ("
+		<< this->get_aggregate_frame_rate() * Engine::logical_refresh_period << "x real time)\n";
+	if (this->frames_run)
+		stream << "Step latency: mean " << total_time / this->frames_run * 1000 << " ms, max " << max_time * 1000 << " ms\n";
+	for (size_t i = 0; i < this->statistics.size(); i++){
+		auto &stats = this->statistics[i];
+		stream << "  #" << i << ": " << stats.frames << " frames";
+		if (stats.frames)
+			stream << ", mean " << stats.total_step_time / stats.frames * 1000 << " ms, max " << stats.max_step_time * 1000 << " ms";
+		if (stats.error.size())
+			stream << ", error: " << stats.error;
+		stream << std::endl;
+	}
+	stream.flags(flags);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "threads.h"
+#include "InputState.h"
+#ifndef HAVE_PCH
+#include <vector>
+#include <memory>
+#include <string>
+#include <functional>
+#include <iosfwd>
+#include <cstdint>
+#endif
+
+class Engine;
+enum class PokemonVersion;
+
+//Runs many headless Engines at once, spread over a WorkStealingPool. Each
+//instance advances one logical frame per step, as fast as the host allows.
+class HeadlessHost{
+public:
+	typedef std::function<InputState(size_t instance, std::uint64_t frame)> input_source_t;
+	struct InstanceStatistics{
+		std::uint64_t frames = 0;
+		double total_step_time = 0;
+		double max_step_time = 0;
+		std::string error;
+	};
+private:
+	std::vector<std::unique_ptr<Engine>> instances;
+	std::vector<InstanceStatistics> statistics;
+	WorkStealingPool pool;
+	input_source_t input_source;
+	std::uint64_t frames_run = 0;
+	double wall_time = 0;
+
+	bool step(size_t instance, std::uint64_t target_frames);
+public:
+	HeadlessHost(size_t instance_count, unsigned thread_count, PokemonVersion version);
+	~HeadlessHost();
+	void set_input_source(input_source_t &&source){
+		this->input_source = std::move(source);
+	}
+	//Advances every instance by the given number of frames. Instances that
+	//throw are stopped and their error is recorded.
+	void run(std::uint64_t frames);
+	const std::vector<InstanceStatistics> &get_statistics() const{
+		return this->statistics;
+	}
+	//Frames per second, summed over all instances.
+	double get_aggregate_frame_rate() const;
+	void report(std::ostream &) const;
+};
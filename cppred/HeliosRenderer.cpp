@@ -4,6 +4,7 @@
 #include "utility.h"
 #ifndef HAVE_PCH
 #include <sstream>
+#include <algorithm>
 #endif
 
 #define CHANNEL_SELECTION 0xF
@@ -12,29 +13,39 @@
 #define CHANNEL3 (1 << 2)
 #define CHANNEL4 (1 << 3)
 
+template <typename T>
+static std::int16_t saturate_s16(T x){
+	return (std::int16_t)(x > int16_max ? int16_max : (x < int16_min ? int16_min : x));
+}
+
 basic_StereoSample<std::int16_t> convert(const basic_StereoSample<intermediate_audio_type> &src){
 #ifdef USE_FLOAT_AUDIO
 	basic_StereoSample<std::int16_t> ret;
-	ret.left = (std::int16_t)(src.left * int16_max);
-	ret.right = (std::int16_t)(src.right * int16_max);
+	ret.left = saturate_s16(cast_round(src.left * int16_max));
+	ret.right = saturate_s16(cast_round(src.right * int16_max));
 	return ret;
 #else
 	basic_StereoSample<std::int16_t> ret;
-	ret.left = (std::int16_t)src.left;
-	ret.right = (std::int16_t)src.right;
+	ret.left = saturate_s16(src.left);
+	ret.right = saturate_s16(src.right);
 	return ret;
 #endif
 }
 
-HeliosRenderer::HeliosRenderer(AbstractAudioDevice &dev):
+HeliosRenderer::HeliosRenderer(AbstractAudioDevice &dev, size_t extra_queued_frames):
 		GbAudioRenderer(dev),
 #ifdef USE_STD_FUNCTION
 		audio_sample_clock(gb_cpu_frequency_power, sampling_frequency, [this](std::uint64_t n){ this->sample_callback(n); }),
-		frame_sequencer_clock(gb_cpu_frequency_power, 512, [this](std::uint64_t n){ this->frame_sequencer_callback(n); })
+		frame_sequencer_clock(gb_cpu_frequency_power, 512, [this](std::uint64_t n){ this->frame_sequencer_callback(n); }),
 #else
 		audio_sample_clock(gb_cpu_frequency_power, sampling_frequency, sample_callback, this),
-		frame_sequencer_clock(gb_cpu_frequency_power, 512, frame_sequencer_callback, this)
+		frame_sequencer_clock(gb_cpu_frequency_power, 512, frame_sequencer_callback, this),
 #endif
+		publishing_frames(max_queued_frames + extra_queued_frames),
+		private_frame_no(0),
+		consumed_frame_no(0),
+		discard_before(0),
+		restart_private_frame(false)
 {
 #ifdef OUTPUT_AUDIO_TO_FILE
 	this->output_file.reset(new std::ofstream("output-0.raw", std::ios::binary));
@@ -62,6 +73,7 @@ HeliosRenderer::HeliosRenderer(AbstractAudioDevice &dev):
 			buffer.reset();
 	}
 #endif
+	this->requested_synthesis_quality = SynthesisQuality::PointSampled;
 	this->initialize_new_frame();
 }
 
@@ -70,27 +82,59 @@ HeliosRenderer::~HeliosRenderer(){
 }
 
 void HeliosRenderer::update(double now){
+	if (this->restart_private_frame.exchange(false)){
+		//Frames may have been published since the discard, too.
+		this->discard_before = this->private_frame_no.load();
+		this->current_frame_position = 0;
+	}
 	this->current_clock = cast_round_u64(now * gb_cpu_frequency);
 	if (this->set_audio_turned_on_at_at_next_update){
 		this->audio_turned_on_at = this->current_clock;
 		this->set_audio_turned_on_at_at_next_update = false;
 	}
+	auto quality = this->requested_synthesis_quality.load();
+	if (quality != this->synthesis_quality){
+		this->synthesis_quality = quality;
+		for (auto &synthesizer : this->synthesizers)
+			synthesizer.set_quality(quality);
+	}
 	auto t = this->current_clock - this->audio_turned_on_at;
-	std::uint64_t i, loops;
+	std::uint64_t i, end;
 	if (t < this->last_simulated_time){
 		i = t - t % 4;
-		loops = 1;
+		end = i + 4;
 	}else{
 		i = this->last_simulated_time;
-		loops = (t - i) / 4;
+		end = i + (t - i) / 4 * 4;
+	}
+
+	if (i >= end){
+		this->last_simulated_time = end;
+		return;
 	}
 
-	for (std::uint64_t j = 0; j < loops; j++, i += 4){
+	//The hardware is simulated in steps of 4 cycles, but most steps do nothing.
+	//Jump directly to the next step at which either of the clocks fires. The
+	//noise LFSR is advanced in bulk at those steps, and at both ends of the
+	//span, so that it observes register writes (which only happen between calls
+	//to update()) at the same steps it used to.
+	this->noise.update_state_before_render(i);
+	while (true){
+		auto next = std::min(this->frame_sequencer_clock.get_next_firing(i), this->audio_sample_clock.get_next_firing(i));
+		if (next >= end)
+			break;
+		//Round up to the 4-cycle grid.
+		next = i + (next - i + 3) / 4 * 4;
+		if (next >= end)
+			break;
+		i = next;
 		this->noise.update_state_before_render(i);
 		this->frame_sequencer_clock.update(i);
 		this->audio_sample_clock.update(i);
+		i += 4;
 	}
-	this->last_simulated_time = i;
+	this->noise.update_state_before_render(end - 4);
+	this->last_simulated_time = end;
 }
 
 void HeliosRenderer::sample_callback(void *This, std::uint64_t sample_no){
@@ -121,19 +165,32 @@ void HeliosRenderer::frame_sequencer_callback(std::uint64_t clock){
 		this->sweep_event();
 }
 
-StereoSampleFinal HeliosRenderer::compute_sample(){
+StereoSampleIntermediate HeliosRenderer::compute_sample(){
 	std::uint64_t sample_no = this->internal_sample_counter++;
 	if (!this->master_toggle){
-		StereoSampleFinal ret;
+		StereoSampleIntermediate ret;
 		ret.left = ret.right = 0;
 		return ret;
 	}
 
 	StereoSampleIntermediate channels[4];
-	channels[0] = this->render_square1(sample_no);
-	channels[1] = this->render_square2(sample_no);
-	channels[2] = this->render_voluntary(sample_no);
-	channels[3] = this->render_noise(sample_no);
+	if (this->NR51 || this->synthesis_quality != SynthesisQuality::PointSampled){
+		channels[0] = this->render_square1(sample_no);
+		channels[1] = this->render_square2(sample_no);
+		channels[2] = this->render_voluntary(sample_no);
+		channels[3] = this->render_noise(sample_no);
+	}else{
+		//No channel is routed to either output, which is the state the SFX
+		//renderer spends most of its time in. The generators still have to
+		//advance, since they anchor their phase at the first update after a
+		//trigger, but there's nothing to render or pan. Band-limited synthesis
+		//has to see every sample, so it can't take this shortcut.
+		this->square1.update_state_before_render(sample_no);
+		this->square2.update_state_before_render(sample_no);
+		this->wave.update_state_before_render(sample_no);
+		for (auto &channel : channels)
+			channel.left = channel.right = 0;
+	}
 
 	StereoSampleIntermediate sample;
 	sample.left = sample.right = 0;
@@ -141,7 +198,7 @@ StereoSampleFinal HeliosRenderer::compute_sample(){
 	for (int i = 4; i--;){
 #ifdef OUTPUT_AUDIO_TO_FILE
 		if (this->output_buffers_by_channel[i])
-			this->output_buffers_by_channel[i]->buffer[this->current_frame_position] = convert(channels[i]);
+			this->output_buffers_by_channel[i]->buffer[this->current_frame_position] = channels[i];
 #endif
 		sample += channels[i];
 	}
@@ -153,19 +210,27 @@ StereoSampleFinal HeliosRenderer::compute_sample(){
 	sample.right *= this->right_volume;
 	sample /= 15;
 
-	return convert(sample);
+	return sample;
 }
 
-void HeliosRenderer::write_sample(StereoSampleFinal *&buffer){
+#ifdef OUTPUT_AUDIO_TO_FILE
+static void write_to_file(std::ofstream &file, const StereoSampleIntermediate *buffer){
+	StereoSampleFinal temp[AudioFrame::length];
+	for (size_t i = 0; i < AudioFrame::length; i++)
+		temp[i] = convert(buffer[i]);
+	file.write((const char *)temp, sizeof(temp));
+}
+#endif
+
+void HeliosRenderer::write_sample(StereoSampleIntermediate *&buffer){
 	buffer[this->current_frame_position++] = this->last_sample;
 	if (this->current_frame_position >= AudioFrame::length){
 #ifdef OUTPUT_AUDIO_TO_FILE
 		if (this->output_file)
-			this->output_file->write((const char *)buffer, AudioFrame::length * sizeof(StereoSampleFinal));
+			write_to_file(*this->output_file, buffer);
 		for (int i = 4; i--;){
-			auto &buffer2 = this->output_buffers_by_channel[i]->buffer;
 			if (this->output_files_by_channel[i])
-				this->output_files_by_channel[i]->write((const char *)buffer2, sizeof(buffer2));
+				write_to_file(*this->output_files_by_channel[i], this->output_buffers_by_channel[i]->buffer);
 		}
 #endif
 		this->current_frame_position = 0;
@@ -178,6 +243,7 @@ void HeliosRenderer::write_sample(StereoSampleFinal *&buffer){
 void HeliosRenderer::initialize_new_frame(){
 	auto frame = this->publishing_frames.get_private_resource();
 	frame->frame_no = this->frame_no++;
+	this->private_frame_no = frame->frame_no;
 	frame->active = this->active;
 	auto &buffer = frame->buffer;
 	memset(buffer, 0, sizeof(buffer));
@@ -197,10 +263,28 @@ StereoSampleIntermediate compute_channel_panning_and_silence(const T1 &generator
 	return ret;
 }
 
+template <typename T>
+StereoSampleIntermediate HeliosRenderer::render_channel(T &generator, int channel, std::uint64_t time){
+	auto &pan = this->stereo_panning[channel];
+	if (this->synthesis_quality == SynthesisQuality::PointSampled)
+		return compute_channel_panning_and_silence(generator, time, pan);
+
+	//The synthesizer must see every sample, whether the channel is audible or
+	//not, to keep its history consistent.
+	auto &synthesizer = this->synthesizers[channel];
+	generator.add_transitions(time, synthesizer);
+	auto value = synthesizer.end_sample(generator.render(time));
+
+	StereoSampleIntermediate ret;
+	ret.left = value * !!pan.left;
+	ret.right = value * !!pan.right;
+	return ret;
+}
+
 StereoSampleIntermediate HeliosRenderer::render_square1(std::uint64_t time){
 	this->square1.update_state_before_render(time);
 #if CHANNEL_SELECTION & CHANNEL1
-	return compute_channel_panning_and_silence(this->square1, time, this->stereo_panning[0]);
+	return this->render_channel(this->square1, 0, time);
 #else
 	StereoSampleIntermediate ret;
 	ret.left = ret.right = 0;
@@ -211,7 +295,7 @@ StereoSampleIntermediate HeliosRenderer::render_square1(std::uint64_t time){
 StereoSampleIntermediate HeliosRenderer::render_square2(std::uint64_t time){
 	this->square2.update_state_before_render(time);
 #if CHANNEL_SELECTION & CHANNEL2
-	return compute_channel_panning_and_silence(this->square2, time, this->stereo_panning[1]);
+	return this->render_channel(this->square2, 1, time);
 #else
 	StereoSampleIntermediate ret;
 	ret.left = ret.right = 0;
@@ -222,7 +306,7 @@ StereoSampleIntermediate HeliosRenderer::render_square2(std::uint64_t time){
 StereoSampleIntermediate HeliosRenderer::render_voluntary(std::uint64_t time){
 	this->wave.update_state_before_render(time);
 #if CHANNEL_SELECTION & CHANNEL3
-	return compute_channel_panning_and_silence(this->wave, time, this->stereo_panning[2]);
+	return this->render_channel(this->wave, 2, time);
 #else
 	StereoSampleIntermediate ret;
 	ret.left = ret.right = 0;
@@ -232,7 +316,7 @@ StereoSampleIntermediate HeliosRenderer::render_voluntary(std::uint64_t time){
 
 StereoSampleIntermediate HeliosRenderer::render_noise(std::uint64_t time){
 #if CHANNEL_SELECTION & CHANNEL4
-	return compute_channel_panning_and_silence(this->noise, time, this->stereo_panning[3]);
+	return this->render_channel(this->noise, 3, time);
 #else
 	StereoSampleIntermediate ret;
 	ret.left = ret.right = 0;
@@ -439,7 +523,16 @@ void HeliosRenderer::copy_voluntary_wave(const void *buffer){
 }
 
 AudioFrame *HeliosRenderer::get_current_frame(){
-	return this->publishing_frames.get_public_resource();
+	std::uint64_t discard_before = this->discard_before;
+	while (true){
+		auto ret = this->publishing_frames.get_public_resource();
+		if (!ret)
+			return nullptr;
+		this->consumed_frame_no = ret->frame_no + 1;
+		if (ret->frame_no >= discard_before)
+			return ret;
+		this->publishing_frames.return_resource(ret);
+	}
 }
 
 void HeliosRenderer::return_used_frame(AudioFrame *frame){
@@ -450,3 +543,18 @@ void HeliosRenderer::set_active(bool active){
 	AudioRenderer::set_active(active);
 	this->publishing_frames.get_private_resource()->active |= active;
 }
+
+size_t HeliosRenderer::get_queued_frame_count() const{
+	std::uint64_t first = std::max<std::uint64_t>(this->consumed_frame_no, this->discard_before);
+	std::uint64_t end = this->private_frame_no;
+	return end > first ? (size_t)(end - first) : 0;
+}
+
+double HeliosRenderer::get_time_to_next_frame() const{
+	return (double)(AudioFrame::length - this->current_frame_position) / sampling_frequency;
+}
+
+void HeliosRenderer::discard_queued_frames(){
+	this->discard_before = this->private_frame_no.load();
+	this->restart_private_frame = true;
+}
@@ -28,7 +28,7 @@ class HeliosRenderer : public GbAudioRenderer{
 	std::uint64_t speed_counter_a = 0;
 	std::uint64_t speed_counter_b = 0;
 	std::uint64_t internal_sample_counter = 0;
-	StereoSampleFinal last_sample;
+	StereoSampleIntermediate last_sample;
 #ifdef OUTPUT_AUDIO_TO_FILE
 	std::unique_ptr<std::ofstream> output_file;
 	std::unique_ptr<std::ofstream> output_files_by_channel[4];
@@ -38,24 +38,44 @@ class HeliosRenderer : public GbAudioRenderer{
 	Square2Generator square2;
 	VoluntaryWaveGenerator wave;
 	NoiseGenerator noise;
+	//Written by the game thread, applied at the next update().
+	std::atomic<SynthesisQuality> requested_synthesis_quality;
+	SynthesisQuality synthesis_quality = SynthesisQuality::PointSampled;
+	BandLimitedSynthesizer synthesizers[4];
+	//TwoWayMixer drains every frame on each update, so this only needs to cover
+	//the frames produced by a single long update (e.g. after a stall).
+	static const size_t max_queued_frames = 16;
 	QueuedPublishingResource<AudioFrame> publishing_frames;
+	//Number of the private frame. Every frame before it has been published.
+	std::atomic<std::uint64_t> private_frame_no;
+	//Number of the frame after the last one the consumer took.
+	std::atomic<std::uint64_t> consumed_frame_no;
+	//Frames before this one are dropped by get_current_frame().
+	std::atomic<std::uint64_t> discard_before;
+	//Set by discard_queued_frames(). The next update() starts the private
+	//frame over, since part of it was rendered before the discard.
+	std::atomic<bool> restart_private_frame;
 
 	static void sample_callback(void *, std::uint64_t);
 	static void frame_sequencer_callback(void *, std::uint64_t);
 	void sample_callback(std::uint64_t);
 	void frame_sequencer_callback(std::uint64_t);
-	StereoSampleFinal compute_sample();
-	void write_sample(StereoSampleFinal *&buffer);
+	StereoSampleIntermediate compute_sample();
+	void write_sample(StereoSampleIntermediate *&buffer);
 	void initialize_new_frame();
 	StereoSampleIntermediate render_square1(std::uint64_t time);
 	StereoSampleIntermediate render_square2(std::uint64_t time);
 	StereoSampleIntermediate render_voluntary(std::uint64_t time);
 	StereoSampleIntermediate render_noise(std::uint64_t time);
+	template <typename T>
+	StereoSampleIntermediate render_channel(T &generator, int channel, std::uint64_t time);
 	void length_counter_event();
 	void volume_event();
 	void sweep_event();
 public:
-	HeliosRenderer(AbstractAudioDevice &);
+	//extra_queued_frames is only needed when the renderer is updated ahead of
+	//the consumer.
+	HeliosRenderer(AbstractAudioDevice &, size_t extra_queued_frames = 0);
 	~HeliosRenderer();
 	void update(double now) override;
 
@@ -104,8 +124,14 @@ public:
 	}
 	byte_t get_NR52() const override;
 	void copy_voluntary_wave(const void *buffer) override;
+	void set_synthesis_quality(SynthesisQuality quality) override{
+		this->requested_synthesis_quality = quality;
+	}
 
 	AudioFrame *get_current_frame() override;
 	void return_used_frame(AudioFrame *frame) override;
 	void set_active(bool active) override;
+	size_t get_queued_frame_count() const override;
+	double get_time_to_next_frame() const override;
+	void discard_queued_frames() override;
 };
@@ -18,6 +18,18 @@ public:
 	double get() override;
 };
 
+//Only advances when told to. Lets headless engines run faster than real time.
+class ManualClock : public AbstractClock{
+	double current_time = 0;
+public:
+	double get() override{
+		return this->current_time;
+	}
+	void advance(double seconds){
+		this->current_time += seconds;
+	}
+};
+
 class SteppingClock : public AbstractClock{
 protected:
 	std::string name;
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "InputQueue.h"
+#include "AsyncLog.h"
+#ifndef HAVE_PCH
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#endif
+
+static int key_to_button(SDL_Keycode key){
+	switch (key){
+		case SDLK_UP:
+			return InputState::offset_up;
+		case SDLK_DOWN:
+			return InputState::offset_down;
+		case SDLK_LEFT:
+			return InputState::offset_left;
+		case SDLK_RIGHT:
+			return InputState::offset_right;
+		case SDLK_z:
+			return InputState::offset_a;
+		case SDLK_x:
+			return InputState::offset_b;
+		case SDLK_a:
+			return InputState::offset_start;
+		case SDLK_s:
+			return InputState::offset_select;
+	}
+	return -1;
+}
+
+InputQueue::InputQueue(): queue(64){
+	this->accept_presses = true;
+	fill(this->direction_press_times, -1);
+}
+
+InputQueue::~InputQueue(){
+	this->detach();
+}
+
+void InputQueue::attach(){
+	if (this->attached)
+		return;
+	SDL_AddEventWatch(event_watch, this);
+	this->attached = true;
+}
+
+void InputQueue::detach(){
+	if (!this->attached)
+		return;
+	SDL_DelEventWatch(event_watch, this);
+	this->attached = false;
+}
+
+int SDLCALL InputQueue::event_watch(void *p, SDL_Event *event){
+	auto &queue = *(InputQueue *)p;
+	if ((event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) || event->key.repeat)
+		return 1;
+	InputEvent e;
+	e.time = queue.clock.get();
+	e.button = key_to_button(event->key.keysym.sym);
+	e.down = event->type == SDL_KEYDOWN;
+	if (e.button < 0 || (e.down && !queue.accept_presses))
+		return 1;
+	queue.queue.enqueue(e);
+	return 1;
+}
+
+void InputQueue::apply(const InputEvent &event){
+	if (event.down)
+		this->last_press_time = event.time;
+	if (event.button < InputState::offset_up){
+		auto value = this->state.get_value() & ~(1 << event.button);
+		if (event.down)
+			value |= 1 << event.button;
+		this->state.set_value((byte_t)value);
+		return;
+	}
+	auto &press_times = this->direction_press_times;
+	auto direction = event.button - InputState::offset_up;
+	press_times[direction] = event.down ? event.time : -1;
+	int index = -1;
+	double max = -1;
+	for (int i = 0; i < (int)array_length(press_times); i++){
+		if (press_times[i] > max){
+			max = press_times[i];
+			index = i;
+		}
+	}
+	auto value = this->state.get_value() & ~InputState::any_direction_mask;
+	if (index >= 0)
+		value |= 1 << (index + InputState::offset_up);
+	this->state.set_value((byte_t)value);
+}
+
+InputState InputQueue::latch(){
+	InputEvent event;
+	while (this->queue.try_dequeue(event))
+		this->apply(event);
+	return this->state;
+}
+
+void LatencyProbe::set_enabled(bool enabled){
+	this->enabled = enabled;
+	this->samples.clear();
+}
+
+void LatencyProbe::frame_presented(double input_time, double now){
+	//Every frame is tagged with the latest press, so only the first frame
+	//that carries a given press counts.
+	if (!this->enabled || input_time <= this->last_press_time)
+		return;
+	this->last_press_time = input_time;
+	this->samples.push_back(now - input_time);
+	if (this->samples.size() < report_interval)
+		return;
+	std::sort(this->samples.begin(), this->samples.end());
+	double sum = 0;
+	for (auto x : this->samples)
+		sum += x;
+	std::stringstream stream;
+	stream << std::fixed << std::setprecision(1)
+		<< "Press-to-present latency over " << this->samples.size() << " presses: min "
+		<< this->samples.front() * 1000 << " ms, median "
+		<< this->samples[this->samples.size() / 2] * 1000 << " ms, mean "
+		<< sum / this->samples.size() * 1000 << " ms, max "
+		<< this->samples.back() * 1000 << " ms\n";
+	Logger() << stream.str();
+	this->samples.clear();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "InputState.h"
+#include "HighResolutionClock.h"
+#include "queue/readerwriterqueue.h"
+#ifndef HAVE_PCH
+#include <SDL.h>
+#include <atomic>
+#include <vector>
+#endif
+
+struct InputEvent{
+	double time;
+	//One of the InputState offsets.
+	int button;
+	bool down;
+};
+
+//Carries button events from SDL to the logic thread. An event watch stamps
+//every key event the moment SDL receives it and puts it in a lock-free
+//queue, so events never wait for the main loop to get around to them. The
+//logic thread calls latch() right before running each tick, which applies
+//the queued events in order.
+//
+//When several directions are held, the one pressed last wins. Press times
+//are the times of the events, not the time they were latched.
+class InputQueue{
+	HighResolutionClock clock;
+	moodycamel::ReaderWriterQueue<InputEvent> queue;
+	//Cleared while the console has focus. Releases are always let through, so
+	//that no button is left stuck.
+	std::atomic<bool> accept_presses;
+	bool attached = false;
+
+	//Consumer state.
+	InputState state;
+	double direction_press_times[4];
+	double last_press_time = -1;
+
+	static int SDLCALL event_watch(void *, SDL_Event *);
+	void apply(const InputEvent &);
+public:
+	InputQueue();
+	~InputQueue();
+	InputQueue(const InputQueue &) = delete;
+	void operator=(const InputQueue &) = delete;
+	void attach();
+	void detach();
+	void set_accept_presses(bool value){
+		this->accept_presses = value;
+	}
+	//The clock the events are stamped with.
+	double get_time(){
+		return this->clock.get();
+	}
+	//Consumer side.
+	InputState latch();
+	//The time of the latest press latched so far, or -1.
+	DEFINE_GETTER(last_press_time)
+};
+
+//Measures the time between a button press and the end of the present of
+//the first frame rendered after the press was latched. That's as close to
+//the photons as software can see; the display adds its own scanout and
+//processing latency on top. Only used by the main thread.
+class LatencyProbe{
+	bool enabled = false;
+	double last_press_time = -1;
+	std::vector<double> samples;
+	static const size_t report_interval = 10;
+public:
+	DEFINE_GETTER(enabled)
+	void set_enabled(bool);
+	//input_time is the press time the presented frame was tagged with.
+	void frame_presented(double input_time, double now);
+};
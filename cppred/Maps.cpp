@@ -95,7 +95,7 @@ TilesetData::TilesetData(
 			bt.tile_no = read_varint(buffer, offset, size);
 			bt.is_script = !!read_varint(buffer, offset, size);
 			if (bt.is_script)
-				bt.script_name = read_string(buffer, offset, size);
+				bt.script = (CppRed::ScriptId)read_varint(buffer, offset, size);
 			else
 				bt.text_id = (TextResourceId)read_varint(buffer, offset, size);
 		}
@@ -246,7 +246,7 @@ MapData::MapData(
 	this->map_text.reserve(buffer.read_varint());
 	while (this->map_text.size() < this->map_text.capacity()){
 		auto text = buffer.read_signed_varint();
-		auto script = buffer.read_string();
+		auto script = (CppRed::ScriptId)buffer.read_varint();
 		MapTextEntry entry;
 		if (text >= 0){
 			entry.simple_text = true;
@@ -266,8 +266,8 @@ MapData::MapData(
 		for (; i < array_length(this->warp_tiles); i++)
 			this->warp_tiles[i] = -1;
 	}
-	this->on_frame = buffer.read_string();
-	this->on_load = buffer.read_string();
+	this->on_frame = (CppRed::ScriptId)buffer.read_varint();
+	this->on_load = (CppRed::ScriptId)buffer.read_varint();
 	this->music = (AudioResourceId)buffer.read_varint();
 	{
 		auto invisible_sprites = (int)buffer.read_varint();
@@ -397,10 +397,8 @@ MapInstance::MapInstance(Map map, MapStore &store, CppRed::Game &game): map(map)
 			this->occupation_bitmap[this->get_block_number(p) * 2 + 1] = it != end;
 		}
 	}
-	if (this->data->on_load.size())
-		this->on_load = game.get_engine().get_script(this->data->on_load.c_str());
-	if (this->data->on_frame.size())
-		this->on_frame = game.get_engine().get_script(this->data->on_frame.c_str());
+	this->on_load = game.get_engine().get_script(this->data->on_load);
+	this->on_frame = game.get_engine().get_script(this->data->on_frame);
 	if (this->on_frame || this->on_load)
 		this->coroutine.reset(new Coroutine(this->data->name + " coroutine", game.get_coroutine().get_clock(), [this](Coroutine &){ this->coroutine_entry_point(); }));
 }
@@ -488,7 +486,7 @@ void MapInstance::loaded(CppRed::Game &game){
 void MapInstance::coroutine_entry_point(){
 	CppRed::Scripts::script_parameters params;
 	if (this->on_load){
-		params.script_name = nullptr;
+		params.script = this->data->on_load;
 		params.caller = nullptr;
 		params.game = this->current_game;
 		params.parameter = nullptr;
@@ -500,7 +498,7 @@ void MapInstance::coroutine_entry_point(){
 	if (!this->on_frame)
 		return;
 	while (true){
-		params.script_name = nullptr;
+		params.script = this->data->on_frame;
 		params.caller = nullptr;
 		params.game = this->current_game;
 		params.parameter = nullptr;
@@ -52,7 +52,7 @@ enum class MapObjectFacingDirection{
 
 struct BookcaseTile{
 	int tile_no = -1;
-	std::string script_name;
+	CppRed::ScriptId script = CppRed::ScriptId::None;
 	TextResourceId text_id;
 	bool is_script;
 };
@@ -118,7 +118,7 @@ struct MapConnection{
 struct MapTextEntry{
 	bool simple_text;
 	TextResourceId text;
-	std::string script;
+	CppRed::ScriptId script;
 };
 
 struct MapData{
@@ -128,8 +128,8 @@ struct MapData{
 	int width, height;
 	std::shared_ptr<TilesetData> tileset;
 	std::shared_ptr<BinaryMapData> map_data;
-	std::string on_load;
-	std::string on_frame;
+	CppRed::ScriptId on_load;
+	CppRed::ScriptId on_frame;
 	MapConnection map_connections[4];
 	int border_block;
 	std::shared_ptr<std::vector<std::unique_ptr<MapObject>>> objects;
@@ -210,6 +210,7 @@ public:
 	const MapData &get_map_data() const{
 		return *this->data;
 	}
+	DEFINE_GETTER(map)
 };
 
 class MapStore{
@@ -229,12 +230,12 @@ class MapStore{
 	static graphics_map_t load_graphics_map();
 	static tilesets_t load_tilesets(const blocksets_t &, const collisions_t &, const graphics_map_t &);
 	static map_data_t load_map_data();
-	static TrainerClassesStore load_trainer_parties();
 	map_objects_t load_objects(const graphics_map_t &graphics_map);
 	void load_maps(const tilesets_t &, const map_data_t &, const graphics_map_t &);
 	//void load_map_objects();
 public:
 	MapStore();
+	static TrainerClassesStore load_trainer_parties();
 	const MapData &get_map_data(Map map) const;
 	MapInstance &get_map_instance(Map map, CppRed::Game &);
 	MapInstance *try_get_map_instance(Map map, CppRed::Game &);
@@ -243,5 +244,9 @@ public:
 	const MapData &get_map_by_legacy_id(int) const;
 	const MapData *try_get_map_by_legacy_id(int) const;
 	void release_map_instance(Map, CppRed::Game &);
+	//Unloaded maps appear as null pointers.
+	auto get_map_instances(){
+		return make_range(this->map_instances);
+	}
 	void stop();
 };
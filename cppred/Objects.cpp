@@ -45,12 +45,12 @@ Sign::Sign(BufferReader &buffer): DialogingMapObject(buffer){
 }
 
 HiddenObject::HiddenObject(BufferReader &buffer): MapObject(buffer){
-	this->script = buffer.read_string();
+	this->script = (CppRed::ScriptId)buffer.read_varint();
 	this->script_parameter = buffer.read_string();
 }
 
 void HiddenObject::activate(CppRed::Game &game, CppRed::Actor &activator, CppRed::Actor *activatee){
-	game.execute(this->script.c_str(), activator, this->script_parameter.c_str());
+	game.execute(this->script, activator, this->script_parameter.c_str());
 }
 
 MapWarp::MapWarp(BufferReader &buffer, const MapStore &map_store): MapObject(buffer){
@@ -166,7 +166,7 @@ void DialogingMapObject::activate(CppRed::Game &game, CppRed::Actor &activator,
 	if (text.simple_text)
 		game.run_dialogue(text.text, true, true);
 	else
-		game.execute(text.script.c_str(), activator);
+		game.execute(text.script, activator);
 }
 
 void ObjectWithSprite::activate(CppRed::Game &game, CppRed::Actor &activator, CppRed::Actor *activatee){
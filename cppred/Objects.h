@@ -13,6 +13,7 @@ class Actor;
 class Game;
 class Npc;
 enum class IntegerVariableId;
+enum class ScriptId;
 }
 struct MapData;
 class MapStore;
@@ -109,12 +110,12 @@ public:
 
 class HiddenObject : public MapObject{
 protected:
-	std::string script;
+	CppRed::ScriptId script;
 	std::string script_parameter;
 
 public:
 	HiddenObject(BufferReader &);
-	HiddenObject(const std::string &name, const Point &position, const std::string &script, const std::string &script_parameter):
+	HiddenObject(const std::string &name, const Point &position, CppRed::ScriptId script, const std::string &script_parameter):
 		MapObject(name, position),
 		script(script),
 		script_parameter(script_parameter){}
@@ -155,6 +155,35 @@ struct PokemonStats{
 	}
 };
 
+//Non-owning view of a contiguous range of a static table.
+template <typename T>
+class array_view{
+	const T *pointer;
+	size_t length;
+public:
+	array_view(): pointer(nullptr), length(0){}
+	array_view(const T *pointer, size_t length): pointer(pointer), length(length){}
+	const T *begin() const{
+		return this->pointer;
+	}
+	const T *end() const{
+		return this->pointer + this->length;
+	}
+	size_t size() const{
+		return this->length;
+	}
+	bool empty() const{
+		return !this->length;
+	}
+	const T &operator[](size_t i) const{
+		return this->pointer[i];
+	}
+};
+
+//The variable-length data of all species is stored contiguously in the
+//species_*_pool tables; BasePokemonInfo only refers to its slice of them.
+//Code that only needs a few fields of many species should prefer the
+//species_* tables in pokemon_declarations.h, which are indexed by SpeciesId.
 struct BasePokemonInfo{
 	PokedexId pokedex_id;
 	SpeciesId species_id;
@@ -177,6 +206,9 @@ struct BasePokemonInfo{
 	byte_t height_feet;
 	byte_t height_inches;
 	int weight_tenths_of_pounds;
+	array_view<MoveId> initial_moves;
+	array_view<EvolutionTrigger> evolution_triggers;
+	array_view<LearnedMove> learned_moves;
 
 	BasePokemonInfo(
 		PokedexId pokedex_id,
@@ -203,7 +235,10 @@ struct BasePokemonInfo{
 		const char * const brief,
 		byte_t height_feet,
 		byte_t height_inches,
-		int weight_tenths_of_pounds
+		int weight_tenths_of_pounds,
+		array_view<MoveId> initial_moves,
+		array_view<EvolutionTrigger> evolution_triggers,
+		array_view<LearnedMove> learned_moves
 	):
 		pokedex_id(pokedex_id),
 		species_id(species_id),
@@ -225,102 +260,22 @@ struct BasePokemonInfo{
 		brief(brief),
 		height_feet(height_feet),
 		height_inches(height_inches),
-		weight_tenths_of_pounds(weight_tenths_of_pounds)
+		weight_tenths_of_pounds(weight_tenths_of_pounds),
+		initial_moves(initial_moves),
+		evolution_triggers(evolution_triggers),
+		learned_moves(learned_moves)
 	{}
 	BasePokemonInfo(const BasePokemonInfo &) = delete;
 	BasePokemonInfo(BasePokemonInfo &&) = delete;
 	void operator=(const BasePokemonInfo &) = delete;
 	void operator=(BasePokemonInfo &&) = delete;
-	virtual std::vector<MoveId> get_initial_moves() const = 0;
-	virtual std::vector<EvolutionTrigger> get_evolution_triggers() const = 0;
-	virtual std::vector<LearnedMove> get_learned_moves() const = 0;
-};
-
-template <size_t N1, size_t N2, size_t N3>
-struct PokemonInfo : public BasePokemonInfo{
-private:
-	template <typename T, size_t N>
-	static std::vector<T> to_vector(const std::array<T, N> &a){
-		std::vector<T> ret;
-		ret.reserve(N);
-		for (auto &i : a)
-			ret.push_back(i);
-		return ret;
-	}
-public:
-	std::array<MoveId, N1> initial_attacks;
-	std::array<EvolutionTrigger, N2> evolution_triggers;
-	std::array<LearnedMove, N3> learned_moves;
-
-	PokemonInfo(
-		PokedexId pokedex_id,
-		SpeciesId species_id,
-		const char *internal_name,
-		bool allocated,
-		std::int8_t starter_index,
-		byte_t base_hp,
-		byte_t base_attack,
-		byte_t base_defense,
-		byte_t base_speed,
-		byte_t base_special,
-		std::array<PokemonTypeId, 2> &&type,
-		byte_t catch_rate,
-		byte_t base_xp_yield,
-		byte_t growth_rate,
-		std::array<byte_t, 7> &&learnable_tms_bitmap,
-		const char *display_name,
-		const GraphicsAsset * const front,
-		const GraphicsAsset * const back,
-		PokemonOverworldSprite overworld_sprite,
-		PokemonCryData &&cry_data,
-		TextResourceId pokedex_entry,
-		const char * const brief,
-		byte_t height_feet,
-		byte_t height_inches,
-		int weight_tenths_of_pounds,
-		std::array<MoveId, N1> &&initial_attacks,
-		std::array<EvolutionTrigger, N2> &&evolution_triggers,
-		std::array<LearnedMove, N3> &&learned_moves
-	):
-	BasePokemonInfo(
-		pokedex_id,
-		species_id,
-		internal_name,
-		allocated,
-		starter_index,
-		base_hp,
-		base_attack,
-		base_defense,
-		base_speed,
-		base_special,
-		std::move(type),
-		catch_rate,
-		base_xp_yield,
-		growth_rate,
-		std::move(learnable_tms_bitmap),
-		display_name,
-		front,
-		back,
-		overworld_sprite,
-		std::move(cry_data),
-		pokedex_entry,
-		brief,
-		height_feet,
-		height_inches,
-		weight_tenths_of_pounds
-	),
-		initial_attacks(std::move(initial_attacks)),
-		evolution_triggers(std::move(evolution_triggers)),
-		learned_moves(std::move(learned_moves))
-	{}
-
-	std::vector<MoveId> get_initial_moves() const override{
-		return to_vector(this->initial_attacks);
+	array_view<MoveId> get_initial_moves() const{
+		return this->initial_moves;
 	}
-	std::vector<EvolutionTrigger> get_evolution_triggers() const override{
-		return to_vector(this->evolution_triggers);
+	array_view<EvolutionTrigger> get_evolution_triggers() const{
+		return this->evolution_triggers;
 	}
-	std::vector<LearnedMove> get_learned_moves() const override{
-		return to_vector(this->learned_moves);
+	array_view<LearnedMove> get_learned_moves() const{
+		return this->learned_moves;
 	}
 };
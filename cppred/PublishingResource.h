@@ -83,7 +83,20 @@ class QueuedPublishingResource{
 #endif
 	//Invariant: private_resource is valid at all times.
 	T *private_resource;
+	//If non-zero, no more than this many resources are ever allocated.
+	size_t max_capacity = 0;
+	std::uint64_t dropped = 0;
 
+	bool pool_exhausted(){
+		if (!this->max_capacity || this->allocated.size() < this->max_capacity)
+			return false;
+#ifndef QueuedPublishingResource_USE_DEQUE
+		return !this->return_queue.peek();
+#else
+		LOCK_MUTEX(this->return_queue_mutex);
+		return !this->return_queue.size();
+#endif
+	}
 	T *reuse_or_allocate(){
 		T *ret;
 #ifndef QueuedPublishingResource_USE_DEQUE
@@ -109,14 +122,22 @@ public:
 	QueuedPublishingResource(){
 		this->private_resource = this->allocate();
 	}
+	//Bounded pool. If the consumer falls behind and all max_capacity resources
+	//are in flight, publish() drops the private resource's contents instead of
+	//allocating more.
 #ifndef QueuedPublishingResource_USE_DEQUE
-	QueuedPublishingResource(size_t max_capacity): return_queue(max_capacity), queue(max_capacity){
+	QueuedPublishingResource(size_t max_capacity): return_queue(max_capacity), queue(max_capacity), max_capacity(max_capacity){
 #else
-	QueuedPublishingResource(size_t max_capacity){
+	QueuedPublishingResource(size_t max_capacity): max_capacity(max_capacity){
 #endif
+		this->allocated.reserve(max_capacity);
 		this->private_resource = this->allocate();
 	}
 	void publish(){
+		if (this->pool_exhausted()){
+			this->dropped++;
+			return;
+		}
 #ifndef QueuedPublishingResource_USE_DEQUE
 		if (!this->queue.try_enqueue(this->private_resource))
 			return;
@@ -131,6 +152,9 @@ public:
 	T *get_private_resource(){
 		return this->private_resource;
 	}
+	std::uint64_t get_dropped_count() const{
+		return this->dropped;
+	}
 	T *get_public_resource(){
 		T *ret = nullptr;
 #ifndef QueuedPublishingResource_USE_DEQUE
@@ -2,6 +2,7 @@
 #include "Renderer.h"
 #include "utility.h"
 #include "Engine.h"
+#include "FrameRecorder.h"
 #ifndef HAVE_PCH
 #include <stdexcept>
 #include <cassert>
@@ -29,6 +30,13 @@ Renderer::Renderer(VideoDevice &device): device(&device){
 	this->initialize_data();
 }
 
+Renderer::Renderer(): device(nullptr){
+	this->push();
+	this->headless_surface.resize(logical_screen_width * logical_screen_height, RGB{ 0xFF, 0xFF, 0xFF, 0xFF });
+	this->initialize_assets();
+	this->initialize_data();
+}
+
 template <typename T>
 void push(T *&p, std::deque<T> &q){
 	if (!q.size())
@@ -77,19 +85,50 @@ std::unique_ptr<VideoDevice> Renderer::initialize_device(int scale){
 	return std::make_unique<VideoDevice>(Point{ logical_screen_width, logical_screen_height } * scale);
 }
 
-void Renderer::initialize_assets(){
-	static_assert(packed_image_data_size * 4 % TileData::size == 0, "");
-	this->tile_data.resize(packed_image_data_size * 4 / TileData::size);
-
-	for (size_t i = 0; i < this->tile_data.size(); i++){
-		auto &tile = this->tile_data[i];
-		size_t offset = 0;
-		for (int y = 0; y < tile_size; y++){
-			int shift = 0;
-			for (int x = 0; x < tile_size; x++, offset++, shift = (shift + 2) % 8)
-				tile.data[offset] = (packed_image_data[(i * TileData::size + offset) / 4] >> shift) & BITMAP(00000011);
+namespace{
+
+struct TileDecodingTables{
+	//Color indices of the four pixels in a packed byte.
+	byte_t pixels[256][4];
+	//The same byte, with the order of its pixels reversed.
+	byte_t reversed[256];
+
+	TileDecodingTables(){
+		for (int i = 0; i < 256; i++){
+			this->reversed[i] = 0;
+			for (int j = 0; j < 4; j++){
+				auto pixel = (i >> (j * 2)) & BITMAP(00000011);
+				this->pixels[i][j] = (byte_t)pixel;
+				this->reversed[i] |= pixel << ((3 - j) * 2);
+			}
 		}
 	}
+};
+
+const TileDecodingTables tile_decoding_tables;
+
+}
+
+void Renderer::initialize_assets(){
+	static_assert(packed_row_size == 2, "decode_tile_row() assumes two bytes per row.");
+	static_assert(packed_image_data_size % packed_tile_size == 0, "");
+	this->tile_data = packed_image_data;
+	this->tile_count = packed_image_data_size / packed_tile_size;
+}
+
+void Renderer::decode_tile_row(byte_t (&dst)[tile_size], int tile_no, int row, bool flipped_x) const{
+	assert(tile_no >= 0 && (size_t)tile_no < this->tile_count && row >= 0 && row < tile_size);
+	auto &tables = tile_decoding_tables;
+	auto src = this->tile_data + tile_no * packed_tile_size + row * packed_row_size;
+	byte_t a = src[0];
+	byte_t b = src[1];
+	if (flipped_x){
+		auto temp = tables.reversed[a];
+		a = tables.reversed[b];
+		b = temp;
+	}
+	memcpy(dst, tables.pixels[a], 4);
+	memcpy(dst + 4, tables.pixels[b], 4);
 }
 
 void Renderer::initialize_data(){
@@ -97,12 +136,16 @@ void Renderer::initialize_data(){
 	this->bg_palette() = null_palette;
 	this->sprite0_palette() = null_palette;
 	this->sprite1_palette() = null_palette;
+	get_final_palette(this->final_palette);
+	this->set_default_palettes();
+	this->set_palette(PaletteRegion::Sprites1, 0);
+}
+
+void Renderer::get_final_palette(RGB (&palette)[4]){
 	for (int i = 0; i < 4; i++){
 		byte_t c = (3 - i) * 0x55;
-		this->final_palette[i] = { c, c, c, 0xFF };
+		palette[i] = { c, c, c, 0xFF };
 	}
-	this->set_default_palettes();
-	this->set_palette(PaletteRegion::Sprites1, 0);
 }
 
 bool sort_sprites(Sprite *a, Sprite *b){
@@ -113,23 +156,52 @@ bool sort_sprites(Sprite *a, Sprite *b){
 	return a->get_id() < b->get_id();
 }
 
-void Renderer::do_software_rendering(){
+namespace{
+
+class PassTimer{
+	double *times;
+	HighResolutionClock clock;
+	double last;
+public:
+	PassTimer(double *times): times(times), last(times ? this->clock.get() : 0){}
+	void lap(Renderer::RenderPass pass){
+		if (!this->times)
+			return;
+		auto now = this->clock.get();
+		this->times[(size_t)pass] += now - this->last;
+		this->last = now;
+	}
+};
+
+}
+
+void Renderer::do_software_rendering(double *pass_times){
 #ifdef MEASURE_RENDERING_TIMES
 	HighResolutionClock clock;
 	auto t0 = clock.get();
 #endif
+	PassTimer timer(pass_times);
 
-	TextureSurface surf;
-	if (!this->main_texture.try_lock(surf))
-		return;
+	auto pixels = this->device ? this->frames.get_private_resource()->pixels : &this->headless_surface[0];
 
 	fill(this->intermediate_render_surface, RenderPoint{-1, nullptr, false});
+	for (auto &c : this->coverage)
+		c.clear();
+	timer.lap(RenderPass::Clear);
 
 	this->render_windows();
+	timer.lap(RenderPass::Windows);
 	this->render_sprites(true);
+	timer.lap(RenderPass::PrioritySprites);
 	this->render_background();
+	timer.lap(RenderPass::Background);
 	this->render_sprites(false);
-	this->final_render(surf);
+	timer.lap(RenderPass::Sprites);
+	auto shades = this->recorder ? this->recorder->begin_frame() : nullptr;
+	this->final_render(pixels, shades);
+	if (shades)
+		this->recorder->end_frame();
+	timer.lap(RenderPass::Final);
 	
 #ifdef MEASURE_RENDERING_TIMES
 	auto t1 = clock.get();
@@ -149,37 +221,35 @@ void Renderer::render_background(){
 
 		auto y0 = (bg_offset.y + y) % (Tilemap::h * tile_size);
 		auto tiles = bg_tilemap.tiles + y0 / tile_size * Tilemap::w;
+		const Tile *decoded_tile = nullptr;
+		byte_t row[tile_size];
+		auto points = this->intermediate_render_surface + y * logical_screen_width;
 
-		for (int x = 0; x < logical_screen_width; x++){
-			auto &point = this->intermediate_render_surface[x + y * logical_screen_width];
-			auto &color_index = point.value;
-			auto &palette = point.palette;
-			if (point.complete)
-				continue;
-
-			color_index = -1;
-			palette = nullptr;
-
-			if (palette)
-				continue;
-
-			auto x0 = (bg_offset.x + x) % (Tilemap::w * tile_size);
-			auto &tile = tiles[x0 / tile_size];
-			int tile_offset_x = x0 % tile_size;
-			auto tile_no = tile.tile_no;
-			tile_no = tile_mapping[tile_no];
-			int tile_offset_y = y0 % tile_size;
-			if (tile.flipped_x)
-				tile_offset_x = (tile_size - 1) - tile_offset_x;
-			if (tile.flipped_y)
-				tile_offset_y = (tile_size - 1) - tile_offset_y;
-			color_index = this->tile_data[tile_no].data[tile_offset_x + tile_offset_y * tile_size];
-			palette = &tile.palette;
-			if (!*palette){
-				palette = &bg_palette;
-				//point.complete = true;
+		this->coverage[y].for_each_uncovered(0, logical_screen_width, [&](int x_begin, int x_end){
+			for (int x = x_begin; x < x_end; x++){
+				auto &point = points[x];
+				auto &color_index = point.value;
+				auto &palette = point.palette;
+				if (point.complete)
+					continue;
+
+				auto x0 = (bg_offset.x + x) % (Tilemap::w * tile_size);
+				auto &tile = tiles[x0 / tile_size];
+				if (&tile != decoded_tile){
+					int tile_offset_y = y0 % tile_size;
+					if (tile.flipped_y)
+						tile_offset_y = (tile_size - 1) - tile_offset_y;
+					this->decode_tile_row(row, tile_mapping[tile.tile_no], tile_offset_y, tile.flipped_x);
+					decoded_tile = &tile;
+				}
+				color_index = row[x0 % tile_size];
+				palette = &tile.palette;
+				if (!*palette){
+					palette = &bg_palette;
+					//point.complete = true;
+				}
 			}
-		}
+		});
 	}
 }
 
@@ -234,6 +304,8 @@ void Renderer::render_sprite(Sprite &sprite, const Palette **sprite_palettes){
 	for (int y = y0, sprite_offset_y = sprite_offset_y0; y < y1; y++, sprite_offset_y++){
 		auto points = this->intermediate_render_surface + y * logical_screen_width;
 		auto sprite_tile_y = sprite_offset_y / tile_size;
+		const SpriteTile *decoded_tile = nullptr;
+		byte_t row[tile_size];
 		for (int x = x0, sprite_offset_x = sprite_offset_x0; x < x1; x++, sprite_offset_x++){
 			auto &point = points[x];
 			auto &color_index = point.value;
@@ -248,14 +320,14 @@ void Renderer::render_sprite(Sprite &sprite, const Palette **sprite_palettes){
 			if (!sprite_is_not_covered_here)
 				continue;
 
-			auto tile_no = tile_mapping[tile.tile_no];
-			int tile_offset_x = sprite_offset_x % tile_size;
-			int tile_offset_y = sprite_offset_y % tile_size;
-			if (tile.flipped_x)
-				tile_offset_x = (tile_size - 1) - tile_offset_x;
-			if (tile.flipped_y)
-				tile_offset_y = (tile_size - 1) - tile_offset_y;
-			auto index = this->tile_data[tile_no].data[tile_offset_x + tile_offset_y * tile_size];
+			if (&tile != decoded_tile){
+				int tile_offset_y = sprite_offset_y % tile_size;
+				if (tile.flipped_y)
+					tile_offset_y = (tile_size - 1) - tile_offset_y;
+				this->decode_tile_row(row, tile_mapping[tile.tile_no], tile_offset_y, tile.flipped_x);
+				decoded_tile = &tile;
+			}
+			auto index = row[sprite_offset_x % tile_size];
 			if (!index)
 				continue;
 			color_index = index;
@@ -293,34 +365,50 @@ void Renderer::render_window(const WindowLayer &window){
 		auto tiles = window_tilemap.tiles + y0 / tile_size * Tilemap::w;
 		auto tile_offset_y = y0 % tile_size;
 		auto points = this->intermediate_render_surface + y * logical_screen_width;
-		for (int x = window_region_start.x; x < end.x; x++){
-			auto &point = points[x];
-			if (point.complete)
-				continue;
-
-			auto &color_index = point.value;
-			auto &palette = point.palette;
-
-			color_index = -1;
-			palette = nullptr;
-
-			auto x0 = euclidean_modulo(x + window_origin.x, Tilemap::w * tile_size);
-			auto &tile = tiles[x0 / tile_size];
-			auto tile_no = tile.tile_no;
-			tile_no = tile_mapping[tile_no];
-			auto tile_offset_x = x0 % tile_size;
-			color_index = this->tile_data[tile_no].data[tile_offset_x + tile_offset_y * tile_size];
-			palette = &tile.palette;
-			if (!*palette){
-				palette = &bg_palette;
-				point.complete = true;
+		const Tile *decoded_tile = nullptr;
+		byte_t row[tile_size];
+		//Only points that use the background palette are final, so the span
+		//is opaque to lower layers only if no tile in it has its own.
+		bool opaque = true;
+		auto &coverage = this->coverage[y];
+		coverage.for_each_uncovered(window_region_start.x, end.x, [&](int x_begin, int x_end){
+			for (int x = x_begin; x < x_end; x++){
+				auto &point = points[x];
+				if (point.complete)
+					continue;
+
+				auto &color_index = point.value;
+				auto &palette = point.palette;
+
+				auto x0 = euclidean_modulo(x + window_origin.x, Tilemap::w * tile_size);
+				auto &tile = tiles[x0 / tile_size];
+				if (&tile != decoded_tile){
+					this->decode_tile_row(row, tile_mapping[tile.tile_no], tile_offset_y, false);
+					decoded_tile = &tile;
+				}
+				color_index = row[x0 % tile_size];
+				palette = &tile.palette;
+				if (!*palette){
+					palette = &bg_palette;
+					point.complete = true;
+				}else
+					opaque = false;
 			}
-		}
+		});
+		if (opaque)
+			coverage.add(window_region_start.x, end.x);
 	}
 }
 
-void Renderer::final_render(TextureSurface &surf){
-	auto pixels = surf.get_row(0);
+void Renderer::final_render(RGB *pixels, byte_t *shades){
+	if (shades){
+		for (auto &point : this->intermediate_render_surface){
+			auto shade = !point.palette ? 0 : point.palette->data[point.value];
+			*(shades++) = (byte_t)shade;
+			*(pixels++) = this->final_palette[shade];
+		}
+		return;
+	}
 	for (auto &point : this->intermediate_render_surface){
 		auto color_index = point.value;
 		auto palette = point.palette;
@@ -405,7 +493,30 @@ Tilemap &Renderer::get_tilemap(TileRegion region){
 
 void Renderer::render(){
 	this->do_software_rendering();
+	if (this->device){
+		this->frames.get_private_resource()->input_time = this->input_time;
+		this->frames.publish();
+	}
+}
+
+void Renderer::render_profiled(double (&pass_times)[pass_count]){
+	if (this->device)
+		throw std::runtime_error("Renderer::render_profiled(): Only headless renderers can be profiled.");
+	this->do_software_rendering(pass_times);
+}
+
+double Renderer::present(){
+	double ret = -1;
+	auto frame = this->frames.get_public_resource();
+	if (frame){
+		TextureSurface surf;
+		if (this->main_texture.try_lock(surf))
+			memcpy(surf.get_row(0), frame->pixels, sizeof(frame->pixels));
+		ret = frame->input_time;
+		this->frames.return_resource_as_ready(frame);
+	}
 	this->device->render_copy(this->main_texture);
+	return ret;
 }
 
 std::vector<Point> Renderer::draw_image_to_tilemap(const Point &corner, const GraphicsAsset &asset, TileRegion region, Palette palette){
@@ -600,3 +711,160 @@ void Renderer::draw_bar(const Point &position, TileRegion region, int width, int
 		*(tiles++) = Tile(HpBarAndStatusGraphics.first_tile + 1);
 	assert(tiles - original == width);
 }
+
+static void write_point(BufferWriter &writer, const Point &p){
+	writer.write_signed_varint(p.x);
+	writer.write_signed_varint(p.y);
+}
+
+static Point read_point(BufferReader &reader){
+	Point ret;
+	ret.x = reader.read_signed_varint();
+	ret.y = reader.read_signed_varint();
+	return ret;
+}
+
+//render_background() relies on the offsets being reduced the way
+//set_bg_global_offset() and set_y_bg_offset() do it.
+static Point read_bg_offset(BufferReader &reader){
+	auto ret = read_point(reader);
+	if (ret.x < 0 || ret.y < 0 || ret.x >= Tilemap::w * Renderer::tile_size || ret.y >= Tilemap::h * Renderer::tile_size)
+		throw std::runtime_error("Renderer::deserialize_context(): Invalid background offset.");
+	return ret;
+}
+
+static void write_palette(BufferWriter &writer, const Palette &palette){
+	writer.write_raw(palette.data, sizeof(palette.data));
+}
+
+static Palette read_palette(BufferReader &reader){
+	Palette ret;
+	for (auto &c : ret.data){
+		c = (char)reader.read_byte();
+		if (c < -1 || c > 3)
+			throw std::runtime_error("Renderer::deserialize_context(): Invalid palette.");
+	}
+	return ret;
+}
+
+static void write_tile(BufferWriter &writer, const Tile &tile){
+	writer.write_varint(tile.tile_no);
+	writer.write_byte((byte_t)(tile.flipped_x | (tile.flipped_y << 1)));
+	write_palette(writer, tile.palette);
+}
+
+static void read_tile(BufferReader &reader, Tile &tile){
+	auto tile_no = reader.read_varint();
+	if (tile_no >= tile_mapping_size)
+		throw std::runtime_error("Renderer::deserialize_context(): Invalid tile.");
+	tile.tile_no = (std::uint16_t)tile_no;
+	auto flags = reader.read_byte();
+	tile.flipped_x = !!(flags & 1);
+	tile.flipped_y = !!(flags & 2);
+	tile.palette = read_palette(reader);
+}
+
+static void write_tilemap(BufferWriter &writer, const Tilemap &tilemap){
+	for (auto &tile : tilemap.tiles)
+		write_tile(writer, tile);
+}
+
+static void read_tilemap(BufferReader &reader, Tilemap &tilemap){
+	for (auto &tile : tilemap.tiles)
+		read_tile(reader, tile);
+}
+
+void Renderer::serialize_context(BufferWriter &writer) const{
+	auto &context = this->context();
+	writer.write_byte((byte_t)(context.enable_bg | (context.enable_window << 1) | (context.enable_sprites << 2)));
+	write_palette(writer, context.bg_palette);
+	write_palette(writer, context.sprite0_palette);
+	write_palette(writer, context.sprite1_palette);
+	write_point(writer, context.bg_global_offset);
+	for (auto &p : context.bg_offsets)
+		write_point(writer, p);
+	write_tilemap(writer, context.bg_tilemap);
+
+	writer.write_varint((std::uint32_t)context.windows.size());
+	for (auto &window : context.windows){
+		write_tilemap(writer, window.window_tilemap);
+		for (auto &p : window.window_offsets)
+			write_point(writer, p);
+		write_point(writer, window.window_origin);
+		write_point(writer, window.window_region_start);
+		write_point(writer, window.window_region_size);
+	}
+
+	writer.write_varint((std::uint32_t)context.sprites.size());
+	for (auto &kv : context.sprites){
+		auto &sprite = *kv.second;
+		writer.write_varint(sprite.get_w());
+		writer.write_varint(sprite.get_h());
+		writer.write_signed_varint(sprite.get_x());
+		writer.write_signed_varint(sprite.get_y());
+		writer.write_byte(sprite.get_visible());
+		write_palette(writer, sprite.get_palette());
+		writer.write_byte((byte_t)sprite.get_palette_region());
+		for (auto &tile : sprite.iterate_tiles()){
+			write_tile(writer, tile);
+			writer.write_byte(tile.has_priority);
+		}
+	}
+}
+
+void Renderer::deserialize_context(BufferReader &reader, std::vector<std::shared_ptr<Sprite>> &sprites){
+	auto &context = this->context();
+	auto flags = reader.read_byte();
+	context.enable_bg = !!(flags & 1);
+	context.enable_window = !!(flags & 2);
+	context.enable_sprites = !!(flags & 4);
+	context.bg_palette = read_palette(reader);
+	context.sprite0_palette = read_palette(reader);
+	context.sprite1_palette = read_palette(reader);
+	context.bg_global_offset = read_bg_offset(reader);
+	for (auto &p : context.bg_offsets)
+		p = read_bg_offset(reader);
+	read_tilemap(reader, context.bg_tilemap);
+
+	auto window_count = reader.read_varint();
+	if (!window_count)
+		throw std::runtime_error("Renderer::deserialize_context(): A context must have at least one window.");
+	context.windows.clear();
+	context.windows.resize(window_count);
+	context.window = &context.windows.back();
+	for (auto &window : context.windows){
+		read_tilemap(reader, window.window_tilemap);
+		for (auto &p : window.window_offsets)
+			p = read_point(reader);
+		window.window_origin = read_point(reader);
+		window.window_region_start = read_point(reader);
+		window.window_region_size = read_point(reader);
+		auto end = window.window_region_start + window.window_region_size;
+		if (window.window_region_start.x < 0 || window.window_region_start.y < 0 || end.x > logical_screen_width || end.y > logical_screen_height)
+			throw std::runtime_error("Renderer::deserialize_context(): Invalid window region.");
+	}
+
+	context.sprites.clear();
+	sprites.clear();
+	auto sprite_count = reader.read_varint();
+	for (std::uint32_t i = 0; i < sprite_count; i++){
+		auto w = reader.read_varint();
+		auto h = reader.read_varint();
+		if (w < 1 || h < 1 || w > logical_screen_tile_width || h > logical_screen_tile_height)
+			throw std::runtime_error("Renderer::deserialize_context(): Invalid sprite size.");
+		auto sprite = this->create_sprite(w, h);
+		sprites.push_back(sprite);
+		sprite->set_x(reader.read_signed_varint());
+		sprite->set_y(reader.read_signed_varint());
+		sprite->set_visible(!!reader.read_byte());
+		sprite->set_palette(read_palette(reader));
+		auto region = reader.read_byte();
+		if (region > (byte_t)PaletteRegion::Sprites1)
+			throw std::runtime_error("Renderer::deserialize_context(): Invalid palette region.");
+		sprite->set_palette_region((PaletteRegion)region);
+		for (auto &tile : sprite->iterate_tiles()){
+			read_tile(reader, tile);
+			tile.has_priority = !!reader.read_byte();
+		}
+	}
+}
@@ -4,6 +4,7 @@
 #include "RendererStructs.h"
 #include "Sprite.h"
 #include "VideoDevice.h"
+#include "PublishingResource.h"
 #ifndef HAVE_PCH
 #include <SDL.h>
 #include <vector>
@@ -13,6 +14,7 @@
 #endif
 
 class Engine;
+class FrameRecorder;
 
 class Renderer{
 public:
@@ -24,10 +26,24 @@ public:
 	static const int logical_screen_height = logical_screen_tile_height * tile_size;
 	static const int tilemap_width = Tilemap::w;
 	static const int tilemap_height = Tilemap::h;
+	//Tiles are kept in the packed form of the static data: 2 bits per pixel,
+	//least significant bits first.
+	static const int packed_row_size = tile_size / 4;
+	static const int packed_tile_size = packed_row_size * tile_size;
 	//Types:
-	typedef BasicTileData<tile_size> TileData;
 	typedef std::map<std::uint64_t, Sprite *> sprite_map_t;
 	typedef typename sprite_map_t::iterator sprite_iterator;
+	//The passes of a software render, in the order they run.
+	enum class RenderPass{
+		Clear = 0,
+		Windows,
+		PrioritySprites,
+		Background,
+		Sprites,
+		Final,
+		Count,
+	};
+	static const size_t pass_count = (size_t)RenderPass::Count;
 
 private:
 	struct WindowLayer{
@@ -58,10 +74,23 @@ private:
 		void pop_window();
 	};
 
+	struct Frame{
+		RGB pixels[logical_screen_width * logical_screen_height];
+		double input_time;
+	};
+
+	//Null for headless renderers, which render into headless_surface instead.
 	VideoDevice *device;
 	Texture main_texture;
-	std::vector<TileData> tile_data;
+	//Completed frames, handed from the thread that calls render() to the one
+	//that calls present().
+	PublishingResource<Frame> frames;
+	std::vector<RGB> headless_surface;
+	const byte_t *tile_data = nullptr;
+	size_t tile_count = 0;
 	RGB final_palette[4];
+	FrameRecorder *recorder = nullptr;
+	double input_time = -1;
 	std::uint64_t next_sprite_id = 0;
 	struct RenderPoint{
 		int value;
@@ -69,6 +98,8 @@ private:
 		bool complete;
 	};
 	RenderPoint intermediate_render_surface[logical_screen_width * logical_screen_height];
+	//Spans of each scanline fully drawn by the windows rendered so far.
+	ScanlineCoverage coverage[logical_screen_height];
 	std::deque<RendererContext> stack;
 	RendererContext *current_context;
 	std::vector<Sprite *> sprite_list;
@@ -107,17 +138,23 @@ private:
 
 	void initialize_assets();
 	void initialize_data();
-	void do_software_rendering();
+	//Decodes one row of a tile into color indices.
+	void decode_tile_row(byte_t (&dst)[tile_size], int tile_no, int row, bool flipped_x) const;
+	//If pass_times is not null, the time spent in each pass is added to it.
+	void do_software_rendering(double *pass_times = nullptr);
 	void render_background();
 	void render_sprites(bool priority);
 	void render_sprite(Sprite &, const Palette **);
 	void render_window(const WindowLayer &);
 	void render_windows();
-	void final_render(TextureSurface &);
+	//If shades is not null, it also receives the final shade of each pixel.
+	void final_render(RGB *pixels, byte_t *shades);
 	void set_y_offset(Point (&)[logical_screen_height], int y0, int y1, const Point &);
 	std::vector<Point> draw_image_to_tilemap_internal(const Point &corner, const GraphicsAsset &, TileRegion, Palette, bool);
 public:
 	Renderer(VideoDevice &);
+	//Headless renderer. Frames are rendered in memory only.
+	Renderer();
 	static std::unique_ptr<VideoDevice> initialize_device(int scale);
 	Renderer(const Renderer &) = delete;
 	Renderer(Renderer &&) = delete;
@@ -129,11 +166,43 @@ public:
 	VideoDevice &get_device(){
 		return *this->device;
 	}
+	bool is_headless() const{
+		return !this->device;
+	}
+	//Only valid for headless renderers. The last rendered frame.
+	const RGB *get_headless_frame() const{
+		return &this->headless_surface[0];
+	}
+	//Color of each of the four shades.
+	static void get_final_palette(RGB (&)[4]);
+	//Every rendered frame is also submitted to the recorder, if there is one.
+	void set_recorder(FrameRecorder *recorder){
+		this->recorder = recorder;
+	}
+	//Frames rendered from now on are tagged with this time. See present().
+	void set_input_time(double time){
+		this->input_time = time;
+	}
 	void set_palette(PaletteRegion region, Palette value);
 	void set_default_palettes();
 	Tile &get_tile(TileRegion, const Point &p);
 	Tilemap &get_tilemap(TileRegion);
+	//Renders the current state into a frame and publishes it.
 	void render();
+	//Only valid for headless renderers. Renders the current state, adding the
+	//time spent in each pass to pass_times.
+	void render_profiled(double (&pass_times)[pass_count]);
+	//Writes the tilemaps, windows, offsets, palettes and sprites of the
+	//current context.
+	void serialize_context(BufferWriter &) const;
+	//Replaces the current context with a serialized one. The sprites it
+	//contains are created anew and returned through sprites. Any sprite
+	//created before the call must have been released.
+	void deserialize_context(BufferReader &, std::vector<std::shared_ptr<Sprite>> &sprites);
+	//Uploads the latest published frame, if there's a new one, and copies it
+	//to the screen. Must be called from the thread that owns the device.
+	//Returns the input time of the new frame, or -1 if there wasn't one.
+	double present();
 	std::vector<Point> draw_image_to_tilemap(const Point &corner, const GraphicsAsset &, TileRegion = TileRegion::Background, Palette = null_palette);
 	std::vector<Point> draw_image_to_tilemap_flipped(const Point &corner, const GraphicsAsset &, TileRegion = TileRegion::Background, Palette = null_palette);
 	void put_string(const Point &position, TileRegion region, const char *string, int pad_to = 0);
@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "RendererBenchmark.h"
+#include "HighResolutionClock.h"
+#ifndef HAVE_PCH
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+#endif
+
+static const byte_t scene_magic[] = { 'C', 'R', 'S', 'C', 'E', 'N', 'E', 0 };
+
+static std::string get_scene_name(const std::string &path){
+	auto slash = path.find_last_of("/\\");
+	auto ret = slash == path.npos ? path : path.substr(slash + 1);
+	auto dot = ret.rfind('.');
+	if (dot != ret.npos && dot)
+		ret.resize(dot);
+	return ret;
+}
+
+RendererScene::RendererScene(const std::string &path): name(get_scene_name(path)){
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("RendererScene::RendererScene(): Can't open " + path);
+	std::vector<byte_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	BufferReader reader(buffer.data(), buffer.size());
+	for (auto b : scene_magic)
+		if (reader.read_byte() != b)
+			throw std::runtime_error("RendererScene::RendererScene(): " + path + " is not a scene.");
+	if (reader.read_u32() > format_version)
+		throw std::runtime_error("RendererScene::RendererScene(): " + path + " was written by a newer version.");
+	this->frame_hash = reader.read_u32();
+	this->frame_hash |= (std::uint64_t)reader.read_u32() << 32;
+	auto offset = buffer.size() - reader.remaining_bytes();
+	this->context.assign(buffer.begin() + offset, buffer.end());
+}
+
+void RendererScene::save(const Renderer &renderer, const std::string &path){
+	std::vector<byte_t> context;
+	BufferWriter context_writer(context);
+	renderer.serialize_context(context_writer);
+
+	Renderer headless;
+	std::vector<std::shared_ptr<Sprite>> sprites;
+	BufferReader reader(context.data(), context.size());
+	headless.deserialize_context(reader, sprites);
+	headless.render();
+	auto hash = hash_frame(headless);
+
+	std::vector<byte_t> buffer;
+	BufferWriter writer(buffer);
+	writer.write_raw(scene_magic, sizeof(scene_magic));
+	writer.write_u32(format_version);
+	writer.write_u32((std::uint32_t)hash);
+	writer.write_u32((std::uint32_t)(hash >> 32));
+	writer.write_raw(context.data(), context.size());
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("RendererScene::save(): Can't open " + path + " for writing.");
+	file.write((const char *)buffer.data(), buffer.size());
+	if (!file)
+		throw std::runtime_error("RendererScene::save(): Error while writing " + path);
+}
+
+std::vector<std::shared_ptr<Sprite>> RendererScene::load_into(Renderer &renderer) const{
+	std::vector<std::shared_ptr<Sprite>> ret;
+	BufferReader reader(this->context.data(), this->context.size());
+	renderer.deserialize_context(reader, ret);
+	return ret;
+}
+
+std::uint64_t RendererScene::hash_frame(const Renderer &renderer){
+	auto pixels = (const byte_t *)renderer.get_headless_frame();
+	std::uint64_t ret = 0xCBF29CE484222325ULL;
+	for (size_t i = 0, n = Renderer::logical_screen_width * Renderer::logical_screen_height * sizeof(RGB); i < n; i++){
+		ret ^= pixels[i];
+		ret *= 0x100000001B3ULL;
+	}
+	return ret;
+}
+
+RendererBenchmark::RendererBenchmark(const std::vector<std::string> &paths){
+	for (auto &path : paths)
+		this->scenes.emplace_back(path);
+	this->results.resize(this->scenes.size());
+	for (size_t i = 0; i < this->scenes.size(); i++){
+		this->results[i].name = this->scenes[i].get_name();
+		this->results[i].expected_hash = this->scenes[i].get_frame_hash();
+	}
+}
+
+void RendererBenchmark::run(unsigned iterations){
+	HighResolutionClock clock;
+	for (size_t i = 0; i < this->scenes.size(); i++){
+		auto &result = this->results[i];
+		//A new renderer for each scene, so that no state carries over.
+		Renderer renderer;
+		auto sprites = this->scenes[i].load_into(renderer);
+		for (unsigned j = 0; j < iterations; j++){
+			auto t0 = clock.get();
+			renderer.render_profiled(result.pass_times);
+			result.total_time += clock.get() - t0;
+			result.frames++;
+			result.actual_hash = RendererScene::hash_frame(renderer);
+			if (result.actual_hash != result.expected_hash)
+				result.mismatches++;
+		}
+	}
+}
+
+static const char * const pass_names[] = {
+	"clear",
+	"windows",
+	"priority sprites",
+	"background",
+	"sprites",
+	"final",
+};
+
+static_assert(array_length(pass_names) == Renderer::pass_count, "");
+
+bool RendererBenchmark::report(std::ostream &stream) const{
+	bool ret = true;
+	auto flags = stream.flags();
+	stream << std::fixed << std::setprecision(0) << "Scenes: " << this->results.size() << std::endl;
+	for (auto &result : this->results){
+		if (!result.frames)
+			continue;
+		auto frames = (double)result.frames;
+		stream << "  " << result.name << ": " << result.total_time / frames * 1e9 << " ns/frame (";
+		for (size_t i = 0; i < Renderer::pass_count; i++){
+			if (i)
+				stream << ", ";
+			stream << pass_names[i] << ' ' << result.pass_times[i] / frames * 1e9;
+		}
+		stream << "), ";
+		if (result.mismatches){
+			ret = false;
+			stream << "MISMATCH in " << result.mismatches << " of " << result.frames << " frames: expected "
+				<< std::hex << std::setw(16) << std::setfill('0') << result.expected_hash << ", got "
+				<< std::setw(16) << result.actual_hash << std::dec << std::setfill(' ') << std::endl;
+		}else
+			stream << "OK\n";
+	}
+	stream.flags(flags);
+	return ret;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "Renderer.h"
+#ifndef HAVE_PCH
+#include <vector>
+#include <memory>
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#endif
+
+//A renderer context saved to a file, together with the hash of the frame it
+//renders to, which is the golden output RendererBenchmark checks against.
+//
+//Format: the 8 bytes "CRSCENE\0", u32 format version, the frame hash as two
+//u32 (low half first), then the output of Renderer::serialize_context().
+class RendererScene{
+	std::string name;
+	std::vector<byte_t> context;
+	std::uint64_t frame_hash;
+public:
+	static const std::uint32_t format_version = 1;
+	explicit RendererScene(const std::string &path);
+	//Saves the current context of a renderer. The frame hash is computed by
+	//rendering the context on a new headless renderer, so the source
+	//renderer is left untouched.
+	static void save(const Renderer &, const std::string &path);
+	//Loads the scene into a headless renderer. The returned sprites must be
+	//kept alive while the scene is rendered.
+	std::vector<std::shared_ptr<Sprite>> load_into(Renderer &) const;
+	//FNV-1a of the last frame rendered by a headless renderer.
+	static std::uint64_t hash_frame(const Renderer &);
+	DEFINE_GETTER(name)
+	DEFINE_GETTER(frame_hash)
+};
+
+//Renders each scene of a corpus over and over on a headless renderer, with
+//no SDL involved, and reports the time per frame and per pass. Every frame
+//is checked against the scene's hash, outside the timed region.
+class RendererBenchmark{
+public:
+	struct Result{
+		std::string name;
+		std::uint64_t expected_hash = 0;
+		std::uint64_t actual_hash = 0;
+		std::uint64_t frames = 0;
+		std::uint64_t mismatches = 0;
+		double total_time = 0;
+		double pass_times[Renderer::pass_count] = {};
+	};
+private:
+	std::vector<RendererScene> scenes;
+	std::vector<Result> results;
+public:
+	RendererBenchmark(const std::vector<std::string> &paths);
+	void run(unsigned iterations);
+	const std::vector<Result> &get_results() const{
+		return this->results;
+	}
+	//Returns false if any frame didn't match its scene's hash.
+	bool report(std::ostream &) const;
+};
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "utility.h"
+#ifndef HAVE_PCH
+#include <algorithm>
+#include <cstring>
+#endif
 
 enum class PaletteRegion{
 	Background = 0,
@@ -56,12 +60,6 @@ static const Palette null_palette = { -1, -1, -1, -1 };
 static const Palette default_palette = { 0, 1, 2, 3 };
 static const Palette default_world_sprite_palette = { 0, 0, 1, 3 };
 
-template <unsigned N>
-struct BasicTileData{
-	static const size_t size = N * N;
-	byte_t data[size];
-};
-
 class Tile{
 public:
 	std::uint16_t tile_no;
@@ -101,3 +99,60 @@ struct Tilemap{
 		return this->tiles[p.x + p.y * w];
 	}
 };
+
+//Sorted, disjoint spans [begin, end) of a scanline that have already been
+//drawn by an opaque layer. A span that doesn't fit is dropped; that only
+//costs some overdraw, since the renderer still checks each point.
+class ScanlineCoverage{
+public:
+	static const int max_spans = 8;
+private:
+	struct Span{
+		int begin, end;
+	};
+	Span spans[max_spans];
+	int count = 0;
+public:
+	void clear(){
+		this->count = 0;
+	}
+	void add(int begin, int end){
+		if (begin >= end)
+			return;
+		int i = 0;
+		while (i < this->count && this->spans[i].end < begin)
+			i++;
+		int j = i;
+		for (; j < this->count && this->spans[j].begin <= end; j++){
+			begin = std::min(begin, this->spans[j].begin);
+			end = std::max(end, this->spans[j].end);
+		}
+		//[i, j) are merged into the new span.
+		if (i == j){
+			if (this->count == max_spans)
+				return;
+			memmove(this->spans + i + 1, this->spans + i, (this->count - i) * sizeof(Span));
+			this->count++;
+		}else if (j - i > 1){
+			memmove(this->spans + i + 1, this->spans + j, (this->count - j) * sizeof(Span));
+			this->count -= j - i - 1;
+		}
+		this->spans[i] = { begin, end };
+	}
+	//Calls f(begin, end) for every part of [begin, end) not yet covered.
+	template <typename F>
+	void for_each_uncovered(int begin, int end, F &&f) const{
+		for (int i = 0; i < this->count && begin < end; i++){
+			auto &span = this->spans[i];
+			if (span.end <= begin)
+				continue;
+			if (span.begin >= end)
+				break;
+			if (span.begin > begin)
+				f(begin, span.begin);
+			begin = span.end;
+		}
+		if (begin < end)
+			f(begin, end);
+	}
+};
@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include "Resampler.h"
+#ifndef HAVE_PCH
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#endif
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define Resampler_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+//Kaiser window parameter. About 70 dB of stopband attenuation.
+static const double kaiser_beta = 7;
+//Fraction of the Nyquist frequency (of the lower of the two rates) that's
+//passed. The rest is left for the transition band.
+static const double passband = 0.91;
+
+static double bessel_i0(double x){
+	double ret = 1;
+	double term = 1;
+	for (int k = 1; k < 32; k++){
+		auto t = x / (2 * k);
+		term *= t * t;
+		ret += term;
+	}
+	return ret;
+}
+
+static double kaiser(double x){
+	if (x <= -1 || x >= 1)
+		return 0;
+	return bessel_i0(kaiser_beta * sqrt(1 - x * x)) / bessel_i0(kaiser_beta);
+}
+
+static double sinc(double x){
+	if (!x)
+		return 1;
+	x *= 3.14159265358979323846;
+	return sin(x) / x;
+}
+
+Resampler::Resampler(unsigned input_rate, unsigned output_rate): input_rate(input_rate), output_rate(output_rate){
+	if (!input_rate || !output_rate)
+		throw std::runtime_error("Resampler::Resampler(): Invalid sampling rate.");
+	this->step = ((std::uint64_t)input_rate << 32) / output_rate;
+
+	//Cutoff, in cycles per input sample.
+	auto cutoff = 0.5 * passband * std::min(1.0, (double)output_rate / input_rate);
+	const double half = taps / 2;
+	this->coefficients.resize((phases + 1) * taps * 2);
+	for (unsigned phase = 0; phase <= phases; phase++){
+		auto row = &this->coefficients[phase * taps * 2];
+		double values[taps];
+		double sum = 0;
+		for (unsigned i = 0; i < taps; i++){
+			//Distance from the output sample to input sample i.
+			auto x = i - (half - 1) - (double)phase / phases;
+			values[i] = 2 * cutoff * sinc(2 * cutoff * x) * kaiser(x / half);
+			sum += values[i];
+		}
+		//Normalized so that every phase has unity gain at DC.
+		for (unsigned i = 0; i < taps; i++)
+			row[i * 2] = row[i * 2 + 1] = (float)(values[i] / sum);
+	}
+	this->input.reserve(taps * 4);
+}
+
+size_t Resampler::get_max_output(size_t count) const{
+	return (size_t)((std::uint64_t)count * this->output_rate / this->input_rate) + 2;
+}
+
+size_t Resampler::process(StereoSampleFinal *dst, const StereoSampleFinal *src, size_t count){
+	auto old_size = this->input.size();
+	this->input.resize(old_size + count * 2);
+	auto p = &this->input[old_size];
+	for (size_t i = 0; i < count; i++){
+		p[i * 2] = src[i].left;
+		p[i * 2 + 1] = src[i].right;
+	}
+
+	size_t available = this->input.size() / 2;
+	size_t ret = 0;
+	while ((this->position >> 32) + taps <= available){
+		auto index = (size_t)(this->position >> 32);
+		dst[ret++] = this->filter(&this->input[index * 2], (std::uint32_t)this->position);
+		this->position += this->step;
+	}
+
+	auto consumed = std::min((size_t)(this->position >> 32), available);
+	this->input.erase(this->input.begin(), this->input.begin() + consumed * 2);
+	this->position -= (std::uint64_t)consumed << 32;
+	return ret;
+}
+
+static std::int16_t saturate(float x){
+	return (std::int16_t)std::max<long>(std::min<long>(lrintf(x), int16_max), int16_min);
+}
+
+StereoSampleFinal Resampler::filter(const float *input, std::uint32_t fraction) const{
+	const unsigned fraction_bits = 32 - phase_bits;
+	auto phase = fraction >> fraction_bits;
+	auto t = (float)(fraction & ((1U << fraction_bits) - 1)) * (1.f / (1U << fraction_bits));
+	auto row0 = &this->coefficients[phase * taps * 2];
+	auto row1 = row0 + taps * 2;
+	float left, right;
+#ifdef Resampler_USE_SSE2
+	//Two stereo samples per iteration, laid out as L0 R0 L1 R1. Both phases
+	//are convolved at once and interpolated at the end.
+	auto acc0 = _mm_setzero_ps();
+	auto acc1 = _mm_setzero_ps();
+	for (unsigned i = 0; i < taps * 2; i += 4){
+		auto x = _mm_loadu_ps(input + i);
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(x, _mm_loadu_ps(row0 + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(x, _mm_loadu_ps(row1 + i)));
+	}
+	auto acc = _mm_add_ps(acc0, _mm_mul_ps(_mm_sub_ps(acc1, acc0), _mm_set1_ps(t)));
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	left = _mm_cvtss_f32(acc);
+	right = _mm_cvtss_f32(_mm_shuffle_ps(acc, acc, 1));
+#else
+	float left0 = 0, right0 = 0, left1 = 0, right1 = 0;
+	for (unsigned i = 0; i < taps * 2; i += 2){
+		left0 += input[i] * row0[i];
+		right0 += input[i + 1] * row0[i + 1];
+		left1 += input[i] * row1[i];
+		right1 += input[i + 1] * row1[i + 1];
+	}
+	left = left0 + (left1 - left0) * t;
+	right = right0 + (right1 - right0) * t;
+#endif
+	StereoSampleFinal ret;
+	ret.left = saturate(left);
+	ret.right = saturate(right);
+	return ret;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "AudioData.h"
+#include "utility.h"
+#ifndef HAVE_PCH
+#include <vector>
+#include <cstdint>
+#endif
+
+//Converts a stream of stereo samples from one rate to another with a
+//polyphase windowed-sinc filter. The phases are tabulated and linearly
+//interpolated between, so any pair of rates is supported. The output lags the
+//input by taps / 2 input samples.
+class Resampler{
+	static const unsigned taps = 48;
+	static const unsigned phase_bits = 8;
+	static const unsigned phases = 1 << phase_bits;
+	unsigned input_rate;
+	unsigned output_rate;
+	//phases + 1 rows of taps coefficients. Each coefficient is stored once for
+	//each channel, so that a row lines up with the interleaved input.
+	std::vector<float> coefficients;
+	//Interleaved input that's still needed by upcoming output samples.
+	std::vector<float> input;
+	//Input samples per output sample, as 32.32 fixed point.
+	std::uint64_t step;
+	//Position in input of the next output sample, as 32.32 fixed point.
+	std::uint64_t position = 0;
+
+	StereoSampleFinal filter(const float *input, std::uint32_t fraction) const;
+public:
+	Resampler(unsigned input_rate, unsigned output_rate);
+	//Upper bound of the number of samples process() writes for count input
+	//samples.
+	size_t get_max_output(size_t count) const;
+	//Returns the number of samples written to dst.
+	size_t process(StereoSampleFinal *dst, const StereoSampleFinal *src, size_t count);
+	DEFINE_GETTER(input_rate)
+	DEFINE_GETTER(output_rate)
+};
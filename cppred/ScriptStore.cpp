@@ -3,46 +3,92 @@
 #include "CppRed/Scripts/ScriptDeclarations.h"
 #include "utility.h"
 #include "Console.h"
-#ifndef HAVE_PCH
-#include <algorithm>
+
+//Define to make it a compile error for the data to reference a script that
+//hasn't been implemented.
+//#define ScriptStore_REQUIRE_ALL_SCRIPTS
+
+namespace CppRed{
+namespace Scripts{
+
+struct unimplemented_script{};
+
+//A stand-in for every script the data references. Wherever
+//ScriptDeclarations.h declares the real script, overload resolution prefers
+//it over the stand-in, so declaring a script is all it takes to add it to
+//the table.
+namespace Unimplemented{
+#define CPPRED_SCRIPT(name) inline unimplemented_script name(const script_parameters &){ return {}; }
+#include "../CodeGeneration/output/scripts.inl"
+#undef CPPRED_SCRIPT
+}
+
+using namespace Unimplemented;
+typedef unimplemented_script (*unimplemented_f)(const script_parameters &);
+
+constexpr ScriptStore::script_f resolve_script(ScriptStore::script_f f){
+	return f;
+}
+
+template <typename = void>
+constexpr ScriptStore::script_f resolve_script(unimplemented_f){
+	return nullptr;
+}
+
+constexpr bool is_implemented(ScriptStore::script_f){
+	return true;
+}
+
+template <typename = void>
+constexpr bool is_implemented(unimplemented_f){
+	return false;
+}
+
+//Indexed by ScriptId.
+static constexpr ScriptStore::script_f scripts[] = {
+	nullptr,
+#define CPPRED_SCRIPT(name) resolve_script(name),
+#include "../CodeGeneration/output/scripts.inl"
+#undef CPPRED_SCRIPT
+};
+
+static_assert(array_length(scripts) == script_id_count, "scripts.inl doesn't match ScriptId.");
+
+#ifdef ScriptStore_REQUIRE_ALL_SCRIPTS
+#define CPPRED_SCRIPT(name) static_assert(is_implemented(name), #name " is referenced by the data but isn't implemented.");
+#include "../CodeGeneration/output/scripts.inl"
+#undef CPPRED_SCRIPT
 #endif
 
-#define ADD_SCRIPT(name) this->scripts.emplace_back(#name, CppRed::Scripts::name)
-
-ScriptStore::ScriptStore(){
-	ADD_SCRIPT(PrintRedSNESText);
-	ADD_SCRIPT(RedsHouse1FText1);
-	ADD_SCRIPT(RedsHouse1FText2);
-	ADD_SCRIPT(PalletTownScript);
-	ADD_SCRIPT(BluesHouseScript);
-	ADD_SCRIPT(BluesHouseText1);
-	ADD_SCRIPT(OaksLabScript);
-	ADD_SCRIPT(OaksLabText1);
-	ADD_SCRIPT(OaksLabText2);
-	ADD_SCRIPT(OaksLabText3);
-	ADD_SCRIPT(OaksLabText4);
-	ADD_SCRIPT(OaksLabText5);
-	ADD_SCRIPT(DisplayOakLabEmailText);
-	ADD_SCRIPT(DisplayOakLabLeftPoster);
-	ADD_SCRIPT(DisplayOakLabRightPoster);
-	ADD_SCRIPT(OpenRedsPC);
-	//Add scripts.
-
-	std::sort(this->scripts.begin(), this->scripts.end(), [](const auto &a, const auto &b){ return a.first < b.first; });
+static const char * const script_names[] = {
+	"None",
+#define CPPRED_SCRIPT(name) #name,
+#include "../CodeGeneration/output/scripts.inl"
+#undef CPPRED_SCRIPT
+};
+
+}
 }
 
 void ScriptStore::execute(const CppRed::Scripts::script_parameters &parameter) const{
-	auto f = this->get_script(parameter.script_name);
+	auto f = this->get_script(parameter.script);
 	if (!f){
-		Logger() << "Script not found. " << parameter.script_name << "(" << (parameter.parameter ? parameter.parameter : "null") << ")\n";
+		Logger() << "Script not found. " << get_name(parameter.script) << "(" << (parameter.parameter ? parameter.parameter : "null") << ")\n";
 		return;
 	}
 	f(parameter);
 }
 
-ScriptStore::script_f ScriptStore::get_script(const char *name) const{
-	auto it = find_first_true(this->scripts.begin(), this->scripts.end(), [name](const auto &x){ return name <= x.first; });
-	if (it == this->scripts.end() || it->first != name)
+ScriptStore::script_f ScriptStore::get_script(CppRed::ScriptId id) const{
+	auto i = (size_t)id;
+	if (i >= CppRed::script_id_count)
 		return nullptr;
-	return it->second;
+	return CppRed::Scripts::scripts[i];
+}
+
+const char *ScriptStore::get_name(CppRed::ScriptId id){
+	auto i = (size_t)id;
+	if (i >= CppRed::script_id_count)
+		return "?";
+	return CppRed::Scripts::script_names[i];
 }
@@ -1,10 +1,6 @@
 #pragma once
 
-#ifndef HAVE_PCH
-#include <vector>
-#include <utility>
-#include <string>
-#endif
+#include "../CodeGeneration/output/scripts.h"
 
 namespace CppRed{
 class Game;
@@ -14,13 +10,14 @@ struct script_parameters;
 }
 }
 
+//Dispatches scripts by ScriptId through a table that's built at compile time.
 class ScriptStore{
 public:
 	typedef void (*script_f)(const CppRed::Scripts::script_parameters &parameter);
-private:
-	std::vector<std::pair<std::string, script_f>> scripts;
-public:
-	ScriptStore();
 	void execute(const CppRed::Scripts::script_parameters &parameter) const;
-	script_f get_script(const char *name) const;
+	//Returns null for ScriptId::None and for the scripts the data references
+	//that haven't been implemented yet.
+	script_f get_script(CppRed::ScriptId) const;
+	//Only meant for diagnostics.
+	static const char *get_name(CppRed::ScriptId);
 };
@@ -0,0 +1,206 @@
+#include "stdafx.h"
+#include "SfxCache.h"
+#include "HeliosRenderer.h"
+#include "AudioDevice.h"
+#include "CppRed/AudioProgram.h"
+#include "Coroutine.h"
+#include "../CodeGeneration/output/audio.h"
+#ifndef HAVE_PCH
+#include <tuple>
+#include <algorithm>
+#endif
+
+bool SfxCache::Key::operator<(const Key &other) const{
+	return std::tie(this->id, this->frequency_modifier, this->tempo_modifier) < std::tie(other.id, other.frequency_modifier, other.tempo_modifier);
+}
+
+SfxCache::SfxCache(PokemonVersion version, SynthesisQuality quality, const std::shared_ptr<const CppRed::AudioProgramData> &data):
+		version(version),
+		data(data),
+		quality(quality){
+	this->queue_all_sfx();
+	this->thread = std::thread([this](){ this->thread_function(); });
+}
+
+SfxCache::~SfxCache(){
+	{
+		LOCK_MUTEX(this->mutex);
+		this->running = false;
+		this->cv.notify_all();
+	}
+	this->thread.join();
+}
+
+void SfxCache::queue_all_sfx(){
+	auto &resources = this->data->resources;
+	for (size_t i = 0; i < resources.size(); i++){
+		if (resources[i].type != AudioResourceType::Sfx)
+			continue;
+		Key key{ (AudioResourceId)i, 0, 0 };
+		this->clips[key];
+		this->queue.push_back(key);
+	}
+}
+
+std::shared_ptr<const SfxClip> SfxCache::get(const Key &key){
+	LOCK_MUTEX(this->mutex);
+	auto it = this->clips.find(key);
+	if (it != this->clips.end())
+		return it->second;
+	auto type = this->data->resources[(int)key.id].type;
+	if (type != AudioResourceType::Sfx && type != AudioResourceType::Cry)
+		return nullptr;
+	this->clips[key];
+	this->queue.push_front(key);
+	this->cv.notify_all();
+	return nullptr;
+}
+
+void SfxCache::set_synthesis_quality(SynthesisQuality quality){
+	LOCK_MUTEX(this->mutex);
+	if (quality == this->quality)
+		return;
+	this->quality = quality;
+	this->generation++;
+	this->clips.clear();
+	this->queue.clear();
+	this->queue_all_sfx();
+	this->cv.notify_all();
+}
+
+void SfxCache::thread_function(){
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true){
+		while (this->running && this->queue.empty())
+			this->cv.wait(lock);
+		if (!this->running)
+			break;
+		auto key = this->queue.front();
+		this->queue.pop_front();
+		auto generation = this->generation;
+		auto quality = this->quality;
+		lock.unlock();
+		auto clip = this->render(key, quality);
+		lock.lock();
+		if (generation == this->generation)
+			this->clips[key] = clip;
+	}
+}
+
+std::shared_ptr<const SfxClip> SfxCache::render(const Key &key, SynthesisQuality quality) const{
+	NullAudioDevice device;
+	HeliosRenderer renderer(device);
+	renderer.set_synthesis_quality(quality);
+	renderer.set_NR52(0xFF);
+	renderer.set_NR50(0x77);
+	CppRed::AudioProgram program(renderer, this->version, false, this->data);
+	auto ret = std::make_shared<SfxClip>();
+	ret->takes_over_output = this->data->resources[(int)key.id].type == AudioResourceType::Cry;
+
+	const double step = 1.0 / 60;
+	//One more update after the program stops, to let the last notes out.
+	int updates_after_end = 1;
+	for (int i = 0; updates_after_end >= 0; i++){
+		if (i == 1){
+			auto lock = program.acquire_lock();
+			program.set_frequency_modifier(key.frequency_modifier);
+			program.set_tempo_modifier(key.tempo_modifier);
+			program.play_sound(key.id);
+		}
+		program.update(i * step);
+		while (auto frame = renderer.get_current_frame()){
+			for (auto &sample : frame->buffer)
+				ret->samples.push_back(convert(sample));
+			renderer.return_used_frame(frame);
+		}
+		if (ret->samples.size() > max_clip_length)
+			return nullptr;
+		if (i >= 1){
+			auto lock = program.acquire_lock();
+			if (!program.is_sfx_playing())
+				updates_after_end--;
+		}
+	}
+
+	//Trailing silence.
+	auto zero = [](const StereoSampleFinal &sample){ return !sample.left && !sample.right; };
+	auto end = std::find_if_not(ret->samples.rbegin(), ret->samples.rend(), zero).base();
+	ret->samples.erase(end, ret->samples.end());
+	//Leading silence, from before the sound started.
+	auto begin = std::find_if_not(ret->samples.begin(), ret->samples.end(), zero);
+	ret->samples.erase(ret->samples.begin(), begin);
+	ret->samples.shrink_to_fit();
+	return ret;
+}
+
+SfxVoice::SfxVoice(){
+	this->sound_id = AudioResourceId::None;
+	this->playing = false;
+}
+
+void SfxVoice::play(const std::shared_ptr<const SfxClip> &clip, AudioResourceId id){
+	LOCK_MUTEX(this->mutex);
+	this->clip = clip;
+	this->position = 0;
+	this->sound_id = id;
+	this->playing = true;
+	this->finish_event.reset();
+}
+
+void SfxVoice::stop(){
+	LOCK_MUTEX(this->mutex);
+	if (!this->playing)
+		return;
+	this->clip.reset();
+	this->playing = false;
+	this->finish_event.signal();
+}
+
+bool SfxVoice::get_sound_id(AudioResourceId &dst){
+	LOCK_MUTEX(this->mutex);
+	if (!this->playing)
+		return false;
+	dst = this->sound_id;
+	return true;
+}
+
+void SfxVoice::wait_for_end(){
+	if (!this->playing)
+		return;
+	auto coroutine = Coroutine::get_current_coroutine_ptr();
+	if (!coroutine)
+		this->finish_event.wait();
+	else{
+		while (!this->finish_event.state())
+			coroutine->yield();
+	}
+}
+
+static intermediate_audio_type expand(std::int16_t x){
+#ifdef USE_FLOAT_AUDIO
+	return x * (1.f / int16_max);
+#else
+	return x;
+#endif
+}
+
+bool SfxVoice::render(StereoSampleIntermediate *dst, size_t n){
+	LOCK_MUTEX(this->mutex);
+	if (!this->playing)
+		return false;
+	auto &samples = this->clip->samples;
+	auto count = std::min(n, samples.size() - this->position);
+	auto src = samples.data() + this->position;
+	for (size_t i = 0; i < count; i++){
+		dst[i].left += expand(src[i].left);
+		dst[i].right += expand(src[i].right);
+	}
+	this->position += count;
+	auto ret = this->clip->takes_over_output;
+	if (this->position >= samples.size()){
+		this->clip.reset();
+		this->playing = false;
+		this->finish_event.signal();
+	}
+	return ret;
+}
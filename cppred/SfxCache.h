@@ -0,0 +1,105 @@
+#pragma once
+#include "AudioData.h"
+#include "pokemon_version.h"
+#include "threads.h"
+#include "utility.h"
+#ifndef HAVE_PCH
+#include <memory>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#endif
+
+enum class AudioResourceId;
+
+namespace CppRed{
+class AudioProgramData;
+}
+
+//A sound effect or cry as the SFX renderer would have produced it, before
+//the mixer's gain.
+struct SfxClip{
+	std::vector<StereoSampleFinal> samples;
+	//Cries take over the output while they play, like they do when they're
+	//rendered live.
+	bool takes_over_output;
+};
+
+//Renders sound effects and cries into clips on a background thread, so that
+//they can be played back without running the SFX program and renderer. Every
+//SFX is queued for rendering on construction. Cries depend on the pitch and
+//length modifiers of each species, so their variants are only rendered the
+//first time they're requested, and go to the front of the queue.
+class SfxCache{
+public:
+	struct Key{
+		AudioResourceId id;
+		int frequency_modifier;
+		int tempo_modifier;
+		bool operator<(const Key &other) const;
+	};
+private:
+	PokemonVersion version;
+	std::shared_ptr<const CppRed::AudioProgramData> data;
+	SynthesisQuality quality;
+	//Null values are clips that are queued or that can't be cached.
+	std::map<Key, std::shared_ptr<const SfxClip>> clips;
+	std::deque<Key> queue;
+	//Incremented whenever the clips are dropped, so that a render that was
+	//started before that is discarded.
+	std::uint64_t generation = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread thread;
+	bool running = true;
+
+	void queue_all_sfx();
+	void thread_function();
+	std::shared_ptr<const SfxClip> render(const Key &, SynthesisQuality) const;
+public:
+	//Clips longer than this are assumed to loop and are left to be played
+	//live.
+	static const size_t max_clip_length = sampling_frequency * 20;
+
+	SfxCache(PokemonVersion, SynthesisQuality, const std::shared_ptr<const CppRed::AudioProgramData> &);
+	~SfxCache();
+	SfxCache(const SfxCache &) = delete;
+	void operator=(const SfxCache &) = delete;
+	//Returns null if the clip isn't ready, in which case the sound should be
+	//played live. Only Sfx and Cry resources can be cached.
+	std::shared_ptr<const SfxClip> get(const Key &);
+	//Drops every clip and renders them again at the new quality. Clips that
+	//are already playing are unaffected.
+	void set_synthesis_quality(SynthesisQuality);
+	DEFINE_GETTER(version)
+};
+
+//Plays a single clip at a time. TwoWayMixer adds it to the output of the SFX
+//renderer.
+class SfxVoice{
+	std::mutex mutex;
+	std::shared_ptr<const SfxClip> clip;
+	size_t position = 0;
+	AudioResourceId sound_id;
+	std::atomic<bool> playing;
+	Event finish_event;
+public:
+	SfxVoice();
+	void play(const std::shared_ptr<const SfxClip> &, AudioResourceId);
+	void stop();
+	bool is_playing() const{
+		return this->playing;
+	}
+	//Returns false if nothing is playing.
+	bool get_sound_id(AudioResourceId &);
+	//Yields the current coroutine, if there is one, until the clip ends.
+	void wait_for_end();
+	//Adds the next n samples of the clip to dst. Returns true if the clip
+	//should take over the output, as with AudioFrame::active.
+	bool render(StereoSampleIntermediate *dst, size_t n);
+};
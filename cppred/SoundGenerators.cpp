@@ -1,8 +1,10 @@
 #include "stdafx.h"
 #include "SoundGenerators.h"
 #include "utility.h"
-
-const int int16_max = (1 << 15) - 1;
+#ifndef HAVE_PCH
+#include <algorithm>
+#include <cmath>
+#endif
 
 const byte_t Square2Generator::duties[4] = {
 	0x80,
@@ -40,6 +42,16 @@ void ClockDivider::configure(unsigned src_frequency_power, std::uint64_t dst_fre
 	this->reset();
 }
 
+void ClockDivider::configure(unsigned src_frequency_power, std::uint64_t dst_frequency){
+	this->callback = nullptr;
+#ifndef USE_STD_FUNCTION
+	this->user_data = nullptr;
+#endif
+	this->src_frequency_power = src_frequency_power;
+	this->dst_frequency = dst_frequency;
+	this->reset();
+}
+
 void ClockDivider::update(std::uint64_t source_clock){
 	if (!this->src_frequency_power)
 		return;
@@ -60,10 +72,37 @@ void ClockDivider::update(std::uint64_t source_clock){
 	this->last_update = time;
 }
 
+std::uint64_t ClockDivider::advance(std::uint64_t source_clock){
+	if (!this->src_frequency_power)
+		return 0;
+
+	auto time = source_clock * this->dst_frequency;
+	time >>= this->src_frequency_power;
+	std::uint64_t ret = 0;
+	if (this->last_update == std::numeric_limits<std::uint64_t>::max())
+		ret = 1;
+	else if (time > this->last_update)
+		ret = time - this->last_update;
+	this->last_update = time;
+	return ret;
+}
+
 void ClockDivider::reset(){
 	this->last_update = std::numeric_limits<std::uint64_t>::max();
 }
 
+std::uint64_t ClockDivider::get_next_firing(std::uint64_t source_clock) const{
+	if (!this->src_frequency_power | !this->dst_frequency)
+		return std::numeric_limits<std::uint64_t>::max();
+	//After a reset, the first update() always fires.
+	if (this->last_update == std::numeric_limits<std::uint64_t>::max())
+		return source_clock;
+	//Smallest s such that (s * dst_frequency) >> src_frequency_power > last_update.
+	auto target = (this->last_update + 1) << this->src_frequency_power;
+	auto ret = (target + this->dst_frequency - 1) / this->dst_frequency;
+	return std::max(ret, source_clock);
+}
+
 WaveformGenerator::WaveformGenerator(){
 	fill<byte_t>(this->registers, 0);
 }
@@ -116,18 +155,49 @@ void FrequenciedGenerator::advance_cycle(std::uint64_t time){
 	}
 }
 
+template <unsigned Shift, typename F>
+void FrequenciedGenerator::for_each_transition(std::uint64_t time, F &&f){
+	if (this->reference_time == this->undefined_reference_time || time <= this->reference_time)
+		return;
+	auto delta = time - this->reference_time;
+	const auto mult = (std::uint64_t)gb_cpu_frequency << Shift;
+	auto div = (std::uint64_t)sampling_frequency * this->get_period();
+	const std::uint64_t step_length = 1 << Shift;
+	const std::uint64_t step_count = 0x10000 >> Shift;
+	std::uint64_t base = this->reference_cycle_position;
+	auto first = (base + (delta - 1) * mult / div) / step_length + 1;
+	auto last = (base + delta * mult / div) / step_length;
+	if (last < first || last - first >= max_transitions_per_sample)
+		return;
+	for (auto i = first; i <= last; i++){
+		auto boundary = i * step_length - base;
+		double fraction = (double)delta - (double)boundary * div / mult;
+		f((unsigned)(i % step_count), fraction);
+	}
+}
+
 void Square2Generator::update_state_before_render(std::uint64_t time){
 	this->advance_cycle<13>(time);
 }
 
 intermediate_audio_type Square2Generator::render(std::uint64_t time) const{
+	return this->render_step(this->cycle_position >> 13);
+}
+
+intermediate_audio_type Square2Generator::render_step(unsigned step) const{
 	if (!this->enabled())
 		return 0;
 
-	bool bit = !!(this->duties[this->selected_duty] & ::bit(this->cycle_position >> 13));
+	bool bit = !!(this->duties[this->selected_duty] & ::bit(step));
 	return this->render_from_bit(bit);
 }
 
+void Square2Generator::add_transitions(std::uint64_t time, BandLimitedSynthesizer &synthesizer){
+	this->for_each_transition<13>(time, [this, &synthesizer](unsigned step, double fraction){
+		synthesizer.add_step(fraction, this->render_step(step));
+	});
+}
+
 intermediate_audio_type EnvelopedGenerator::render_from_bit(bool signal) const{
 #ifdef USE_FLOAT_AUDIO
 	auto y = (signal * 2 - 1) * this->volume;
@@ -321,6 +391,121 @@ intermediate_audio_type CapacitorFilter::update(intermediate_audio_type in){
 #endif
 }
 
+BandLimitedStepTable::BandLimitedStepTable(SynthesisQuality quality){
+	if (quality == SynthesisQuality::Fast){
+		//Box filter. A transition f samples before a sample contributes f of its
+		//height to that sample and all of it to the next one.
+		this->first_offset = 0;
+		this->width = 1;
+		this->residuals.resize(phases + 1);
+		for (unsigned i = 0; i <= phases; i++)
+			this->residuals[i] = (float)i / phases - 1;
+		return;
+	}
+
+	const int half_width = 8;
+	const double cutoff = 0.45;
+	const double pi = 3.14159265358979323846;
+	const int oversampling = 16;
+	this->first_offset = -half_width;
+	this->width = 2 * half_width;
+
+	//Integrate a Blackman-windowed sinc, to obtain the band-limited step at
+	//every phase in [-half_width; half_width].
+	auto kernel = [&](double x){
+		double window = 0.42 + 0.5 * cos(pi * x / half_width) + 0.08 * cos(2 * pi * x / half_width);
+		double y = pi * 2 * cutoff * x;
+		double sinc = y ? sin(y) / y : 1;
+		return 2 * cutoff * sinc * window;
+	};
+	const unsigned points = 2 * half_width * phases;
+	std::vector<double> step(points + 1);
+	double sum = 0;
+	step[0] = 0;
+	for (unsigned i = 0; i < points; i++){
+		for (int j = 0; j < oversampling; j++){
+			double x = -half_width + (i + (j + 0.5) / oversampling) / phases;
+			sum += kernel(x) / (phases * oversampling);
+		}
+		step[i + 1] = sum;
+	}
+
+	this->residuals.resize((phases + 1) * this->width);
+	for (unsigned phase = 0; phase <= phases; phase++){
+		for (unsigned i = 0; i < this->width; i++){
+			int offset = (int)i + this->first_offset;
+			auto value = step[(i * phases) + phase] / sum - (offset >= 0);
+			this->residuals[phase * this->width + i] = (float)value;
+		}
+	}
+}
+
+const float *BandLimitedStepTable::get_residuals(double fraction) const{
+	unsigned phase = 0;
+	if (fraction > 0)
+		phase = (unsigned)(fraction * phases + 0.5);
+	if (phase > phases)
+		phase = phases;
+	return &this->residuals[phase * this->width];
+}
+
+const BandLimitedStepTable *BandLimitedStepTable::get(SynthesisQuality quality){
+	switch (quality){
+		case SynthesisQuality::Fast:
+			{
+				static const BandLimitedStepTable ret(quality);
+				return &ret;
+			}
+		case SynthesisQuality::BandLimited:
+			{
+				static const BandLimitedStepTable ret(quality);
+				return &ret;
+			}
+		default:
+			return nullptr;
+	}
+}
+
+BandLimitedSynthesizer::BandLimitedSynthesizer(){
+	this->set_quality(SynthesisQuality::PointSampled);
+}
+
+void BandLimitedSynthesizer::set_quality(SynthesisQuality quality){
+	this->table = BandLimitedStepTable::get(quality);
+	fill(this->residuals, 0.f);
+	fill(this->levels, (intermediate_audio_type)0);
+	this->level = 0;
+	this->position = 0;
+}
+
+void BandLimitedSynthesizer::add_step(double fraction, intermediate_audio_type new_level){
+	auto delta = new_level - this->level;
+	if (!delta)
+		return;
+	this->level = new_level;
+	auto residuals = this->table->get_residuals(fraction);
+	auto width = this->table->get_width();
+	auto start = this->position + this->table->get_first_offset();
+	for (unsigned i = 0; i < width; i++)
+		this->residuals[(start + i) & history_mask] += residuals[i] * delta;
+}
+
+intermediate_audio_type BandLimitedSynthesizer::end_sample(intermediate_audio_type point_sample){
+	//Whatever the transitions didn't account for (envelope, triggers, etc.)
+	//happens right at the sample.
+	this->add_step(0, point_sample);
+	this->levels[this->position & history_mask] = this->level;
+	auto index = (this->position + this->table->get_first_offset()) & history_mask;
+	this->position++;
+	auto residual = this->residuals[index];
+	this->residuals[index] = 0;
+#ifdef USE_FLOAT_AUDIO
+	return this->levels[index] + residual;
+#else
+	return this->levels[index] + (intermediate_audio_type)lrintf(residual);
+#endif
+}
+
 void NoiseGenerator::set_register3(byte_t value){
 	EnvelopedGenerator::set_register3(value);
 	this->width_mode = 14 - (value & bit(3));
@@ -334,19 +519,7 @@ void NoiseGenerator::set_register3(byte_t value){
 		frequency = (1 << 19) / divisor_code;
 	frequency >>= clock_shift + 1;
 
-	this->noise_scheduler.configure(
-		gb_cpu_frequency_power,
-		frequency,
-#ifdef USE_STD_FUNCTION
-		[this](std::uint64_t)
-		{
-			this->noise_update_event();
-		}
-#else
-		NoiseGenerator::noise_update_event,
-		this
-#endif
-	);
+	this->noise_scheduler.configure(gb_cpu_frequency_power, frequency);
 }
 
 intermediate_audio_type NoiseGenerator::render(std::uint64_t time) const{
@@ -357,11 +530,7 @@ intermediate_audio_type NoiseGenerator::render(std::uint64_t time) const{
 }
 
 void NoiseGenerator::update_state_before_render(std::uint64_t time){
-	this->noise_scheduler.update(time);
-}
-
-void NoiseGenerator::noise_update_event(void *This, std::uint64_t){
-	((NoiseGenerator *)This)->noise_update_event();
+	this->advance_lfsr(this->noise_scheduler.advance(time));
 }
 
 void NoiseGenerator::noise_update_event(){
@@ -375,6 +544,89 @@ void NoiseGenerator::noise_update_event(){
 	this->output ^= !!output;
 }
 
+namespace{
+
+//The full sequence of states of a Bits-wide LFSR, as clocked by
+//NoiseGenerator::noise_update_event(). Each entry also stores, in bit 15, the
+//parity of the feedback bits produced between entry 0 and it, which is what
+//NoiseGenerator::output accumulates. The all-zeroes state is a fixed point and
+//is not part of the sequence.
+template <unsigned Bits>
+class LfsrSequence{
+public:
+	static const unsigned period = (1 << Bits) - 1;
+private:
+	//One extra entry, so that sequence[period] is entry 0 again, carrying the
+	//parity of an entire period.
+	std::uint16_t sequence[period + 1];
+	std::uint16_t positions[period + 1];
+	static const std::uint16_t parity_bit = 1 << 15;
+	static const std::uint16_t state_mask = period;
+public:
+	LfsrSequence(){
+		unsigned state = state_mask;
+		unsigned parity = 0;
+		for (unsigned i = 0; i <= period; i++){
+			this->sequence[i] = (std::uint16_t)(state | (parity << 15));
+			if (i < period)
+				this->positions[state] = (std::uint16_t)i;
+			unsigned feedback = (state ^ (state >> 1)) & 1;
+			state = (state >> 1) | (feedback << (Bits - 1));
+			parity ^= feedback;
+		}
+		this->positions[0] = 0;
+	}
+	//Advances a non-zero state by the given number of steps, and returns the
+	//parity of the feedback bits produced along the way.
+	bool advance(unsigned &state, std::uint64_t steps) const{
+		unsigned position = this->positions[state];
+		bool whole_periods = (steps / period) % 2 && (this->sequence[period] & parity_bit);
+		unsigned remainder = (unsigned)(steps % period);
+		unsigned parity = this->sequence[position];
+		unsigned destination = position + remainder;
+		if (destination >= period){
+			parity ^= this->sequence[period];
+			destination -= period;
+		}
+		parity ^= this->sequence[destination];
+		state = this->sequence[destination] & state_mask;
+		return whole_periods != !!(parity & parity_bit);
+	}
+	static const LfsrSequence &get(){
+		static const LfsrSequence ret;
+		return ret;
+	}
+};
+
+}
+
+void NoiseGenerator::advance_lfsr(std::uint64_t steps){
+	if (!steps)
+		return;
+	//Right after a trigger the register has all its bits set. The first step
+	//masks it back down to 15 bits.
+	if (this->noise_register > 0x7FFF){
+		this->noise_update_event();
+		steps--;
+	}
+
+	if (this->width_mode == 14){
+		unsigned state = this->noise_register;
+		if (state)
+			this->output ^= LfsrSequence<15>::get().advance(state, steps);
+		this->noise_register = state;
+		return;
+	}
+
+	//In 7-bit mode, the low 7 bits cycle on their own, while the high 8 bits
+	//are shifted down into bit 6, where they are overwritten by the feedback.
+	unsigned state = this->noise_register & 0x7F;
+	unsigned high = steps < 15 ? (this->noise_register >> steps) & 0x7F80 : 0;
+	if (state)
+		this->output ^= LfsrSequence<7>::get().advance(state, steps);
+	this->noise_register = high | state;
+}
+
 void NoiseGenerator::trigger_event(){
 	EnvelopedGenerator::trigger_event();
 	this->noise_register |= ~this->noise_register;
@@ -440,13 +692,27 @@ void VoluntaryWaveGenerator::update_state_before_render(std::uint64_t time){
 }
 
 intermediate_audio_type VoluntaryWaveGenerator::render(std::uint64_t time) const{
+	return this->render_sample(this->sample_register);
+}
+
+intermediate_audio_type VoluntaryWaveGenerator::render_step(unsigned step) const{
+	return this->render_sample(this->wave_buffer[step]);
+}
+
+void VoluntaryWaveGenerator::add_transitions(std::uint64_t time, BandLimitedSynthesizer &synthesizer){
+	this->for_each_transition<11>(time, [this, &synthesizer](unsigned step, double fraction){
+		synthesizer.add_step(fraction, this->render_step(step));
+	});
+}
+
+intermediate_audio_type VoluntaryWaveGenerator::render_sample(byte_t sample) const{
 	if (!this->enabled())
 		return 0;
 
 #ifdef USE_FLOAT_AUDIO
-	return (this->sample_register >> this->volume_shift) * (2.f / 15.f) - 1;
+	return (sample >> this->volume_shift) * (2.f / 15.f) - 1;
 #else
-	auto ret = this->sample_register >> this->volume_shift;
+	auto ret = sample >> this->volume_shift;
 	ret *= 2 * int16_max;
 	ret /= 15;
 	ret -= int16_max;
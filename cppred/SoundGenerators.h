@@ -3,8 +3,11 @@
 #include "AudioData.h"
 #ifndef HAVE_PCH
 #include <limits>
+#include <vector>
 #endif
 
+class BandLimitedSynthesizer;
+
 class ClockDivider{
 public:
 #ifdef USE_STD_FUNCTION
@@ -29,8 +32,17 @@ public:
 	ClockDivider(unsigned src_frequency_power, std::uint64_t dst_frequency, callback_t callback, void *user_data);
 	void configure(unsigned src_frequency_power, std::uint64_t dst_frequency, callback_t callback, void *user_data);
 #endif
+	//Configures a divider with no callback, to be driven only through advance().
+	void configure(unsigned src_frequency_power, std::uint64_t dst_frequency);
 	void update(std::uint64_t);
+	//Like update(), but instead of invoking the callback, returns the number of
+	//times it would have been invoked.
+	std::uint64_t advance(std::uint64_t);
 	void reset();
+	//Returns the earliest source clock >= source_clock at which update() would
+	//invoke the callback, or std::numeric_limits<std::uint64_t>::max() if the
+	//divider is not configured.
+	std::uint64_t get_next_firing(std::uint64_t source_clock) const;
 };
 
 class WaveformGenerator{
@@ -96,8 +108,17 @@ protected:
 	const decltype(reference_time) undefined_reference_time = std::numeric_limits<decltype(reference_time)>::max();
 	const decltype(reference_cycle_position) undefined_reference_cycle_position = std::numeric_limits<decltype(reference_cycle_position)>::max();
 
+	static const unsigned max_transitions_per_sample = 32;
+
 	template <unsigned Shift>
 	void advance_cycle(std::uint64_t time);
+	//Calls f(step, fraction) for each waveform step boundary crossed between
+	//the previous sample and this one, where step is the index of the step
+	//being entered and fraction is how long before this sample (in samples)
+	//the boundary was crossed. Does nothing if the phase was just reset, or if
+	//there are too many boundaries for the result to matter.
+	template <unsigned Shift, typename F>
+	void for_each_transition(std::uint64_t time, F &&f);
 	void frequency_change(unsigned old_frequency);
 	virtual unsigned get_period() = 0;
 	void write_register3_frequency(byte_t value);
@@ -119,6 +140,8 @@ public:
 	virtual ~Square2Generator(){}
 	void update_state_before_render(std::uint64_t time) override;
 	intermediate_audio_type render(std::uint64_t time) const override;
+	intermediate_audio_type render_step(unsigned step) const;
+	void add_transitions(std::uint64_t time, BandLimitedSynthesizer &);
 
 	virtual void set_register1(byte_t value) override;
 	virtual void set_register3(byte_t value) override;
@@ -149,15 +172,22 @@ class NoiseGenerator : public EnvelopedGenerator{
 	unsigned noise_register = 1;
 	bool output = true;
 
+	//Only counts LFSR clocks. The register is advanced in bulk through the
+	//precomputed sequences, so renders cost O(samples) rather than O(clocks).
 	ClockDivider noise_scheduler;
 
-	static void noise_update_event(void *, std::uint64_t);
 	void noise_update_event();
+	void advance_lfsr(std::uint64_t steps);
 	void trigger_event() override;
 public:
 	void set_register3(byte_t value) override;
 	intermediate_audio_type render(std::uint64_t time) const override;
+	//Applies every LFSR clock up to the given time. Register writes must be
+	//preceded by a call for the time at which they happen.
 	void update_state_before_render(std::uint64_t time) override;
+	//Noise only changes on LFSR clocks, which aren't tracked to sub-sample
+	//precision.
+	void add_transitions(std::uint64_t, BandLimitedSynthesizer &){}
 };
 
 class VoluntaryWaveGenerator : public WaveformGenerator, public FrequenciedGenerator{
@@ -168,10 +198,13 @@ class VoluntaryWaveGenerator : public WaveformGenerator, public FrequenciedGener
 
 	bool enabled() const override;
 	void trigger_event() override;
+	intermediate_audio_type render_sample(byte_t sample) const;
 public:
 	VoluntaryWaveGenerator();
 	void update_state_before_render(std::uint64_t time) override;
 	intermediate_audio_type render(std::uint64_t time) const override;
+	intermediate_audio_type render_step(unsigned step) const;
+	void add_transitions(std::uint64_t time, BandLimitedSynthesizer &);
 	unsigned get_period() override;
 
 	void set_register0(byte_t);
@@ -192,3 +225,50 @@ class CapacitorFilter{
 public:
 	intermediate_audio_type update(intermediate_audio_type in);
 };
+
+//Residuals (band-limited step minus ideal step) of a unit transition, for a
+//number of sub-sample positions of the transition.
+class BandLimitedStepTable{
+public:
+	static const unsigned phases = 64;
+private:
+	//Offset, relative to the sample the transition falls in, of the first
+	//sample affected by it.
+	int first_offset;
+	unsigned width;
+	std::vector<float> residuals;
+
+	BandLimitedStepTable(SynthesisQuality);
+public:
+	int get_first_offset() const{
+		return this->first_offset;
+	}
+	unsigned get_width() const{
+		return this->width;
+	}
+	//fraction is in [0; 1]. Returns width values.
+	const float *get_residuals(double fraction) const;
+	static const BandLimitedStepTable *get(SynthesisQuality);
+};
+
+//Turns the point-sampled output of a channel, plus the exact positions of
+//its transitions between samples, into a band-limited signal. The output is
+//delayed by -first_offset samples.
+class BandLimitedSynthesizer{
+	static const unsigned history_length = 32;
+	static const unsigned history_mask = history_length - 1;
+	const BandLimitedStepTable *table = nullptr;
+	float residuals[history_length];
+	intermediate_audio_type levels[history_length];
+	intermediate_audio_type level = 0;
+	std::uint64_t position = 0;
+public:
+	BandLimitedSynthesizer();
+	void set_quality(SynthesisQuality);
+	//Adds a transition to new_level that happened fraction samples before the
+	//current one.
+	void add_step(double fraction, intermediate_audio_type new_level);
+	//Completes the current sample, given the channel's point-sampled value
+	//for it.
+	intermediate_audio_type end_sample(intermediate_audio_type point_sample);
+};
@@ -24,6 +24,9 @@ public:
 	auto iterate_tiles(){
 		return make_range(this->tiles);
 	}
+	auto iterate_tiles() const{
+		return make_range(this->tiles);
+	}
 
 	DEFINE_GETTER(id)
 	DEFINE_GETTER_SETTER(x)
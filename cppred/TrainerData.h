@@ -69,6 +69,9 @@ class TrainerClassData : public PartialTrainerClass{
 public:
 	TrainerClassData(BufferReader &);
 	const std::vector<TrainerPartyMember> &get_party(size_t) const;
+	size_t get_party_count() const{
+		return this->parties.size();
+	}
 	FullTrainerClass get_trainer(size_t) const;
 };
 
@@ -77,6 +80,9 @@ class TrainerClassesStore{
 	std::vector<std::shared_ptr<TrainerClassData>> trainers_by_name;
 public:
 	TrainerClassesStore(BufferReader &);
+	const std::vector<std::shared_ptr<TrainerClassData>> &get_trainer_classes() const{
+		return this->trainers_by_id;
+	}
 	std::shared_ptr<TrainerClassData> get_trainer_class_by_id(TrainerId) const;
 	std::shared_ptr<TrainerClassData> get_trainer_by_name(const char *) const;
 	FullTrainerClass get_trainer_class_by_id(TrainerId id, size_t index) const{
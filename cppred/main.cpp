@@ -1,14 +1,92 @@
 #include "stdafx.h"
 #include "Engine.h"
+#include "HeadlessHost.h"
+#include "AsyncLog.h"
+#include "pokemon_version.h"
+#include "CppRed/BattleSimulator.h"
+#include "RendererBenchmark.h"
 #ifndef HAVE_PCH
 #include <SDL_main.h>
 #include <stdexcept>
 #include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 #endif
 
+//Usage: cppred [--log-file <path>] [--log-trace <path>] [--record <path>] [--audio-buffer <samples>] [--music-lookahead <seconds>] [--headless <instances> [<frames> [<threads>]]]
+//       cppred --simulate-battles [<battles per pairing> [<threads>]]
+//       cppred --benchmark-renderer <iterations> <scene>...
+static int run_headless(int argc, char **argv){
+	size_t instances = argc > 1 ? std::stoul(argv[1]) : 1;
+	std::uint64_t frames = argc > 2 ? std::stoull(argv[2]) : 3600;
+	unsigned threads = argc > 3 ? std::stoul(argv[3]) : std::thread::hardware_concurrency();
+	HeadlessHost host(instances, threads, PokemonVersion::Red);
+	host.run(frames);
+	host.report(std::cout);
+	return 0;
+}
+
+static int run_battle_simulation(int argc, char **argv){
+	unsigned battles = argc > 1 ? std::stoul(argv[1]) : 10;
+	unsigned threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+	CppRed::BattleSimulator simulator(threads);
+	simulator.run(battles);
+	simulator.report(std::cout);
+	return 0;
+}
+
+//SDL stores the period length in 16 bits, and most backends only honor
+//powers of two.
+static unsigned parse_audio_buffer_length(const char *s){
+	auto ret = std::stoul(s);
+	if (!ret || ret > 0xFFFF || (ret & (ret - 1)))
+		throw std::runtime_error("--audio-buffer: The length must be a power of two between 1 and 32768.");
+	return (unsigned)ret;
+}
+
+//Returns non-zero if any scene didn't render to its golden hash.
+static int run_renderer_benchmark(int argc, char **argv){
+	if (argc < 3)
+		throw std::runtime_error("--benchmark-renderer: Expected an iteration count and at least one scene.");
+	unsigned iterations = std::stoul(argv[1]);
+	RendererBenchmark benchmark(std::vector<std::string>(argv + 2, argv + argc));
+	benchmark.run(iterations);
+	return benchmark.report(std::cout) ? 0 : 1;
+}
+
 int main(int argc, char **argv){
 	try{
-		Engine engine;
+		std::string record_path;
+		unsigned audio_buffer_length = 0;
+		double music_lookahead = 0;
+		int i = 1;
+		for (; i + 1 < argc; i += 2){
+			std::string option = argv[i];
+			if (option == "--log-file")
+				AsyncLog::get().set_text_file(argv[i + 1]);
+			else if (option == "--log-trace")
+				AsyncLog::get().set_trace_file(argv[i + 1]);
+			else if (option == "--record")
+				record_path = argv[i + 1];
+			else if (option == "--audio-buffer")
+				audio_buffer_length = parse_audio_buffer_length(argv[i + 1]);
+			else if (option == "--music-lookahead")
+				music_lookahead = std::stod(argv[i + 1]);
+			else
+				break;
+		}
+		if (i < argc && std::string(argv[i]) == "--headless")
+			return run_headless(argc - i, argv + i);
+		if (i < argc && std::string(argv[i]) == "--simulate-battles")
+			return run_battle_simulation(argc - i, argv + i);
+		if (i < argc && std::string(argv[i]) == "--benchmark-renderer")
+			return run_renderer_benchmark(argc - i, argv + i);
+		Engine engine(false, audio_buffer_length);
+		engine.set_music_lookahead(music_lookahead);
+		if (record_path.size())
+			engine.start_recording(record_path);
 		engine.run();
 	}catch (std::exception &e){
 		std::ofstream file("error.txt");
@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "CppRed/BattleCore.h"
+#ifndef HAVE_PCH
+#include <iostream>
+#endif
+
+//Checks that each battle stage reads its own stat, through the effect every
+//stat has on a turn. Returns non-zero on failure.
+
+using CppRed::BattleCore;
+using CppRed::BattleEventType;
+using CppRed::BattleParty;
+using CppRed::BattlePokemon;
+using CppRed::StatusCondition;
+typedef PokemonStats::StatId StatId;
+
+static BattleParty make_party(MoveId move, int attack, int defense, int speed, int special){
+	BattleParty ret;
+	auto &pokemon = ret.members[0];
+	pokemon = BattlePokemon();
+	pokemon.species = SpeciesId::Rhydon;
+	pokemon.level = 50;
+	pokemon.moves[0] = move;
+	pokemon.pp[0] = 30;
+	pokemon.hp = pokemon.max_hp = 999;
+	pokemon.stats[(int)StatId::Hp] = pokemon.max_hp;
+	pokemon.stats[(int)StatId::Attack] = attack;
+	pokemon.stats[(int)StatId::Defense] = defense;
+	pokemon.stats[(int)StatId::Speed] = speed;
+	pokemon.stats[(int)StatId::Special] = special;
+	pokemon.type[0] = pokemon.type[1] = PokemonTypeId::Normal;
+	pokemon.status = StatusCondition::Normal;
+	ret.size = 1;
+	return ret;
+}
+
+//Total damage side 0 deals with its first move over a fixed set of seeds.
+static int total_damage(const BattleParty &attacker, const BattleParty &defender){
+	int ret = 0;
+	for (std::uint32_t seed = 1; seed <= 16; seed++){
+		BattleCore core(attacker, defender, xorshift128_state{ { seed, 2, 3, 4 } });
+		core.resolve_turn(0, BattleCore::no_action);
+		auto events = core.get_events();
+		for (size_t i = 0; i < core.get_event_count(); i++)
+			if (events[i].type == BattleEventType::Damage && events[i].side == 1)
+				ret += events[i].value;
+	}
+	return ret;
+}
+
+static int first_to_move(const BattleParty &side0, const BattleParty &side1){
+	BattleCore core(side0, side1, xorshift128_state{ { 1, 2, 3, 4 } });
+	core.resolve_turn(0, 0);
+	auto events = core.get_events();
+	for (size_t i = 0; i < core.get_event_count(); i++)
+		if (events[i].type == BattleEventType::MoveUsed)
+			return events[i].side;
+	return -1;
+}
+
+static bool check(bool condition, const char *what){
+	std::cout << (condition ? "OK:     " : "FAILED: ") << what << std::endl;
+	return condition;
+}
+
+int main(){
+	bool ok = true;
+
+	auto strong = make_party(MoveId::Tackle, 200, 50, 50, 50);
+	auto weak = make_party(MoveId::Tackle, 20, 50, 50, 50);
+	auto target = make_party(MoveId::Tackle, 50, 50, 50, 50);
+	ok &= check(total_damage(strong, target) > total_damage(weak, target), "Attack raises physical damage");
+
+	auto sturdy = make_party(MoveId::Tackle, 50, 200, 50, 50);
+	auto frail = make_party(MoveId::Tackle, 50, 20, 50, 50);
+	ok &= check(total_damage(target, sturdy) < total_damage(target, frail), "Defense lowers physical damage");
+
+	auto fast = make_party(MoveId::Tackle, 50, 10, 200, 50);
+	auto slow = make_party(MoveId::Tackle, 50, 200, 10, 50);
+	ok &= check(first_to_move(fast, slow) == 0 && first_to_move(slow, fast) == 1, "Speed decides who moves first");
+
+	auto bright = make_party(MoveId::Ember, 50, 50, 50, 200);
+	auto dull = make_party(MoveId::Ember, 50, 50, 50, 20);
+	ok &= check(total_damage(bright, target) > total_damage(dull, target), "Special raises special damage");
+
+	return ok ? 0 : 1;
+}
@@ -1,6 +1,12 @@
 #include "stdafx.h"
 #include "threads.h"
 #include "utility.h"
+#ifndef HAVE_PCH
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#endif
 
 void Event::signal(){
 	LOCK_MUTEX(this->mutex);
@@ -77,3 +83,248 @@ bool Event::wait_for(unsigned ms){
 	}while (clock.get() < target);
 	return false;
 }
+
+WorkStealingPool::WorkStealingPool(unsigned thread_count){
+	this->remaining = 0;
+	this->requeued = 0;
+	this->idle_workers = 0;
+	if (!thread_count)
+		thread_count = 1;
+	this->workers.reserve(thread_count);
+	for (unsigned i = 0; i < thread_count; i++)
+		this->workers.emplace_back(new Worker);
+	for (unsigned i = 0; i < thread_count; i++)
+		this->workers[i]->thread = std::thread([this, i](){ this->worker_loop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool(){
+	{
+		LOCK_MUTEX(this->mutex);
+		this->stopping = true;
+		this->start_cv.notify_all();
+	}
+	for (auto &worker : this->workers)
+		worker->thread.join();
+}
+
+void WorkStealingPool::run(size_t count, const task_t &task){
+	if (!count)
+		return;
+	this->task = &task;
+	this->remaining = count;
+	for (size_t i = 0; i < count; i++){
+		auto &worker = *this->workers[i % this->workers.size()];
+		LOCK_MUTEX(worker.mutex);
+		worker.tasks.push_back(i);
+	}
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->generation++;
+	this->start_cv.notify_all();
+	this->done_cv.wait(lock, [this](){ return !this->remaining; });
+}
+
+bool WorkStealingPool::pop(size_t index, size_t &task){
+	{
+		auto &worker = *this->workers[index];
+		LOCK_MUTEX(worker.mutex);
+		if (worker.tasks.size()){
+			task = worker.tasks.front();
+			worker.tasks.pop_front();
+			return true;
+		}
+	}
+	auto n = this->workers.size();
+	for (size_t i = 1; i < n; i++){
+		auto &worker = *this->workers[(index + i) % n];
+		LOCK_MUTEX(worker.mutex);
+		if (worker.tasks.size()){
+			task = worker.tasks.back();
+			worker.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::worker_loop(size_t index){
+	std::uint64_t last_generation = 0;
+	auto &worker = *this->workers[index];
+	while (true){
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->start_cv.wait(lock, [this, last_generation](){ return this->stopping || this->generation != last_generation; });
+			if (this->stopping)
+				return;
+			last_generation = this->generation;
+		}
+		while (this->remaining){
+			//Read before looking at the queues, so that a task queued after
+			//they were found empty isn't missed.
+			auto seen = this->requeued.load();
+			size_t task;
+			if (!this->pop(index, task)){
+				//Every remaining task is running on some other worker.
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->idle_workers++;
+				this->idle_cv.wait(lock, [this, seen](){ return !this->remaining || this->requeued != seen; });
+				this->idle_workers--;
+				continue;
+			}
+			if ((*this->task)(task)){
+				{
+					LOCK_MUTEX(worker.mutex);
+					worker.tasks.push_back(task);
+				}
+				this->requeued++;
+				if (this->idle_workers){
+					LOCK_MUTEX(this->mutex);
+					this->idle_cv.notify_one();
+				}
+			}else if (this->remaining.fetch_sub(1) == 1){
+				LOCK_MUTEX(this->mutex);
+				this->done_cv.notify_all();
+				this->idle_cv.notify_all();
+			}
+		}
+	}
+}
+
+TaskGraph::TaskGraph(){
+	this->start_time = this->clock.get();
+}
+
+TaskGraph::~TaskGraph(){
+	//The workers can't be abandoned, since the tasks may refer to objects
+	//that are about to be destroyed.
+	{
+		LOCK_MUTEX(this->mutex);
+		if (!this->error)
+			this->error.reset(new std::string("The graph was destroyed before it finished."));
+	}
+	this->join();
+}
+
+TaskGraph::task_id TaskGraph::add(const std::string &name, std::function<void()> &&f, std::initializer_list<task_id> dependencies){
+	if (this->started)
+		throw std::runtime_error("TaskGraph::add(): The graph has already started.");
+	task_id ret = this->tasks.size();
+	this->tasks.emplace_back();
+	auto &task = this->tasks.back();
+	task.name = name;
+	task.function = std::move(f);
+	for (auto dependency : dependencies){
+		if (dependency >= ret)
+			throw std::runtime_error("TaskGraph::add(): Invalid dependency for " + name);
+		this->tasks[dependency].dependents.push_back(ret);
+		task.pending_dependencies++;
+	}
+	return ret;
+}
+
+void TaskGraph::start(unsigned thread_count){
+	if (this->started)
+		throw std::runtime_error("TaskGraph::start(): The graph has already started.");
+	LOCK_MUTEX(this->mutex);
+	this->started = true;
+	this->unfinished = this->tasks.size();
+	for (task_id i = 0; i < this->tasks.size(); i++)
+		if (!this->tasks[i].pending_dependencies)
+			this->ready.push_back(i);
+	thread_count = (unsigned)std::min<size_t>(thread_count, this->tasks.size());
+	for (unsigned i = 0; i < thread_count; i++)
+		this->threads.emplace_back([this, i](){ this->worker_loop((int)i); });
+}
+
+bool TaskGraph::run_one(std::unique_lock<std::mutex> &lock, int thread){
+	if (!this->ready.size())
+		return false;
+	auto id = this->ready.front();
+	this->ready.pop_front();
+	auto &task = this->tasks[id];
+	bool skip = !!this->error;
+	std::string error;
+	Stage stage;
+	lock.unlock();
+	stage.name = task.name;
+	stage.thread = thread;
+	stage.start = this->clock.get() - this->start_time;
+	if (!skip){
+		try{
+			task.function();
+		}catch (std::exception &e){
+			error = task.name + ": " + e.what();
+		}catch (...){
+			error = task.name + ": Unknown exception.";
+		}
+	}
+	stage.end = this->clock.get() - this->start_time;
+	lock.lock();
+	if (!skip)
+		this->trace.push_back(stage);
+	if (error.size() && !this->error)
+		this->error.reset(new std::string(error));
+	for (auto dependent : task.dependents)
+		if (!--this->tasks[dependent].pending_dependencies)
+			this->ready.push_back(dependent);
+	this->unfinished--;
+	this->cv.notify_all();
+	return true;
+}
+
+void TaskGraph::worker_loop(int thread){
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (this->unfinished)
+		if (!this->run_one(lock, thread))
+			this->cv.wait(lock);
+}
+
+void TaskGraph::join(){
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		while (this->unfinished)
+			if (!this->run_one(lock, -1))
+				this->cv.wait(lock);
+	}
+	for (auto &thread : this->threads)
+		thread.join();
+	this->threads.clear();
+}
+
+void TaskGraph::run_inline(const std::string &name, const std::function<void()> &f){
+	Stage stage;
+	stage.name = name;
+	stage.thread = -1;
+	stage.start = this->clock.get() - this->start_time;
+	f();
+	stage.end = this->clock.get() - this->start_time;
+	LOCK_MUTEX(this->mutex);
+	this->trace.push_back(stage);
+}
+
+void TaskGraph::wait(){
+	if (!this->started)
+		this->start(0);
+	this->join();
+	if (this->error)
+		throw std::runtime_error("TaskGraph::wait(): " + *this->error);
+}
+
+void TaskGraph::print_trace(std::ostream &stream) const{
+	auto trace = this->trace;
+	std::stable_sort(trace.begin(), trace.end(), [](const Stage &a, const Stage &b){ return a.start < b.start; });
+	double end = 0;
+	for (auto &stage : trace)
+		end = std::max(end, stage.end);
+	auto flags = stream.flags();
+	stream << std::fixed << std::setprecision(2);
+	for (auto &stage : trace){
+		stream << std::setw(8) << stage.start * 1000 << " - " << std::setw(8) << stage.end * 1000 << " ms (" << std::setw(7) << (stage.end - stage.start) * 1000 << " ms) ";
+		if (stage.thread < 0)
+			stream << "main     ";
+		else
+			stream << "worker " << std::setw(2) << stage.thread;
+		stream << ' ' << stage.name << '\n';
+	}
+	stream << "Total: " << end * 1000 << " ms\n";
+	stream.flags(flags);
+}
@@ -1,9 +1,17 @@
 #pragma once
-
+#include "HighResolutionClock.h"
 #ifndef HAVE_PCH
 #include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <string>
+#include <initializer_list>
+#include <iosfwd>
 #endif
 
 class Event{
@@ -23,6 +31,108 @@ public:
 	bool state();
 };
 
+//A fixed set of worker threads, each with its own queue of tasks. A worker
+//runs the tasks at the front of its own queue and, when that runs dry, steals
+//from the back of the others'.
+class WorkStealingPool{
+public:
+	//Returns true if the task should be queued again. Must not throw.
+	typedef std::function<bool(size_t)> task_t;
+private:
+	struct Worker{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+		std::thread thread;
+	};
+	std::vector<std::unique_ptr<Worker>> workers;
+	const task_t *task = nullptr;
+	std::atomic<size_t> remaining;
+	std::mutex mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	//Workers that find nothing to run wait here until a task is queued again
+	//or every task has finished.
+	std::condition_variable idle_cv;
+	std::atomic<std::uint64_t> requeued;
+	std::atomic<unsigned> idle_workers;
+	std::uint64_t generation = 0;
+	bool stopping = false;
+
+	void worker_loop(size_t index);
+	bool pop(size_t index, size_t &task);
+public:
+	WorkStealingPool(unsigned thread_count);
+	~WorkStealingPool();
+	WorkStealingPool(const WorkStealingPool &) = delete;
+	void operator=(const WorkStealingPool &) = delete;
+	//Runs task(i) for every i in [0; count), again and again until it returns
+	//false. Task i starts out on worker i % thread count, and goes back to
+	//whichever worker last ran it. Returns once every task has finished.
+	void run(size_t count, const task_t &task);
+	size_t get_thread_count() const{
+		return this->workers.size();
+	}
+};
+
+//A set of tasks, with dependencies between them, that is run once. A task
+//becomes ready when every task it depends on has finished. Ready tasks are
+//run by the worker threads, and by the thread that calls wait() while it
+//waits. The start and end of every task are recorded, as well as those of
+//the stages the owner runs on its own thread through run_inline().
+//
+//If a task throws, the tasks that haven't started yet are skipped, and
+//wait() throws.
+class TaskGraph{
+public:
+	typedef size_t task_id;
+	struct Stage{
+		std::string name;
+		//-1 for the thread that owns the graph.
+		int thread;
+		double start;
+		double end;
+	};
+private:
+	struct Task{
+		std::string name;
+		std::function<void()> function;
+		std::vector<task_id> dependents;
+		size_t pending_dependencies = 0;
+	};
+	HighResolutionClock clock;
+	double start_time;
+	std::vector<Task> tasks;
+	std::deque<task_id> ready;
+	size_t unfinished = 0;
+	std::vector<Stage> trace;
+	std::unique_ptr<std::string> error;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool started = false;
+
+	bool run_one(std::unique_lock<std::mutex> &, int thread);
+	void worker_loop(int thread);
+	void join();
+public:
+	TaskGraph();
+	~TaskGraph();
+	TaskGraph(const TaskGraph &) = delete;
+	void operator=(const TaskGraph &) = delete;
+	//Must be called before start().
+	task_id add(const std::string &name, std::function<void()> &&, std::initializer_list<task_id> dependencies = {});
+	//Starts up to thread_count workers. With no workers, every task is run
+	//by wait().
+	void start(unsigned thread_count);
+	//Runs f on the calling thread and records it in the trace.
+	void run_inline(const std::string &name, const std::function<void()> &f);
+	void wait();
+	const std::vector<Stage> &get_trace() const{
+		return this->trace;
+	}
+	void print_trace(std::ostream &) const;
+};
+
 inline bool join_thread(std::unique_ptr<std::thread> &t){
 	if (!t)
 		return false;
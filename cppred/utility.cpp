@@ -88,6 +88,24 @@ std::uint64_t cast_round_u64(double x){
 	return (std::uint64_t)round(x);
 }
 
+std::uint32_t ceil_sqrt(std::uint32_t x){
+	//Digit-by-digit square root; computes floor(sqrt(x)) exactly.
+	std::uint32_t ret = 0;
+	std::uint32_t remainder = x;
+	std::uint32_t one = (std::uint32_t)1 << 30;
+	while (one > remainder)
+		one >>= 2;
+	while (one){
+		if (remainder >= ret + one){
+			remainder -= ret + one;
+			ret = (ret >> 1) + one;
+		}else
+			ret >>= 1;
+		one >>= 2;
+	}
+	return ret + (ret * ret != x);
+}
+
 std::uint32_t read_u32(const void *void_buffer){
 	auto buffer = (const byte_t *)void_buffer;
 	std::uint32_t ret = 0;
@@ -169,6 +187,65 @@ std::uint32_t BufferReader::read_u32(){
 	return ret;
 }
 
+void BufferReader::skip(size_t n){
+	if (this->remaining_bytes() < n)
+		throw std::runtime_error("Buffer too short.");
+	this->offset += n;
+}
+
+BufferReader BufferReader::read_sub_buffer(size_t n){
+	if (this->remaining_bytes() < n)
+		throw std::runtime_error("Buffer too short.");
+	BufferReader ret(this->buffer + this->offset, n);
+	this->offset += n;
+	return ret;
+}
+
+void BufferWriter::write_u32(std::uint32_t n){
+	for (int i = 0; i < 4; i++){
+		this->buffer->push_back((byte_t)n);
+		n >>= 8;
+	}
+}
+
+void BufferWriter::write_varint(std::uint32_t n){
+	do{
+		byte_t byte = n & BITMAP(01111111);
+		n >>= 7;
+		if (n)
+			byte |= BITMAP(10000000);
+		this->buffer->push_back(byte);
+	}while (n);
+}
+
+void BufferWriter::write_signed_varint(std::int32_t n){
+	//Inverse of uints_to_ints().
+	this->write_varint(n >= 0 ? (std::uint32_t)n * 2 : (std::uint32_t)(-(n + 1)) * 2 + 1);
+}
+
+void BufferWriter::write_string(const std::string &s){
+	this->write_raw(s.c_str(), s.size() + 1);
+}
+
+void BufferWriter::write_buffer(const void *data, size_t size){
+	this->write_varint((std::uint32_t)size);
+	this->write_raw(data, size);
+}
+
+void BufferWriter::write_raw(const void *data, size_t size){
+	auto p = (const byte_t *)data;
+	this->buffer->insert(this->buffer->end(), p, p + size);
+}
+
+void BufferWriter::overwrite_u32(size_t offset, std::uint32_t n){
+	if (offset + 4 > this->buffer->size())
+		throw std::runtime_error("BufferWriter::overwrite_u32(): Invalid write.");
+	for (int i = 0; i < 4; i++){
+		(*this->buffer)[offset + i] = (byte_t)n;
+		n >>= 8;
+	}
+}
+
 std::vector<byte_t> BufferReader::read_string_as_vector(){
 	return basic_read_string<std::vector<byte_t>>(this->buffer, this->offset, this->size);
 }
@@ -171,6 +171,8 @@ int euclidean_modulo_u(int n, int mod);
 int euclidean_modulo(int n, int mod);
 int cast_round(double);
 std::uint64_t cast_round_u64(double);
+//Returns the smallest r such that r * r >= x.
+std::uint32_t ceil_sqrt(std::uint32_t x);
 std::uint32_t read_u32(const void *);
 std::uint32_t read_varint(const byte_t *buffer, size_t &offset, size_t size);
 std::int32_t read_signed_varint(const byte_t *buffer, size_t &offset, size_t size);
@@ -338,6 +340,32 @@ public:
 	size_t remaining_bytes() const{
 		return this->size - this->offset;
 	}
+	void skip(size_t);
+	//Returns a reader over the next n bytes and advances past them.
+	BufferReader read_sub_buffer(size_t n);
+};
+
+//Appends to an existing vector, so that a caller that keeps the vector alive
+//between writes doesn't reallocate.
+class BufferWriter{
+	std::vector<byte_t> *buffer;
+public:
+	BufferWriter(std::vector<byte_t> &buffer): buffer(&buffer){}
+	void write_byte(byte_t b){
+		this->buffer->push_back(b);
+	}
+	void write_u32(std::uint32_t);
+	void write_varint(std::uint32_t);
+	void write_signed_varint(std::int32_t);
+	//Null-terminated, like BufferReader::read_string().
+	void write_string(const std::string &);
+	//Length-prefixed, like BufferReader::read_buffer().
+	void write_buffer(const void *, size_t);
+	void write_raw(const void *, size_t);
+	void overwrite_u32(size_t offset, std::uint32_t);
+	size_t size() const{
+		return this->buffer->size();
+	}
 };
 
 template <typename T>
@@ -404,4 +432,7 @@ public:
 	void get_data(byte_t (&dst)[size]) const{
 		memcpy(dst, this->data, size);
 	}
+	void set_data(const byte_t (&src)[size]){
+		memcpy(this->data, src, size);
+	}
 };